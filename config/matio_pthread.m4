@@ -0,0 +1,40 @@
+AC_DEFUN([MATIO_CHECK_PTHREAD],
+[
+AC_ARG_ENABLE(threads,AS_HELP_STRING([--enable-threads=yes],
+              [Use POSIX threads to process v7.3 chunks in parallel]),
+              threads=$enableval,threads=yes)
+if test "x$threads" != "xno"
+then
+    saved_LIBS="$LIBS"
+    saved_CFLAGS="$CFLAGS"
+
+    AC_MSG_CHECKING([for POSIX threads])
+
+    PTHREAD_CFLAGS="-pthread"
+    PTHREAD_LIBS="-lpthread"
+    LIBS="$saved_LIBS $PTHREAD_LIBS"
+    CFLAGS="$saved_CFLAGS $PTHREAD_CFLAGS"
+
+    AC_TRY_LINK( [
+#include <stdlib.h>
+#include <pthread.h>
+                  ],
+[pthread_create(NULL,NULL,NULL,NULL);], ac_have_pthread=yes,
+    ac_have_pthread=no)
+
+    LIBS="$saved_LIBS"
+    CFLAGS="$saved_CFLAGS"
+
+    if test "$ac_have_pthread" = "yes"
+    then
+        AC_DEFINE_UNQUOTED([HAVE_PTHREAD],[1],[Have POSIX threads])
+        AC_SUBST(PTHREAD_LIBS)
+        AC_SUBST(PTHREAD_CFLAGS)
+        AC_MSG_RESULT([$PTHREAD_LIBS])
+    else
+        AC_MSG_RESULT([no])
+    fi
+else
+    ac_have_pthread=no
+fi
+])
@@ -51,13 +51,346 @@
 #if defined(MAT73) && MAT73
 #   include "mat73.h"
 #endif
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+#   include <pthread.h>
+#endif
+
+/* Allocator used for variables created without a MAT file and for the MAT
+ * files opened or created afterwards, NULL for the C library */
+static const mat_allocator_t *default_allocator = NULL;
+
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+/* Guards the reference counts of data shared by duplicated variables */
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/** @if mat_devman
+ * @brief Column of a field gathered from the elements of a structure array
+ *
+ * @ingroup mat_internal
+ * @endif
+ */
+struct mat_struct_column {
+    mat_t    *mat;         /**< MAT file of the structure array, or NULL */
+    matvar_t *matvar;      /**< Structure array */
+    int       field_index; /**< 0-relative index of the field */
+    matvar_t *column;      /**< Gathered column */
+    int       err;         /**< Non-zero if the column could not be gathered */
+};
+
+/** @if mat_devman
+ * @brief Columns gathered by one thread
+ *
+ * @ingroup mat_internal
+ * @endif
+ */
+struct mat_struct_columns {
+    struct mat_struct_column *columns; /**< All columns */
+    int ncolumns;                      /**< Number of columns */
+    int first;                         /**< First column gathered */
+    int step;                          /**< Step to the next column gathered */
+};
+
+/** @if mat_devman
+ * @brief Activates the scale and offset of @c matvar for the next read
+ *
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar MAT variable about to be read, or NULL to clear the scaling
+ * @endif
+ */
+static void
+SetReadScaling(mat_t *mat, const matvar_t *matvar)
+{
+    if ( NULL != matvar && matvar->internal->scaling ) {
+        mat->scaling = 1;
+        mat->scale   = matvar->internal->scale;
+        mat->offset  = matvar->internal->offset;
+    } else {
+        mat->scaling = 0;
+        mat->scale   = 1.0;
+        mat->offset  = 0.0;
+    }
+}
+
+/* Edge length of the square tiles used by the blocked transpose */
+#define MAT_TRANSPOSE_TILE 32
+
+#define MAT_TRANSPOSE_TILE_LOOP(T) \
+    { \
+        const T *src = (const T*)in; \
+        T *dst = (T*)out; \
+        for ( j = jj; j < j_end; j++ ) \
+            for ( i = ii; i < i_end; i++ ) \
+                dst[j+i*out_stride] = src[i+j*in_stride]; \
+    }
+
+/** @if mat_devman
+ * @brief Transposes a strided 2-D block of elements tile by tile
+ *
+ * Stores element (i,j) of @c in, located at @c in[i+j*in_stride], at
+ * @c out[j+i*out_stride] for @c i < @c n0 and @c j < @c n1.
+ * @ingroup mat_internal
+ * @endif
+ */
+static void
+TransposeBlock(void *out,const void *in,size_t elem_size,size_t n0,size_t n1,
+    size_t in_stride,size_t out_stride)
+{
+    size_t i, j, ii, jj, i_end, j_end;
+
+    for ( jj = 0; jj < n1; jj += MAT_TRANSPOSE_TILE ) {
+        j_end = jj + MAT_TRANSPOSE_TILE;
+        if ( j_end > n1 )
+            j_end = n1;
+        for ( ii = 0; ii < n0; ii += MAT_TRANSPOSE_TILE ) {
+            i_end = ii + MAT_TRANSPOSE_TILE;
+            if ( i_end > n0 )
+                i_end = n0;
+            switch ( elem_size ) {
+                case 1:
+                    MAT_TRANSPOSE_TILE_LOOP(mat_uint8_t);
+                    break;
+                case 2:
+                    MAT_TRANSPOSE_TILE_LOOP(mat_uint16_t);
+                    break;
+                case 4:
+                    MAT_TRANSPOSE_TILE_LOOP(mat_uint32_t);
+                    break;
+#ifdef HAVE_MAT_UINT64_T
+                case 8:
+                    MAT_TRANSPOSE_TILE_LOOP(mat_uint64_t);
+                    break;
+#endif
+                default:
+                {
+                    const char *src = in;
+                    char *dst = out;
+                    for ( j = jj; j < j_end; j++ )
+                        for ( i = ii; i < i_end; i++ )
+                            memcpy(dst+(j+i*out_stride)*elem_size,
+                                   src+(i+j*in_stride)*elem_size,elem_size);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+#define MAT_COPY_STRIDED_LOOP(T) \
+    { \
+        const T *src = (const T*)in; \
+        T *dst = (T*)out; \
+        for ( i = 0; i < n; i++ ) \
+            dst[i*out_stride] = src[i*in_stride]; \
+    }
+
+/** @if mat_devman
+ * @brief Copies @c n elements between two strided buffers
+ *
+ * Stores @c in[i*in_stride] at @c out[i*out_stride] for @c i < @c n.  With
+ * an output stride of 2 this fills one half of an interleaved complex
+ * buffer, and with an input stride of 2 it extracts one half.
+ * @ingroup mat_internal
+ * @param out Destination buffer
+ * @param out_stride Stride of @c out in elements
+ * @param in Source buffer
+ * @param in_stride Stride of @c in in elements
+ * @param elem_size Size of each element in bytes
+ * @param n Number of elements to copy
+ * @endif
+ */
+void
+Mat_CopyStrided(void *out,size_t out_stride,const void *in,size_t in_stride,
+    size_t elem_size,size_t n)
+{
+    size_t i;
+
+    if ( 1 == out_stride && 1 == in_stride ) {
+        memcpy(out,in,n*elem_size);
+        return;
+    }
+
+    switch ( elem_size ) {
+        case 1:
+            MAT_COPY_STRIDED_LOOP(mat_uint8_t);
+            break;
+        case 2:
+            MAT_COPY_STRIDED_LOOP(mat_uint16_t);
+            break;
+        case 4:
+            MAT_COPY_STRIDED_LOOP(mat_uint32_t);
+            break;
+#ifdef HAVE_MAT_UINT64_T
+        case 8:
+            MAT_COPY_STRIDED_LOOP(mat_uint64_t);
+            break;
+#endif
+        default:
+            for ( i = 0; i < n; i++ )
+                memcpy((char*)out+i*out_stride*elem_size,
+                       (const char*)in+i*in_stride*elem_size,elem_size);
+            break;
+    }
+}
+
+/** @if mat_devman
+ * @brief Copies a block of column-major elements to or from row-major order
+ *
+ * Worker of Mat_ScatterRowMajor and Mat_GatherRowMajor.  @c block holds
+ * elements @c first to @c first+n-1 of a column-major array of dimensions
+ * @c dims at every @c block_stride-th element, and @c array holds the whole
+ * array in row-major order at every @c array_stride-th element.  Whole
+ * columns of a 2-D array are transposed tile by tile.
+ * @ingroup mat_internal
+ * @param block Block of column-major elements
+ * @param block_stride Stride of @c block in elements
+ * @param array Row-major array
+ * @param array_stride Stride of @c array in elements
+ * @param elem_size Size of each element in bytes
+ * @param rank Number of dimensions
+ * @param dims Dimensions of the array
+ * @param first Column-major index of the first element of the block
+ * @param n Number of elements in the block
+ * @param gather 1 to copy from @c array to @c block, 0 for the reverse
+ * @endif
+ */
+static void
+CopyRowMajor(char *block,size_t block_stride,char *array,size_t array_stride,
+    size_t elem_size,int rank,const size_t *dims,size_t first,size_t n,
+    int gather)
+{
+    size_t nrows, ncols = 1, i, j, run, off, q;
+    char *row;
+    int k, nsplit = 0;
+
+    for ( k = 0; k < rank; k++ ) {
+        if ( dims[k] > 1 )
+            nsplit++;
+    }
+    if ( nsplit < 2 ) {
+        /* Both orders are the same */
+        row = array+first*array_stride*elem_size;
+        if ( gather )
+            Mat_CopyStrided(block,block_stride,row,array_stride,elem_size,n);
+        else
+            Mat_CopyStrided(row,array_stride,block,block_stride,elem_size,n);
+        return;
+    }
+
+    nrows = dims[0];
+    for ( k = 1; k < rank; k++ )
+        ncols *= dims[k];
+    i = first % nrows;
+    j = first / nrows;
+    while ( n > 0 ) {
+        if ( 0 == i && 2 == rank && 1 == block_stride && 1 == array_stride &&
+             n >= 2*nrows ) {
+            /* Whole columns of a matrix */
+            run = n / nrows;
+            if ( gather )
+                TransposeBlock(block,array+j*elem_size,elem_size,run,nrows,
+                               ncols,nrows);
+            else
+                TransposeBlock(array+j*elem_size,block,elem_size,nrows,run,
+                               nrows,ncols);
+            block += run*nrows*elem_size;
+            n     -= run*nrows;
+            j     += run;
+            continue;
+        }
+        /* Row-major offset of column j of the trailing dimensions */
+        off = 0;
+        q   = j;
+        for ( k = 1; k < rank; k++ ) {
+            off = off*dims[k] + q % dims[k];
+            q  /= dims[k];
+        }
+        run = nrows - i;
+        if ( run > n )
+            run = n;
+        row = array+(i*ncols+off)*array_stride*elem_size;
+        if ( gather )
+            Mat_CopyStrided(block,block_stride,row,ncols*array_stride,
+                            elem_size,run);
+        else
+            Mat_CopyStrided(row,ncols*array_stride,block,block_stride,
+                            elem_size,run);
+        block += run*block_stride*elem_size;
+        n     -= run;
+        i      = 0;
+        j++;
+    }
+}
+
+/** @if mat_devman
+ * @brief Stores a block of column-major elements at their row-major positions
+ *
+ * Stores elements @c first to @c first+n-1 of a column-major array of
+ * dimensions @c dims, given at every @c in_stride-th element of @c in, at
+ * their positions in the row-major (C) order of the array.  Row-major element
+ * @c k is stored at @c out[k*out_stride].  Decoders call this on each block
+ * as it is decoded, so a row-major read needs no column-major copy of the
+ * whole array.
+ * @ingroup mat_internal
+ * @param out Destination buffer of the whole array
+ * @param out_stride Stride of @c out in elements
+ * @param in Block of decoded elements
+ * @param in_stride Stride of @c in in elements
+ * @param elem_size Size of each element in bytes
+ * @param rank Number of dimensions
+ * @param dims Dimensions of the array
+ * @param first Column-major index of the first element of the block
+ * @param n Number of elements in the block
+ * @endif
+ */
+void
+Mat_ScatterRowMajor(void *out,size_t out_stride,const void *in,
+    size_t in_stride,size_t elem_size,int rank,const size_t *dims,
+    size_t first,size_t n)
+{
+    CopyRowMajor((char*)in,in_stride,out,out_stride,elem_size,rank,dims,
+                 first,n,0);
+}
+
+/** @if mat_devman
+ * @brief Collects a block of column-major elements from a row-major array
+ *
+ * The reverse of Mat_ScatterRowMajor.  Stores elements @c first to
+ * @c first+n-1 of the column-major order of the row-major array @c in at
+ * every @c out_stride-th element of @c out.  Encoders call this on each
+ * block as it is encoded, so writing row-major data needs no column-major
+ * copy of the whole array.
+ * @ingroup mat_internal
+ * @param out Block of elements to encode
+ * @param out_stride Stride of @c out in elements
+ * @param in Row-major array
+ * @param in_stride Stride of @c in in elements
+ * @param elem_size Size of each element in bytes
+ * @param rank Number of dimensions
+ * @param dims Dimensions of the array
+ * @param first Column-major index of the first element of the block
+ * @param n Number of elements in the block
+ * @endif
+ */
+void
+Mat_GatherRowMajor(void *out,size_t out_stride,const void *in,
+    size_t in_stride,size_t elem_size,int rank,const size_t *dims,
+    size_t first,size_t n)
+{
+    CopyRowMajor(out,out_stride,(char*)in,in_stride,elem_size,rank,dims,
+                 first,n,1);
+}
 
 static void
 ReadData(mat_t *mat, matvar_t *matvar)
 {
     if ( mat == NULL || matvar == NULL || mat->fp == NULL )
         return;
-    else if ( mat->version == MAT_FT_MAT5 )
+
+    Mat_AsyncWait5(mat);
+    SetReadScaling(mat,matvar);
+    if ( mat->version == MAT_FT_MAT5 )
         Read5(mat,matvar);
 #if defined(MAT73) && MAT73
     else if ( mat->version == MAT_FT_MAT73 )
@@ -65,9 +398,322 @@ ReadData(mat_t *mat, matvar_t *matvar)
 #endif
     else if ( mat->version == MAT_FT_MAT4 )
         Read4(mat,matvar);
+    SetReadScaling(mat,NULL);
     return;
 }
 
+/** @if mat_devman
+ * @brief Makes a variable share the data of another variable
+ *
+ * Both variables reference the data through a shared reference count, and
+ * the data is released when the last of them releases it.
+ * @ingroup mat_internal
+ * @param out Variable without data
+ * @param in Numeric, character or sparse variable with data
+ * @retval 0 on success
+ * @endif
+ */
+static int
+ShareData(matvar_t *out,const matvar_t *in)
+{
+    struct mat_shared_data *shared;
+
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+    pthread_mutex_lock(&shared_lock);
+#endif
+    shared = in->internal->shared;
+    if ( NULL == shared ) {
+        shared = Mat_Malloc(in->internal->allocator,sizeof(*shared));
+        if ( NULL != shared ) {
+            shared->refs = 1;
+            in->internal->shared = shared;
+        }
+    }
+    if ( NULL != shared )
+        shared->refs++;
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+    pthread_mutex_unlock(&shared_lock);
+#endif
+    if ( NULL == shared )
+        return 1;
+
+    out->data         = in->data;
+    out->mem_conserve = in->mem_conserve;
+    out->internal->shared = shared;
+    out->internal->data_free = in->internal->data_free;
+    out->internal->data_free_context = in->internal->data_free_context;
+    return 0;
+}
+
+/** @if mat_devman
+ * @brief Releases a reference to the shared data of a variable
+ *
+ * @ingroup mat_internal
+ * @param matvar Variable with shared data
+ * @return 1 if other variables still reference the data, or 0 if the
+ *         variable was the last one and must release the data
+ * @endif
+ */
+static int
+ReleaseShared(matvar_t *matvar)
+{
+    struct mat_shared_data *shared = matvar->internal->shared;
+    size_t refs;
+
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+    pthread_mutex_lock(&shared_lock);
+#endif
+    refs = --shared->refs;
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+    pthread_mutex_unlock(&shared_lock);
+#endif
+    matvar->internal->shared = NULL;
+    if ( refs > 0 )
+        return 1;
+    Mat_Free(matvar->internal->allocator,shared);
+    return 0;
+}
+
+/** @if mat_devman
+ * @brief Returns 1 if other variables reference the data of a variable
+ *
+ * @ingroup mat_internal
+ * @endif
+ */
+static int
+IsDataShared(const matvar_t *matvar)
+{
+    int is_shared = 0;
+
+    if ( NULL != matvar->internal->shared ) {
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+        pthread_mutex_lock(&shared_lock);
+#endif
+        is_shared = matvar->internal->shared->refs > 1;
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+        pthread_mutex_unlock(&shared_lock);
+#endif
+    }
+    return is_shared;
+}
+
+/** @if mat_devman
+ * @brief Frees the data of a numeric, character or sparse variable
+ *
+ * @ingroup mat_internal
+ * @param matvar MAT variable whose data is freed
+ * @endif
+ */
+static void
+FreeData(matvar_t *matvar)
+{
+    if ( NULL != matvar->data && NULL != matvar->internal->shared &&
+         ReleaseShared(matvar) )
+        return;
+    if ( NULL != matvar->data && NULL != matvar->internal->data_free ) {
+        /* The data is owned by the deallocator, called once */
+        matvar->internal->data_free(matvar->data,
+                                    matvar->internal->data_free_context);
+        matvar->internal->data_free = NULL;
+        return;
+    }
+    if ( NULL == matvar->data || matvar->mem_conserve ||
+         NULL != matvar->internal->arena )
+        return;
+
+    if ( MAT_C_SPARSE == matvar->class_type ) {
+        mat_sparse_t *sparse = matvar->data;
+        if ( sparse->ir != NULL )
+            Mat_VarDataFree(matvar,sparse->ir);
+        if ( sparse->jc != NULL )
+            Mat_VarDataFree(matvar,sparse->jc);
+        if ( matvar->isComplex && NULL != sparse->data ) {
+            mat_complex_split_t *complex_data = sparse->data;
+            Mat_VarDataFree(matvar,complex_data->Re);
+            Mat_VarDataFree(matvar,complex_data->Im);
+            Mat_VarMemFree(matvar,complex_data);
+        } else if ( sparse->data != NULL ) {
+            Mat_VarDataFree(matvar,sparse->data);
+        }
+        Mat_VarMemFree(matvar,sparse);
+    } else if ( MAT_IS_INTERLEAVED(matvar) ) {
+        Mat_VarDataFree(matvar,matvar->data);
+    } else if ( matvar->isComplex ) {
+        mat_complex_split_t *complex_data = matvar->data;
+        Mat_VarDataFree(matvar,complex_data->Re);
+        Mat_VarDataFree(matvar,complex_data->Im);
+        Mat_VarMemFree(matvar,complex_data);
+    } else {
+        Mat_VarDataFree(matvar,matvar->data);
+    }
+}
+
+/** @if mat_devman
+ * @brief Number of bytes a lazily read element counts against the bound
+ *
+ * @ingroup mat_internal
+ * @endif
+ */
+static size_t
+LazyBytes(const matvar_t *matvar)
+{
+    if ( matvar->isComplex && MAT_C_SPARSE != matvar->class_type )
+        return 2*matvar->nbytes;
+    return matvar->nbytes;
+}
+
+/** @if mat_devman
+ * @brief Removes a lazily read element from the list of its MAT file
+ *
+ * Elements whose data is in memory are in the least-recently-used list of
+ * the file, and elements without data in the list of unread elements.
+ * @ingroup mat_internal
+ * @endif
+ */
+static void
+UnlinkLazy(mat_t *mat,matvar_t *matvar)
+{
+    if ( NULL != matvar->internal->lazy_prev )
+        matvar->internal->lazy_prev->internal->lazy_next =
+            matvar->internal->lazy_next;
+    else if ( 2 == matvar->internal->lazy )
+        mat->lazy_head = matvar->internal->lazy_next;
+    else
+        mat->lazy_unread = matvar->internal->lazy_next;
+    if ( NULL != matvar->internal->lazy_next )
+        matvar->internal->lazy_next->internal->lazy_prev =
+            matvar->internal->lazy_prev;
+    else if ( 2 == matvar->internal->lazy )
+        mat->lazy_tail = matvar->internal->lazy_prev;
+    matvar->internal->lazy_prev = NULL;
+    matvar->internal->lazy_next = NULL;
+}
+
+/** @if mat_devman
+ * @brief Detaches the lazily read elements from their MAT file
+ *
+ * Called before the file is closed or replaced.  The elements keep the data
+ * already read, and the elements never read are left without data.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @endif
+ */
+static void
+DetachLazy(mat_t *mat)
+{
+    matvar_t *matvar;
+
+    while ( NULL != (matvar = mat->lazy_head) ||
+            NULL != (matvar = mat->lazy_unread) ) {
+        UnlinkLazy(mat,matvar);
+        matvar->internal->lazy = 0;
+        matvar->internal->fp   = NULL;
+    }
+    mat->lazy_tail  = NULL;
+    mat->lazy_bytes = 0;
+}
+
+/** @if mat_devman
+ * @brief Marks an element of a cell array or structure to be read on access
+ *
+ * The element is added to the list of unread elements of the file, so that
+ * it is detached from the file when the file is closed.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar Element of a cell array or structure without data
+ * @endif
+ */
+void
+Mat_VarSetLazy(mat_t *mat,matvar_t *matvar)
+{
+    matvar->internal->fp        = mat;
+    matvar->internal->lazy      = 1;
+    matvar->internal->lazy_prev = NULL;
+    matvar->internal->lazy_next = mat->lazy_unread;
+    if ( NULL != mat->lazy_unread )
+        mat->lazy_unread->internal->lazy_prev = matvar;
+    mat->lazy_unread = matvar;
+}
+
+/** @if mat_devman
+ * @brief Reads the data of an element of a cell array or structure
+ *
+ * The element must have been read with the information of its parent.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar Element of a cell array or structure
+ * @endif
+ */
+static void
+ReadElement(mat_t *mat,matvar_t *matvar)
+{
+    SetReadScaling(mat,NULL);
+    switch ( mat->version ) {
+        case MAT_FT_MAT5:
+            Mat_AsyncWait5(mat);
+            Mat_VarReadLazy5(mat,matvar);
+            break;
+        case MAT_FT_MAT73:
+#if defined(MAT73) && MAT73
+            Mat_VarReadLazy73(mat,matvar);
+#endif
+            break;
+        default:
+            break;
+    }
+}
+
+/** @if mat_devman
+ * @brief Reads the data of an element of a cell array or structure on access
+ *
+ * Reads the data of an element left unread by a lazy read (see
+ * Mat_SetLazyLoading) and marks it as the most recently used.  When the
+ * data of the elements in memory exceeds the bound of the file, the data of
+ * the least recently used elements is freed, and read again on their next
+ * access.  Does nothing for other variables.
+ * @ingroup mat_internal
+ * @param matvar Element of a cell array or structure
+ * @endif
+ */
+void
+Mat_VarReadLazy(matvar_t *matvar)
+{
+    mat_t *mat;
+
+    if ( NULL == matvar || !matvar->internal->lazy ||
+         NULL == (mat = matvar->internal->fp) )
+        return;
+
+    if ( 2 == matvar->internal->lazy ) {
+        UnlinkLazy(mat,matvar);
+    } else {
+        ReadElement(mat,matvar);
+        if ( NULL == matvar->data )
+            return;
+        UnlinkLazy(mat,matvar);
+        matvar->internal->lazy = 2;
+        mat->lazy_bytes += LazyBytes(matvar);
+    }
+
+    /* Append to the tail as the most recently used element */
+    matvar->internal->lazy_prev = mat->lazy_tail;
+    if ( NULL != mat->lazy_tail )
+        mat->lazy_tail->internal->lazy_next = matvar;
+    else
+        mat->lazy_head = matvar;
+    mat->lazy_tail = matvar;
+
+    while ( mat->lazy_max_bytes > 0 && mat->lazy_bytes > mat->lazy_max_bytes &&
+            mat->lazy_head != matvar ) {
+        matvar_t *lru = mat->lazy_head;
+        UnlinkLazy(mat,lru);
+        mat->lazy_bytes -= LazyBytes(lru);
+        FreeData(lru);
+        lru->data = NULL;
+        Mat_VarSetLazy(mat,lru);
+    }
+}
+
 static void
 Mat_PrintNumber(enum matio_types type, void *data)
 {
@@ -182,11 +828,40 @@ Mat_CreateVer(const char *matname,const char *hdr_str,enum mat_ft mat_file_ver)
  */
 mat_t *
 Mat_Open(const char *matname,int mode)
+{
+    return Mat_OpenChunkCache(matname,mode,0,0,-1.0);
+}
+
+/** @brief Opens an existing Matlab MAT file with a given chunk cache
+ *
+ * Opens a Matlab MAT file like Mat_Open.  For version 7.3 MAT files, the
+ * HDF5 raw data chunk cache of each dataset in the file is configured with
+ * @c nslots hash table slots and a size of @c nbytes.  The cache should hold
+ * all the chunks touched by one slab read, e.g. a full row of chunks when
+ * reading columns of a matrix chunked by tiles, so that each chunk is only
+ * decompressed once.  The settings are ignored for other versions.
+ * @ingroup MAT
+ * @param matname Name of MAT file to open
+ * @param mode File access mode (MAT_ACC_RDONLY,MAT_ACC_RDWR,etc).
+ * @param nslots Number of chunk slots in the cache (ideally a prime about
+ *        100 times the number of chunks that fit in @c nbytes), 0 for the
+ *        HDF5 default
+ * @param nbytes Size of the chunk cache in bytes, 0 for the HDF5 default
+ * @param w0 Preemption policy between 0 and 1, negative for the HDF5 default
+ * @return A pointer to the MAT file or NULL if it failed.  This is not a
+ * simple FILE * and should not be used as one.
+ */
+mat_t *
+Mat_OpenChunkCache(const char *matname,int mode,size_t nslots,size_t nbytes,
+    double w0)
 {
     FILE *fp = NULL;
     mat_int16_t tmp, tmp2;
     mat_t *mat = NULL;
     size_t bytesread = 0;
+#if defined(MAT73) && MAT73
+    hid_t fapl_id = H5P_DEFAULT;
+#endif
 
     if ( (mode & 0x01) == MAT_ACC_RDONLY ) {
         fp = fopen( matname, "rb" );
@@ -217,6 +892,25 @@ Mat_Open(const char *matname,int mode)
     mat->byteswap      = 0;
     mat->version       = 0;
     mat->refs_id       = -1;
+    mat->num_refs      = 0;
+    mat->dir           = NULL;
+    mat->dir_types     = NULL;
+    mat->scaling       = 0;
+    mat->scale         = 1.0;
+    mat->offset        = 0.0;
+    mat->nthreads      = 1;
+    mat->lazy          = 0;
+    mat->lazy_max_bytes = 0;
+    mat->lazy_bytes    = 0;
+    mat->lazy_head     = NULL;
+    mat->lazy_tail     = NULL;
+    mat->lazy_unread   = NULL;
+    mat->shallow       = 0;
+    mat->arena         = 0;
+    mat->allocator     = default_allocator;
+    mat->async         = NULL;
+    mat->scratch       = NULL;
+    mat->scratch_size  = 0;
 
     bytesread += fread(mat->header,1,116,fp);
     mat->header[116] = '\0';
@@ -287,10 +981,30 @@ Mat_Open(const char *matname,int mode)
 
         mat->fp = malloc(sizeof(hid_t));
 
+        if ( nslots > 0 || nbytes > 0 || w0 >= 0.0 ) {
+            int    mdc_nelmts;
+            size_t rdcc_nslots, rdcc_nbytes;
+            double rdcc_w0;
+
+            fapl_id = H5Pcreate(H5P_FILE_ACCESS);
+            H5Pget_cache(fapl_id,&mdc_nelmts,&rdcc_nslots,&rdcc_nbytes,
+                         &rdcc_w0);
+            if ( nslots > 0 )
+                rdcc_nslots = nslots;
+            if ( nbytes > 0 )
+                rdcc_nbytes = nbytes;
+            if ( w0 >= 0.0 )
+                rdcc_w0 = w0 > 1.0 ? 1.0 : w0;
+            H5Pset_cache(fapl_id,mdc_nelmts,rdcc_nslots,rdcc_nbytes,rdcc_w0);
+        }
+
         if ( (mode & 0x01) == MAT_ACC_RDONLY )
-            *(hid_t*)mat->fp=H5Fopen(mat->filename,H5F_ACC_RDONLY,H5P_DEFAULT);
+            *(hid_t*)mat->fp=H5Fopen(mat->filename,H5F_ACC_RDONLY,fapl_id);
         else if ( (mode & 0x01) == MAT_ACC_RDWR )
-            *(hid_t*)mat->fp=H5Fopen(mat->filename,H5F_ACC_RDWR,H5P_DEFAULT);
+            *(hid_t*)mat->fp=H5Fopen(mat->filename,H5F_ACC_RDWR,fapl_id);
+
+        if ( H5P_DEFAULT != fapl_id )
+            H5Pclose(fapl_id);
 
         if ( -1 < *(hid_t*)mat->fp ) {
             hsize_t num_objs;
@@ -312,17 +1026,26 @@ Mat_Open(const char *matname,int mode)
 
 /** @brief Closes an open Matlab MAT file
  *
- * Closes the given Matlab MAT file and frees any memory with it.
+ * Closes the given Matlab MAT file and frees any memory with it.  The
+ * variables queued by asynchronous writes (see Mat_SetAsyncWrite) are
+ * written before the file is closed.
  * @ingroup MAT
  * @param mat Pointer to the MAT file
- * @retval 0
+ * @retval 0 on success
+ * @retval 1 if a variable queued by an asynchronous write failed
  */
 int
 Mat_Close( mat_t *mat )
 {
+    int err = 0;
+
     if ( NULL != mat ) {
+        if ( mat->version == MAT_FT_MAT5 )
+            err = Mat_AsyncStop5(mat) ? 1 : 0;
+        DetachLazy(mat);
 #if defined(MAT73) && MAT73
         if ( mat->version == 0x0200 ) {
+            Mat_FreeDir73(mat);
             if ( mat->refs_id > -1 )
                 H5Gclose(mat->refs_id);
             H5Fclose(*(hid_t*)mat->fp);
@@ -338,9 +1061,10 @@ Mat_Close( mat_t *mat )
             free(mat->subsys_offset);
         if ( mat->filename )
             free(mat->filename);
+        Mat_Free(mat->allocator,mat->scratch);
         free(mat);
     }
-    return 0;
+    return err;
 }
 
 /** @brief Gets the filename for the given MAT file
@@ -375,52 +1099,251 @@ Mat_GetVersion(mat_t *matfp)
     return file_type;
 }
 
-/** @brief Rewinds a Matlab MAT file to the first variable
+/** @brief Sets the number of threads used to process the data of a MAT file
  *
- * Rewinds a Matlab MAT file to the first variable
+ * Sets the number of threads used to compress and decompress the chunks of
+ * version 7.3 MAT files.  With more than one thread, the data of deflated
+ * numeric datasets read by Mat_VarRead, Mat_VarReadDataAll and
+ * Mat_VarReadData is inflated by a pool of @c nthreads threads while the
+ * calling thread reads the raw chunks, and the data written by Mat_VarWrite
+ * with compression is deflated by the pool while the calling thread stores
+ * the chunks.  The setting has no effect if matio was built without
+ * threads, or for other file versions.
  * @ingroup MAT
  * @param mat Pointer to the MAT file
+ * @param nthreads Number of threads, 1 to process the data serially
  * @retval 0 on success
  */
 int
-Mat_Rewind( mat_t *mat )
+Mat_SetNumThreads(mat_t *mat,int nthreads)
 {
-    switch ( mat->version ) {
-        case MAT_FT_MAT73:
-            mat->next_index = 0;
-            break;
-        case MAT_FT_MAT5:
-            fseek(mat->fp,128L,SEEK_SET);
-            break;
-        case MAT_FT_MAT4:
-            fseek(mat->fp,0L,SEEK_SET);
-            break;
-        default:
-            return -1;
-    }
+    if ( NULL == mat )
+        return 1;
+    mat->nthreads = nthreads > 1 ? nthreads : 1;
     return 0;
 }
 
-/** @brief Returns the size of a Matlab Class
+/** @brief Reads the elements of cell arrays and structures when accessed
  *
- * Returns the size (in bytes) of the matlab class class_type
+ * With lazy loading enabled, Mat_VarRead, Mat_VarReadNext and
+ * Mat_VarReadDataAll read only the information of the elements of cell
+ * arrays and structures.  The data of an element is read the first time the
+ * element is returned by Mat_VarGetCell, Mat_VarGetStructFieldByName,
+ * Mat_VarGetStructFieldByIndex or Mat_VarGetStructField, so the MAT file
+ * must stay open while the elements are accessed.  Elements not accessed
+ * before the file is closed keep no data, and are returned without data
+ * afterwards.  If @c max_bytes is not 0, the data of the least recently
+ * accessed elements is freed when the data of the elements read this way
+ * exceeds @c max_bytes, and read again on their next access.  A pointer to
+ * the data of an element is therefore only valid until the next access to
+ * another element.  Version 5 and version 7.3 MAT files support lazy
+ * loading.
  * @ingroup MAT
- * @param class_type Matlab class type (MAT_C_*)
- * @returns Size of the class
+ * @param mat Pointer to the MAT file
+ * @param enable 1 to read the elements when accessed, 0 to read them with
+ *               their cell array or structure
+ * @param max_bytes Bound on the data of the elements in memory, 0 for none
+ * @retval 0 on success
  */
-size_t
-Mat_SizeOfClass(int class_type)
+int
+Mat_SetLazyLoading(mat_t *mat,int enable,size_t max_bytes)
 {
-    switch (class_type) {
-        case MAT_C_DOUBLE:
-            return sizeof(double);
-        case MAT_C_SINGLE:
-            return sizeof(float);
-#ifdef HAVE_MAT_INT64_T
-        case MAT_C_INT64:
-            return sizeof(mat_int64_t);
-#endif
-#ifdef HAVE_MAT_UINT64_T
+    if ( NULL == mat || (MAT_FT_MAT5 != mat->version &&
+         MAT_FT_MAT73 != mat->version) )
+        return 1;
+    mat->lazy           = enable ? 1 : 0;
+    mat->lazy_max_bytes = max_bytes;
+    return 0;
+}
+
+/** @brief Reads only the top-level information of variables
+ *
+ * With shallow information enabled, Mat_VarReadInfo and Mat_VarReadNextInfo
+ * read the class, dimensions and field names of a variable, but not the
+ * information of the elements of cell arrays and structures, and skip the
+ * rest of the variable.  The cell arrays and structures returned this way
+ * have no elements, and their data can not be read with Mat_VarReadDataAll.
+ * Mat_VarRead and Mat_VarReadNext always read the complete variable.
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file
+ * @param enable 1 to read only the top-level information, 0 to read the
+ *               information of all elements
+ * @retval 0 on success
+ */
+int
+Mat_SetShallowInfo(mat_t *mat,int enable)
+{
+    if ( NULL == mat )
+        return 1;
+    mat->shallow = enable ? 1 : 0;
+    return 0;
+}
+
+/** @brief Reads each variable tree into an arena
+ *
+ * With arena allocation enabled, the variables read by Mat_VarReadInfo,
+ * Mat_VarReadNextInfo, Mat_VarRead and Mat_VarReadNext, and the elements,
+ * names, dimensions and data of their cell arrays and structures, are
+ * allocated in a few large blocks owned by the variable that is returned.
+ * Mat_VarFree on that variable releases the blocks at once instead of
+ * freeing each element, and does nothing on its elements.  The elements of
+ * such a variable are therefore only valid until the variable is freed, and
+ * variables stored into it with Mat_VarSetCell or Mat_VarSetStructFieldByName
+ * (and similar) are not freed with it.  Lazy loading (see Mat_SetLazyLoading)
+ * does not apply to these variables.  Only version 5 MAT files support arena
+ * allocation.
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file
+ * @param enable 1 to read variables into an arena, 0 to allocate each part
+ *               of a variable separately
+ * @retval 0 on success
+ */
+int
+Mat_SetArenaAllocation(mat_t *mat,int enable)
+{
+    if ( NULL == mat || MAT_FT_MAT5 != mat->version )
+        return 1;
+    mat->arena = enable ? 1 : 0;
+    return 0;
+}
+
+/** @brief Sets the allocator of the memory allocated by the library
+ *
+ * With a MAT file, sets the allocator of the variables read from the file
+ * and of the buffers used to read and write it.  Without a MAT file, sets
+ * the allocator of the variables created by Mat_VarCalloc, Mat_VarCreate,
+ * Mat_VarCreateStruct and Mat_VarDuplicate (of variables using the default
+ * allocator), and the initial allocator of the MAT files opened or created
+ * afterwards.  A variable is freed with the allocator it was created with,
+ * so the allocator must remain valid until all memory allocated with it is
+ * freed.  The library keeps a pointer to @c allocator rather than a copy.
+ * The temporary buffers of reads and writes use the allocator of the file,
+ * or of the variable when there is no file.  The arrays returned by
+ * Mat_VarGetCells and Mat_CalcSubscripts, the MAT file structure itself with
+ * its header, file name and list of version 7.3 variables, the chunk buffers
+ * of the threads reading or writing version 7.3 datasets (see
+ * Mat_SetNumThreads) and the memory allocated by HDF5 still use the C
+ * library.
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file, or NULL to set the default allocator
+ * @param allocator Pointer to the allocator, or NULL for the C library
+ * @retval 0 on success
+ */
+int
+Mat_SetAllocator(mat_t *mat,const mat_allocator_t *allocator)
+{
+    if ( NULL != allocator && (NULL == allocator->alloc ||
+         NULL == allocator->resize || NULL == allocator->release) )
+        return 1;
+    if ( NULL == mat ) {
+        default_allocator = allocator;
+    } else {
+        /* The scratch buffer is released with the allocator it came from */
+        Mat_Free(mat->allocator,mat->scratch);
+        mat->scratch      = NULL;
+        mat->scratch_size = 0;
+        mat->allocator    = allocator;
+    }
+    return 0;
+}
+
+/** @brief Writes variables to a MAT file from a background thread
+ *
+ * With asynchronous writes enabled, Mat_VarWrite encodes the variable into
+ * a buffer, queues the buffer and returns, so the variable can be modified
+ * or freed immediately.  A background thread compresses the queued variables
+ * and appends them to the file in the order they were written.  If
+ * @c max_bytes is not 0, Mat_VarWrite waits for the thread while the
+ * variables in the queue would exceed @c max_bytes.  The errors of the
+ * thread are returned by Mat_Flush and Mat_Close.  The other functions
+ * accessing the file wait for the queued variables first.  The allocator of
+ * the file (see Mat_SetAllocator) is called from both threads.  Only
+ * version 5 MAT files support asynchronous writes, and only if matio was
+ * built with threads.
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file
+ * @param enable 1 to write the variables from a background thread, 0 to
+ *               write the queued variables and stop the thread
+ * @param max_bytes Bound on the variables in the queue, 0 for none
+ * @retval 0 on success
+ */
+int
+Mat_SetAsyncWrite(mat_t *mat,int enable,size_t max_bytes)
+{
+    if ( NULL == mat || MAT_FT_MAT5 != mat->version )
+        return 1;
+    if ( enable )
+        return Mat_AsyncStart5(mat,max_bytes);
+    return Mat_AsyncStop5(mat) ? 1 : 0;
+}
+
+/** @brief Waits for the variables written asynchronously to a MAT file
+ *
+ * Waits until the background thread (see Mat_SetAsyncWrite) wrote all the
+ * queued variables, and reports whether any of the variables queued since
+ * the previous call failed.
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file
+ * @retval 0 on success
+ * @retval 1 if a queued variable failed
+ */
+int
+Mat_Flush(mat_t *mat)
+{
+    if ( NULL == mat )
+        return 1;
+    if ( MAT_FT_MAT5 == mat->version )
+        return Mat_AsyncFlush5(mat) ? 1 : 0;
+    return 0;
+}
+
+/** @brief Rewinds a Matlab MAT file to the first variable
+ *
+ * Rewinds a Matlab MAT file to the first variable
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file
+ * @retval 0 on success
+ */
+int
+Mat_Rewind( mat_t *mat )
+{
+    Mat_AsyncWait5(mat);
+    switch ( mat->version ) {
+        case MAT_FT_MAT73:
+            mat->next_index = 0;
+            break;
+        case MAT_FT_MAT5:
+            fseek(mat->fp,128L,SEEK_SET);
+            break;
+        case MAT_FT_MAT4:
+            fseek(mat->fp,0L,SEEK_SET);
+            break;
+        default:
+            return -1;
+    }
+    return 0;
+}
+
+/** @brief Returns the size of a Matlab Class
+ *
+ * Returns the size (in bytes) of the matlab class class_type
+ * @ingroup MAT
+ * @param class_type Matlab class type (MAT_C_*)
+ * @returns Size of the class
+ */
+size_t
+Mat_SizeOfClass(int class_type)
+{
+    switch (class_type) {
+        case MAT_C_DOUBLE:
+            return sizeof(double);
+        case MAT_C_SINGLE:
+            return sizeof(float);
+#ifdef HAVE_MAT_INT64_T
+        case MAT_C_INT64:
+            return sizeof(mat_int64_t);
+#endif
+#ifdef HAVE_MAT_UINT64_T
         case MAT_C_UINT64:
             return sizeof(mat_uint64_t);
 #endif
@@ -449,1274 +1372,4351 @@ Mat_SizeOfClass(int class_type)
  *===================================================================
  */
 
-/** @brief Allocates memory for a new matvar_t and initializes all the fields
+/* Alignment of data buffers when the allocator does not request one */
+#define MAT_DATA_ALIGN 16
+
+/** @if mat_devman
+ * @brief Returns the allocator set with Mat_SetAllocator(NULL,...)
  *
- * @ingroup MAT
- * @return A newly allocated matvar_t
+ * @ingroup mat_internal
+ * @return Pointer to the allocator, or NULL for the C library
+ * @endif
  */
-matvar_t *
-Mat_VarCalloc(void)
+const mat_allocator_t *
+Mat_GetDefaultAllocator(void)
 {
-    matvar_t *matvar;
+    return default_allocator;
+}
 
-    matvar = malloc(sizeof(*matvar));
+/** @if mat_devman
+ * @brief Allocates memory with an allocator
+ *
+ * @ingroup mat_internal
+ * @param allocator Pointer to the allocator, or NULL for the C library
+ * @param size Number of bytes to allocate
+ * @return Pointer to the memory, or NULL on error
+ * @endif
+ */
+void *
+Mat_Malloc(const mat_allocator_t *allocator,size_t size)
+{
+    if ( NULL == allocator )
+        return malloc(size);
+    return allocator->alloc(size,allocator->user_data);
+}
 
-    if ( NULL != matvar ) {
-        matvar->nbytes       = 0;
-        matvar->rank         = 0;
-        matvar->data_type    = MAT_T_UNKNOWN;
-        matvar->data_size    = 0;
-        matvar->class_type   = MAT_C_EMPTY;
-        matvar->isComplex    = 0;
-        matvar->isGlobal     = 0;
-        matvar->isLogical    = 0;
-        matvar->dims         = NULL;
-        matvar->name         = NULL;
-        matvar->data         = NULL;
-        matvar->mem_conserve = 0;
-        matvar->compression  = 0;
-        matvar->internal     = malloc(sizeof(*matvar->internal));
-        if ( NULL == matvar->internal ) {
-            free(matvar);
-            matvar = NULL;
-        } else {
-            matvar->internal->hdf5_name = NULL;
-            matvar->internal->hdf5_ref  =  0;
-            matvar->internal->id        = -1;
-            matvar->internal->fp = NULL;
-            matvar->internal->fpos         = 0;
-            matvar->internal->datapos      = 0;
-            matvar->internal->fieldnames   = NULL;
-            matvar->internal->num_fields   = 0;
-#if defined(HAVE_ZLIB)
-            matvar->internal->z         = NULL;
-#endif
-        }
-    }
+/** @if mat_devman
+ * @brief Allocates zeroed memory with an allocator
+ *
+ * @ingroup mat_internal
+ * @param allocator Pointer to the allocator, or NULL for the C library
+ * @param nmemb Number of elements
+ * @param size Size of an element
+ * @return Pointer to the memory, or NULL on error
+ * @endif
+ */
+void *
+Mat_Calloc(const mat_allocator_t *allocator,size_t nmemb,size_t size)
+{
+    void *ptr;
 
-    return matvar;
+    if ( NULL == allocator )
+        return calloc(nmemb,size);
+    if ( size > 0 && nmemb > (size_t)-1/size )
+        return NULL;
+    ptr = allocator->alloc(nmemb*size,allocator->user_data);
+    if ( NULL != ptr )
+        memset(ptr,0,nmemb*size);
+    return ptr;
 }
 
-/** @brief Creates a MAT Variable with the given name and (optionally) data
- *
- * Creates a MAT variable that can be written to a Matlab MAT file with the
- * given name, data type, dimensions and data.  Rank should always be 2 or more.
- * i.e. Scalar values would have rank=2 and dims[2] = {1,1}.  Data type is
- * one of the MAT_T types.  MAT adds MAT_T_STRUCT and MAT_T_CELL to create
- * Structures and Cell Arrays respectively.  For MAT_T_STRUCT, data should be a
- * NULL terminated array of matvar_t * variables (i.e. for a 3x2 structure with
- * 10 fields, there should be 61 matvar_t * variables where the last one is
- * NULL).  For cell arrays, the NULL termination isn't necessary.  So to create
- * a cell array of size 3x2, data would be the address of an array of 6
- * matvar_t * variables.
+/** @if mat_devman
+ * @brief Resizes memory allocated with an allocator
  *
- * EXAMPLE:
- *   To create a struct of size 3x2 with 3 fields:
- * @code
- *     int rank=2, dims[2] = {3,2}, nfields = 3;
- *     matvar_t **vars;
+ * @ingroup mat_internal
+ * @param allocator Pointer to the allocator, or NULL for the C library
+ * @param ptr Memory to resize, or NULL
+ * @param size New number of bytes
+ * @return Pointer to the resized memory, or NULL on error
+ * @endif
+ */
+void *
+Mat_Realloc(const mat_allocator_t *allocator,void *ptr,size_t size)
+{
+    if ( NULL == allocator )
+        return realloc(ptr,size);
+    return allocator->resize(ptr,size,allocator->user_data);
+}
+
+/** @if mat_devman
+ * @brief Frees memory allocated with an allocator
  *
- *     vars = malloc((3*2*nfields+1)*sizeof(matvar_t *));
- *     vars[0]             = Mat_VarCreate(...);
- *        :
- *     vars[3*2*nfields-1] = Mat_VarCreate(...);
- *     vars[3*2*nfields]   = NULL;
- * @endcode
+ * @ingroup mat_internal
+ * @param allocator Pointer to the allocator, or NULL for the C library
+ * @param ptr Memory to free, or NULL
+ * @endif
+ */
+void
+Mat_Free(const mat_allocator_t *allocator,void *ptr)
+{
+    if ( NULL == allocator )
+        free(ptr);
+    else if ( NULL != ptr )
+        allocator->release(ptr,allocator->user_data);
+}
+
+/** @if mat_devman
+ * @brief Copies a string into memory allocated with an allocator
  *
- * EXAMPLE:
- *   To create a cell array of size 3x2:
- * @code
- *     int rank=2, dims[2] = {3,2};
- *     matvar_t **vars;
+ * @ingroup mat_internal
+ * @param allocator Pointer to the allocator, or NULL for the C library
+ * @param str String to copy
+ * @return Pointer to the copy, or NULL on error
+ * @endif
+ */
+char *
+Mat_Strdup(const mat_allocator_t *allocator,const char *str)
+{
+    size_t len = strlen(str)+1;
+    char *copy = Mat_Malloc(allocator,len);
+
+    if ( NULL != copy )
+        memcpy(copy,str,len);
+    return copy;
+}
+
+/** @if mat_devman
+ * @brief Allocates a data buffer with an allocator
  *
- *     vars = malloc(3*2*sizeof(matvar_t *));
- *     vars[0]             = Mat_VarCreate(...);
- *        :
- *     vars[5] = Mat_VarCreate(...);
- * @endcode
+ * @ingroup mat_internal
+ * @param allocator Pointer to the allocator, or NULL for the C library
+ * @param size Number of bytes to allocate
+ * @return Pointer to the memory, or NULL on error
+ * @endif
+ */
+void *
+Mat_MallocData(const mat_allocator_t *allocator,size_t size)
+{
+    if ( NULL == allocator || NULL == allocator->alloc_data ||
+         NULL == allocator->release_data )
+        return Mat_Malloc(allocator,size);
+    return allocator->alloc_data(size,allocator->data_alignment ?
+        allocator->data_alignment : MAT_DATA_ALIGN,allocator->user_data);
+}
+
+/** @if mat_devman
+ * @brief Frees a data buffer allocated with Mat_MallocData
  *
- * @ingroup MAT
- * @param name Name of the variable to create
- * @param class_type class type of the variable in Matlab(one of the mx Classes)
- * @param data_type data type of the variable (one of the MAT_T_ Types)
- * @param rank Rank of the variable
- * @param dims array of dimensions of the variable of size rank
- * @param data pointer to the data
- * @param opt 0, or bitwise or of the following options:
- * - MAT_F_DONT_COPY_DATA to just use the pointer to the data and not copy the
- *       data itself. Note that the pointer should not be freed until you are
- *       done with the mat variable.  The Mat_VarFree function will NOT free
- *       data that was created with MAT_F_DONT_COPY_DATA, so free it yourself.
- * - MAT_F_COMPLEX to specify that the data is complex.  The data variable
- *       should be a pointer to a mat_complex_split_t type.
- * - MAT_F_GLOBAL to assign the variable as a global variable
- * - MAT_F_LOGICAL to specify that it is a logical variable
- * @return A MAT variable that can be written to a file or otherwise used
+ * @ingroup mat_internal
+ * @param allocator Pointer to the allocator, or NULL for the C library
+ * @param ptr Memory to free, or NULL
+ * @endif
  */
-matvar_t *
-Mat_VarCreate(const char *name,enum matio_classes class_type,
-    enum matio_types data_type,int rank,size_t *dims,void *data,int opt)
+void
+Mat_FreeData(const mat_allocator_t *allocator,void *ptr)
 {
-    size_t i, nmemb = 1, nfields = 0, data_size;
-    matvar_t *matvar = NULL;
+    if ( NULL == allocator || NULL == allocator->alloc_data ||
+         NULL == allocator->release_data )
+        Mat_Free(allocator,ptr);
+    else if ( NULL != ptr )
+        allocator->release_data(ptr,allocator->user_data);
+}
 
-    if (dims == NULL) return NULL;
+#if defined(HAVE_ZLIB)
+static voidpf
+ZAlloc(voidpf opaque,uInt items,uInt size)
+{
+    return Mat_Calloc((const mat_allocator_t *)opaque,items,size);
+}
 
-    matvar = Mat_VarCalloc();
-    if ( NULL == matvar )
-        return NULL;
+static void
+ZFree(voidpf opaque,voidpf address)
+{
+    Mat_Free((const mat_allocator_t *)opaque,address);
+}
 
-    matvar->compression = MAT_COMPRESSION_NONE;
-    matvar->isComplex   = opt & MAT_F_COMPLEX;
-    matvar->isGlobal    = opt & MAT_F_GLOBAL;
-    matvar->isLogical   = opt & MAT_F_LOGICAL;
-    if ( name )
-        matvar->name = strdup_printf("%s",name);
-    matvar->rank = rank;
-    matvar->dims = malloc(matvar->rank*sizeof(*matvar->dims));
-    for ( i = 0; i < matvar->rank; i++ ) {
-        matvar->dims[i] = dims[i];
-        nmemb *= dims[i];
+/** @if mat_devman
+ * @brief Makes zlib allocate the state of a stream with an allocator
+ *
+ * Must be called before the stream is initialized.  Streams copied from
+ * @c z with inflateCopy use the same allocator.
+ * @ingroup mat_internal
+ * @param z zlib stream
+ * @param allocator Pointer to the allocator, or NULL for the C library
+ * @endif
+ */
+void
+Mat_SetStreamAllocator(z_stream *z,const mat_allocator_t *allocator)
+{
+    if ( NULL == allocator ) {
+        z->zalloc = Z_NULL;
+        z->zfree  = Z_NULL;
+        z->opaque = Z_NULL;
+    } else {
+        z->zalloc = ZAlloc;
+        z->zfree  = ZFree;
+        z->opaque = (voidpf)allocator;
     }
-    matvar->class_type = class_type;
-    matvar->data_type  = data_type;
-    switch ( data_type ) {
-        case MAT_T_INT8:
-            data_size = 1;
-            break;
-        case MAT_T_UINT8:
-            data_size = 1;
-            break;
-        case MAT_T_INT16:
-            data_size = 2;
-            break;
-        case MAT_T_UINT16:
-            data_size = 2;
-            break;
-        case MAT_T_INT64:
-            data_size = 8;
-            break;
-        case MAT_T_UINT64:
-            data_size = 8;
-            break;
-        case MAT_T_INT32:
-            data_size = 4;
-            break;
-        case MAT_T_UINT32:
-            data_size = 4;
-            break;
-        case MAT_T_SINGLE:
-            data_size = sizeof(float);
-            break;
-        case MAT_T_DOUBLE:
-            data_size = sizeof(double);
-            break;
-        case MAT_T_UTF8:
-            data_size = 1;
-            break;
-        case MAT_T_UTF16:
-            data_size = 2;
-            break;
-        case MAT_T_UTF32:
-            data_size = 4;
-            break;
-        case MAT_T_CELL:
-            data_size = sizeof(matvar_t **);
-            break;
-        case MAT_T_STRUCT:
-        {
-            matvar_t **fields;
+}
 
-            data_size = sizeof(matvar_t **);
-            if ( data != NULL ) {
-                fields = data;
-                nfields = 0;
-                while ( fields[nfields] != NULL )
-                    nfields++;
-                if ( nmemb )
-                    nfields = nfields / nmemb;
-                matvar->internal->num_fields = nfields;
-                if ( nfields ) {
-                    matvar->internal->fieldnames =
-                        calloc(nfields,sizeof(*matvar->internal->fieldnames));
-                    for ( i = 0; i < nfields; i++ )
-                        matvar->internal->fieldnames[i] = strdup(fields[i]->name);
-                    nmemb *= nfields;
-                }
-            }
-            break;
-        }
-        default:
-            Mat_Error("Unrecognized data_type");
-            Mat_VarFree(matvar);
-            return NULL;
-    }
-    if ( matvar->class_type == MAT_C_SPARSE ) {
-        matvar->data_size = sizeof(mat_sparse_t);
-        matvar->nbytes    = matvar->data_size;
-    } else {
-        matvar->data_size = data_size;
-        matvar->nbytes = nmemb*matvar->data_size;
-    }
-    if ( data == NULL ) {
-        if ( MAT_C_CELL == matvar->class_type && nmemb > 0 )
-            matvar->data = calloc(nmemb,sizeof(matvar_t*));
-        else
-            matvar->data = NULL;
-    } else if ( opt & MAT_F_DONT_COPY_DATA ) {
-        matvar->data         = data;
-        matvar->mem_conserve = 1;
-    } else if ( MAT_C_SPARSE == matvar->class_type ) {
-        mat_sparse_t *sparse_data, *sparse_data_in;
+/* Number of idle streams kept by each pool */
+#define MAT_STREAM_POOL_SIZE 4
 
-        sparse_data_in = data;
-        sparse_data    = malloc(sizeof(mat_sparse_t));
-        if ( NULL != sparse_data ) {
-            sparse_data->nzmax = sparse_data_in->nzmax;
-            sparse_data->nir   = sparse_data_in->nir;
-            sparse_data->njc   = sparse_data_in->njc;
-            sparse_data->ndata = sparse_data_in->ndata;
-            sparse_data->ir = malloc(sparse_data->nir*sizeof(*sparse_data->ir));
-            if ( NULL != sparse_data->ir )
-                memcpy(sparse_data->ir,sparse_data_in->ir,
-                       sparse_data->nir*sizeof(*sparse_data->ir));
-            sparse_data->jc = malloc(sparse_data->njc*sizeof(*sparse_data->jc));
-            if ( NULL != sparse_data->jc )
-                memcpy(sparse_data->jc,sparse_data_in->jc,
-                       sparse_data->njc*sizeof(*sparse_data->jc));
-            if ( matvar->isComplex ) {
-                sparse_data->data = malloc(sizeof(mat_complex_split_t));
-                if ( NULL != sparse_data->data ) {
-                    mat_complex_split_t *complex_data,*complex_data_in;
-                    complex_data     = sparse_data->data;
-                    complex_data_in  = sparse_data_in->data;
-                    complex_data->Re = malloc(sparse_data->ndata*data_size);
-                    complex_data->Im = malloc(sparse_data->ndata*data_size);
-                    if ( NULL != complex_data->Re )
-                        memcpy(complex_data->Re,complex_data_in->Re,
-                               sparse_data->ndata*data_size);
-                    if ( NULL != complex_data->Im )
-                        memcpy(complex_data->Im,complex_data_in->Im,
-                               sparse_data->ndata*data_size);
-                }
-            } else {
-                sparse_data->data = malloc(sparse_data->ndata*data_size);
-                if ( NULL != sparse_data->data )
-                    memcpy(sparse_data->data,sparse_data_in->data,
-                           sparse_data->ndata*data_size);
-            }
-        }
-        matvar->data = sparse_data;
-    } else {
-        if ( matvar->isComplex ) {
-            matvar->data   = malloc(sizeof(mat_complex_split_t));
-            if ( NULL != matvar->data && matvar->nbytes > 0 ) {
-                mat_complex_split_t *complex_data    = matvar->data;
-                mat_complex_split_t *complex_data_in = data;
+/** @if mat_devman
+ * @brief Idle zlib streams that are reset instead of initialized again
+ *
+ * Only streams allocated with the C library are kept, so the pools do not
+ * hold memory of an allocator that may be released.
+ * @ingroup mat_internal
+ * @endif
+ */
+struct mat_stream_pool {
+    z_stream *z[MAT_STREAM_POOL_SIZE]; /**< The idle streams */
+    int       n;                       /**< Number of idle streams */
+};
 
-                complex_data->Re = malloc(matvar->nbytes);
-                complex_data->Im = malloc(matvar->nbytes);
-                if ( NULL != complex_data->Re )
-                    memcpy(complex_data->Re,complex_data_in->Re,matvar->nbytes);
-                if ( NULL != complex_data->Im )
-                    memcpy(complex_data->Im,complex_data_in->Im,matvar->nbytes);
-            }
-        } else if ( matvar->nbytes > 0 ) {
-            matvar->data   = malloc(matvar->nbytes);
-            if ( NULL != matvar->data )
-                memcpy(matvar->data,data,matvar->nbytes);
-        }
-        matvar->mem_conserve = 0;
-    }
+static struct mat_stream_pool inflate_pool = {{NULL},0};
+static struct mat_stream_pool deflate_pool = {{NULL},0};
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+/* Guards the pools of idle streams */
+static pthread_mutex_t stream_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
-    return matvar;
+/** @if mat_devman
+ * @brief Takes an idle stream out of a pool
+ *
+ * @ingroup mat_internal
+ * @param pool Pool of idle streams
+ * @return Pointer to the stream, or NULL if the pool is empty
+ * @endif
+ */
+static z_stream *
+StreamPoolGet(struct mat_stream_pool *pool)
+{
+    z_stream *z = NULL;
+
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+    pthread_mutex_lock(&stream_lock);
+#endif
+    if ( pool->n > 0 )
+        z = pool->z[--pool->n];
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+    pthread_mutex_unlock(&stream_lock);
+#endif
+    if ( NULL != z ) {
+        z->next_in   = NULL;
+        z->avail_in  = 0;
+        z->next_out  = NULL;
+        z->avail_out = 0;
+    }
+    return z;
 }
 
-/** @brief Deletes a variable from a file
+/** @if mat_devman
+ * @brief Keeps a stream that is no longer used in a pool
  *
- * @ingroup MAT
- * @param mat Pointer to the mat_t file structure
- * @param name Name of the variable to delete
- * @returns 0 on success
+ * @ingroup mat_internal
+ * @param pool Pool of idle streams
+ * @param allocator Allocator of the stream, or NULL for the C library
+ * @param z zlib stream
+ * @retval 0 if the stream was added to the pool
+ * @retval 1 if the stream must be ended by the caller
+ * @endif
  */
-int
-Mat_VarDelete(mat_t *mat, const char *name)
+static int
+StreamPoolPut(struct mat_stream_pool *pool,const mat_allocator_t *allocator,
+    z_stream *z)
 {
-    int   err = 1;
-    enum mat_ft mat_file_ver = MAT_FT_DEFAULT;
-    char *tmp_name, *new_name, *temp;
-    mat_t *tmp;
-    matvar_t *matvar;
+    int err = 1;
 
-    if ( NULL == mat || NULL == name )
+    if ( NULL != allocator || ZAlloc == z->zalloc || Z_NULL == z->state )
         return err;
-
-    switch ( mat->version ) {
-        case 0x0200:
-            mat_file_ver = MAT_FT_MAT73;
-            break;
-        case 0x0100:
-            mat_file_ver = MAT_FT_MAT5;
-            break;
-        case 0x0010:
-            mat_file_ver = MAT_FT_MAT4;
-            break;
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+    pthread_mutex_lock(&stream_lock);
+#endif
+    if ( pool->n < MAT_STREAM_POOL_SIZE ) {
+        pool->z[pool->n++] = z;
+        err = 0;
     }
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+    pthread_mutex_unlock(&stream_lock);
+#endif
+    return err;
+}
 
-    temp     = strdup_printf("XXXXXX");
-    tmp_name = mktemp(temp);
-    tmp      = Mat_CreateVer(tmp_name,mat->header,mat_file_ver);
-    if ( tmp != NULL ) {
-        while ( NULL != (matvar = Mat_VarReadNext(mat)) ) {
-            if ( strcmp(matvar->name,name) )
-                Mat_VarWrite(tmp,matvar,0);
-            else
-                err = 0;
-            Mat_VarFree(matvar);
+/** @if mat_devman
+ * @brief Returns a stream initialized for decompression
+ *
+ * An idle stream of the pool is reset if there is one, otherwise a new
+ * stream is allocated and initialized.
+ * @ingroup mat_internal
+ * @param allocator Pointer to the allocator, or NULL for the C library
+ * @return Pointer to the stream, or NULL on error
+ * @endif
+ */
+z_stream *
+Mat_InflateInit(const mat_allocator_t *allocator)
+{
+    z_stream *z = NULL;
+
+    if ( NULL == allocator && NULL != (z = StreamPoolGet(&inflate_pool)) ) {
+        if ( Z_OK == inflateReset(z) )
+            return z;
+        inflateEnd(z);
+        Mat_Free(allocator,z);
+    }
+    z = Mat_Calloc(allocator,1,sizeof(*z));
+    if ( NULL != z ) {
+        Mat_SetStreamAllocator(z,allocator);
+        if ( Z_OK != inflateInit(z) ) {
+            Mat_Free(allocator,z);
+            z = NULL;
         }
-        /* FIXME: Memory leak */
-        new_name = strdup_printf("%s",mat->filename);
-        fclose(mat->fp);
+    }
+    return z;
+}
 
-        if ( (err = remove(new_name)) == -1 ) {
-            Mat_Close(tmp);
-            Mat_Critical("remove of %s failed",new_name);
-        } else if ( !Mat_Close(tmp) && (err=rename(tmp_name,new_name))==-1) {
-            Mat_Critical("rename failed oldname=%s,newname=%s",tmp_name,
-                new_name);
-        } else {
-            tmp = Mat_Open(new_name,mat->mode);
-            if ( NULL != tmp ) {
-                memcpy(mat,tmp,sizeof(mat_t));
-                Mat_Close(tmp);
-            }
+/** @if mat_devman
+ * @brief Releases a decompression stream
+ *
+ * The stream is kept in the pool if it was allocated with the C library
+ * and the pool is not full.
+ * @ingroup mat_internal
+ * @param allocator Allocator of the stream, or NULL for the C library
+ * @param z zlib stream, or NULL
+ * @endif
+ */
+void
+Mat_InflateEnd(const mat_allocator_t *allocator,z_stream *z)
+{
+    if ( NULL != z && StreamPoolPut(&inflate_pool,allocator,z) ) {
+        inflateEnd(z);
+        Mat_Free(allocator,z);
+    }
+}
+
+/** @if mat_devman
+ * @brief Returns a stream initialized for compression
+ *
+ * An idle stream of the pool is reset if there is one, otherwise a new
+ * stream is allocated and initialized with the default compression level.
+ * @ingroup mat_internal
+ * @param allocator Pointer to the allocator, or NULL for the C library
+ * @return Pointer to the stream, or NULL on error
+ * @endif
+ */
+z_stream *
+Mat_DeflateInit(const mat_allocator_t *allocator)
+{
+    z_stream *z = NULL;
+
+    if ( NULL == allocator && NULL != (z = StreamPoolGet(&deflate_pool)) ) {
+        if ( Z_OK == deflateReset(z) )
+            return z;
+        deflateEnd(z);
+        Mat_Free(allocator,z);
+    }
+    z = Mat_Calloc(allocator,1,sizeof(*z));
+    if ( NULL != z ) {
+        Mat_SetStreamAllocator(z,allocator);
+        if ( Z_OK != deflateInit(z,Z_DEFAULT_COMPRESSION) ) {
+            Mat_Free(allocator,z);
+            z = NULL;
         }
-        free(new_name);
     }
-    free(temp);
-    return err;
+    return z;
 }
 
-/** @brief Duplicates a matvar_t structure
+/** @if mat_devman
+ * @brief Releases a compression stream
  *
- * Provides a clean function for duplicating a matvar_t structure.
- * @ingroup MAT
- * @param in pointer to the matvar_t structure to be duplicated
- * @param opt 0 does a shallow duplicate and only assigns the data pointer to
- *            the duplicated array.  1 will do a deep duplicate and actually
- *            duplicate the contents of the data.  Warning: If you do a shallow
- *            copy and free both structures, the data will be freed twice and
- *            memory will be corrupted.  This may be fixed in a later release.
- * @returns Pointer to the duplicated matvar_t structure.
+ * The stream is kept in the pool if it was allocated with the C library
+ * and the pool is not full.
+ * @ingroup mat_internal
+ * @param allocator Allocator of the stream, or NULL for the C library
+ * @param z zlib stream, or NULL
+ * @endif
  */
-matvar_t *
-Mat_VarDuplicate(const matvar_t *in, int opt)
+void
+Mat_DeflateEnd(const mat_allocator_t *allocator,z_stream *z)
 {
-    matvar_t *out;
-    int i;
+    if ( NULL != z && StreamPoolPut(&deflate_pool,allocator,z) ) {
+        deflateEnd(z);
+        Mat_Free(allocator,z);
+    }
+}
+#endif
 
-    out = Mat_VarCalloc();
-    if ( out == NULL )
-        return NULL;
+/* Alignment of the allocations carved out of an arena */
+#define MAT_ARENA_ALIGN 16
+/* Sizes of the first and of the largest regular blocks of an arena */
+#define MAT_ARENA_MIN_BLOCK 4096
+#define MAT_ARENA_MAX_BLOCK (1024*1024)
 
-    out->nbytes       = in->nbytes;
-    out->rank         = in->rank;
-    out->data_type    = in->data_type;
-    out->data_size    = in->data_size;
-    out->class_type   = in->class_type;
-    out->isComplex    = in->isComplex;
-    out->isGlobal     = in->isGlobal;
-    out->isLogical    = in->isLogical;
-    out->mem_conserve = in->mem_conserve;
-    out->compression  = in->compression;
+/** @if mat_devman
+ * @brief Block of memory of an arena
+ *
+ * The allocations follow the header at the next multiple of MAT_ARENA_ALIGN.
+ * @ingroup mat_internal
+ * @endif
+ */
+struct mat_arena_block {
+    struct mat_arena_block *next; /**< Next (older) block */
+    size_t size;                  /**< Bytes available after the header */
+    size_t used;                  /**< Bytes allocated after the header */
+};
 
-    out->name = NULL;
-    out->dims = NULL;
-    out->data = NULL;
+#define MAT_ARENA_HEADER (((sizeof(struct mat_arena_block)+MAT_ARENA_ALIGN-1)/\
+    MAT_ARENA_ALIGN)*MAT_ARENA_ALIGN)
 
-    if ( NULL != in->internal->hdf5_name )
-        out->internal->hdf5_name = strdup(in->internal->hdf5_name);
+/** @if mat_devman
+ * @brief Data buffer of an arena allocated by the data hook of its allocator
+ *
+ * @ingroup mat_internal
+ * @endif
+ */
+struct mat_arena_data {
+    void *ptr;                    /**< The buffer */
+    struct mat_arena_data *next;  /**< Next buffer of the arena */
+};
 
-    out->internal->hdf5_ref = in->internal->hdf5_ref;
-    out->internal->id       = in->internal->id;
-    out->internal->fpos     = in->internal->fpos;
-    out->internal->datapos  = in->internal->datapos;
 #if defined(HAVE_ZLIB)
-    out->internal->z        = NULL;
+/** @if mat_devman
+ * @brief zlib stream of a variable in an arena
+ *
+ * The stream may be kept in a pool after the arena is released, so only
+ * the list entry is allocated in the arena.
+ * @ingroup mat_internal
+ * @endif
+ */
+struct mat_arena_stream {
+    z_stream *z;                    /**< The stream */
+    struct mat_arena_stream *next;  /**< Next stream of the arena */
+};
 #endif
-    out->internal->num_fields = in->internal->num_fields;
-    if ( NULL != in->internal->fieldnames && in->internal->num_fields > 0 ) {
-        out->internal->fieldnames = calloc(in->internal->num_fields,
-                                           sizeof(*in->internal->fieldnames));
-        for ( i = 0; i < in->internal->num_fields; i++ ) {
-            if ( NULL != in->internal->fieldnames[i] )
-                out->internal->fieldnames[i] =
-                    strdup(in->internal->fieldnames[i]);
-        }
-    }
 
-    if (in->name != NULL && (NULL != (out->name = malloc(strlen(in->name)+1))))
-        memcpy(out->name,in->name,strlen(in->name)+1);
-
-    out->dims = malloc(in->rank*sizeof(*out->dims));
-    if ( out->dims != NULL )
-        memcpy(out->dims,in->dims,in->rank*sizeof(*out->dims));
+/** @if mat_devman
+ * @brief Creates an empty arena
+ *
+ * @ingroup mat_internal
+ * @param allocator Allocator of the blocks, or NULL for the C library
+ * @return Pointer to the new arena, or NULL on error
+ * @endif
+ */
+struct mat_arena *
+Mat_ArenaCreate(const mat_allocator_t *allocator)
+{
+    struct mat_arena *arena = Mat_Malloc(allocator,sizeof(*arena));
+
+    if ( NULL != arena ) {
+        arena->allocator  = allocator;
+        arena->blocks     = NULL;
+        arena->block_size = MAT_ARENA_MIN_BLOCK;
+        arena->root       = NULL;
+        arena->data       = NULL;
 #if defined(HAVE_ZLIB)
-    if ( (in->internal->z != NULL) && (NULL != (out->internal->z = malloc(sizeof(z_stream)))) )
-        inflateCopy(out->internal->z,in->internal->z);
+        arena->streams    = NULL;
 #endif
-
-    if ( !opt ) {
-        out->data = in->data;
-    } else if ( (in->data != NULL) && (in->class_type == MAT_C_STRUCT) ) {
-        matvar_t **infields, **outfields;
-        int nfields = 0;
-
-        out->data = malloc(in->nbytes);
-        if ( out->data != NULL && in->data_size > 0 ) {
-            nfields   = in->nbytes / in->data_size;
-            infields  = (matvar_t **)in->data;
-            outfields = (matvar_t **)out->data;
-            for ( i = 0; i < nfields; i++ ) {
-                outfields[i] = Mat_VarDuplicate(infields[i],opt);
-            }
-        }
-    } else if ( (in->data != NULL) && (in->class_type == MAT_C_CELL) ) {
-        matvar_t **incells, **outcells;
-        int ncells = 0;
-
-        out->data = malloc(in->nbytes);
-        if ( out->data != NULL && in->data_size > 0 ) {
-            ncells   = in->nbytes / in->data_size;
-            incells  = (matvar_t **)in->data;
-            outcells = (matvar_t **)out->data;
-            for ( i = 0; i < ncells; i++ ) {
-                outcells[i] = Mat_VarDuplicate(incells[i],opt);
-            }
-        }
-    } else if ( in->data != NULL ) {
-        if ( out->isComplex ) {
-            out->data = malloc(sizeof(mat_complex_split_t));
-            if ( out->data != NULL ) {
-                mat_complex_split_t *out_data = out->data;
-                mat_complex_split_t *in_data  = in->data;
-                out_data->Re = malloc(out->nbytes);
-                if ( NULL != out_data->Re )
-                    memcpy(out_data->Re,in_data->Re,out->nbytes);
-                out_data->Im = malloc(out->nbytes);
-                if ( NULL != out_data->Im )
-                    memcpy(out_data->Im,in_data->Im,out->nbytes);
-            }
-        } else {
-            out->data = malloc(in->nbytes);
-            if ( out->data != NULL )
-                memcpy(out->data,in->data,in->nbytes);
-        }
     }
-    return out;
+    return arena;
 }
 
-/** @brief Frees all the allocated memory associated with the structure
+/** @if mat_devman
+ * @brief Releases an arena and everything allocated in it
  *
- * Frees memory used by a MAT variable.  Frees the data associated with a
- * MAT variable if it's non-NULL and MAT_F_DONT_COPY_DATA was not used.
- * @ingroup MAT
- * @param matvar Pointer to the matvar_t structure
+ * @ingroup mat_internal
+ * @param arena Pointer to the arena
+ * @endif
  */
 void
-Mat_VarFree(matvar_t *matvar)
+Mat_ArenaDestroy(struct mat_arena *arena)
 {
-    size_t nmemb = 0, i;
-    if ( !matvar )
+    struct mat_arena_block *block;
+
+    if ( NULL == arena )
         return;
-    if ( matvar->dims ) {
-        nmemb = 1;
-        for ( i = 0; i < matvar->rank; i++ )
-            nmemb *= matvar->dims[i];
-        free(matvar->dims);
+#if defined(HAVE_ZLIB)
+    while ( NULL != arena->streams ) {
+        Mat_InflateEnd(arena->allocator,arena->streams->z);
+        arena->streams = arena->streams->next;
     }
-    if ( matvar->name )
-        free(matvar->name);
-    if ( matvar->data != NULL) {
-        switch (matvar->class_type ) {
-            case MAT_C_STRUCT:
-                if ( !matvar->mem_conserve && NULL != matvar->data ) {
-                    matvar_t **fields = matvar->data;
-                    int nfields = matvar->internal->num_fields;
-                    for ( i = 0; i < nmemb*nfields; i++ )
-                        Mat_VarFree(fields[i]);
+#endif
+    while ( NULL != arena->data ) {
+        Mat_FreeData(arena->allocator,arena->data->ptr);
+        arena->data = arena->data->next;
+    }
+    while ( NULL != (block = arena->blocks) ) {
+        arena->blocks = block->next;
+        Mat_Free(arena->allocator,block);
+    }
+    Mat_Free(arena->allocator,arena);
+}
 
-                    free(matvar->data);
-                    break;
-                }
-            case MAT_C_CELL:
-                if ( !matvar->mem_conserve && NULL != matvar->data ) {
-                    matvar_t **cells = matvar->data;
-                    for ( i = 0; i < nmemb; i++ )
-                        Mat_VarFree(cells[i]);
+/** @if mat_devman
+ * @brief Allocates memory in an arena
+ *
+ * Allocations larger than a quarter of a block get a block of their own, so
+ * that the current block is not abandoned with most of its space unused.
+ * @ingroup mat_internal
+ * @param arena Pointer to the arena
+ * @param size Number of bytes to allocate
+ * @param align Alignment of the memory, a power of two
+ * @return Pointer to the memory, or NULL on error
+ * @endif
+ */
+static void *
+ArenaMalloc(struct mat_arena *arena,size_t size,size_t align)
+{
+    struct mat_arena_block *block = arena->blocks;
+    size_t pad = 0;
 
-                    free(matvar->data);
-                }
-                break;
-            case MAT_C_SPARSE:
-                if ( !matvar->mem_conserve ) {
-                    mat_sparse_t *sparse;
-                    sparse = matvar->data;
-                    if ( sparse->ir != NULL )
-                        free(sparse->ir);
-                    if ( sparse->jc != NULL )
-                        free(sparse->jc);
-                    if ( matvar->isComplex && NULL != sparse->data ) {
-                        mat_complex_split_t *complex_data = sparse->data;
-                        free(complex_data->Re);
-                        free(complex_data->Im);
-                        free(complex_data);
-                    } else if ( sparse->data != NULL ) {
-                        free(sparse->data);
-                    }
-                    free(sparse);
-                }
-                break;
-            case MAT_C_DOUBLE:
-            case MAT_C_SINGLE:
-            case MAT_C_INT64:
-            case MAT_C_UINT64:
-            case MAT_C_INT32:
-            case MAT_C_UINT32:
-            case MAT_C_INT16:
-            case MAT_C_UINT16:
-            case MAT_C_INT8:
-            case MAT_C_UINT8:
-            case MAT_C_CHAR:
-                if ( !matvar->mem_conserve && NULL != matvar->data ) {
-                    if ( matvar->isComplex ) {
-                        mat_complex_split_t *complex_data = matvar->data;
-                        free(complex_data->Re);
-                        free(complex_data->Im);
-                        free(complex_data);
-                    } else {
-                        free(matvar->data);
-                    }
-                }
-                break;
-            case MAT_C_EMPTY:
-            case MAT_C_OBJECT:
-            case MAT_C_FUNCTION:
-                break;
-        }
+    if ( align < MAT_ARENA_ALIGN )
+        align = MAT_ARENA_ALIGN;
+    size = ((size+MAT_ARENA_ALIGN-1)/MAT_ARENA_ALIGN)*MAT_ARENA_ALIGN;
+    if ( NULL != block ) {
+        size_t addr = (size_t)((char *)block+MAT_ARENA_HEADER+block->used);
+        pad = (align-addr % align) % align;
     }
+    if ( NULL == block || block->size-block->used < pad+size ) {
+        size_t block_size = arena->block_size;
 
-    if ( NULL != matvar->internal ) {
-#if defined(HAVE_ZLIB)
-        if ( matvar->compression == MAT_COMPRESSION_ZLIB ) {
-            inflateEnd(matvar->internal->z);
-            free(matvar->internal->z);
-        }
-#endif
-#if defined(MAT73) && MAT73
-        if ( -1 < matvar->internal->id ) {
-            switch ( H5Iget_type(matvar->internal->id) ) {
-                case H5I_GROUP:
-                    H5Gclose(matvar->internal->id);
-                    matvar->internal->id = -1;
-                    break;
-                case H5I_DATASET:
-                    H5Dclose(matvar->internal->id);
-                    matvar->internal->id = -1;
-                    break;
-                default:
-                    break;
-            }
-        }
-        if ( 0 < matvar->internal->hdf5_ref ) {
-            switch ( H5Iget_type(matvar->internal->id) ) {
-                case H5I_GROUP:
-                    H5Gclose(matvar->internal->id);
-                    matvar->internal->hdf5_ref = -1;
-                    break;
-                case H5I_DATASET:
-                    H5Dclose(matvar->internal->id);
-                    matvar->internal->hdf5_ref = -1;
-                    break;
-                default:
-                    break;
-            }
-        }
-        if ( NULL != matvar->internal->hdf5_name ) {
-            free(matvar->internal->hdf5_name);
-            matvar->internal->hdf5_name = NULL;
-        }
-#endif
-        if ( NULL != matvar->internal->fieldnames &&
-             matvar->internal->num_fields > 0 ) {
-            size_t i;
-            for ( i = 0; i < matvar->internal->num_fields; i++ ) {
-                if ( NULL != matvar->internal->fieldnames[i] )
-                    free(matvar->internal->fieldnames[i]);
+        if ( size+align > block_size/4 ) {
+            char *ptr;
+
+            block = Mat_Malloc(arena->allocator,MAT_ARENA_HEADER+size+align);
+            if ( NULL == block )
+                return NULL;
+            ptr = (char *)block+MAT_ARENA_HEADER;
+            ptr += (align-(size_t)ptr % align) % align;
+            block->size = size+align;
+            block->used = size+align;
+            /* Keep the current block first */
+            if ( NULL == arena->blocks ) {
+                block->next   = NULL;
+                arena->blocks = block;
+            } else {
+                block->next = arena->blocks->next;
+                arena->blocks->next = block;
             }
-            free(matvar->internal->fieldnames);
+            return ptr;
         }
-        free(matvar->internal);
-        matvar->internal = NULL;
+        block = Mat_Malloc(arena->allocator,MAT_ARENA_HEADER+block_size);
+        if ( NULL == block )
+            return NULL;
+        block->size   = block_size;
+        block->used   = 0;
+        block->next   = arena->blocks;
+        arena->blocks = block;
+        if ( 2*block_size <= MAT_ARENA_MAX_BLOCK )
+            arena->block_size = 2*block_size;
+        pad = (align-(size_t)((char *)block+MAT_ARENA_HEADER) % align) % align;
     }
-    /* FIXME: Why does this cause a SEGV? */
-#if 0
-    memset(matvar,0,sizeof(matvar_t));
-#endif
-    free(matvar);
+    block->used += pad+size;
+    return (char *)block+MAT_ARENA_HEADER+block->used-size;
 }
 
-void
-Mat_VarFree2(matvar_t *matvar)
+/** @if mat_devman
+ * @brief Allocates a data buffer in an arena
+ *
+ * If the allocator of the arena has a data hook, the buffer is allocated by
+ * the hook and freed when the arena is released.
+ * @ingroup mat_internal
+ * @param arena Pointer to the arena
+ * @param size Number of bytes to allocate
+ * @return Pointer to the memory, or NULL on error
+ * @endif
+ */
+static void *
+ArenaMallocData(struct mat_arena *arena,size_t size)
 {
-    if ( !matvar )
-        return;
-    if ( matvar->dims )
-        free(matvar->dims);
-    if ( matvar->name )
-        free(matvar->name);
-    if ( (matvar->data != NULL) && (matvar->class_type == MAT_C_STRUCT ||
-          matvar->class_type == MAT_C_CELL) && matvar->data_size > 0 ) {
-        int i;
-        matvar_t **fields = (matvar_t **)matvar->data;
-        int nfields = matvar->nbytes / matvar->data_size;
-        for ( i = 0; i < nfields; i++ )
-            Mat_VarFree(fields[i]);
-        free(matvar->data);
-    } else if ( (matvar->data != NULL) && (!matvar->mem_conserve) &&
-                (matvar->class_type == MAT_C_SPARSE) ) {
-        mat_sparse_t *sparse;
-        sparse = matvar->data;
-        if ( sparse->ir != NULL )
-            free(sparse->ir);
-        if ( sparse->jc != NULL )
-            free(sparse->jc);
-        if ( sparse->data != NULL )
-            free(sparse->data);
-        free(sparse);
-    } else {
-        if ( matvar->data && !matvar->mem_conserve )
-            free(matvar->data);
-    }
-#if defined(HAVE_ZLIB)
-    if ( matvar->compression == MAT_COMPRESSION_ZLIB )
-        inflateEnd(matvar->internal->z);
-#endif
-    /* FIXME: Why does this cause a SEGV? */
-#if 0
-    memset(matvar,0,sizeof(matvar_t));
-#endif
+    const mat_allocator_t *allocator = arena->allocator;
+    struct mat_arena_data *data;
+
+    if ( NULL == allocator || NULL == allocator->alloc_data ||
+         NULL == allocator->release_data )
+        return ArenaMalloc(arena,size,NULL == allocator ? MAT_ARENA_ALIGN :
+                           allocator->data_alignment);
+    data = ArenaMalloc(arena,sizeof(*data),MAT_ARENA_ALIGN);
+    if ( NULL == data )
+        return NULL;
+    data->ptr = Mat_MallocData(allocator,size);
+    if ( NULL == data->ptr )
+        return NULL;
+    data->next  = arena->data;
+    arena->data = data;
+    return data->ptr;
 }
 
-/** @brief Calculate a single subscript from a set of subscript values
+/** @if mat_devman
+ * @brief Allocates memory owned by a variable
  *
- * Calculates a single linear subscript (0-relative) given a 1-relative
- * subscript for each dimension.  The calculation uses the formula below where
- * index is the linear index, s is an array of length RANK where each element
- * is the subscript for the correspondind dimension, D is an array whose
- * elements are the dimensions of the variable.
- * \f[
- *   index = \sum\limits_{k=0}^{RANK-1} [(s_k - 1) \prod\limits_{l=0}^{k} D_l ]
- * \f]
- * @ingroup MAT
- * @param rank Rank of the variable
- * @param dims dimensions of the variable
- * @param subs Dimension subscripts
- * @return Single (linear) subscript
+ * The memory is allocated in the arena of the variable if it has one, and
+ * with its allocator otherwise.
+ * @ingroup mat_internal
+ * @param matvar Variable owning the memory
+ * @param size Number of bytes to allocate
+ * @return Pointer to the memory, or NULL on error
+ * @endif
  */
-int
-Mat_CalcSingleSubscript(int rank,int *dims,int *subs)
+void *
+Mat_VarMemAlloc(const matvar_t *matvar,size_t size)
 {
-    int index = 0, i, j, k, err = 0;
+    if ( NULL != matvar->internal->arena )
+        return ArenaMalloc(matvar->internal->arena,size,MAT_ARENA_ALIGN);
+    return Mat_Malloc(matvar->internal->allocator,size);
+}
 
-    for ( i = 0; i < rank; i++ ) {
-        k = subs[i];
-        if ( k > dims[i] ) {
-            err = 1;
-            Mat_Critical("Mat_CalcSingleSubscript: index out of bounds");
-            break;
-        } else if ( k < 1 ) {
-            err = 1;
-            break;
-        }
-        k--;
-        for ( j = i; j--; )
-            k *= dims[j];
-        index += k;
-    }
-    if ( err )
-        index = -1;
+/** @if mat_devman
+ * @brief Allocates zeroed memory owned by a variable
+ *
+ * @ingroup mat_internal
+ * @param matvar Variable owning the memory
+ * @param nmemb Number of elements
+ * @param size Size of an element
+ * @return Pointer to the memory, or NULL on error
+ * @endif
+ */
+void *
+Mat_VarMemCalloc(const matvar_t *matvar,size_t nmemb,size_t size)
+{
+    void *ptr;
 
-    return index;
+    if ( NULL == matvar->internal->arena )
+        return Mat_Calloc(matvar->internal->allocator,nmemb,size);
+    if ( size > 0 && nmemb > (size_t)-1/size )
+        return NULL;
+    ptr = ArenaMalloc(matvar->internal->arena,nmemb*size,MAT_ARENA_ALIGN);
+    if ( NULL != ptr )
+        memset(ptr,0,nmemb*size);
+    return ptr;
 }
 
-
-/** @brief Calculate a set of subscript values from a single(linear) subscript
+/** @if mat_devman
+ * @brief Resizes memory owned by a variable
  *
- * Calculates 1-relative subscripts for each dimension given a 0-relative
- * linear index.  Subscripts are calculated as follows where s is the array
- * of dimension subscripts, D is the array of dimensions, and index is the
- * linear index.
- * \f[
- *   s_k = \lfloor\frac{1}{L} \prod\limits_{l = 0}^{k} D_l\rfloor + 1
- * \f]
- * \f[
- *   L = index - \sum\limits_{l = k}^{RANK - 1} s_k \prod\limits_{m = 0}^{k} D_m
- * \f]
- * @ingroup MAT
- * @param rank Rank of the variable
- * @param dims dimensions of the variable
- * @param index linear index
- * @return Array of dimension subscripts
+ * @ingroup mat_internal
+ * @param matvar Variable owning the memory
+ * @param ptr Memory to resize, or NULL
+ * @param old_size Number of bytes of @c ptr
+ * @param size New number of bytes
+ * @return Pointer to the resized memory, or NULL on error
+ * @endif
  */
-int *
-Mat_CalcSubscripts(int rank,int *dims,int index)
+void *
+Mat_VarMemRealloc(const matvar_t *matvar,void *ptr,size_t old_size,
+                  size_t size)
 {
-    int i, j, k, *subs;
-    double l;
-
-    subs = malloc(rank*sizeof(int));
-    l = index;
-    for ( i = rank; i--; ) {
-        k = 1;
-        for ( j = i; j--; )
-            k *= dims[j];
-        subs[i] = floor(l / (double)k);
-        l -= subs[i]*k;
-        subs[i]++;
-    }
+    void *new_ptr;
 
-    return subs;
+    if ( NULL == matvar->internal->arena )
+        return Mat_Realloc(matvar->internal->allocator,ptr,size);
+    new_ptr = ArenaMalloc(matvar->internal->arena,size,MAT_ARENA_ALIGN);
+    if ( NULL != new_ptr && NULL != ptr )
+        memcpy(new_ptr,ptr,old_size < size ? old_size : size);
+    return new_ptr;
 }
 
-/** @brief Calculates the size of a matlab variable in bytes
+/** @if mat_devman
+ * @brief Frees memory allocated with Mat_VarMemAlloc
  *
+ * Memory of an arena is only released with the arena, so this frees @c ptr
+ * only if the variable has no arena.
+ * @ingroup mat_internal
+ * @param matvar Variable owning the memory
+ * @param ptr Memory to free, or NULL
+ * @endif
+ */
+void
+Mat_VarMemFree(const matvar_t *matvar,void *ptr)
+{
+    if ( NULL == matvar->internal->arena )
+        Mat_Free(matvar->internal->allocator,ptr);
+}
+
+/** @if mat_devman
+ * @brief Copies a string into memory owned by a variable
+ *
+ * @ingroup mat_internal
+ * @param matvar Variable owning the memory
+ * @param str String to copy
+ * @return Pointer to the copy, or NULL on error
+ * @endif
+ */
+char *
+Mat_VarMemStrdup(const matvar_t *matvar,const char *str)
+{
+    size_t len = strlen(str)+1;
+    char *copy = Mat_VarMemAlloc(matvar,len);
+
+    if ( NULL != copy )
+        memcpy(copy,str,len);
+    return copy;
+}
+
+/** @if mat_devman
+ * @brief Allocates a data buffer owned by a variable
+ *
+ * Data buffers are the data of numeric and character variables, the parts
+ * of complex data, and the arrays of sparse variables.
+ * @ingroup mat_internal
+ * @param matvar Variable owning the buffer
+ * @param size Number of bytes to allocate
+ * @return Pointer to the memory, or NULL on error
+ * @endif
+ */
+void *
+Mat_VarDataAlloc(const matvar_t *matvar,size_t size)
+{
+    if ( NULL != matvar->internal->arena )
+        return ArenaMallocData(matvar->internal->arena,size);
+    return Mat_MallocData(matvar->internal->allocator,size);
+}
+
+/** @if mat_devman
+ * @brief Frees a data buffer allocated with Mat_VarDataAlloc
+ *
+ * @ingroup mat_internal
+ * @param matvar Variable owning the buffer
+ * @param ptr Memory to free, or NULL
+ * @endif
+ */
+void
+Mat_VarDataFree(const matvar_t *matvar,void *ptr)
+{
+    if ( NULL == matvar->internal->arena )
+        Mat_FreeData(matvar->internal->allocator,ptr);
+}
+
+#if defined(HAVE_ZLIB)
+/** @if mat_devman
+ * @brief Makes the arena of a variable release a stream
+ *
+ * @ingroup mat_internal
+ * @param matvar Variable owning the stream
+ * @param z zlib stream
+ * @retval 0 on success
+ * @endif
+ */
+static int
+ArenaAddStream(const matvar_t *matvar,z_stream *z)
+{
+    struct mat_arena *arena = matvar->internal->arena;
+    struct mat_arena_stream *stream;
+
+    if ( NULL == arena )
+        return 0;
+    stream = Mat_VarMemAlloc(matvar,sizeof(*stream));
+    if ( NULL == stream )
+        return 1;
+    stream->z      = z;
+    stream->next   = arena->streams;
+    arena->streams = stream;
+    return 0;
+}
+
+/** @if mat_devman
+ * @brief Allocates a zeroed zlib stream owned by a variable
+ *
+ * The state of the stream is allocated with the allocator of the variable.
+ * A stream of a variable in an arena is ended when the arena is released.
+ * @ingroup mat_internal
+ * @param matvar Variable owning the stream
+ * @return Pointer to the stream, or NULL on error
+ * @endif
+ */
+z_stream *
+Mat_VarStreamCalloc(const matvar_t *matvar)
+{
+    const mat_allocator_t *allocator = matvar->internal->allocator;
+    z_stream *z = Mat_Calloc(allocator,1,sizeof(*z));
+
+    if ( NULL != z ) {
+        Mat_SetStreamAllocator(z,allocator);
+        if ( ArenaAddStream(matvar,z) ) {
+            Mat_Free(allocator,z);
+            z = NULL;
+        }
+    }
+    return z;
+}
+
+/** @if mat_devman
+ * @brief Returns a decompression stream owned by a variable
+ *
+ * The stream is taken from the pool of idle streams when possible and
+ * is released with Mat_VarStreamFree.
+ * @ingroup mat_internal
+ * @param matvar Variable owning the stream
+ * @return Pointer to the stream, or NULL on error
+ * @endif
+ */
+z_stream *
+Mat_VarInflateInit(const matvar_t *matvar)
+{
+    z_stream *z = Mat_InflateInit(matvar->internal->allocator);
+
+    if ( NULL != z && ArenaAddStream(matvar,z) ) {
+        Mat_InflateEnd(matvar->internal->allocator,z);
+        z = NULL;
+    }
+    return z;
+}
+
+/** @if mat_devman
+ * @brief Releases the decompression stream of a variable
+ *
+ * Streams of variables in an arena are released with the arena.
+ * @ingroup mat_internal
+ * @param matvar Variable owning the stream
+ * @endif
+ */
+void
+Mat_VarStreamFree(matvar_t *matvar)
+{
+    if ( NULL == matvar->internal->arena )
+        Mat_InflateEnd(matvar->internal->allocator,matvar->internal->z);
+    matvar->internal->z = NULL;
+}
+#endif
+
+/** @brief Allocates memory for a new matvar_t and initializes all the fields
+ *
+ * @ingroup MAT
+ * @return A newly allocated matvar_t
+ */
+matvar_t *
+Mat_VarCalloc(void)
+{
+    return Mat_VarCallocMem(default_allocator,NULL);
+}
+
+/** @if mat_devman
+ * @brief Allocates a new matvar_t and initializes all the fields
+ *
+ * @ingroup mat_internal
+ * @param allocator Allocator of the variable, or NULL for the C library
+ * @param arena Arena holding the variable, or NULL
+ * @return A newly allocated matvar_t
+ * @endif
+ */
+matvar_t *
+Mat_VarCallocMem(const mat_allocator_t *allocator,struct mat_arena *arena)
+{
+    matvar_t *matvar;
+
+    if ( NULL != arena ) {
+        allocator = arena->allocator;
+        matvar = ArenaMalloc(arena,sizeof(*matvar)+sizeof(*matvar->internal),
+                             MAT_ARENA_ALIGN);
+    } else {
+        matvar = Mat_Malloc(allocator,sizeof(*matvar));
+    }
+
+    if ( NULL != matvar ) {
+        matvar->nbytes       = 0;
+        matvar->rank         = 0;
+        matvar->data_type    = MAT_T_UNKNOWN;
+        matvar->data_size    = 0;
+        matvar->class_type   = MAT_C_EMPTY;
+        matvar->isComplex    = 0;
+        matvar->isGlobal     = 0;
+        matvar->isLogical    = 0;
+        matvar->dims         = NULL;
+        matvar->name         = NULL;
+        matvar->data         = NULL;
+        matvar->mem_conserve = 0;
+        matvar->compression  = 0;
+        if ( NULL != arena )
+            matvar->internal = (struct matvar_internal *)(matvar+1);
+        else
+            matvar->internal = Mat_Malloc(allocator,sizeof(*matvar->internal));
+        if ( NULL == matvar->internal ) {
+            Mat_Free(allocator,matvar);
+            matvar = NULL;
+        } else {
+            matvar->internal->hdf5_name = NULL;
+            matvar->internal->hdf5_ref  =  0;
+            matvar->internal->id        = -1;
+            matvar->internal->fp = NULL;
+            matvar->internal->fpos         = 0;
+            matvar->internal->datapos      = 0;
+            matvar->internal->fieldnames   = NULL;
+            matvar->internal->num_fields   = 0;
+            matvar->internal->field_index  = NULL;
+            matvar->internal->field_index_size = 0;
+            matvar->internal->name_shared  = 0;
+#if defined(HAVE_ZLIB)
+            matvar->internal->z         = NULL;
+#endif
+            matvar->internal->read_flags = 0;
+            matvar->internal->scaling   = 0;
+            matvar->internal->scale     = 1.0;
+            matvar->internal->offset    = 0.0;
+            matvar->internal->chunk_shape = MAT_CHUNK_DEFAULT;
+            matvar->internal->chunk_bytes = 0;
+            matvar->internal->lazy      = 0;
+            matvar->internal->lazy_prev = NULL;
+            matvar->internal->lazy_next = NULL;
+            matvar->internal->arena     = arena;
+            matvar->internal->allocator = allocator;
+            matvar->internal->data_free = NULL;
+            matvar->internal->data_free_context = NULL;
+            matvar->internal->shared    = NULL;
+            matvar->internal->data_capacity = 0;
+            matvar->internal->capacity_buf  = NULL;
+        }
+    }
+
+    return matvar;
+}
+
+/** @if mat_devman
+ * @brief Allocates an element of a cell array or structure
+ *
+ * The element uses the allocator and the arena of its parent.
+ * @ingroup mat_internal
+ * @param parent Cell array or structure
+ * @return A newly allocated matvar_t
+ * @endif
+ */
+matvar_t *
+Mat_VarCallocElement(const matvar_t *parent)
+{
+    return Mat_VarCallocMem(parent->internal->allocator,
+                            parent->internal->arena);
+}
+
+/** @brief Creates a MAT Variable with the given name and (optionally) data
+ *
+ * Creates a MAT variable that can be written to a Matlab MAT file with the
+ * given name, data type, dimensions and data.  Rank should always be 2 or more.
+ * i.e. Scalar values would have rank=2 and dims[2] = {1,1}.  Data type is
+ * one of the MAT_T types.  MAT adds MAT_T_STRUCT and MAT_T_CELL to create
+ * Structures and Cell Arrays respectively.  For MAT_T_STRUCT, data should be a
+ * NULL terminated array of matvar_t * variables (i.e. for a 3x2 structure with
+ * 10 fields, there should be 61 matvar_t * variables where the last one is
+ * NULL).  For cell arrays, the NULL termination isn't necessary.  So to create
+ * a cell array of size 3x2, data would be the address of an array of 6
+ * matvar_t * variables.
+ *
+ * EXAMPLE:
+ *   To create a struct of size 3x2 with 3 fields:
+ * @code
+ *     int rank=2, dims[2] = {3,2}, nfields = 3;
+ *     matvar_t **vars;
+ *
+ *     vars = malloc((3*2*nfields+1)*sizeof(matvar_t *));
+ *     vars[0]             = Mat_VarCreate(...);
+ *        :
+ *     vars[3*2*nfields-1] = Mat_VarCreate(...);
+ *     vars[3*2*nfields]   = NULL;
+ * @endcode
+ *
+ * EXAMPLE:
+ *   To create a cell array of size 3x2:
+ * @code
+ *     int rank=2, dims[2] = {3,2};
+ *     matvar_t **vars;
+ *
+ *     vars = malloc(3*2*sizeof(matvar_t *));
+ *     vars[0]             = Mat_VarCreate(...);
+ *        :
+ *     vars[5] = Mat_VarCreate(...);
+ * @endcode
+ *
+ * @ingroup MAT
+ * @param name Name of the variable to create
+ * @param class_type class type of the variable in Matlab(one of the mx Classes)
+ * @param data_type data type of the variable (one of the MAT_T_ Types)
+ * @param rank Rank of the variable
+ * @param dims array of dimensions of the variable of size rank
+ * @param data pointer to the data
+ * @param opt 0, or bitwise or of the following options:
+ * - MAT_F_DONT_COPY_DATA to just use the pointer to the data and not copy the
+ *       data itself. Note that the pointer should not be freed until you are
+ *       done with the mat variable.  The Mat_VarFree function will NOT free
+ *       data that was created with MAT_F_DONT_COPY_DATA, so free it yourself,
+ *       or hand it to the variable with Mat_VarSetDataDeallocator.
+ * - MAT_F_COMPLEX to specify that the data is complex.  The data variable
+ *       should be a pointer to a mat_complex_split_t type.
+ * - MAT_F_GLOBAL to assign the variable as a global variable
+ * - MAT_F_LOGICAL to specify that it is a logical variable
+ * - MAT_F_ROW_MAJOR to specify that the data of a numeric or character array
+ *       is in row-major (C) order.  The data is kept in row-major order, also
+ *       with MAT_F_DONT_COPY_DATA, and transposed to the column-major order
+ *       of MAT files while it is written.
+ * - MAT_F_COMPLEX_INTERLEAVED with MAT_F_COMPLEX to specify that the data of
+ *       a numeric array is a single buffer of interleaved real and imaginary
+ *       parts (re,im,re,im,...) rather than a mat_complex_split_t.  The data
+ *       is kept interleaved and split into parts as it is written.
+ * @return A MAT variable that can be written to a file or otherwise used, or
+ *         NULL if the data could not be copied
+ */
+matvar_t *
+Mat_VarCreate(const char *name,enum matio_classes class_type,
+    enum matio_types data_type,int rank,size_t *dims,void *data,int opt)
+{
+    size_t i, nmemb = 1, nfields = 0, data_size;
+    matvar_t *matvar = NULL;
+
+    if (dims == NULL) return NULL;
+
+    matvar = Mat_VarCalloc();
+    if ( NULL == matvar )
+        return NULL;
+
+    matvar->compression = MAT_COMPRESSION_NONE;
+    matvar->isComplex   = opt & MAT_F_COMPLEX;
+    matvar->isGlobal    = opt & MAT_F_GLOBAL;
+    matvar->isLogical   = opt & MAT_F_LOGICAL;
+    if ( name )
+        matvar->name = Mat_VarMemStrdup(matvar,name);
+    matvar->rank = rank;
+    matvar->dims = Mat_VarMemAlloc(matvar,matvar->rank*sizeof(*matvar->dims));
+    for ( i = 0; i < matvar->rank; i++ ) {
+        matvar->dims[i] = dims[i];
+        nmemb *= dims[i];
+    }
+    matvar->class_type = class_type;
+    matvar->data_type  = data_type;
+    if ( matvar->isComplex && (opt & MAT_F_COMPLEX_INTERLEAVED) &&
+         MAT_C_DOUBLE <= class_type && MAT_C_UINT64 >= class_type )
+        matvar->internal->read_flags |= MAT_F_COMPLEX_INTERLEAVED;
+    if ( (opt & MAT_F_ROW_MAJOR) && MAT_C_CELL != class_type &&
+         MAT_C_STRUCT != class_type && MAT_C_SPARSE != class_type )
+        matvar->internal->read_flags |= MAT_F_ROW_MAJOR;
+    switch ( data_type ) {
+        case MAT_T_INT8:
+            data_size = 1;
+            break;
+        case MAT_T_UINT8:
+            data_size = 1;
+            break;
+        case MAT_T_INT16:
+            data_size = 2;
+            break;
+        case MAT_T_UINT16:
+            data_size = 2;
+            break;
+        case MAT_T_INT64:
+            data_size = 8;
+            break;
+        case MAT_T_UINT64:
+            data_size = 8;
+            break;
+        case MAT_T_INT32:
+            data_size = 4;
+            break;
+        case MAT_T_UINT32:
+            data_size = 4;
+            break;
+        case MAT_T_SINGLE:
+            data_size = sizeof(float);
+            break;
+        case MAT_T_DOUBLE:
+            data_size = sizeof(double);
+            break;
+        case MAT_T_UTF8:
+            data_size = 1;
+            break;
+        case MAT_T_UTF16:
+            data_size = 2;
+            break;
+        case MAT_T_UTF32:
+            data_size = 4;
+            break;
+        case MAT_T_CELL:
+            data_size = sizeof(matvar_t **);
+            break;
+        case MAT_T_STRUCT:
+        {
+            matvar_t **fields;
+
+            data_size = sizeof(matvar_t **);
+            if ( data != NULL ) {
+                fields = data;
+                nfields = 0;
+                while ( fields[nfields] != NULL )
+                    nfields++;
+                if ( nmemb )
+                    nfields = nfields / nmemb;
+                matvar->internal->num_fields = nfields;
+                if ( nfields ) {
+                    matvar->internal->fieldnames =
+                        Mat_VarMemCalloc(matvar,nfields,
+                                         sizeof(*matvar->internal->fieldnames));
+                    for ( i = 0; i < nfields; i++ )
+                        matvar->internal->fieldnames[i] =
+                            Mat_VarMemStrdup(matvar,fields[i]->name);
+                    Mat_VarIndexStructFields(matvar);
+                    nmemb *= nfields;
+                }
+            }
+            break;
+        }
+        default:
+            Mat_Error("Unrecognized data_type");
+            Mat_VarFree(matvar);
+            return NULL;
+    }
+    if ( matvar->class_type == MAT_C_SPARSE ) {
+        matvar->data_size = sizeof(mat_sparse_t);
+        matvar->nbytes    = matvar->data_size;
+    } else {
+        matvar->data_size = data_size;
+        matvar->nbytes = nmemb*matvar->data_size;
+    }
+    if ( data == NULL ) {
+        if ( MAT_C_CELL == matvar->class_type && nmemb > 0 )
+            matvar->data = Mat_VarMemCalloc(matvar,nmemb,sizeof(matvar_t*));
+        else
+            matvar->data = NULL;
+    } else if ( opt & MAT_F_DONT_COPY_DATA ) {
+        matvar->data         = data;
+        matvar->mem_conserve = 1;
+    } else if ( MAT_C_SPARSE == matvar->class_type ) {
+        mat_sparse_t *sparse_data, *sparse_data_in;
+
+        sparse_data_in = data;
+        sparse_data    = Mat_VarMemAlloc(matvar,sizeof(mat_sparse_t));
+        if ( NULL != sparse_data ) {
+            sparse_data->nzmax = sparse_data_in->nzmax;
+            sparse_data->nir   = sparse_data_in->nir;
+            sparse_data->njc   = sparse_data_in->njc;
+            sparse_data->ndata = sparse_data_in->ndata;
+            sparse_data->ir = Mat_VarDataAlloc(matvar,
+                sparse_data->nir*sizeof(*sparse_data->ir));
+            if ( NULL != sparse_data->ir )
+                memcpy(sparse_data->ir,sparse_data_in->ir,
+                       sparse_data->nir*sizeof(*sparse_data->ir));
+            sparse_data->jc = Mat_VarDataAlloc(matvar,
+                sparse_data->njc*sizeof(*sparse_data->jc));
+            if ( NULL != sparse_data->jc )
+                memcpy(sparse_data->jc,sparse_data_in->jc,
+                       sparse_data->njc*sizeof(*sparse_data->jc));
+            if ( matvar->isComplex ) {
+                sparse_data->data = Mat_VarMemAlloc(matvar,
+                                                   sizeof(mat_complex_split_t));
+                if ( NULL != sparse_data->data ) {
+                    mat_complex_split_t *complex_data,*complex_data_in;
+                    complex_data     = sparse_data->data;
+                    complex_data_in  = sparse_data_in->data;
+                    complex_data->Re = Mat_VarDataAlloc(matvar,
+                                           sparse_data->ndata*data_size);
+                    complex_data->Im = Mat_VarDataAlloc(matvar,
+                                           sparse_data->ndata*data_size);
+                    if ( NULL != complex_data->Re )
+                        memcpy(complex_data->Re,complex_data_in->Re,
+                               sparse_data->ndata*data_size);
+                    if ( NULL != complex_data->Im )
+                        memcpy(complex_data->Im,complex_data_in->Im,
+                               sparse_data->ndata*data_size);
+                }
+            } else {
+                sparse_data->data = Mat_VarDataAlloc(matvar,
+                                               sparse_data->ndata*data_size);
+                if ( NULL != sparse_data->data )
+                    memcpy(sparse_data->data,sparse_data_in->data,
+                           sparse_data->ndata*data_size);
+            }
+        }
+        matvar->data = sparse_data;
+    } else {
+        int err = 0;
+
+        matvar->mem_conserve = 0;
+        if ( MAT_IS_INTERLEAVED(matvar) ) {
+            if ( matvar->nbytes > 0 ) {
+                matvar->data = Mat_VarDataAlloc(matvar,2*matvar->nbytes);
+                if ( NULL != matvar->data )
+                    memcpy(matvar->data,data,2*matvar->nbytes);
+                else
+                    err = 1;
+            }
+        } else if ( matvar->isComplex ) {
+            matvar->data   = Mat_VarMemAlloc(matvar,sizeof(mat_complex_split_t));
+            if ( NULL == matvar->data ) {
+                err = 1;
+            } else if ( matvar->nbytes > 0 ) {
+                mat_complex_split_t *complex_data    = matvar->data;
+                mat_complex_split_t *complex_data_in = data;
+
+                complex_data->Re = Mat_VarDataAlloc(matvar,matvar->nbytes);
+                complex_data->Im = Mat_VarDataAlloc(matvar,matvar->nbytes);
+                if ( NULL != complex_data->Re && NULL != complex_data->Im ) {
+                    memcpy(complex_data->Re,complex_data_in->Re,matvar->nbytes);
+                    memcpy(complex_data->Im,complex_data_in->Im,matvar->nbytes);
+                } else {
+                    err = 1;
+                }
+            }
+        } else if ( matvar->nbytes > 0 ) {
+            matvar->data   = Mat_VarDataAlloc(matvar,matvar->nbytes);
+            if ( NULL != matvar->data )
+                memcpy(matvar->data,data,matvar->nbytes);
+            else
+                err = 1;
+        }
+        if ( err ) {
+            Mat_Critical("Couldn't allocate memory for the data");
+            Mat_VarFree(matvar);
+            return NULL;
+        }
+    }
+
+    return matvar;
+}
+
+/** @brief Deletes a variable from a file
+ *
+ * @ingroup MAT
+ * @param mat Pointer to the mat_t file structure
+ * @param name Name of the variable to delete
+ * @returns 0 on success
+ */
+int
+Mat_VarDelete(mat_t *mat, const char *name)
+{
+    int   err = 1;
+    enum mat_ft mat_file_ver = MAT_FT_DEFAULT;
+    char *tmp_name, *new_name, *temp;
+    mat_t *tmp;
+    matvar_t *matvar;
+
+    if ( NULL == mat || NULL == name )
+        return err;
+
+    /* The variables written asynchronously are copied with the others */
+    Mat_AsyncWait5(mat);
+    switch ( mat->version ) {
+        case 0x0200:
+            mat_file_ver = MAT_FT_MAT73;
+            break;
+        case 0x0100:
+            mat_file_ver = MAT_FT_MAT5;
+            break;
+        case 0x0010:
+            mat_file_ver = MAT_FT_MAT4;
+            break;
+    }
+
+    temp     = strdup_printf("XXXXXX");
+    tmp_name = mktemp(temp);
+    tmp      = Mat_CreateVer(tmp_name,mat->header,mat_file_ver);
+    if ( tmp != NULL ) {
+        /* The copied variables must be read completely */
+        mat->lazy = 0;
+        while ( NULL != (matvar = Mat_VarReadNext(mat)) ) {
+            if ( strcmp(matvar->name,name) )
+                Mat_VarWrite(tmp,matvar,0);
+            else
+                err = 0;
+            Mat_VarFree(matvar);
+        }
+        /* FIXME: Memory leak */
+        new_name = strdup_printf("%s",mat->filename);
+        fclose(mat->fp);
+
+        if ( (err = remove(new_name)) == -1 ) {
+            Mat_Close(tmp);
+            Mat_Critical("remove of %s failed",new_name);
+        } else if ( !Mat_Close(tmp) && (err=rename(tmp_name,new_name))==-1) {
+            Mat_Critical("rename failed oldname=%s,newname=%s",tmp_name,
+                new_name);
+        } else {
+            tmp = Mat_Open(new_name,mat->mode);
+            if ( NULL != tmp ) {
+                /* The background writer keeps writing to mat */
+                tmp->async = mat->async;
+                DetachLazy(mat);
+                Mat_Free(mat->allocator,mat->scratch);
+                memcpy(mat,tmp,sizeof(mat_t));
+                tmp->async = NULL;
+                Mat_Close(tmp);
+            }
+        }
+        free(new_name);
+    }
+    free(temp);
+    return err;
+}
+
+/** @if mat_devman
+ * @brief Copies the data of a numeric, character or sparse variable
+ *
+ * @ingroup mat_internal
+ * @param out Variable without data, allocating the copy
+ * @param in Variable whose data is copied
+ * @endif
+ */
+static void
+CopyData(matvar_t *out,const matvar_t *in)
+{
+    out->mem_conserve = 0;
+    if ( MAT_C_SPARSE == in->class_type ) {
+        mat_sparse_t *sparse, *in_sparse = in->data;
+        size_t nbytes = in_sparse->ndata*Mat_SizeOf(in->data_type);
+
+        sparse = Mat_VarMemCalloc(out,1,sizeof(*sparse));
+        if ( NULL == sparse )
+            return;
+        *sparse = *in_sparse;
+        sparse->ir = NULL;
+        sparse->jc = NULL;
+        sparse->data = NULL;
+        if ( NULL != in_sparse->ir ) {
+            sparse->ir = Mat_VarDataAlloc(out,sparse->nir*sizeof(*sparse->ir));
+            if ( NULL != sparse->ir )
+                memcpy(sparse->ir,in_sparse->ir,
+                       sparse->nir*sizeof(*sparse->ir));
+        }
+        if ( NULL != in_sparse->jc ) {
+            sparse->jc = Mat_VarDataAlloc(out,sparse->njc*sizeof(*sparse->jc));
+            if ( NULL != sparse->jc )
+                memcpy(sparse->jc,in_sparse->jc,
+                       sparse->njc*sizeof(*sparse->jc));
+        }
+        if ( in->isComplex && NULL != in_sparse->data ) {
+            mat_complex_split_t *complex_data, *in_data = in_sparse->data;
+
+            complex_data = Mat_VarMemAlloc(out,sizeof(*complex_data));
+            if ( NULL != complex_data ) {
+                complex_data->Re = Mat_VarDataAlloc(out,nbytes);
+                if ( NULL != complex_data->Re )
+                    memcpy(complex_data->Re,in_data->Re,nbytes);
+                complex_data->Im = Mat_VarDataAlloc(out,nbytes);
+                if ( NULL != complex_data->Im )
+                    memcpy(complex_data->Im,in_data->Im,nbytes);
+            }
+            sparse->data = complex_data;
+        } else if ( NULL != in_sparse->data ) {
+            sparse->data = Mat_VarDataAlloc(out,nbytes);
+            if ( NULL != sparse->data )
+                memcpy(sparse->data,in_sparse->data,nbytes);
+        }
+        out->data = sparse;
+    } else if ( MAT_IS_INTERLEAVED(in) ) {
+        out->data = Mat_VarDataAlloc(out,2*in->nbytes);
+        if ( out->data != NULL )
+            memcpy(out->data,in->data,2*in->nbytes);
+    } else if ( in->isComplex ) {
+        out->data = Mat_VarMemAlloc(out,sizeof(mat_complex_split_t));
+        if ( out->data != NULL ) {
+            mat_complex_split_t *out_data = out->data;
+            mat_complex_split_t *in_data  = in->data;
+            out_data->Re = Mat_VarDataAlloc(out,out->nbytes);
+            if ( NULL != out_data->Re )
+                memcpy(out_data->Re,in_data->Re,out->nbytes);
+            out_data->Im = Mat_VarDataAlloc(out,out->nbytes);
+            if ( NULL != out_data->Im )
+                memcpy(out_data->Im,in_data->Im,out->nbytes);
+        }
+    } else {
+        out->data = Mat_VarDataAlloc(out,in->nbytes);
+        if ( out->data != NULL )
+            memcpy(out->data,in->data,in->nbytes);
+    }
+}
+
+/** @if mat_devman
+ * @brief Duplicates a variable without its data
+ *
+ * @ingroup mat_internal
+ * @param in Variable to duplicate
+ * @param fieldname Field name of the parent structure of the duplicate to use
+ *        as its name, or NULL to copy the name of @c in
+ * @return Pointer to the duplicated variable, whose data is NULL
+ * @endif
+ */
+static matvar_t *
+DuplicateInfo(const matvar_t *in,char *fieldname)
+{
+    matvar_t *out;
+    int i;
+
+    out = Mat_VarCallocMem(in->internal->allocator,NULL);
+    if ( out == NULL )
+        return NULL;
+
+    out->nbytes       = in->nbytes;
+    out->rank         = in->rank;
+    out->data_type    = in->data_type;
+    out->data_size    = in->data_size;
+    out->class_type   = in->class_type;
+    out->isComplex    = in->isComplex;
+    out->isGlobal     = in->isGlobal;
+    out->isLogical    = in->isLogical;
+    out->mem_conserve = in->mem_conserve;
+    out->compression  = in->compression;
+
+    out->name = NULL;
+    out->dims = NULL;
+    out->data = NULL;
+
+    if ( NULL != in->internal->hdf5_name )
+        out->internal->hdf5_name =
+            Mat_VarMemStrdup(out,in->internal->hdf5_name);
+
+    out->internal->hdf5_ref = in->internal->hdf5_ref;
+    out->internal->id       = in->internal->id;
+    out->internal->fpos     = in->internal->fpos;
+    out->internal->datapos  = in->internal->datapos;
+#if defined(HAVE_ZLIB)
+    out->internal->z        = NULL;
+#endif
+    out->internal->read_flags = in->internal->read_flags;
+    out->internal->scaling  = in->internal->scaling;
+    out->internal->scale    = in->internal->scale;
+    out->internal->offset   = in->internal->offset;
+    out->internal->chunk_shape = in->internal->chunk_shape;
+    out->internal->chunk_bytes = in->internal->chunk_bytes;
+    out->internal->num_fields = in->internal->num_fields;
+    if ( NULL != in->internal->fieldnames && in->internal->num_fields > 0 ) {
+        out->internal->fieldnames = Mat_VarMemCalloc(out,
+            in->internal->num_fields,sizeof(*in->internal->fieldnames));
+        for ( i = 0; i < in->internal->num_fields; i++ ) {
+            if ( NULL != in->internal->fieldnames[i] )
+                out->internal->fieldnames[i] =
+                    Mat_VarMemStrdup(out,in->internal->fieldnames[i]);
+        }
+        Mat_VarIndexStructFields(out);
+    }
+
+    if ( NULL != fieldname )
+        Mat_VarShareName(out,fieldname);
+    else if ( in->name != NULL )
+        out->name = Mat_VarMemStrdup(out,in->name);
+
+    out->dims = Mat_VarMemAlloc(out,in->rank*sizeof(*out->dims));
+    if ( out->dims != NULL )
+        memcpy(out->dims,in->dims,in->rank*sizeof(*out->dims));
+#if defined(HAVE_ZLIB)
+    if ( (in->internal->z != NULL) && (NULL != (out->internal->z = Mat_VarStreamCalloc(out))) )
+        inflateCopy(out->internal->z,in->internal->z);
+#endif
+
+    return out;
+}
+
+/** @if mat_devman
+ * @brief Duplicates a variable without its data
+ *
+ * @ingroup mat_internal
+ * @param in Variable to duplicate
+ * @return Pointer to the duplicated variable, whose data is NULL
+ * @endif
+ */
+matvar_t *
+Mat_VarDuplicateInfo(const matvar_t *in)
+{
+    return DuplicateInfo(in,NULL);
+}
+
+/** @if mat_devman
+ * @brief Duplicates a variable
+ *
+ * @ingroup mat_internal
+ * @param in Variable to duplicate
+ * @param opt 0 for a shallow duplicate, 1 for a deep duplicate (see
+ *        Mat_VarDuplicate)
+ * @param fieldname Field name of the parent structure of the duplicate to use
+ *        as its name, or NULL to copy the name of @c in
+ * @return Pointer to the duplicated variable
+ * @endif
+ */
+static matvar_t *
+Duplicate(const matvar_t *in,int opt,char *fieldname)
+{
+    matvar_t *out;
+    int i;
+
+    out = DuplicateInfo(in,fieldname);
+    if ( NULL == out )
+        return out;
+    if ( NULL == in->data ) {
+        /* An element left unread by lazy loading is read on access */
+        if ( in->internal->lazy && NULL != in->internal->fp ) {
+            if ( 0 < out->internal->hdf5_ref )
+                out->internal->id = -1;
+            Mat_VarSetLazy(in->internal->fp,out);
+        }
+        return out;
+    }
+
+    if ( in->class_type == MAT_C_STRUCT ) {
+        matvar_t **infields, **outfields;
+        int nfields = 0;
+
+        out->mem_conserve = 0;
+        out->data = Mat_VarMemAlloc(out,in->nbytes);
+        if ( out->data != NULL && in->data_size > 0 ) {
+            nfields   = in->nbytes / in->data_size;
+            infields  = (matvar_t **)in->data;
+            outfields = (matvar_t **)out->data;
+            for ( i = 0; i < nfields; i++ ) {
+                /* The fields share the names of the duplicated structure */
+                if ( NULL == infields[i] )
+                    outfields[i] = NULL;
+                else
+                    outfields[i] = Duplicate(infields[i],opt,
+                        NULL == out->internal->fieldnames ? NULL :
+                        out->internal->fieldnames[i %
+                                                  out->internal->num_fields]);
+            }
+        }
+    } else if ( in->class_type == MAT_C_CELL ) {
+        matvar_t **incells, **outcells;
+        int ncells = 0;
+
+        out->mem_conserve = 0;
+        out->data = Mat_VarMemAlloc(out,in->nbytes);
+        if ( out->data != NULL && in->data_size > 0 ) {
+            ncells   = in->nbytes / in->data_size;
+            incells  = (matvar_t **)in->data;
+            outcells = (matvar_t **)out->data;
+            for ( i = 0; i < ncells; i++ ) {
+                outcells[i] = Duplicate(incells[i],opt,NULL);
+            }
+        }
+    } else if ( opt || NULL != in->internal->arena || ShareData(out,in) ) {
+        /* The data of an arena is released with the arena, so it is copied */
+        CopyData(out,in);
+    }
+    return out;
+}
+
+/** @brief Duplicates a matvar_t structure
+ *
+ * Provides a clean function for duplicating a matvar_t structure.  Elements
+ * of cell arrays and structures left unread by lazy loading (see
+ * Mat_SetLazyLoading) are read on access in the duplicate as well.
+ * @ingroup MAT
+ * @param in pointer to the matvar_t structure to be duplicated
+ * @param opt 0 does a shallow duplicate whose numeric, character and sparse
+ *            data is shared with @c in through a reference count, and whose
+ *            cell and structure elements are shallow duplicates as well.  The
+ *            data is freed with the last variable referencing it, so both
+ *            variables can be freed in any order.  Call Mat_VarUnshareData
+ *            before modifying the data of either variable.  1 will do a deep
+ *            duplicate and actually duplicate the contents of the data.
+ * @returns Pointer to the duplicated matvar_t structure.
+ */
+matvar_t *
+Mat_VarDuplicate(const matvar_t *in, int opt)
+{
+    return Duplicate(in,opt,NULL);
+}
+
+/** @brief Gives a variable its own copy of data shared with other variables
+ *
+ * Copies the numeric, character or sparse data of a variable that shares it
+ * with other variables through Mat_VarDuplicate or Mat_VarGetStructs, so that
+ * the data can be modified without affecting them.  The elements of cell
+ * arrays and structures are unshared as well.  Data that is not shared is
+ * left in place.
+ * @ingroup MAT
+ * @param matvar MAT variable
+ * @retval 0 on success
+ */
+int
+Mat_VarUnshareData(matvar_t *matvar)
+{
+    matvar_t src;
+    void *copy;
+
+    if ( NULL == matvar )
+        return 1;
+    if ( MAT_C_STRUCT == matvar->class_type ||
+         MAT_C_CELL == matvar->class_type ) {
+        matvar_t **elems = matvar->data;
+        size_t i, nmemb = 0;
+        int err = 0;
+
+        if ( NULL != elems && matvar->data_size > 0 )
+            nmemb = matvar->nbytes / matvar->data_size;
+        for ( i = 0; i < nmemb; i++ ) {
+            if ( NULL != elems[i] )
+                err += Mat_VarUnshareData(elems[i]);
+        }
+        return err;
+    }
+    if ( NULL == matvar->data || NULL == matvar->internal->shared )
+        return 0;
+    if ( !IsDataShared(matvar) ) {
+        ReleaseShared(matvar);
+        return 0;
+    }
+
+    src = *matvar;
+    matvar->data = NULL;
+    CopyData(matvar,&src);
+    copy = matvar->data;
+    matvar->data = src.data;
+    matvar->mem_conserve = src.mem_conserve;
+    if ( NULL == copy )
+        return 1;
+    /* Release the reference, freeing the data if the others are gone */
+    FreeData(matvar);
+    matvar->data         = copy;
+    matvar->mem_conserve = 0;
+    matvar->internal->data_free = NULL;
+    return 0;
+}
+
+/** @brief Frees all the allocated memory associated with the structure
+ *
+ * Frees memory used by a MAT variable.  Frees the data associated with a
+ * MAT variable if it's non-NULL and MAT_F_DONT_COPY_DATA was not used.
+ * @ingroup MAT
+ * @param matvar Pointer to the matvar_t structure
+ */
+void
+Mat_VarFree(matvar_t *matvar)
+{
+    size_t nmemb = 0, i;
+    const mat_allocator_t *allocator = NULL;
+    if ( !matvar )
+        return;
+    if ( NULL != matvar->internal && NULL != matvar->internal->arena ) {
+        /* The elements of an arena are released with its root variable */
+        if ( matvar == matvar->internal->arena->root )
+            Mat_ArenaDestroy(matvar->internal->arena);
+        return;
+    }
+    if ( NULL != matvar->internal && matvar->internal->lazy ) {
+        /* Stop tracking a lazily read element and counting its data */
+        mat_t *mat = matvar->internal->fp;
+        UnlinkLazy(mat,matvar);
+        if ( 2 == matvar->internal->lazy )
+            mat->lazy_bytes -= LazyBytes(matvar);
+    }
+    if ( matvar->dims ) {
+        nmemb = 1;
+        for ( i = 0; i < matvar->rank; i++ )
+            nmemb *= matvar->dims[i];
+        Mat_VarMemFree(matvar,matvar->dims);
+    }
+    if ( matvar->name && !(NULL != matvar->internal &&
+                           matvar->internal->name_shared) )
+        Mat_VarMemFree(matvar,matvar->name);
+    if ( matvar->data != NULL) {
+        switch (matvar->class_type ) {
+            case MAT_C_STRUCT:
+                if ( !matvar->mem_conserve && NULL != matvar->data ) {
+                    matvar_t **fields = matvar->data;
+                    int nfields = matvar->internal->num_fields;
+                    for ( i = 0; i < nmemb*nfields; i++ )
+                        Mat_VarFree(fields[i]);
+
+                    Mat_VarMemFree(matvar,matvar->data);
+                    break;
+                }
+            case MAT_C_CELL:
+                if ( !matvar->mem_conserve && NULL != matvar->data ) {
+                    matvar_t **cells = matvar->data;
+                    for ( i = 0; i < nmemb; i++ )
+                        Mat_VarFree(cells[i]);
+
+                    Mat_VarMemFree(matvar,matvar->data);
+                }
+                break;
+            case MAT_C_SPARSE:
+            case MAT_C_DOUBLE:
+            case MAT_C_SINGLE:
+            case MAT_C_INT64:
+            case MAT_C_UINT64:
+            case MAT_C_INT32:
+            case MAT_C_UINT32:
+            case MAT_C_INT16:
+            case MAT_C_UINT16:
+            case MAT_C_INT8:
+            case MAT_C_UINT8:
+            case MAT_C_CHAR:
+                FreeData(matvar);
+                break;
+            case MAT_C_EMPTY:
+            case MAT_C_OBJECT:
+            case MAT_C_FUNCTION:
+                break;
+        }
+    }
+
+    if ( NULL != matvar->internal ) {
+#if defined(HAVE_ZLIB)
+        if ( matvar->compression == MAT_COMPRESSION_ZLIB )
+            Mat_VarStreamFree(matvar);
+#endif
+#if defined(MAT73) && MAT73
+        if ( -1 < matvar->internal->id ) {
+            switch ( H5Iget_type(matvar->internal->id) ) {
+                case H5I_GROUP:
+                    H5Gclose(matvar->internal->id);
+                    matvar->internal->id = -1;
+                    break;
+                case H5I_DATASET:
+                    H5Dclose(matvar->internal->id);
+                    matvar->internal->id = -1;
+                    break;
+                default:
+                    break;
+            }
+        }
+        if ( 0 < matvar->internal->hdf5_ref ) {
+            switch ( H5Iget_type(matvar->internal->id) ) {
+                case H5I_GROUP:
+                    H5Gclose(matvar->internal->id);
+                    matvar->internal->hdf5_ref = -1;
+                    break;
+                case H5I_DATASET:
+                    H5Dclose(matvar->internal->id);
+                    matvar->internal->hdf5_ref = -1;
+                    break;
+                default:
+                    break;
+            }
+        }
+        if ( NULL != matvar->internal->hdf5_name ) {
+            Mat_VarMemFree(matvar,matvar->internal->hdf5_name);
+            matvar->internal->hdf5_name = NULL;
+        }
+#endif
+        if ( NULL != matvar->internal->fieldnames &&
+             matvar->internal->num_fields > 0 ) {
+            size_t i;
+            for ( i = 0; i < matvar->internal->num_fields; i++ ) {
+                if ( NULL != matvar->internal->fieldnames[i] )
+                    Mat_VarMemFree(matvar,
+                                   matvar->internal->fieldnames[i]);
+            }
+            Mat_VarMemFree(matvar,matvar->internal->fieldnames);
+        }
+        Mat_VarMemFree(matvar,matvar->internal->field_index);
+        allocator = matvar->internal->allocator;
+        Mat_Free(allocator,matvar->internal);
+        matvar->internal = NULL;
+    }
+    /* FIXME: Why does this cause a SEGV? */
+#if 0
+    memset(matvar,0,sizeof(matvar_t));
+#endif
+    Mat_Free(allocator,matvar);
+}
+
+void
+Mat_VarFree2(matvar_t *matvar)
+{
+    if ( !matvar )
+        return;
+    if ( matvar->dims )
+        Mat_VarMemFree(matvar,matvar->dims);
+    if ( matvar->name && !matvar->internal->name_shared )
+        Mat_VarMemFree(matvar,matvar->name);
+    if ( (matvar->data != NULL) && (NULL != matvar->internal->data_free ||
+                                    NULL != matvar->internal->shared) ) {
+        FreeData(matvar);
+    } else if ( (matvar->data != NULL) && (matvar->class_type == MAT_C_STRUCT ||
+          matvar->class_type == MAT_C_CELL) && matvar->data_size > 0 ) {
+        int i;
+        matvar_t **fields = (matvar_t **)matvar->data;
+        int nfields = matvar->nbytes / matvar->data_size;
+        for ( i = 0; i < nfields; i++ )
+            Mat_VarFree(fields[i]);
+        Mat_VarMemFree(matvar,matvar->data);
+    } else if ( (matvar->data != NULL) && (!matvar->mem_conserve) &&
+                (matvar->class_type == MAT_C_SPARSE) ) {
+        mat_sparse_t *sparse;
+        sparse = matvar->data;
+        if ( sparse->ir != NULL )
+            Mat_VarDataFree(matvar,sparse->ir);
+        if ( sparse->jc != NULL )
+            Mat_VarDataFree(matvar,sparse->jc);
+        if ( sparse->data != NULL )
+            Mat_VarDataFree(matvar,sparse->data);
+        Mat_VarMemFree(matvar,sparse);
+    } else {
+        if ( matvar->data && !matvar->mem_conserve )
+            Mat_VarDataFree(matvar,matvar->data);
+    }
+#if defined(HAVE_ZLIB)
+    if ( matvar->compression == MAT_COMPRESSION_ZLIB )
+        inflateEnd(matvar->internal->z);
+#endif
+    /* FIXME: Why does this cause a SEGV? */
+#if 0
+    memset(matvar,0,sizeof(matvar_t));
+#endif
+}
+
+/** @brief Calculate a single subscript from a set of subscript values
+ *
+ * Calculates a single linear subscript (0-relative) given a 1-relative
+ * subscript for each dimension.  The calculation uses the formula below where
+ * index is the linear index, s is an array of length RANK where each element
+ * is the subscript for the correspondind dimension, D is an array whose
+ * elements are the dimensions of the variable.
+ * \f[
+ *   index = \sum\limits_{k=0}^{RANK-1} [(s_k - 1) \prod\limits_{l=0}^{k} D_l ]
+ * \f]
+ * @ingroup MAT
+ * @param rank Rank of the variable
+ * @param dims dimensions of the variable
+ * @param subs Dimension subscripts
+ * @return Single (linear) subscript
+ */
+int
+Mat_CalcSingleSubscript(int rank,int *dims,int *subs)
+{
+    int index = 0, i, j, k, err = 0;
+
+    for ( i = 0; i < rank; i++ ) {
+        k = subs[i];
+        if ( k > dims[i] ) {
+            err = 1;
+            Mat_Critical("Mat_CalcSingleSubscript: index out of bounds");
+            break;
+        } else if ( k < 1 ) {
+            err = 1;
+            break;
+        }
+        k--;
+        for ( j = i; j--; )
+            k *= dims[j];
+        index += k;
+    }
+    if ( err )
+        index = -1;
+
+    return index;
+}
+
+
+/** @brief Calculate a set of subscript values from a single(linear) subscript
+ *
+ * Calculates 1-relative subscripts for each dimension given a 0-relative
+ * linear index.  Subscripts are calculated as follows where s is the array
+ * of dimension subscripts, D is the array of dimensions, and index is the
+ * linear index.
+ * \f[
+ *   s_k = \lfloor\frac{1}{L} \prod\limits_{l = 0}^{k} D_l\rfloor + 1
+ * \f]
+ * \f[
+ *   L = index - \sum\limits_{l = k}^{RANK - 1} s_k \prod\limits_{m = 0}^{k} D_m
+ * \f]
+ * @ingroup MAT
+ * @param rank Rank of the variable
+ * @param dims dimensions of the variable
+ * @param index linear index
+ * @return Array of dimension subscripts
+ */
+int *
+Mat_CalcSubscripts(int rank,int *dims,int index)
+{
+    int i, j, k, *subs;
+    double l;
+
+    subs = malloc(rank*sizeof(int));
+    l = index;
+    for ( i = rank; i--; ) {
+        k = 1;
+        for ( j = i; j--; )
+            k *= dims[j];
+        subs[i] = floor(l / (double)k);
+        l -= subs[i]*k;
+        subs[i]++;
+    }
+
+    return subs;
+}
+
+/** @brief Calculates the size of a matlab variable in bytes
+ *
+ * @ingroup MAT
+ * @param matvar matlab variable
+ * @returns size of the variable in bytes
+ */
+size_t
+Mat_VarGetSize(matvar_t *matvar)
+{
+    int nmemb, i;
+    size_t bytes = 0;
+
+    if ( matvar->class_type == MAT_C_STRUCT ) {
+        int nfields;
+        matvar_t **fields;
+        /* This is really nmemb*nfields, but we'll get a
+         * more accurate count of the bytes by loopoing over all of them
+         */
+        nfields = matvar->internal->num_fields;
+        fields  = matvar->data;
+        for ( i = 0; i < nfields && NULL != fields; i++ )
+            bytes += Mat_VarGetSize(fields[i]);
+    } else if ( matvar->class_type == MAT_C_CELL ) {
+        int ncells;
+        matvar_t **cells;
+
+        if ( matvar->data_size < 1 )
+            return bytes;
+        ncells = matvar->nbytes / matvar->data_size;
+        cells  = matvar->data;
+        for ( i = 0; i < ncells; i++ )
+            bytes += Mat_VarGetSize(cells[i]);
+    } else {
+        nmemb = 1;
+        for ( i = 0; i < matvar->rank; i++ )
+            nmemb *= matvar->dims[i];
+        bytes += nmemb*Mat_SizeOfClass(matvar->class_type);
+    }
+    return bytes;
+}
+
+/** @brief Prints the variable information
+ *
+ * Prints to stdout the values of the @ref matvar_t structure
+ * @ingroup MAT
+ * @param matvar Pointer to the matvar_t structure
+ * @param printdata set to 1 if the Variables data should be printed, else 0
+ */
+void
+Mat_VarPrint( matvar_t *matvar, int printdata )
+{
+    size_t nmemb;
+    int i, j;
+    const char *class_type_desc[16] = {"Undefined","Cell Array","Structure",
+       "Object","Character Array","Sparse Array","Double Precision Array",
+       "Single Precision Array", "8-bit, signed integer array",
+       "8-bit, unsigned integer array","16-bit, signed integer array",
+       "16-bit, unsigned integer array","32-bit, signed integer array",
+       "32-bit, unsigned integer array","64-bit, signed integer array",
+       "64-bit, unsigned integer array"};
+    const char *data_type_desc[23] = {"Unknown","8-bit, signed integer",
+       "8-bit, unsigned integer","16-bit, signed integer",
+       "16-bit, unsigned integer","32-bit, signed integer",
+       "32-bit, unsigned integer","IEEE 754 single-precision","RESERVED",
+       "IEEE 754 double-precision","RESERVED","RESERVED",
+       "64-bit, signed integer","64-bit, unsigned integer", "Matlab Array",
+       "Compressed Data","Unicode UTF-8 Encoded Character Data",
+       "Unicode UTF-16 Encoded Character Data",
+       "Unicode UTF-32 Encoded Character Data","","String","Cell Array",
+       "Structure"};
+
+    if ( matvar == NULL )
+        return;
+    if ( matvar->name )
+        printf("      Name: %s\n", matvar->name);
+    printf("      Rank: %d\n", matvar->rank);
+    if ( matvar->rank == 0 )
+        return;
+    printf("Dimensions: %" SIZE_T_FMTSTR,matvar->dims[0]);
+    nmemb = matvar->dims[0];
+    for ( i = 1; i < matvar->rank; i++ ) {
+        printf(" x %" SIZE_T_FMTSTR,matvar->dims[i]);
+        nmemb *= matvar->dims[i];
+    }
+    printf("\n");
+    printf("Class Type: %s",class_type_desc[matvar->class_type]);
+    if ( matvar->isComplex )
+        printf(" (complex)");
+    else if ( matvar->isLogical )
+        printf(" (logical)");
+    printf("\n");
+    if ( matvar->data_type )
+        printf(" Data Type: %s\n", data_type_desc[matvar->data_type]);
+
+    if ( MAT_C_STRUCT == matvar->class_type ) {
+        matvar_t **fields = (matvar_t **)matvar->data;
+        int nfields = matvar->internal->num_fields;
+        if ( nmemb*nfields > 0 && NULL != fields ) {
+            printf("Fields[%" SIZE_T_FMTSTR "] {\n", nfields*nmemb);
+            for ( i = 0; i < nfields*nmemb; i++ ) {
+                if ( NULL == fields[i] ) {
+                    printf("      Name: %s\n      Rank: %d\n",
+                           matvar->internal->fieldnames[i%nfields],0);
+                } else {
+                    Mat_VarPrint(fields[i],printdata);
+                }
+            }
+            printf("}\n");
+        } else {
+            printf("Fields[%d] {\n", nfields);
+            for ( i = 0; i < nfields; i++ )
+                printf("      Name: %s\n      Rank: %d\n",
+                       matvar->internal->fieldnames[i],0);
+            printf("}\n");
+        }
+        return;
+    } else if ( matvar->data == NULL || matvar->data_size < 1 ) {
+        return;
+    } else if ( MAT_C_CELL == matvar->class_type ) {
+        matvar_t **cells = (matvar_t **)matvar->data;
+        int ncells = matvar->nbytes / matvar->data_size;
+        printf("{\n");
+        for ( i = 0; i < ncells; i++ )
+            Mat_VarPrint(cells[i],printdata);
+        printf("}\n");
+        return;
+    } else if ( !printdata ) {
+        return;
+    }
+
+    printf("{\n");
+
+    if ( matvar->rank > 2 ) {
+        printf("I can't print more than 2 dimensions\n");
+    } else if ( matvar->rank == 1 && matvar->dims[0] > 15 ) {
+        printf("I won't print more than 15 elements in a vector\n");
+    } else if ( matvar->rank==2 ) {
+        switch( matvar->class_type ) {
+            case MAT_C_DOUBLE:
+            case MAT_C_SINGLE:
+#ifdef HAVE_MAT_INT64_T
+            case MAT_C_INT64:
+#endif
+#ifdef HAVE_MAT_UINT64_T
+            case MAT_C_UINT64:
+#endif
+            case MAT_C_INT32:
+            case MAT_C_UINT32:
+            case MAT_C_INT16:
+            case MAT_C_UINT16:
+            case MAT_C_INT8:
+            case MAT_C_UINT8:
+            {
+                size_t stride = Mat_SizeOf(matvar->data_type);
+                if ( matvar->isComplex ) {
+                    size_t cstride = stride;
+                    char *rp, *ip;
+                    if ( MAT_IS_INTERLEAVED(matvar) ) {
+                        rp      = matvar->data;
+                        ip      = rp+stride;
+                        cstride = 2*stride;
+                    } else {
+                        mat_complex_split_t *complex_data = matvar->data;
+                        rp = complex_data->Re;
+                        ip = complex_data->Im;
+                    }
+                   for ( i = 0; i < matvar->dims[0] && i < 15; i++ ) {
+                        for ( j = 0; j < matvar->dims[1] && j < 15; j++ ) {
+                            size_t idx = matvar->dims[0]*j+i;
+                            Mat_PrintNumber(matvar->data_type,rp+idx*cstride);
+                            printf(" + ");
+                            Mat_PrintNumber(matvar->data_type,ip+idx*cstride);
+                            printf("i ");
+                        }
+                        if ( j < matvar->dims[1] )
+                            printf("...");
+                        printf("\n");
+                    }
+                    if ( i < matvar->dims[0] )
+                        printf(".\n.\n.\n");
+               } else {
+                   char *data = matvar->data;
+                   for ( i = 0; i < matvar->dims[0] && i < 15; i++ ) {
+                        for ( j = 0; j < matvar->dims[1] && j < 15; j++ ) {
+                            size_t idx = matvar->dims[0]*j+i;
+                            Mat_PrintNumber(matvar->data_type,
+                                            data+idx*stride);
+                            printf(" ");
+                        }
+                        if ( j < matvar->dims[1] )
+                            printf("...");
+                        printf("\n");
+                    }
+                    if ( i < matvar->dims[0] )
+                        printf(".\n.\n.\n");
+                }
+                break;
+            }
+            case MAT_C_CHAR:
+            {
+                char *data = matvar->data;
+                if ( !printdata )
+                    break;
+                for ( i = 0; i < matvar->dims[0]; i++ ) {
+                    for ( j = 0; j < matvar->dims[1]; j++ )
+                        printf("%c",data[j*matvar->dims[0]+i]);
+                    printf("\n");
+                }
+                break;
+            }
+            case MAT_C_SPARSE:
+            {
+                mat_sparse_t *sparse;
+                size_t stride = Mat_SizeOf(matvar->data_type);
+#if !defined(EXTENDED_SPARSE)
+                if ( MAT_T_DOUBLE != matvar->data_type )
+                    break;
+#endif
+                sparse = matvar->data;
+                if ( matvar->isComplex ) {
+                    mat_complex_split_t *complex_data = sparse->data;
+                    char *re,*im;
+                    re = complex_data->Re;
+                    im = complex_data->Im;
+                    for ( i = 0; i < sparse->njc-1; i++ ) {
+                        for (j = sparse->jc[i];
+                             j<sparse->jc[i+1] && j<sparse->ndata;j++ ) {
+                            printf("    (%d,%d)  ",sparse->ir[j]+1,i+1);
+                            Mat_PrintNumber(matvar->data_type,re+j*stride);
+                            printf(" + ");
+                            Mat_PrintNumber(matvar->data_type,im+j*stride);
+                            printf("i\n");
+                        }
+                    }
+                } else {
+                    char *data;
+                    data = sparse->data;
+                    for ( i = 0; i < sparse->njc-1; i++ ) {
+                        for (j = sparse->jc[i];
+                             j<sparse->jc[i+1] && j<sparse->ndata;j++ ){
+                            printf("    (%d,%d)  ",sparse->ir[j]+1,i+1);
+                            Mat_PrintNumber(matvar->data_type,data+j*stride);
+                            printf("\n");
+                        }
+                    }
+                }
+                break;
+            } /* case MAT_C_SPARSE: */
+            default:
+                break;
+        } /* switch( matvar->class_type ) */
+    }
+
+    printf("}\n");
+
+    return;
+}
+
+/** @if mat_devman
+ * @brief Returns the scratch buffer of a MAT file with at least @c size bytes
+ *
+ * The buffer is kept with the MAT file and only grows, so repeated reads of
+ * interleaved data do not allocate.  Its contents are not preserved.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param size Number of bytes needed
+ * @return Pointer to the buffer, or NULL on error
+ * @endif
+ */
+static void *
+ScratchBuffer(mat_t *mat,size_t size)
+{
+    if ( size > mat->scratch_size ) {
+        Mat_Free(mat->allocator,mat->scratch);
+        mat->scratch      = Mat_Malloc(mat->allocator,size);
+        mat->scratch_size = NULL == mat->scratch ? 0 : size;
+    }
+    return mat->scratch;
+}
+
+/** @if mat_devman
+ * @brief Reads a slab of a variable in the column-major order of the file
+ *
+ * @ingroup mat_internal
+ * @endif
+ */
+static int
+ReadDataSlab(mat_t *mat,matvar_t *matvar,void *data,int *start,int *stride,
+    int *edge)
+{
+    int err = 0;
+
+    SetReadScaling(mat,matvar);
+    switch ( mat->version ) {
+        case MAT_FT_MAT73:
+#if defined(MAT73) && MAT73
+            err = Mat_VarReadData73(mat,matvar,data,start,stride,edge);
+#else
+            err = 1;
+#endif
+            break;
+        case MAT_FT_MAT5:
+            Mat_AsyncWait5(mat);
+            err = ReadData5(mat,matvar,data,start,stride,edge);
+            break;
+        case MAT_FT_MAT4:
+            err = ReadData4(mat,matvar,data,start,stride,edge);
+            break;
+    }
+    SetReadScaling(mat,NULL);
+
+    return err;
+}
+
+/** @if mat_devman
+ * @brief Converts a slab read in column-major order to row-major in place
+ *
+ * Moves each element of @c data along the cycles of the permutation, so the
+ * only extra memory is a bit per element marking the elements in place.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param data Slab of size @c edge read in column-major order
+ * @param elem_size Size of each element in bytes, at most 16
+ * @param rank Number of dimensions
+ * @param edge Number of elements in each dimension
+ * @retval 0 on success
+ * @endif
+ */
+static int
+SlabToRowMajor(mat_t *mat,void *data,size_t elem_size,int rank,int *edge)
+{
+    size_t nmemb = 1, ncols, s, pos, dest, q, i, off;
+    double tmp[2][2];
+    unsigned char *done;
+    char *ptr = data;
+    int k, t = 0, nsplit = 0;
+
+    if ( elem_size > sizeof(tmp[0]) )
+        return 1;
+    for ( k = 0; k < rank; k++ ) {
+        nmemb *= edge[k];
+        if ( edge[k] > 1 )
+            nsplit++;
+    }
+    if ( nsplit < 2 )
+        return 0;
+    ncols = nmemb / edge[0];
+
+    done = ScratchBuffer(mat,(nmemb+7)/8);
+    if ( NULL == done )
+        return 1;
+    memset(done,0,(nmemb+7)/8);
+    for ( s = 0; s < nmemb; s++ ) {
+        if ( done[s/8] & (1 << (s%8)) )
+            continue;
+        memcpy(tmp[t],ptr+s*elem_size,elem_size);
+        pos = s;
+        do {
+            /* Row-major index of column-major element pos */
+            i   = pos % edge[0];
+            q   = pos / edge[0];
+            off = 0;
+            for ( k = 1; k < rank; k++ ) {
+                off = off*edge[k] + q % edge[k];
+                q  /= edge[k];
+            }
+            dest = i*ncols + off;
+            memcpy(tmp[1-t],ptr+dest*elem_size,elem_size);
+            memcpy(ptr+dest*elem_size,tmp[t],elem_size);
+            t = 1-t;
+            done[dest/8] |= 1 << (dest%8);
+            pos = dest;
+        } while ( dest != s );
+    }
+
+    return 0;
+}
+
+/** @if mat_devman
+ * @brief Returns the size of the elements of a slab read from @c matvar
+ *
+ * Version 4 slabs keep the class of the data in the file unless scaling was
+ * set with Mat_VarSetScaling.
+ * @ingroup mat_internal
+ * @endif
+ */
+static size_t
+SlabElemSize(const mat_t *mat,const matvar_t *matvar)
+{
+    if ( MAT_FT_MAT4 == mat->version && !matvar->internal->scaling )
+        return Mat_SizeOf(matvar->data_type);
+    return Mat_SizeOfClass(matvar->class_type);
+}
+
+/** @brief Reads MAT variable data from a file
+ *
+ * Reads data from a MAT variable.  The variable must have been read by
+ * Mat_VarReadInfo.  If MAT_F_ROW_MAJOR was set with Mat_VarSetReadFlags, the
+ * slab is stored in @c data in row-major order.  If MAT_F_COMPLEX_INTERLEAVED
+ * was set, @c data for a complex variable is a single buffer that receives
+ * the interleaved real and imaginary parts instead of a mat_complex_split_t.
+ * @ingroup MAT
+ * @param mat MAT file to read data from
+ * @param matvar MAT variable information
+ * @param data pointer to store data in (must be pre-allocated)
+ * @param start array of starting indeces
+ * @param stride stride of data
+ * @param edge array specifying the number to read in each direction
+ * @retval 0 on success
+ */
+int
+Mat_VarReadData(mat_t *mat,matvar_t *matvar,void *data,
+      int *start,int *stride,int *edge)
+{
+    int err = 0;
+
+    switch ( matvar->class_type ) {
+        case MAT_C_DOUBLE:
+        case MAT_C_SINGLE:
+        case MAT_C_INT64:
+        case MAT_C_UINT64:
+        case MAT_C_INT32:
+        case MAT_C_UINT32:
+        case MAT_C_INT16:
+        case MAT_C_UINT16:
+        case MAT_C_INT8:
+        case MAT_C_UINT8:
+            break;
+        default:
+            return -1;
+    }
+
+    if ( MAT_IS_INTERLEAVED(matvar) && MAT_FT_MAT73 != mat->version ) {
+        /* Read the parts to a buffer and interleave them into data */
+        size_t elem_size = SlabElemSize(mat,matvar), nmemb = 1;
+        size_t dims[10];
+        mat_complex_split_t tmp;
+        char *out = data;
+        int k;
+
+        if ( matvar->rank > 10 )
+            return 1;
+        for ( k = 0; k < matvar->rank; k++ ) {
+            dims[k] = edge[k];
+            nmemb  *= edge[k];
+        }
+        tmp.Re = ScratchBuffer(mat,2*nmemb*elem_size);
+        if ( NULL == tmp.Re )
+            return 1;
+        tmp.Im = (char*)tmp.Re+nmemb*elem_size;
+        err = ReadDataSlab(mat,matvar,&tmp,start,stride,edge);
+        if ( !err && (matvar->internal->read_flags & MAT_F_ROW_MAJOR) ) {
+            Mat_ScatterRowMajor(out,2,tmp.Re,1,elem_size,matvar->rank,dims,
+                                0,nmemb);
+            Mat_ScatterRowMajor(out+elem_size,2,tmp.Im,1,elem_size,
+                                matvar->rank,dims,0,nmemb);
+        } else if ( !err ) {
+            Mat_CopyStrided(out,2,tmp.Re,1,elem_size,nmemb);
+            Mat_CopyStrided(out+elem_size,2,tmp.Im,1,elem_size,nmemb);
+        }
+    } else {
+        err = ReadDataSlab(mat,matvar,data,start,stride,edge);
+        if ( !err && MAT_FT_MAT73 != mat->version &&
+             (matvar->internal->read_flags & MAT_F_ROW_MAJOR) ) {
+            /* Version 7.3 slabs are stored in row-major order as read */
+            size_t elem_size = SlabElemSize(mat,matvar);
+
+            if ( matvar->isComplex ) {
+                mat_complex_split_t *complex_data = data;
+                err  = SlabToRowMajor(mat,complex_data->Re,elem_size,
+                                      matvar->rank,edge);
+                err += SlabToRowMajor(mat,complex_data->Im,elem_size,
+                                      matvar->rank,edge);
+            } else {
+                err = SlabToRowMajor(mat,data,elem_size,matvar->rank,edge);
+            }
+        }
+    }
+
+    return err;
+}
+
+/** @brief Reads all the data for a matlab variable
+ *
+ * Allocates memory for an reads the data for a given matlab variable.
+ * @ingroup MAT
+ * @param mat Matlab MAT file structure pointer
+ * @param matvar Variable whose data is to be read
+ * @returns non-zero on error
+ */
+int
+Mat_VarReadDataAll(mat_t *mat,matvar_t *matvar)
+{
+    int err = 0;
+
+    if ( (mat == NULL) || (matvar == NULL) )
+        err = 1;
+    else
+        ReadData(mat,matvar);
+
+    return err;
+}
+
+/** @if mat_devman
+ * @brief Reads a subset of a MAT variable using a 1-D indexing
+ *
+ * Dispatches to the reader of the file version with the scaling of
+ * @c matvar applied.
+ * @ingroup mat_internal
+ * @endif
+ */
+static int
+ReadDataLinear(mat_t *mat,matvar_t *matvar,void *data,int start,int stride,
+    int edge)
+{
+    int err = 0;
+
+    SetReadScaling(mat,matvar);
+    switch ( mat->version ) {
+        case MAT_FT_MAT73:
+#if defined(MAT73) && MAT73
+            err = Mat_VarReadDataLinear73(mat,matvar,data,start,stride,edge);
+#else
+            err = 1;
+#endif
+            break;
+        case MAT_FT_MAT5:
+            Mat_AsyncWait5(mat);
+            err = Mat_VarReadDataLinear5(mat,matvar,data,start,stride,edge);
+            break;
+        case MAT_FT_MAT4:
+            err = Mat_VarReadDataLinear4(mat,matvar,data,start,stride,edge);
+            break;
+    }
+    SetReadScaling(mat,NULL);
+
+    return err;
+}
+
+/** @brief Reads a subset of a MAT variable using a 1-D indexing
+ *
+ * Reads data from a MAT variable using a linear (1-D) indexing mode. The
+ * variable must have been read by Mat_VarReadInfo.  If
+ * MAT_F_COMPLEX_INTERLEAVED was set with Mat_VarSetReadFlags, @c data for a
+ * complex variable receives the interleaved real and imaginary parts.
+ * @ingroup MAT
+ * @param mat MAT file to read data from
+ * @param matvar MAT variable information
+ * @param data pointer to store data in (must be pre-allocated)
+ * @param start starting index
+ * @param stride stride of data
+ * @param edge number of elements to read
+ * @retval 0 on success
+ */
+int
+Mat_VarReadDataLinear(mat_t *mat,matvar_t *matvar,void *data,int start,
+    int stride,int edge)
+{
+    int err = 0;
+
+    switch ( matvar->class_type ) {
+        case MAT_C_DOUBLE:
+        case MAT_C_SINGLE:
+        case MAT_C_INT64:
+        case MAT_C_UINT64:
+        case MAT_C_INT32:
+        case MAT_C_UINT32:
+        case MAT_C_INT16:
+        case MAT_C_UINT16:
+        case MAT_C_INT8:
+        case MAT_C_UINT8:
+            break;
+        default:
+            return -1;
+    }
+
+    if ( MAT_IS_INTERLEAVED(matvar) && MAT_FT_MAT73 != mat->version ) {
+        /* Read the parts to a buffer and interleave them into data */
+        size_t elem_size = Mat_SizeOfClass(matvar->class_type);
+        mat_complex_split_t tmp;
+
+        if ( edge < 1 )
+            return 0;
+        tmp.Re = ScratchBuffer(mat,2*edge*elem_size);
+        if ( NULL == tmp.Re )
+            return 1;
+        tmp.Im = (char*)tmp.Re+edge*elem_size;
+        err = ReadDataLinear(mat,matvar,&tmp,start,stride,edge);
+        if ( !err ) {
+            Mat_CopyStrided(data,2,tmp.Re,1,elem_size,edge);
+            Mat_CopyStrided((char*)data+elem_size,2,tmp.Im,1,elem_size,edge);
+        }
+    } else {
+        err = ReadDataLinear(mat,matvar,data,start,stride,edge);
+    }
+
+    return err;
+}
+
+/** @brief Reads the information of the next variable in a MAT file
+ *
+ * Reads the next variable's information (class,flags-complex/global/logical,
+ * rank,dimensions, name, etc) from the Matlab MAT file.  After reading, the MAT
+ * file is positioned past the current variable.
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file
+ * @return Pointer to the @ref matvar_t structure containing the MAT
+ * variable information
+ */
+matvar_t *
+Mat_VarReadNextInfo( mat_t *mat )
+{
+    matvar_t *matvar = NULL;
+    if( mat == NULL )
+        return NULL;
+
+    switch ( mat->version ) {
+        case MAT_FT_MAT5:
+            Mat_AsyncWait5(mat);
+            matvar = Mat_VarReadNextInfo5(mat);
+            break;
+        case MAT_FT_MAT73:
+#if defined(MAT73) && MAT73
+            matvar = Mat_VarReadNextInfo73(mat);
+#endif
+            break;
+        case MAT_FT_MAT4:
+            matvar = Mat_VarReadNextInfo4(mat);
+            break;
+    }
+
+    return matvar;
+}
+
+/** @brief Reads the information of a variable with the given name from a MAT file
+ *
+ * Reads the named variable (or the next variable if name is NULL) information
+ * (class,flags-complex/global/logical,rank,dimensions,and name) from the
+ * Matlab MAT file
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file
+ * @param name Name of the variable to read
+ * @return Pointer to the @ref matvar_t structure containing the MAT
+ * variable information
+ */
+matvar_t *
+Mat_VarReadInfo( mat_t *mat, const char *name )
+{
+
+    long  fpos;
+    matvar_t *matvar = NULL;
+
+    if ( (mat == NULL) || (name == NULL) )
+        return NULL;
+
+    if ( mat->version == MAT_FT_MAT73 ) {
+#if defined(MAT73) && MAT73
+        matvar = Mat_VarReadInfo73(mat,name);
+#endif
+    } else {
+        Mat_AsyncWait5(mat);
+        fpos = ftell(mat->fp);
+        fseek(mat->fp,mat->bof,SEEK_SET);
+        do {
+            matvar = Mat_VarReadNextInfo(mat);
+            if ( matvar != NULL ) {
+                if ( !matvar->name ) {
+                    Mat_VarFree(matvar);
+                    matvar = NULL;
+                } else if ( strcmp(matvar->name,name) ) {
+                    Mat_VarFree(matvar);
+                    matvar = NULL;
+                }
+            } else {
+                Mat_Critical("An error occurred in reading the MAT file");
+                break;
+            }
+        } while ( !matvar && !feof(((FILE *)mat->fp)) );
+
+        fseek(mat->fp,fpos,SEEK_SET);
+    }
+    return matvar;
+}
+
+/** @brief Reads the variable with the given name from a MAT file
+ *
+ * Reads the next variable in the Matlab MAT file
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file
+ * @param name Name of the variable to read
+ * @return Pointer to the @ref matvar_t structure containing the MAT
+ * variable information
+ */
+matvar_t *
+Mat_VarRead( mat_t *mat, const char *name )
+{
+    long  fpos = 0;
+    int   shallow;
+    matvar_t *matvar = NULL;;
+
+    if ( (mat == NULL) || (name == NULL) )
+        return NULL;
+
+    Mat_AsyncWait5(mat);
+    if ( MAT_FT_MAT73 != mat->version )
+        fpos = ftell(mat->fp);
+
+    /* The data is read with the information of all elements */
+    shallow = mat->shallow;
+    mat->shallow = 0;
+    matvar = Mat_VarReadInfo(mat,name);
+    mat->shallow = shallow;
+    if ( matvar )
+        ReadData(mat,matvar);
+
+    if ( MAT_FT_MAT73 != mat->version )
+        fseek(mat->fp,fpos,SEEK_SET);
+    return matvar;
+}
+
+/** @brief Reads the next variable in a MAT file
+ *
+ * Reads the next variable in the Matlab MAT file
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file
+ * @return Pointer to the @ref matvar_t structure containing the MAT
+ * variable information
+ */
+matvar_t *
+Mat_VarReadNext( mat_t *mat )
+{
+    long fpos = 0;
+    int  shallow;
+    matvar_t *matvar = NULL;
+
+    Mat_AsyncWait5(mat);
+    if ( mat->version != MAT_FT_MAT73 ) {
+        if ( feof(((FILE *)mat->fp)) )
+            return NULL;
+        /* Read position so we can reset the file position if an error occurs */
+        fpos = ftell(mat->fp);
+    }
+    /* The data is read with the information of all elements */
+    shallow = mat->shallow;
+    mat->shallow = 0;
+    matvar = Mat_VarReadNextInfo(mat);
+    mat->shallow = shallow;
+    if ( matvar )
+        ReadData(mat,matvar);
+    else if (mat->version != MAT_FT_MAT73 )
+        fseek(mat->fp,fpos,SEEK_SET);
+    return matvar;
+}
+
+/** @if mat_devman
+ * @brief Returns the data type of the elements of a numeric class
+ *
+ * @ingroup mat_internal
+ * @endif
+ */
+static enum matio_types
+ClassDataType(enum matio_classes class_type)
+{
+    switch ( class_type ) {
+        case MAT_C_DOUBLE: return MAT_T_DOUBLE;
+        case MAT_C_SINGLE: return MAT_T_SINGLE;
+        case MAT_C_INT64:  return MAT_T_INT64;
+        case MAT_C_UINT64: return MAT_T_UINT64;
+        case MAT_C_INT32:  return MAT_T_INT32;
+        case MAT_C_UINT32: return MAT_T_UINT32;
+        case MAT_C_INT16:  return MAT_T_INT16;
+        case MAT_C_UINT16: return MAT_T_UINT16;
+        case MAT_C_INT8:   return MAT_T_INT8;
+        case MAT_C_UINT8:  return MAT_T_UINT8;
+        default:           return MAT_T_UNKNOWN;
+    }
+}
+
+/** @if mat_devman
+ * @brief Reads the information of a variable with all of its elements
+ *
+ * Reads the information of the variable named @c name, or of the next
+ * variable if @c name is NULL, outside of an arena.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param name Name of the variable, or NULL
+ * @return Pointer to the variable information, or NULL
+ * @endif
+ */
+static matvar_t *
+ReadIntoInfo(mat_t *mat,const char *name)
+{
+    int shallow, arena;
+    matvar_t *info;
+
+    shallow = mat->shallow;
+    arena   = mat->arena;
+    mat->shallow = 0;
+    mat->arena   = 0;
+    if ( NULL != name )
+        info = Mat_VarReadInfo(mat,name);
+    else
+        info = Mat_VarReadNextInfo(mat);
+    mat->shallow = shallow;
+    mat->arena   = arena;
+    return info;
+}
+
+/** @if mat_devman
+ * @brief Returns the first data buffer of a numeric variable
+ *
+ * @ingroup mat_internal
+ * @param matvar MAT variable
+ * @return The real part of split complex data, or the data
+ * @endif
+ */
+static const void *
+DataBuffer(const matvar_t *matvar)
+{
+    if ( NULL != matvar->data && matvar->isComplex &&
+         !MAT_IS_INTERLEAVED(matvar) )
+        return ((mat_complex_split_t*)matvar->data)->Re;
+    return matvar->data;
+}
+
+/** @if mat_devman
+ * @brief Returns the size of each data buffer of a variable
+ *
+ * A buffer reused by ReadInto may hold more bytes than the variable read
+ * into it.  Its size is kept with the buffer, and any other buffer holds
+ * @c nbytes.
+ * @ingroup mat_internal
+ * @param matvar MAT variable with numeric data
+ * @return Size of each data buffer in bytes
+ * @endif
+ */
+static size_t
+DataCapacity(const matvar_t *matvar)
+{
+    const void *buf = DataBuffer(matvar);
+
+    if ( NULL != buf && buf == matvar->internal->capacity_buf &&
+         matvar->internal->data_capacity > matvar->nbytes )
+        return matvar->internal->data_capacity;
+    return matvar->nbytes;
+}
+
+/** @if mat_devman
+ * @brief Reads the data of a variable and moves it into another variable
+ *
+ * Reads the data of a numeric variable into the data buffers of @c matvar
+ * when they have the same layout and hold at least as many bytes, or into new
+ * buffers otherwise.  The contents of @c info and @c matvar are then
+ * exchanged, and @c info is freed with the previous contents of @c matvar.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param info Variable information read by ReadIntoInfo, freed on return
+ * @param matvar Variable receiving the information and data
+ * @retval 0 on success
+ * @endif
+ */
+static int
+ReadInto(mat_t *mat,matvar_t *info,matvar_t *matvar)
+{
+    size_t nmemb = 1, nbytes, capacity = 0;
+    void *data = NULL;
+    matvar_t tmp;
+    int k, err = 0;
+
+    /* The read flags of matvar apply to each variable read into it */
+    Mat_VarSetReadFlags(info,matvar->internal->read_flags);
+    for ( k = 0; k < info->rank; k++ )
+        nmemb *= info->dims[k];
+    nbytes = nmemb*Mat_SizeOfClass(info->class_type);
+
+    if ( MAT_T_UNKNOWN != ClassDataType(info->class_type) &&
+         MAT_T_UNKNOWN != ClassDataType(matvar->class_type) &&
+         NULL != matvar->data && !IsDataShared(matvar) &&
+         (!matvar->mem_conserve || NULL != matvar->internal->data_free) &&
+         info->isComplex == matvar->isComplex &&
+         MAT_IS_INTERLEAVED(info) == MAT_IS_INTERLEAVED(matvar) &&
+         nmemb > 0 && nbytes <= (capacity = DataCapacity(matvar)) &&
+         info->rank <= 10 && nmemb == (size_t)(int)nmemb ) {
+        /* Decode into the buffers of matvar */
+        data = matvar->data;
+        matvar->data = NULL;
+        if ( MAT_FT_MAT73 == mat->version ||
+             (info->internal->read_flags & MAT_F_ROW_MAJOR) ) {
+            int start[10], stride[10], edge[10];
+
+            for ( k = 0; k < info->rank; k++ ) {
+                start[k]  = 0;
+                stride[k] = 1;
+                edge[k]   = (int)info->dims[k];
+            }
+            err = Mat_VarReadData(mat,info,data,start,stride,edge);
+        } else {
+            err = Mat_VarReadDataLinear(mat,info,data,0,1,(int)nmemb);
+        }
+        info->data      = data;
+        info->nbytes    = nbytes;
+        info->data_size = Mat_SizeOfClass(info->class_type);
+        info->data_type = ClassDataType(info->class_type);
+    } else {
+        ReadData(mat,info);
+    }
+
+    tmp     = *matvar;
+    *matvar = *info;
+    *info   = tmp;
+    if ( NULL != data ) {
+        /* The reused data keeps its deallocator */
+        matvar->internal->data_free = info->internal->data_free;
+        matvar->internal->data_free_context =
+            info->internal->data_free_context;
+        matvar->internal->shared = info->internal->shared;
+        info->internal->data_free = NULL;
+        info->internal->shared    = NULL;
+        /* Keep the size of the buffers, which nbytes no longer tells */
+        matvar->internal->data_capacity = capacity;
+        matvar->internal->capacity_buf  = DataBuffer(matvar);
+    }
+    Mat_VarFree(info);
+
+    return err;
+}
+
+/** @brief Reads the variable with the given name into an existing variable
+ *
+ * Reads the variable named @c name like Mat_VarRead, but stores it in
+ * @c matvar instead of a new variable.  The data of a numeric variable is
+ * decoded into the data buffers of @c matvar when they have the same layout
+ * (real, split complex or interleaved complex) and are large enough, so that
+ * reading variables of the same size repeatedly does not allocate new data
+ * buffers.  Otherwise the previous data of @c matvar is freed and new buffers
+ * are allocated.  Interleaved complex data is rearranged through a buffer
+ * kept with @c mat, which is only reallocated when a larger variable is
+ * read.  The read flags set on @c matvar with Mat_VarSetReadFlags
+ * are kept and apply to each variable read into it.
+ *
+ * @c matvar may be a variable previously read by this function,
+ * Mat_VarRead or Mat_VarReadNext, or an empty variable from Mat_VarCalloc.
+ * It must use the allocator of @c mat and must not be held in an arena.
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file
+ * @param name Name of the variable to read
+ * @param matvar Variable receiving the information and data
+ * @retval 0 on success
+ */
+int
+Mat_VarReadInto(mat_t *mat,const char *name,matvar_t *matvar)
+{
+    long fpos = 0;
+    int  err;
+    matvar_t *info;
+
+    if ( NULL == mat || NULL == name || NULL == matvar ||
+         NULL != matvar->internal->arena ||
+         mat->allocator != matvar->internal->allocator )
+        return 1;
+
+    Mat_AsyncWait5(mat);
+    if ( MAT_FT_MAT73 != mat->version )
+        fpos = ftell(mat->fp);
+    info = ReadIntoInfo(mat,name);
+    err  = (NULL == info) ? 1 : ReadInto(mat,info,matvar);
+    if ( MAT_FT_MAT73 != mat->version )
+        fseek(mat->fp,fpos,SEEK_SET);
+    return err;
+}
+
+/** @brief Reads the next variable in a MAT file into an existing variable
+ *
+ * Reads the next variable like Mat_VarReadNext, but stores it in @c matvar
+ * instead of a new variable, reusing its data buffers as described for
+ * Mat_VarReadInto.
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file
+ * @param matvar Variable receiving the information and data
+ * @retval 0 on success, nonzero on error or past the last variable
+ */
+int
+Mat_VarReadNextInto(mat_t *mat,matvar_t *matvar)
+{
+    long fpos = 0;
+    matvar_t *info;
+
+    if ( NULL == mat || NULL == matvar ||
+         NULL != matvar->internal->arena ||
+         mat->allocator != matvar->internal->allocator )
+        return 1;
+
+    Mat_AsyncWait5(mat);
+    if ( MAT_FT_MAT73 != mat->version ) {
+        if ( feof((FILE *)mat->fp) )
+            return 1;
+        fpos = ftell(mat->fp);
+    }
+    info = ReadIntoInfo(mat,NULL);
+    if ( NULL == info ) {
+        if ( MAT_FT_MAT73 != mat->version )
+            fseek(mat->fp,fpos,SEEK_SET);
+        return 1;
+    }
+    return ReadInto(mat,info,matvar);
+}
+
+/** @if mat_devman
+ * @brief Reads a subscript value of a path expression
+ *
+ * @ingroup mat_internal
+ * @param str Pointer to the expression, advanced past the value
+ * @param dim Size of the indexed dimension, the value of @c end
+ * @param value Pointer to store the 1-relative value
+ * @retval 0 on success
+ * @endif
+ */
+static int
+ReadPathValue(const char **str,size_t dim,long *value)
+{
+    char *end;
+
+    if ( !strncmp(*str,"end",3) ) {
+        *value = (long)dim;
+        *str  += 3;
+    } else if ( **str >= '0' && **str <= '9' ) {
+        *value = strtol(*str,&end,10);
+        *str   = end;
+    } else {
+        return 1;
+    }
+    return 0;
+}
+
+/** @if mat_devman
+ * @brief Reads the range of one dimension of a path expression
+ *
+ * The range is either a colon for the whole dimension or one to three
+ * values in the form first[:step][:last].
+ * @ingroup mat_internal
+ * @param str Pointer to the expression, advanced past the range
+ * @param dim Size of the indexed dimension
+ * @param start Pointer to store the 0-relative start of the range
+ * @param stride Pointer to store the stride of the range
+ * @param edge Pointer to store the number of elements of the range
+ * @retval 0 on success
+ * @endif
+ */
+static int
+ReadPathRange(const char **str,size_t dim,int *start,int *stride,int *edge)
+{
+    long v[3], first, step = 1, last;
+    int n = 0;
+
+    if ( ':' == **str ) {
+        (*str)++;
+        *start  = 0;
+        *stride = 1;
+        *edge   = (int)dim;
+        return dim < 1;
+    }
+    for ( ;; ) {
+        if ( n == 3 || ReadPathValue(str,dim,v+n) )
+            return 1;
+        n++;
+        if ( ':' != **str )
+            break;
+        (*str)++;
+    }
+    first = v[0];
+    last  = v[n-1];
+    if ( 3 == n )
+        step = v[1];
+    if ( first < 1 || step < 1 || last < first || last > (long)dim )
+        return 1;
+    *start  = (int)(first-1);
+    *stride = (int)step;
+    *edge   = (int)((last-first)/step+1);
+    return 0;
+}
+
+/** @if mat_devman
+ * @brief Reads the subscripts of a path expression enclosed in () or {}
+ *
+ * A single subscript indexes the elements of @c matvar linearly, otherwise
+ * there must be one subscript for each dimension of @c matvar.
+ * @ingroup mat_internal
+ * @param str Pointer to the opening bracket, advanced past the closing one
+ * @param matvar Indexed variable
+ * @param rank Pointer to store the number of subscripts
+ * @param start Array of at least 10 elements to store the start of each range
+ * @param stride Array of at least 10 elements to store the stride of each range
+ * @param edge Array of at least 10 elements to store the length of each range
+ * @retval 0 on success
+ * @endif
+ */
+static int
+ReadPathSubscripts(const char **str,const matvar_t *matvar,int *rank,
+    int *start,int *stride,int *edge)
+{
+    const char *ptr = *str;
+    char close = '{' == *ptr ? '}' : ')';
+    size_t nmemb = 1;
+    int k, n = 1;
+
+    for ( k = 0; k < matvar->rank; k++ )
+        nmemb *= matvar->dims[k];
+    for ( ptr++; close != *ptr; ptr++ ) {
+        if ( '\0' == *ptr )
+            return 1;
+        else if ( ',' == *ptr )
+            n++;
+    }
+    if ( n > 10 || (n > 1 && n != matvar->rank) )
+        return 1;
+
+    ptr = *str+1;
+    for ( k = 0; k < n; k++ ) {
+        if ( ReadPathRange(&ptr,1 == n ? nmemb : matvar->dims[k],start+k,
+                           stride+k,edge+k) )
+            return 1;
+        if ( *ptr++ != (k < n-1 ? ',' : close) )
+            return 1;
+    }
+    *rank = n;
+    *str  = ptr;
+    return 0;
+}
+
+/** @if mat_devman
+ * @brief Calculates the linear index of subscripts selecting one element
+ *
+ * @ingroup mat_internal
+ * @param matvar Indexed variable
+ * @param rank Number of subscripts
+ * @param start 0-relative subscripts
+ * @param edge Length of the range of each subscript
+ * @return Linear index of the element, or -1 if more than one is selected
+ * @endif
+ */
+static long
+PathIndex(const matvar_t *matvar,int rank,const int *start,const int *edge)
+{
+    long index = 0, size = 1;
+    int k;
+
+    for ( k = 0; k < rank; k++ ) {
+        if ( 1 != edge[k] )
+            return -1;
+        index += start[k]*size;
+        size  *= (long)matvar->dims[k];
+    }
+    return index;
+}
+
+/** @if mat_devman
+ * @brief Reads a slab of a numeric variable read by Mat_VarReadInfo
+ *
+ * Stores the slab as the data of @c matvar and sets its dimensions to the
+ * size of the slab.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar Numeric variable
+ * @param rank Number of subscripts, 1 for a linear slab
+ * @param start 0-relative start of each range
+ * @param stride Stride of each range
+ * @param edge Length of each range
+ * @retval 0 on success
+ * @endif
+ */
+static int
+ReadPathSlab(mat_t *mat,matvar_t *matvar,int rank,int *start,int *stride,
+    int *edge)
+{
+    size_t nmemb = 1;
+    void *data;
+    int k, err;
+
+    if ( MAT_T_UNKNOWN == ClassDataType(matvar->class_type) )
+        return 1;
+    for ( k = 0; k < rank; k++ )
+        nmemb *= edge[k];
+    matvar->data_size = Mat_SizeOfClass(matvar->class_type);
+    matvar->nbytes    = nmemb*matvar->data_size;
+    if ( MAT_IS_INTERLEAVED(matvar) ) {
+        data = Mat_VarDataAlloc(matvar,2*matvar->nbytes);
+    } else if ( matvar->isComplex ) {
+        mat_complex_split_t *complex_data;
+
+        complex_data = Mat_VarMemAlloc(matvar,sizeof(*complex_data));
+        if ( NULL != complex_data ) {
+            complex_data->Re = Mat_VarDataAlloc(matvar,matvar->nbytes);
+            complex_data->Im = Mat_VarDataAlloc(matvar,matvar->nbytes);
+            if ( NULL == complex_data->Re || NULL == complex_data->Im ) {
+                Mat_VarDataFree(matvar,complex_data->Re);
+                Mat_VarDataFree(matvar,complex_data->Im);
+                Mat_VarMemFree(matvar,complex_data);
+                complex_data = NULL;
+            }
+        }
+        data = complex_data;
+    } else {
+        data = Mat_VarDataAlloc(matvar,matvar->nbytes);
+    }
+    if ( NULL == data ) {
+        Mat_Critical("Failed to allocate %d bytes",matvar->nbytes);
+        return 1;
+    }
+
+    if ( 1 == rank )
+        err = Mat_VarReadDataLinear(mat,matvar,data,*start,*stride,*edge);
+    else
+        err = Mat_VarReadData(mat,matvar,data,start,stride,edge);
+    matvar->data      = data;
+    matvar->data_type = ClassDataType(matvar->class_type);
+    if ( 1 == rank ) {
+        if ( 2 != matvar->rank || 1 != matvar->dims[0] ) {
+            matvar->rank    = 2;
+            matvar->dims[0] = *edge;
+            matvar->dims[1] = 1;
+        } else {
+            matvar->dims[1] = *edge;
+        }
+    } else {
+        for ( k = 0; k < rank; k++ )
+            matvar->dims[k] = edge[k];
+    }
+    return err;
+}
+
+/** @brief Reads a part of a variable selected by a path expression
+ *
+ * Reads the part of a variable selected by a MATLAB-style expression such as
+ * @c "a.b{3}.c(1:10,:)".  The expression starts with the name of the
+ * variable and is followed by any number of the following selections:
+ * - @c .field selects a field of a structure.  A structure array must first
+ *   be indexed with @c (i) or @c (i,j,...) to select one structure.
+ * - @c {i} or @c {i,j,...} selects one element of a cell array.
+ * - @c (r) or @c (r1,r2,...) as the last selection reads a slab of a
+ *   numeric array, where each range is @c :, @c first, @c first:last or
+ *   @c first:step:last.  A single range indexes the array linearly.
+ *
+ * Subscripts are 1-relative and may be @c end.  Only the information of the
+ * variable is read to find the selected part, and only the data of the
+ * selected part is read.
  * @ingroup MAT
- * @param matvar matlab variable
- * @returns size of the variable in bytes
+ * @param mat Pointer to the MAT file
+ * @param path Path expression
+ * @return Pointer to a new variable named @c path with the selected data, or
+ *         NULL if the expression is not valid for the variable
+ */
+matvar_t *
+Mat_VarReadPath(mat_t *mat,const char *path)
+{
+    matvar_t *matvar, *elem, **slot = NULL;
+    const char *ptr;
+    char *name;
+    int rank = 0, err = 0, start[10], stride[10], edge[10], shallow, arena;
+    long index = -1, fpos = 0;
+    size_t len;
+
+    if ( NULL == mat || NULL == path )
+        return NULL;
+
+    len  = strcspn(path,".({");
+    name = Mat_Malloc(mat->allocator,len+1);
+    if ( NULL == name )
+        return NULL;
+    memcpy(name,path,len);
+    name[len] = '\0';
+    Mat_AsyncWait5(mat);
+    if ( MAT_FT_MAT73 != mat->version )
+        fpos = ftell(mat->fp);
+    shallow = mat->shallow;
+    arena   = mat->arena;
+    mat->shallow = 0;
+    /* The selected element is detached from the tree of the variable */
+    mat->arena   = 0;
+    matvar = Mat_VarReadInfo(mat,name);
+    mat->shallow = shallow;
+    mat->arena   = arena;
+    Mat_Free(mat->allocator,name);
+    if ( NULL == matvar )
+        return NULL;
+
+    elem = matvar;
+    ptr  = path+len;
+    while ( !err && '\0' != *ptr ) {
+        if ( '.' == *ptr ) {
+            size_t nmemb = 1;
+            int k, nfields;
+
+            len = strcspn(++ptr,".({");
+            if ( MAT_C_STRUCT != elem->class_type || 0 == len ) {
+                err = 1;
+                break;
+            }
+            for ( k = 0; k < elem->rank; k++ )
+                nmemb *= elem->dims[k];
+            if ( index < 0 && 1 == nmemb )
+                index = 0;
+            nfields = Mat_VarGetNumberOfFields(elem);
+            k       = Mat_VarGetStructFieldIndex(elem,ptr,len);
+            if ( index < 0 || k < 0 || NULL == elem->data ) {
+                err = 1;
+                break;
+            }
+            slot  = (matvar_t **)elem->data+index*nfields+k;
+            ptr  += len;
+            index = -1;
+        } else if ( '{' == *ptr ) {
+            if ( MAT_C_CELL != elem->class_type || NULL == elem->data ||
+                 ReadPathSubscripts(&ptr,elem,&rank,start,stride,edge) ||
+                 0 > (index = PathIndex(elem,rank,start,edge)) ) {
+                err = 1;
+                break;
+            }
+            slot  = (matvar_t **)elem->data+index;
+            rank  = 0;
+            index = -1;
+        } else if ( '(' == *ptr ) {
+            if ( ReadPathSubscripts(&ptr,elem,&rank,start,stride,edge) ) {
+                err = 1;
+            } else if ( MAT_C_STRUCT == elem->class_type && '.' == *ptr ) {
+                /* Select one structure of a structure array */
+                index = PathIndex(elem,rank,start,edge);
+                rank  = 0;
+                err   = index < 0;
+            } else if ( '\0' != *ptr ||
+                        MAT_T_UNKNOWN == ClassDataType(elem->class_type) ) {
+                err = 1;
+            }
+            continue;
+        } else {
+            err = 1;
+            break;
+        }
+        elem = *slot;
+        if ( NULL == elem )
+            err = 1;
+    }
+    if ( err ) {
+        Mat_Critical("Mat_VarReadPath: %s is not a valid path",path);
+        Mat_VarFree(matvar);
+        if ( MAT_FT_MAT73 != mat->version )
+            fseek(mat->fp,fpos,SEEK_SET);
+        return NULL;
+    }
+
+    if ( NULL != slot ) {
+        /* Keep only the selected element */
+        *slot = NULL;
+        Mat_VarFree(matvar);
+    }
+    if ( !elem->internal->name_shared )
+        Mat_VarMemFree(elem,elem->name);
+    elem->internal->name_shared = 0;
+    elem->name = Mat_VarMemStrdup(elem,path);
+
+    if ( rank > 0 )
+        err = ReadPathSlab(mat,elem,rank,start,stride,edge);
+    else if ( NULL != slot )
+        ReadElement(mat,elem);
+    else
+        ReadData(mat,elem);
+
+    if ( MAT_FT_MAT73 != mat->version )
+        fseek(mat->fp,fpos,SEEK_SET);
+    if ( err ) {
+        Mat_VarFree(elem);
+        elem = NULL;
+    }
+    return elem;
+}
+
+/** @if mat_devman
+ * @brief Creates the column of a field gathered from a structure array
+ *
+ * Creates an nmemb-by-n array of the class of @c field with uninitialized
+ * data, where row i is to hold the field of element i of the structure array.
+ * @ingroup mat_internal
+ * @param name Name of the field
+ * @param field Field of the first element, or NULL for a double column
+ * @param nmemb Number of elements of the structure array
+ * @param n Number of elements of the field
+ * @return The new column, or NULL on error
+ * @endif
+ */
+matvar_t *
+Mat_VarCreateColumn(const char *name,const matvar_t *field,size_t nmemb,
+    size_t n)
+{
+    size_t dims[2];
+    matvar_t *column;
+
+    dims[0] = nmemb;
+    dims[1] = n;
+    if ( NULL == field )
+        column = Mat_VarCreate(name,MAT_C_DOUBLE,MAT_T_DOUBLE,2,dims,NULL,0);
+    else
+        column = Mat_VarCreate(name,field->class_type,
+                     ClassDataType(field->class_type),2,dims,NULL,
+                     field->isLogical ? MAT_F_LOGICAL : 0);
+    if ( NULL != column && column->nbytes > 0 &&
+         NULL == (column->data = Mat_VarDataAlloc(column,column->nbytes)) ) {
+        Mat_VarFree(column);
+        column = NULL;
+    }
+    return column;
+}
+
+/** @if mat_devman
+ * @brief Copies a row of a column written as a field of a structure array
+ *
+ * Row i of a numeric column is the 1-by-n field of element i.  Row i of a
+ * character column is the string of element i, which ends at the first NUL
+ * character or at the end of the row.
+ * @ingroup mat_internal
+ * @param column nmemb-by-n column
+ * @param i 0-relative index of the row
+ * @param row Buffer to store the elements of the row, or NULL to only count
+ *            them
+ * @return Number of elements of the row
+ * @endif
  */
 size_t
-Mat_VarGetSize(matvar_t *matvar)
+Mat_VarGetColumnRow(const matvar_t *column,size_t i,void *row)
 {
-    int nmemb, i;
-    size_t bytes = 0;
+    size_t n, elem_size;
+    const char *data;
 
-    if ( matvar->class_type == MAT_C_STRUCT ) {
-        int nfields;
-        matvar_t **fields;
-        /* This is really nmemb*nfields, but we'll get a
-         * more accurate count of the bytes by loopoing over all of them
-         */
-        nfields = matvar->internal->num_fields;
-        fields  = matvar->data;
-        for ( i = 0; i < nfields; i++ )
-            bytes += Mat_VarGetSize(fields[i]);
-    } else if ( matvar->class_type == MAT_C_CELL ) {
-        int ncells;
-        matvar_t **cells;
+    n         = column->dims[1];
+    elem_size = Mat_SizeOf(column->data_type);
+    data      = (const char*)column->data + i*elem_size;
+    if ( MAT_C_CHAR == column->class_type ) {
+        size_t j, k;
+
+        for ( j = 0; j < n; j++ ) {
+            const char *c = data + j*column->dims[0]*elem_size;
+            for ( k = 0; k < elem_size && '\0' == c[k]; k++ );
+            if ( k == elem_size )
+                break;
+        }
+        n = j;
+    }
+    if ( NULL != row && n > 0 )
+        Mat_CopyStrided(row,1,data,column->dims[0],elem_size,n);
+    return n;
+}
+
+/** @if mat_devman
+ * @brief Converts character data of a MAT file to UTF-8
+ *
+ * 8-bit data of type MAT_T_UTF8 is copied.  Other 8-bit data is taken as
+ * ISO-8859-1 and 16-bit data as UTF-16, where an unpaired surrogate is
+ * replaced by U+FFFD.  16-bit data must be in the byte order of the host.
+ * @ingroup mat_internal
+ * @param out Buffer to store the UTF-8 string, which must hold n bytes for
+ *            MAT_T_UTF8, 2*n bytes for other 8-bit data and 3*n bytes for
+ *            16-bit data
+ * @param in Character data
+ * @param n Number of characters of @c in
+ * @param data_type Data type of @c in
+ * @return Number of bytes stored in @c out
+ * @endif
+ */
+size_t
+Mat_CharToUtf8(char *out,const void *in,size_t n,enum matio_types data_type)
+{
+    size_t i, len = 0;
+
+    if ( MAT_T_UTF8 == data_type ) {
+        memcpy(out,in,n);
+        len = n;
+    } else if ( 1 == Mat_SizeOf(data_type) ) {
+        const mat_uint8_t *c8 = in;
+
+        for ( i = 0; i < n; i++ ) {
+            if ( c8[i] < 0x80 ) {
+                out[len++] = c8[i];
+            } else {
+                out[len++] = 0xc0 | (c8[i] >> 6);
+                out[len++] = 0x80 | (c8[i] & 0x3f);
+            }
+        }
+    } else if ( 2 == Mat_SizeOf(data_type) ) {
+        const mat_uint16_t *c16 = in;
+
+        for ( i = 0; i < n; i++ ) {
+            mat_uint32_t c = c16[i];
+
+            if ( c >= 0xd800 && c < 0xdc00 && i+1 < n &&
+                 c16[i+1] >= 0xdc00 && c16[i+1] < 0xe000 ) {
+                c = 0x10000 + ((c-0xd800) << 10) + (c16[++i]-0xdc00);
+            } else if ( c >= 0xd800 && c < 0xe000 ) {
+                c = 0xfffd;
+            }
+            if ( c < 0x80 ) {
+                out[len++] = c;
+            } else if ( c < 0x800 ) {
+                out[len++] = 0xc0 | (c >> 6);
+                out[len++] = 0x80 | (c & 0x3f);
+            } else if ( c < 0x10000 ) {
+                out[len++] = 0xe0 | (c >> 12);
+                out[len++] = 0x80 | ((c >> 6) & 0x3f);
+                out[len++] = 0x80 | (c & 0x3f);
+            } else {
+                out[len++] = 0xf0 | (c >> 18);
+                out[len++] = 0x80 | ((c >> 12) & 0x3f);
+                out[len++] = 0x80 | ((c >> 6) & 0x3f);
+                out[len++] = 0x80 | (c & 0x3f);
+            }
+        }
+    }
+    return len;
+}
+
+/** @if mat_devman
+ * @brief Converts a UTF-8 string to UTF-16
+ *
+ * Characters outside of the basic multilingual plane are stored as surrogate
+ * pairs.  An invalid byte sequence is replaced by U+FFFD.
+ * @ingroup mat_internal
+ * @param out Buffer to store the UTF-16 string, which needs at most @c len
+ *            elements, or NULL to only count them
+ * @param in UTF-8 string
+ * @param len Number of bytes of @c in
+ * @return Number of 16-bit elements of the UTF-16 string
+ * @endif
+ */
+size_t
+Mat_Utf8ToUtf16(mat_uint16_t *out,const char *in,size_t len)
+{
+    const mat_uint8_t *c8 = (const mat_uint8_t*)in;
+    size_t i = 0, n = 0;
+
+    while ( i < len ) {
+        mat_uint32_t c = c8[i], min = 0;
+        size_t j, extra = 0;
+
+        if ( c >= 0xf0 && c < 0xf8 ) {
+            extra = 3;
+            min   = 0x10000;
+            c    &= 0x07;
+        } else if ( c >= 0xe0 && c < 0xf0 ) {
+            extra = 2;
+            min   = 0x800;
+            c    &= 0x0f;
+        } else if ( c >= 0xc0 && c < 0xe0 ) {
+            extra = 1;
+            min   = 0x80;
+            c    &= 0x1f;
+        } else if ( c >= 0x80 ) {
+            c = 0xfffd;
+        }
+        for ( j = 1; j <= extra && i+j < len; j++ ) {
+            if ( (c8[i+j] & 0xc0) != 0x80 )
+                break;
+            c = (c << 6) | (c8[i+j] & 0x3f);
+        }
+        if ( j <= extra ) {
+            /* Truncated sequence, skip the lead byte only */
+            c = 0xfffd;
+            j = 1;
+        } else if ( c < min || c > 0x10ffff ||
+                    (c >= 0xd800 && c < 0xe000) ) {
+            c = 0xfffd;
+        }
+        i += j;
+
+        if ( c >= 0x10000 ) {
+            if ( NULL != out ) {
+                out[n]   = 0xd800 + ((c-0x10000) >> 10);
+                out[n+1] = 0xdc00 + ((c-0x10000) & 0x3ff);
+            }
+            n += 2;
+        } else {
+            if ( NULL != out )
+                out[n] = c;
+            n++;
+        }
+    }
+    return n;
+}
+
+/** @if mat_devman
+ * @brief Appends a string to the pool of a cell array of strings
+ *
+ * Converts the character data of string i to UTF-8 with Mat_CharToUtf8,
+ * stores it with a terminating NUL at offset @c offsets[i] of the pool,
+ * which is grown as needed, and sets @c offsets[i+1].
+ * @ingroup mat_internal
+ * @param cellstr Cell array of strings
+ * @param i 0-relative index of the string
+ * @param pool_size Pointer to the number of bytes allocated for the pool
+ * @param data Character data of the string
+ * @param n Number of characters of @c data
+ * @param data_type Data type of @c data
+ * @retval 0 on success
+ * @endif
+ */
+int
+Mat_CellStrAppend(mat_cellstr_t *cellstr,size_t i,size_t *pool_size,
+    const void *data,size_t n,enum matio_types data_type)
+{
+    size_t len, offset = cellstr->offsets[i];
+
+    len = MAT_T_UTF8 == data_type ? n : Mat_SizeOf(data_type) == 1 ? 2*n : 3*n;
+    if ( offset+len+1 > *pool_size ) {
+        size_t size = 2*(*pool_size);
+        char  *pool;
+
+        if ( size < offset+len+1 )
+            size = offset+len+1;
+        pool = Mat_Realloc(cellstr->allocator,cellstr->pool,size);
+        if ( NULL == pool ) {
+            Mat_Critical("Couldn't allocate memory for the strings");
+            return 1;
+        }
+        cellstr->pool = pool;
+        *pool_size    = size;
+    }
+    len = n > 0 ? Mat_CharToUtf8(cellstr->pool+offset,data,n,data_type) : 0;
+    cellstr->pool[offset+len] = '\0';
+    cellstr->offsets[i+1] = offset+len+1;
+    return 0;
+}
+
+/** @if mat_devman
+ * @brief Creates the column of a field of a structure array in memory
+ *
+ * Checks that the field is a real numeric array of the same class and number
+ * of elements in every element of the structure array.
+ * @ingroup mat_internal
+ * @param matvar Structure array
+ * @param field_index 0-relative index of the field
+ * @param from_file Set to 1 if the data of a field is not in memory
+ * @return The new column, or NULL on error
+ * @endif
+ */
+static matvar_t *
+NewStructColumn(matvar_t *matvar,int field_index,int *from_file)
+{
+    size_t i, k, n = 0, nmemb = 1;
+    int nfields = matvar->internal->num_fields;
+    matvar_t **fields = matvar->data, *first = NULL;
+
+    for ( k = 0; k < matvar->rank; k++ )
+        nmemb *= matvar->dims[k];
+
+    for ( i = 0; i < nmemb; i++ ) {
+        matvar_t *field = fields[i*nfields+field_index];
+        size_t numel = 1;
+
+        if ( NULL == field || field->isComplex ||
+             MAT_T_UNKNOWN == ClassDataType(field->class_type) )
+            return NULL;
+        for ( k = 0; k < field->rank; k++ )
+            numel *= field->dims[k];
+        if ( NULL == first ) {
+            first = field;
+            n     = numel;
+        } else if ( numel != n || field->class_type != first->class_type ||
+                    field->isLogical != first->isLogical ) {
+            return NULL;
+        }
+        if ( NULL == field->data && numel > 0 )
+            *from_file = 1;
+    }
+
+    return Mat_VarCreateColumn(matvar->internal->fieldnames[field_index],
+                               first,nmemb,n);
+}
+
+/** @if mat_devman
+ * @brief Copies or reads a field of every element into its column
+ *
+ * The field of element i is stored in row i of the column.  The data of
+ * fields that is not in memory is read with Mat_VarReadDataLinear from the
+ * file of the field or else the file of the structure array.
+ * @ingroup mat_internal
+ * @param column Column created by NewStructColumn
+ * @retval 0 on success
+ * @endif
+ */
+static int
+FillStructColumn(struct mat_struct_column *column)
+{
+    matvar_t *matvar = column->matvar;
+    matvar_t **fields = matvar->data;
+    int nfields = matvar->internal->num_fields, err = 0;
+    size_t i, nmemb = column->column->dims[0], n = column->column->dims[1];
+    size_t elem_size = Mat_SizeOfClass(column->column->class_type);
+    char *buf = NULL;
+
+    if ( 0 == n )
+        return 0;
+    for ( i = 0; i < nmemb && !err; i++ ) {
+        matvar_t *field = fields[i*nfields+column->field_index];
+        char *row = (char*)column->column->data+i*elem_size;
+        mat_t *mat = field->internal->fp;
+
+        if ( NULL == mat )
+            mat = column->mat;
+        if ( NULL != field->data ) {
+            Mat_CopyStrided(row,nmemb,field->data,1,elem_size,n);
+        } else if ( NULL == mat ) {
+            err = 1;
+        } else if ( 1 == n ) {
+            err = Mat_VarReadDataLinear(mat,field,row,0,1,1);
+        } else if ( NULL == buf && NULL == (buf =
+                    Mat_VarMemAlloc(column->column,n*elem_size)) ) {
+            err = 1;
+        } else {
+            err = Mat_VarReadDataLinear(mat,field,buf,0,1,(int)n);
+            if ( !err )
+                Mat_CopyStrided(row,nmemb,buf,1,elem_size,n);
+        }
+    }
+    Mat_VarMemFree(column->column,buf);
+    return err;
+}
+
+/** @if mat_devman
+ * @brief Fills every @c step-th column starting at column @c first
+ *
+ * @ingroup mat_internal
+ * @param arg Pointer to a mat_struct_columns structure
+ * @return NULL
+ * @endif
+ */
+static void *
+FillStructColumns(void *arg)
+{
+    struct mat_struct_columns *work = arg;
+    int k;
+
+    for ( k = work->first; k < work->ncolumns; k += work->step )
+        work->columns[k].err = FillStructColumn(work->columns+k);
+    return NULL;
+}
+
+/** @if mat_devman
+ * @brief Finds the fields of the columns of a structure array
+ *
+ * @ingroup mat_internal
+ * @param matvar Structure array
+ * @param ncolumns Number of columns
+ * @param field_names Names of the fields
+ * @param field_index Array of @c ncolumns to store the 0-relative index of
+ *                    each field
+ * @retval 0 on success
+ * @endif
+ */
+static int
+StructColumnFields(matvar_t *matvar,int ncolumns,
+    const char * const *field_names,int *field_index)
+{
+    int k;
+
+    if ( MAT_C_STRUCT != matvar->class_type ) {
+        Mat_Critical("%s is not a structure array",matvar->name);
+        return 1;
+    }
+    for ( k = 0; k < ncolumns; k++ ) {
+        field_index[k] = NULL == field_names[k] ? -1 :
+            Mat_VarGetStructFieldIndex(matvar,field_names[k],
+                                       strlen(field_names[k]));
+        if ( field_index[k] < 0 ) {
+            Mat_Critical("%s has no field %s",matvar->name,
+                         NULL == field_names[k] ? "(null)" : field_names[k]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/** @if mat_devman
+ * @brief Gathers fields of a structure array in memory into columns
+ *
+ * @ingroup mat_internal
+ * @param mat MAT file of the structure array, or NULL
+ * @param matvar Structure array
+ * @param ncolumns Number of columns
+ * @param field_index 0-relative index of the field of each column
+ * @param columns Array of @c ncolumns pointers to store the new columns
+ * @param nthreads Number of threads used when the data is in memory
+ * @retval 0 on success
+ * @endif
+ */
+static int
+GatherStructColumns(mat_t *mat,matvar_t *matvar,int ncolumns,
+    const int *field_index,matvar_t **columns,int nthreads)
+{
+    const mat_allocator_t *allocator = matvar->internal->allocator;
+    struct mat_struct_column *work;
+    struct mat_struct_columns all;
+    int k, err = 0, from_file = 0;
+
+    if ( NULL == matvar->data && matvar->nbytes > 0 )
+        return 1;
+    work = Mat_Malloc(allocator,ncolumns*sizeof(*work));
+    if ( NULL == work )
+        return 1;
+
+    for ( k = 0; k < ncolumns; k++ ) {
+        work[k].mat         = mat;
+        work[k].matvar      = matvar;
+        work[k].field_index = field_index[k];
+        work[k].err         = 0;
+        work[k].column      = NULL;
+        if ( !err && NULL == (work[k].column =
+             NewStructColumn(matvar,field_index[k],&from_file)) ) {
+            Mat_Critical("Field %s of %s is not a real numeric array of the "
+                         "same class and size in every element",
+                         matvar->internal->fieldnames[field_index[k]],
+                         matvar->name);
+            err = 1;
+        }
+        columns[k] = work[k].column;
+    }
+
+    all.columns  = work;
+    all.ncolumns = err ? 0 : ncolumns;
+    all.first    = 0;
+    all.step     = 1;
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+    /* The data in memory is copied in parallel, but a file is read by one
+     * thread */
+    if ( nthreads > ncolumns )
+        nthreads = ncolumns;
+    if ( !err && !from_file && nthreads > 1 ) {
+        pthread_t *threads = Mat_Malloc(allocator,nthreads*sizeof(*threads));
+        struct mat_struct_columns *parts =
+            Mat_Malloc(allocator,nthreads*sizeof(*parts));
+        int nstarted = 0;
+
+        if ( NULL != threads && NULL != parts ) {
+            for ( k = 0; k < nthreads; k++ ) {
+                parts[k].columns  = work;
+                parts[k].ncolumns = ncolumns;
+                parts[k].first    = k;
+                parts[k].step     = nthreads;
+            }
+            for ( k = 1; k < nthreads; k++ ) {
+                if ( 0 != pthread_create(threads+k,NULL,FillStructColumns,
+                                         parts+k) )
+                    break;
+                nstarted++;
+            }
+            /* The calling thread also fills the columns of the threads that
+             * could not be started */
+            FillStructColumns(parts);
+            for ( k = nstarted+1; k < nthreads; k++ )
+                FillStructColumns(parts+k);
+            for ( k = 1; k <= nstarted; k++ )
+                pthread_join(threads[k],NULL);
+            all.ncolumns = 0;
+        }
+        Mat_Free(allocator,threads);
+        Mat_Free(allocator,parts);
+    }
+#endif
+    FillStructColumns(&all);
+
+    for ( k = 0; k < ncolumns; k++ ) {
+        if ( work[k].err )
+            err = 1;
+    }
+    Mat_Free(allocator,work);
+    return err;
+}
+
+/** @brief Gathers fields of a structure array into columns
+ *
+ * Gathers the field @c field_names[k] of every element of the structure array
+ * @c matvar into the new variable @c columns[k] without going through the
+ * elements one field at a time.  The field must be a real numeric array of
+ * the same class and number of elements n in every element.  Its column is an
+ * nmemb-by-n array of that class whose row i holds the field of element i
+ * (linear index) of @c matvar, so a field of scalars gives a column vector.
+ * The data of fields that is not in memory, for example fields left unread
+ * by lazy loading (see Mat_SetLazyLoading), is read directly into the column.
+ * @ingroup MAT
+ * @param matvar Structure array
+ * @param ncolumns Number of fields to gather
+ * @param field_names Array of @c ncolumns field names
+ * @param columns Array of @c ncolumns pointers to store the new columns, which
+ *                should be freed with Mat_VarFree
+ * @param nthreads Number of threads gathering the columns in parallel when the
+ *                 data of all the fields is in memory, 1 to gather them
+ *                 serially
+ * @retval 0 on success
+ */
+int
+Mat_VarGetStructColumns(matvar_t *matvar,int ncolumns,
+    const char * const *field_names,matvar_t **columns,int nthreads)
+{
+    mat_t *mat;
+    long fpos = 0;
+    int k, err, *field_index;
+
+    if ( NULL == matvar || NULL == field_names || NULL == columns ||
+         ncolumns < 1 )
+        return 1;
+    for ( k = 0; k < ncolumns; k++ )
+        columns[k] = NULL;
+    field_index = Mat_Malloc(matvar->internal->allocator,
+                             ncolumns*sizeof(*field_index));
+    if ( NULL == field_index )
+        return 1;
+
+    /* Reading unread fields must not move the position of a version 5 file */
+    mat = matvar->internal->fp;
+    if ( NULL != mat && MAT_FT_MAT73 != mat->version && NULL != mat->fp )
+        fpos = ftell(mat->fp);
+    err = StructColumnFields(matvar,ncolumns,field_names,field_index) ||
+          GatherStructColumns(mat,matvar,ncolumns,field_index,columns,
+                              nthreads);
+    if ( NULL != mat && MAT_FT_MAT73 != mat->version && NULL != mat->fp )
+        fseek(mat->fp,fpos,SEEK_SET);
+
+    if ( err ) {
+        for ( k = 0; k < ncolumns; k++ ) {
+            Mat_VarFree(columns[k]);
+            columns[k] = NULL;
+        }
+    }
+    Mat_Free(matvar->internal->allocator,field_index);
+    return err;
+}
+
+/** @brief Reads fields of a structure array into columns
+ *
+ * Reads the fields @c field_names of every element of the structure array
+ * @c name into columns as Mat_VarGetStructColumns does for a structure array
+ * in memory, without a variable for each element.  The elements of version 5
+ * structure arrays are read in a single pass over the variable.  For version
+ * 7.3 files, only the information of the structure array is read and the data
+ * of each field is read directly into its row of the column.
+ * @ingroup MAT
+ * @param mat Pointer to the MAT file
+ * @param name Name of the structure array
+ * @param ncolumns Number of fields to read
+ * @param field_names Array of @c ncolumns field names
+ * @param columns Array of @c ncolumns pointers to store the new columns, which
+ *                should be freed with Mat_VarFree
+ * @retval 0 on success
+ */
+int
+Mat_VarReadStructColumns(mat_t *mat,const char *name,int ncolumns,
+    const char * const *field_names,matvar_t **columns)
+{
+    matvar_t *matvar;
+    long fpos = 0;
+    int k, err = 1, shallow, *field_index;
 
-        ncells = matvar->nbytes / matvar->data_size;
-        cells  = matvar->data;
-        for ( i = 0; i < ncells; i++ )
-            bytes += Mat_VarGetSize(cells[i]);
-    } else {
-        nmemb = 1;
-        for ( i = 0; i < matvar->rank; i++ )
-            nmemb *= matvar->dims[i];
-        bytes += nmemb*Mat_SizeOfClass(matvar->class_type);
+    if ( NULL == mat || NULL == name || NULL == field_names ||
+         NULL == columns || ncolumns < 1 )
+        return 1;
+    for ( k = 0; k < ncolumns; k++ )
+        columns[k] = NULL;
+    field_index = Mat_Malloc(mat->allocator,ncolumns*sizeof(*field_index));
+    if ( NULL == field_index )
+        return 1;
+
+    /* The elements of a version 5 structure array are read with the data */
+    Mat_AsyncWait5(mat);
+    if ( MAT_FT_MAT73 != mat->version )
+        fpos = ftell(mat->fp);
+    shallow = mat->shallow;
+    mat->shallow = MAT_FT_MAT5 == mat->version;
+    matvar = Mat_VarReadInfo(mat,name);
+    mat->shallow = shallow;
+    if ( NULL != matvar &&
+         !StructColumnFields(matvar,ncolumns,field_names,field_index) ) {
+        if ( MAT_FT_MAT5 == mat->version ) {
+            SetReadScaling(mat,NULL);
+            err = Mat_VarReadStructColumns5(mat,matvar,ncolumns,field_index,
+                                            columns);
+        } else {
+            err = GatherStructColumns(mat,matvar,ncolumns,field_index,
+                                      columns,1);
+        }
     }
-    return bytes;
+    Mat_VarFree(matvar);
+    if ( MAT_FT_MAT73 != mat->version )
+        fseek(mat->fp,fpos,SEEK_SET);
+
+    if ( err ) {
+        for ( k = 0; k < ncolumns; k++ ) {
+            Mat_VarFree(columns[k]);
+            columns[k] = NULL;
+        }
+    }
+    Mat_Free(mat->allocator,field_index);
+    return err;
 }
 
-/** @brief Prints the variable information
+/** @brief Writes columns as the fields of a structure array
  *
- * Prints to stdout the values of the @ref matvar_t structure
+ * Writes an nmemb-by-1 structure array @c name whose field
+ * @c field_names[k] of element i is row i of @c columns[k], without creating
+ * a variable for each element.  All columns must be nmemb-by-n arrays with
+ * the same number of rows nmemb.  A real numeric or logical column gives
+ * 1-by-n fields.  A character column gives a string in each element, which
+ * ends at the first NUL character of its row or at the end of the row, so
+ * the strings of the elements can have different lengths.  The elements
+ * are encoded as they are written from the data of the columns, which is
+ * the inverse of Mat_VarGetStructColumns.  The variable will be written to
+ * the end of the file.
  * @ingroup MAT
- * @param matvar Pointer to the matvar_t structure
- * @param printdata set to 1 if the Variables data should be printed, else 0
+ * @param mat MAT file to write to
+ * @param name Name of the structure array
+ * @param ncolumns Number of fields
+ * @param field_names Array of @c ncolumns field names
+ * @param columns Array of @c ncolumns columns
+ * @param compress Whether or not to compress the data
+ * @retval 0 on success
  */
-void
-Mat_VarPrint( matvar_t *matvar, int printdata )
+int
+Mat_VarWriteStructColumns(mat_t *mat,const char *name,int ncolumns,
+    const char * const *field_names,matvar_t * const *columns,
+    enum matio_compression compress)
 {
     size_t nmemb;
-    int i, j;
-    const char *class_type_desc[16] = {"Undefined","Cell Array","Structure",
-       "Object","Character Array","Sparse Array","Double Precision Array",
-       "Single Precision Array", "8-bit, signed integer array",
-       "8-bit, unsigned integer array","16-bit, signed integer array",
-       "16-bit, unsigned integer array","32-bit, signed integer array",
-       "32-bit, unsigned integer array","64-bit, signed integer array",
-       "64-bit, unsigned integer array"};
-    const char *data_type_desc[23] = {"Unknown","8-bit, signed integer",
-       "8-bit, unsigned integer","16-bit, signed integer",
-       "16-bit, unsigned integer","32-bit, signed integer",
-       "32-bit, unsigned integer","IEEE 754 single-precision","RESERVED",
-       "IEEE 754 double-precision","RESERVED","RESERVED",
-       "64-bit, signed integer","64-bit, unsigned integer", "Matlab Array",
-       "Compressed Data","Unicode UTF-8 Encoded Character Data",
-       "Unicode UTF-16 Encoded Character Data",
-       "Unicode UTF-32 Encoded Character Data","","String","Cell Array",
-       "Structure"};
+    int k, l, err = 0;
 
-    if ( matvar == NULL )
-        return;
-    if ( matvar->name )
-        printf("      Name: %s\n", matvar->name);
-    printf("      Rank: %d\n", matvar->rank);
-    if ( matvar->rank == 0 )
-        return;
-    printf("Dimensions: %" SIZE_T_FMTSTR,matvar->dims[0]);
-    nmemb = matvar->dims[0];
-    for ( i = 1; i < matvar->rank; i++ ) {
-        printf(" x %" SIZE_T_FMTSTR,matvar->dims[i]);
-        nmemb *= matvar->dims[i];
-    }
-    printf("\n");
-    printf("Class Type: %s",class_type_desc[matvar->class_type]);
-    if ( matvar->isComplex )
-        printf(" (complex)");
-    else if ( matvar->isLogical )
-        printf(" (logical)");
-    printf("\n");
-    if ( matvar->data_type )
-        printf(" Data Type: %s\n", data_type_desc[matvar->data_type]);
+    if ( NULL == mat || NULL == name || NULL == field_names ||
+         NULL == columns || ncolumns < 1 || NULL == columns[0] ||
+         NULL == columns[0]->dims )
+        return 1;
 
-    if ( MAT_C_STRUCT == matvar->class_type ) {
-        matvar_t **fields = (matvar_t **)matvar->data;
-        int nfields = matvar->internal->num_fields;
-        if ( nmemb*nfields > 0 ) {
-            printf("Fields[%" SIZE_T_FMTSTR "] {\n", nfields*nmemb);
-            for ( i = 0; i < nfields*nmemb; i++ ) {
-                if ( NULL == fields[i] ) {
-                    printf("      Name: %s\n      Rank: %d\n",
-                           matvar->internal->fieldnames[i%nfields],0);
-                } else {
-                    Mat_VarPrint(fields[i],printdata);
-                }
+    nmemb = columns[0]->dims[0];
+    for ( k = 0; k < ncolumns && !err; k++ ) {
+        const matvar_t *column = columns[k];
+
+        if ( NULL == field_names[k] )
+            return 1;
+        for ( l = 0; l < k; l++ ) {
+            if ( !strcmp(field_names[k],field_names[l]) ) {
+                Mat_Critical("Field %s of %s is given twice",field_names[k],
+                             name);
+                return 1;
             }
-            printf("}\n");
-        } else {
-            printf("Fields[%d] {\n", nfields);
-            for ( i = 0; i < nfields; i++ )
-                printf("      Name: %s\n      Rank: %d\n",
-                       matvar->internal->fieldnames[i],0);
-            printf("}\n");
         }
-        return;
-    } else if ( matvar->data == NULL || matvar->data_size < 1 ) {
-        return;
-    } else if ( MAT_C_CELL == matvar->class_type ) {
-        matvar_t **cells = (matvar_t **)matvar->data;
-        int ncells = matvar->nbytes / matvar->data_size;
-        printf("{\n");
-        for ( i = 0; i < ncells; i++ )
-            Mat_VarPrint(cells[i],printdata);
-        printf("}\n");
-        return;
-    } else if ( !printdata ) {
-        return;
+        if ( NULL == column || 2 != column->rank || NULL == column->dims ||
+             column->dims[0] != nmemb || column->isComplex ||
+             (NULL == column->data && column->dims[0]*column->dims[1] > 0) ) {
+            err = 1;
+        } else if ( MAT_C_CHAR == column->class_type ) {
+            err = Mat_SizeOf(column->data_type) < 1 ||
+                  Mat_SizeOf(column->data_type) > 2;
+        } else if ( MAT_C_STRUCT == column->class_type ||
+                    MAT_C_CELL   == column->class_type ||
+                    MAT_C_SPARSE == column->class_type ||
+                    MAT_C_EMPTY  == column->class_type ||
+                    MAT_C_FUNCTION == column->class_type ||
+                    MAT_C_OBJECT == column->class_type ) {
+            err = 1;
+        }
+        if ( err )
+            Mat_Critical("Column %s of %s must be a real numeric or character "
+                         "array with %lu rows",field_names[k],name,
+                         (unsigned long)nmemb);
     }
+    if ( err )
+        return err;
 
-    printf("{\n");
+    if ( 0 == nmemb ) {
+        /* An empty structure array has no elements to encode */
+        matvar_t *matvar;
+        size_t dims[2] = {0,1};
 
-    if ( matvar->rank > 2 ) {
-        printf("I can't print more than 2 dimensions\n");
-    } else if ( matvar->rank == 1 && matvar->dims[0] > 15 ) {
-        printf("I won't print more than 15 elements in a vector\n");
-    } else if ( matvar->rank==2 ) {
-        switch( matvar->class_type ) {
-            case MAT_C_DOUBLE:
-            case MAT_C_SINGLE:
-#ifdef HAVE_MAT_INT64_T
-            case MAT_C_INT64:
-#endif
-#ifdef HAVE_MAT_UINT64_T
-            case MAT_C_UINT64:
-#endif
-            case MAT_C_INT32:
-            case MAT_C_UINT32:
-            case MAT_C_INT16:
-            case MAT_C_UINT16:
-            case MAT_C_INT8:
-            case MAT_C_UINT8:
-            {
-                size_t stride = Mat_SizeOf(matvar->data_type);
-                if ( matvar->isComplex ) {
-                    mat_complex_split_t *complex_data = matvar->data;
-                    char *rp = complex_data->Re;
-                    char *ip = complex_data->Im;
-                   for ( i = 0; i < matvar->dims[0] && i < 15; i++ ) {
-                        for ( j = 0; j < matvar->dims[1] && j < 15; j++ ) {
-                            size_t idx = matvar->dims[0]*j+i;
-                            Mat_PrintNumber(matvar->data_type,rp+idx*stride);
-                            printf(" + ");
-                            Mat_PrintNumber(matvar->data_type,ip+idx*stride);
-                            printf("i ");
-                        }
-                        if ( j < matvar->dims[1] )
-                            printf("...");
-                        printf("\n");
-                    }
-                    if ( i < matvar->dims[0] )
-                        printf(".\n.\n.\n");
-               } else {
-                   char *data = matvar->data;
-                   for ( i = 0; i < matvar->dims[0] && i < 15; i++ ) {
-                        for ( j = 0; j < matvar->dims[1] && j < 15; j++ ) {
-                            size_t idx = matvar->dims[0]*j+i;
-                            Mat_PrintNumber(matvar->data_type,
-                                            data+idx*stride);
-                            printf(" ");
-                        }
-                        if ( j < matvar->dims[1] )
-                            printf("...");
-                        printf("\n");
-                    }
-                    if ( i < matvar->dims[0] )
-                        printf(".\n.\n.\n");
-                }
-                break;
-            }
-            case MAT_C_CHAR:
-            {
-                char *data = matvar->data;
-                if ( !printdata )
-                    break;
-                for ( i = 0; i < matvar->dims[0]; i++ ) {
-                    for ( j = 0; j < matvar->dims[1]; j++ )
-                        printf("%c",data[j*matvar->dims[0]+i]);
-                    printf("\n");
-                }
-                break;
-            }
-            case MAT_C_SPARSE:
-            {
-                mat_sparse_t *sparse;
-                size_t stride = Mat_SizeOf(matvar->data_type);
-#if !defined(EXTENDED_SPARSE)
-                if ( MAT_T_DOUBLE != matvar->data_type )
-                    break;
+        matvar = Mat_VarCreateStruct(name,2,dims,(const char **)field_names,
+                                     ncolumns);
+        if ( NULL == matvar )
+            return 1;
+        err = Mat_VarWrite(mat,matvar,compress);
+        Mat_VarFree(matvar);
+    } else if ( mat->version == MAT_FT_MAT5 ) {
+        Mat_AsyncWait5(mat);
+        err = Mat_VarWriteStructColumns5(mat,name,ncolumns,field_names,
+                                         columns,compress);
+#if defined(MAT73) && MAT73
+    } else if ( mat->version == MAT_FT_MAT73 ) {
+        err = Mat_VarWriteStructColumns73(mat,name,ncolumns,field_names,
+                                          columns,compress);
 #endif
-                sparse = matvar->data;
-                if ( matvar->isComplex ) {
-                    mat_complex_split_t *complex_data = sparse->data;
-                    char *re,*im;
-                    re = complex_data->Re;
-                    im = complex_data->Im;
-                    for ( i = 0; i < sparse->njc-1; i++ ) {
-                        for (j = sparse->jc[i];
-                             j<sparse->jc[i+1] && j<sparse->ndata;j++ ) {
-                            printf("    (%d,%d)  ",sparse->ir[j]+1,i+1);
-                            Mat_PrintNumber(matvar->data_type,re+j*stride);
-                            printf(" + ");
-                            Mat_PrintNumber(matvar->data_type,im+j*stride);
-                            printf("i\n");
-                        }
-                    }
-                } else {
-                    char *data;
-                    data = sparse->data;
-                    for ( i = 0; i < sparse->njc-1; i++ ) {
-                        for (j = sparse->jc[i];
-                             j<sparse->jc[i+1] && j<sparse->ndata;j++ ){
-                            printf("    (%d,%d)  ",sparse->ir[j]+1,i+1);
-                            Mat_PrintNumber(matvar->data_type,data+j*stride);
-                            printf("\n");
-                        }
-                    }
-                }
-                break;
-            } /* case MAT_C_SPARSE: */
-            default:
-                break;
-        } /* switch( matvar->class_type ) */
+    } else {
+        Mat_Critical("Structure arrays can not be written to this MAT file");
+        err = 1;
     }
 
-    printf("}\n");
-
-    return;
+    return err;
 }
 
-/** @brief Reads MAT variable data from a file
+/** @brief Reads a cell array of strings into a string pool
  *
- * Reads data from a MAT variable.  The variable must have been read by
- * Mat_VarReadInfo.
+ * Reads the cell array of strings @c name into a mat_cellstr_t holding the
+ * strings converted to UTF-8 in one pool, without a variable for each cell.
+ * Every cell must be a character array with at most one row, an empty cell
+ * gives an empty string.  The strings are decoded as they are read from the
+ * file.
  * @ingroup MAT
- * @param mat MAT file to read data from
- * @param matvar MAT variable information
- * @param data pointer to store data in (must be pre-allocated)
- * @param start array of starting indeces
- * @param stride stride of data
- * @param edge array specifying the number to read in each direction
- * @retval 0 on success
+ * @param mat Pointer to the MAT file
+ * @param name Name of the cell array
+ * @return Pointer to the strings, which should be freed with Mat_CellStrFree,
+ *         or NULL on error
  */
-int
-Mat_VarReadData(mat_t *mat,matvar_t *matvar,void *data,
-      int *start,int *stride,int *edge)
+mat_cellstr_t *
+Mat_VarReadCellStr(mat_t *mat,const char *name)
 {
-    int err = 0;
+    matvar_t *matvar;
+    mat_cellstr_t *cellstr = NULL;
+    long fpos = 0;
+    int  k, shallow, err = 1;
 
-    switch ( matvar->class_type ) {
-        case MAT_C_DOUBLE:
-        case MAT_C_SINGLE:
-        case MAT_C_INT64:
-        case MAT_C_UINT64:
-        case MAT_C_INT32:
-        case MAT_C_UINT32:
-        case MAT_C_INT16:
-        case MAT_C_UINT16:
-        case MAT_C_INT8:
-        case MAT_C_UINT8:
-            break;
-        default:
-            return -1;
-    }
+    if ( NULL == mat || NULL == name )
+        return NULL;
 
-    switch ( mat->version ) {
-        case MAT_FT_MAT73:
+    /* The cells are read with the strings */
+    Mat_AsyncWait5(mat);
+    if ( MAT_FT_MAT73 != mat->version )
+        fpos = ftell(mat->fp);
+    shallow = mat->shallow;
+    mat->shallow = 1;
+    matvar = Mat_VarReadInfo(mat,name);
+    mat->shallow = shallow;
+    if ( NULL == matvar ) {
+        /* Nothing to read */
+    } else if ( MAT_C_CELL != matvar->class_type ) {
+        Mat_Critical("%s is not a cell array of strings",name);
+    } else if ( NULL != (cellstr = Mat_Calloc(mat->allocator,1,
+                                                sizeof(*cellstr))) ) {
+        size_t nstrings = 1;
+
+        for ( k = 0; k < matvar->rank; k++ )
+            nstrings *= matvar->dims[k];
+        cellstr->allocator = mat->allocator;
+        cellstr->rank     = matvar->rank;
+        cellstr->nstrings = nstrings;
+        cellstr->dims     = Mat_Malloc(mat->allocator,
+                                       matvar->rank*sizeof(*cellstr->dims));
+        cellstr->offsets  = Mat_Malloc(mat->allocator,
+                                       (nstrings+1)*sizeof(*cellstr->offsets));
+        if ( NULL != cellstr->dims && NULL != cellstr->offsets ) {
+            memcpy(cellstr->dims,matvar->dims,
+                   matvar->rank*sizeof(*cellstr->dims));
+            cellstr->offsets[0] = 0;
+            if ( 0 == nstrings ) {
+                err = 0;
+            } else if ( MAT_FT_MAT5 == mat->version ) {
+                err = Mat_VarReadCellStr5(mat,matvar,cellstr);
 #if defined(MAT73) && MAT73
-            err = Mat_VarReadData73(mat,matvar,data,start,stride,edge);
-#else
-            err = 1;
+            } else if ( MAT_FT_MAT73 == mat->version ) {
+                err = Mat_VarReadCellStr73(mat,matvar,cellstr);
 #endif
-            break;
-        case MAT_FT_MAT5:
-            err = ReadData5(mat,matvar,data,start,stride,edge);
-            break;
-        case MAT_FT_MAT4:
-            err = ReadData4(mat,matvar,data,start,stride,edge);
-            break;
+            }
+        }
+        if ( !err && cellstr->offsets[nstrings] > 0 ) {
+            /* Release the space reserved for the conversion */
+            char *pool = Mat_Realloc(cellstr->allocator,cellstr->pool,
+                                     cellstr->offsets[nstrings]);
+            if ( NULL != pool )
+                cellstr->pool = pool;
+        }
     }
+    Mat_VarFree(matvar);
+    if ( MAT_FT_MAT73 != mat->version )
+        fseek(mat->fp,fpos,SEEK_SET);
 
-    return err;
+    if ( err ) {
+        Mat_CellStrFree(cellstr);
+        cellstr = NULL;
+    }
+    return cellstr;
 }
 
-/** @brief Reads all the data for a matlab variable
+/** @brief Frees the memory of a cell array of strings
  *
- * Allocates memory for an reads the data for a given matlab variable.
+ * Frees the pool, offsets and dimensions of a cell array of strings read by
+ * Mat_VarReadCellStr, and the structure itself.
  * @ingroup MAT
- * @param mat Matlab MAT file structure pointer
- * @param matvar Variable whose data is to be read
- * @returns non-zero on error
+ * @param cellstr Pointer to the cell array of strings
  */
-int
-Mat_VarReadDataAll(mat_t *mat,matvar_t *matvar)
+void
+Mat_CellStrFree(mat_cellstr_t *cellstr)
 {
-    int err = 0;
+    if ( NULL == cellstr )
+        return;
+    Mat_Free(cellstr->allocator,cellstr->dims);
+    Mat_Free(cellstr->allocator,cellstr->offsets);
+    Mat_Free(cellstr->allocator,cellstr->pool);
+    Mat_Free(cellstr->allocator,cellstr);
+}
 
-    if ( (mat == NULL) || (matvar == NULL) )
-        err = 1;
-    else
-        ReadData(mat,matvar);
+/** @if mat_devman
+ * @brief Returns a string of a cell array of strings
+ *
+ * String i ends at the first NUL byte or at @c offsets[i+1].
+ * @ingroup mat_internal
+ * @param cellstr Cell array of strings
+ * @param i 0-relative index of the string
+ * @param len Pointer to store the number of bytes of the string
+ * @return Pointer to the string in the pool
+ * @endif
+ */
+const char *
+Mat_CellStrGet(const mat_cellstr_t *cellstr,size_t i,size_t *len)
+{
+    const char *str = cellstr->pool+cellstr->offsets[i], *end;
 
-    return err;
+    *len = cellstr->offsets[i+1]-cellstr->offsets[i];
+    end  = *len > 0 ? memchr(str,'\0',*len) : NULL;
+    if ( NULL != end )
+        *len = end-str;
+    return str;
 }
 
-/** @brief Reads a subset of a MAT variable using a 1-D indexing
+/** @brief Writes a cell array of strings from a string pool
  *
- * Reads data from a MAT variable using a linear (1-D) indexing mode. The
- * variable must have been read by Mat_VarReadInfo.
+ * Writes the strings of @c cellstr as a cell array of character arrays
+ * @c name, which is the inverse of Mat_VarReadCellStr.  String i of the pool
+ * is the UTF-8 string from @c offsets[i] up to the first NUL byte or to
+ * @c offsets[i+1], and it is written as a 1-by-n character array of 16-bit
+ * characters.  No variable is created for the cells.  The variable will be
+ * written to the end of the file.
  * @ingroup MAT
- * @param mat MAT file to read data from
- * @param matvar MAT variable information
- * @param data pointer to store data in (must be pre-allocated)
- * @param start starting index
- * @param stride stride of data
- * @param edge number of elements to read
+ * @param mat MAT file to write to
+ * @param name Name of the cell array
+ * @param cellstr Cell array of strings
+ * @param compress Whether or not to compress the data
  * @retval 0 on success
  */
 int
-Mat_VarReadDataLinear(mat_t *mat,matvar_t *matvar,void *data,int start,
-    int stride,int edge)
+Mat_VarWriteCellStr(mat_t *mat,const char *name,const mat_cellstr_t *cellstr,
+    enum matio_compression compress)
 {
-    int err = 0;
+    size_t i, nstrings = 1;
+    int k, err = 0;
 
-    switch ( matvar->class_type ) {
-        case MAT_C_DOUBLE:
-        case MAT_C_SINGLE:
-        case MAT_C_INT64:
-        case MAT_C_UINT64:
-        case MAT_C_INT32:
-        case MAT_C_UINT32:
-        case MAT_C_INT16:
-        case MAT_C_UINT16:
-        case MAT_C_INT8:
-        case MAT_C_UINT8:
-            break;
-        default:
-            return -1;
+    if ( NULL == mat || NULL == name || NULL == cellstr ||
+         cellstr->rank < 2 || NULL == cellstr->dims )
+        return 1;
+
+    for ( k = 0; k < cellstr->rank; k++ )
+        nstrings *= cellstr->dims[k];
+    if ( nstrings != cellstr->nstrings ||
+         (nstrings > 0 && NULL == cellstr->offsets) ) {
+        err = 1;
+    } else {
+        for ( i = 0; i < nstrings && !err; i++ ) {
+            if ( cellstr->offsets[i+1] < cellstr->offsets[i] )
+                err = 1;
+        }
+        if ( nstrings > 0 && cellstr->offsets[nstrings] > 0 &&
+             NULL == cellstr->pool )
+            err = 1;
+    }
+    if ( err ) {
+        Mat_Critical("The strings of %s do not match its dimensions",name);
+        return err;
     }
 
-    switch ( mat->version ) {
-        case MAT_FT_MAT73:
+    if ( 0 == nstrings ) {
+        /* An empty cell array has no strings to encode */
+        matvar_t *matvar;
+
+        matvar = Mat_VarCreate(name,MAT_C_CELL,MAT_T_CELL,cellstr->rank,
+                               cellstr->dims,NULL,0);
+        if ( NULL == matvar )
+            return 1;
+        err = Mat_VarWrite(mat,matvar,compress);
+        Mat_VarFree(matvar);
+    } else if ( mat->version == MAT_FT_MAT5 ) {
+        Mat_AsyncWait5(mat);
+        err = Mat_VarWriteCellStr5(mat,name,cellstr,compress);
 #if defined(MAT73) && MAT73
-            err = Mat_VarReadDataLinear73(mat,matvar,data,start,stride,edge);
-#else
-            err = 1;
+    } else if ( mat->version == MAT_FT_MAT73 ) {
+        err = Mat_VarWriteCellStr73(mat,name,cellstr,compress);
 #endif
-            break;
-        case MAT_FT_MAT5:
-            err = Mat_VarReadDataLinear5(mat,matvar,data,start,stride,edge);
-            break;
-        case MAT_FT_MAT4:
-            err = Mat_VarReadDataLinear4(mat,matvar,data,start,stride,edge);
-            break;
+    } else {
+        Mat_Critical("Cell arrays can not be written to this MAT file");
+        err = 1;
     }
 
     return err;
 }
 
-/** @brief Reads the information of the next variable in a MAT file
+/** @brief Sets a function releasing the data of a variable
  *
- * Reads the next variable's information (class,flags-complex/global/logical,
- * rank,dimensions, name, etc) from the Matlab MAT file.  After reading, the MAT
- * file is positioned past the current variable.
+ * Hands the data of a numeric, character or sparse variable to a
+ * deallocator.  When the library releases the data, by Mat_VarFree or when
+ * Mat_VarReadInto reads a variable of another size into @c matvar, it calls
+ * @c data_free with the data pointer of the variable and @c context instead
+ * of freeing the data itself.  The pointer is @c matvar->data, so for
+ * complex and sparse variables it is the mat_complex_split_t or mat_sparse_t
+ * structure.
+ *
+ * With a variable created by Mat_VarCreate with MAT_F_DONT_COPY_DATA, the
+ * deallocator transfers the ownership of the caller's buffer to the variable,
+ * so data owned by another library is written and released without a copy.
+ * With a variable read from a file, the deallocator takes the ownership of
+ * the data allocated by the library, for example to hand it to another
+ * library; the data was allocated with the allocator of the file set by
+ * Mat_SetAllocator.  Mat_VarReadInto decodes into the buffers of a variable
+ * with a deallocator when they are large enough, and the buffers keep the
+ * deallocator.
  * @ingroup MAT
- * @param mat Pointer to the MAT file
- * @return Pointer to the @ref matvar_t structure containing the MAT
- * variable information
+ * @param matvar MAT variable
+ * @param data_free Function releasing the data, or NULL to let the library
+ *        release it
+ * @param context Pointer passed to @c data_free
+ * @retval 0 on success, nonzero for structures, cell arrays and variables
+ *         held in an arena
  */
-matvar_t *
-Mat_VarReadNextInfo( mat_t *mat )
+int
+Mat_VarSetDataDeallocator(matvar_t *matvar,
+    void (*data_free)(void *data,void *context),void *context)
 {
-    matvar_t *matvar = NULL;
-    if( mat == NULL )
-        return NULL;
-
-    switch ( mat->version ) {
-        case MAT_FT_MAT5:
-            matvar = Mat_VarReadNextInfo5(mat);
-            break;
-        case MAT_FT_MAT73:
-#if defined(MAT73) && MAT73
-            matvar = Mat_VarReadNextInfo73(mat);
-#endif
-            break;
-        case MAT_FT_MAT4:
-            matvar = Mat_VarReadNextInfo4(mat);
-            break;
-    }
-
-    return matvar;
+    if ( NULL == matvar || NULL != matvar->internal->arena ||
+         MAT_C_STRUCT == matvar->class_type ||
+         MAT_C_CELL == matvar->class_type )
+        return 1;
+    matvar->internal->data_free = data_free;
+    matvar->internal->data_free_context = context;
+    return 0;
 }
 
-/** @brief Reads the information of a variable with the given name from a MAT file
+/** @brief Sets the layout of the data of a variable when read
  *
- * Reads the named variable (or the next variable if name is NULL) information
- * (class,flags-complex/global/logical,rank,dimensions,and name) from the
- * Matlab MAT file
+ * Sets options for the memory layout of the data read by Mat_VarReadDataAll
+ * and Mat_VarReadData.  The variable must have been read by Mat_VarReadInfo
+ * and its data must not have been read yet.
  * @ingroup MAT
- * @param mat Pointer to the MAT file
- * @param name Name of the variable to read
- * @return Pointer to the @ref matvar_t structure containing the MAT
- * variable information
+ * @param matvar MAT variable information
+ * @param opt 0, or bitwise or of the following options:
+ * - MAT_F_ROW_MAJOR to store the data of numeric and character arrays in
+ *       row-major (C) order instead of the column-major order of the file.
+ *       Each block of data is stored at its row-major place as it is
+ *       decoded, except for the slabs of version 4 and 5 files read by
+ *       Mat_VarReadData, which are reordered in place.  This applies to the
+ *       elements of cell arrays and structures as well.  Linear reads with
+ *       Mat_VarReadDataLinear are not affected.
+ * - MAT_F_COMPLEX_INTERLEAVED to store the data of complex numeric arrays as a
+ *       single buffer of interleaved real and imaginary parts (re,im,re,...)
+ *       instead of a mat_complex_split_t.  The parts are interleaved as they
+ *       are decoded.  This applies to the slabs read by Mat_VarReadData and
+ *       Mat_VarReadDataLinear and to the elements of cell arrays and
+ *       structures.  Sparse arrays are always split.
+ * @retval 0 on success
  */
-matvar_t *
-Mat_VarReadInfo( mat_t *mat, const char *name )
+int
+Mat_VarSetReadFlags(matvar_t *matvar,int opt)
 {
+    if ( NULL == matvar )
+        return 1;
 
-    long  fpos;
-    matvar_t *matvar = NULL;
-
-    if ( (mat == NULL) || (name == NULL) )
-        return NULL;
-
-    if ( mat->version == MAT_FT_MAT73 ) {
-        do {
-            matvar = Mat_VarReadNextInfo(mat);
-            if ( matvar != NULL ) {
-                if ( !matvar->name ) {
-                    Mat_VarFree(matvar);
-                    matvar = NULL;
-                } else if ( strcmp(matvar->name,name) ) {
-                    Mat_VarFree(matvar);
-                    matvar = NULL;
-                }
-            } else {
-                Mat_Critical("An error occurred in reading the MAT file");
-                break;
-            }
-        } while ( NULL == matvar && mat->next_index < mat->num_datasets);
-    } else {
-        fpos = ftell(mat->fp);
-        fseek(mat->fp,mat->bof,SEEK_SET);
-        do {
-            matvar = Mat_VarReadNextInfo(mat);
-            if ( matvar != NULL ) {
-                if ( !matvar->name ) {
-                    Mat_VarFree(matvar);
-                    matvar = NULL;
-                } else if ( strcmp(matvar->name,name) ) {
-                    Mat_VarFree(matvar);
-                    matvar = NULL;
-                }
-            } else {
-                Mat_Critical("An error occurred in reading the MAT file");
-                break;
-            }
-        } while ( !matvar && !feof(((FILE *)mat->fp)) );
+    if ( MAT_C_CELL == matvar->class_type ||
+         MAT_C_STRUCT == matvar->class_type ) {
+        /* The elements are decoded with the same layout */
+        matvar_t **elems = matvar->data;
+        size_t i, nmemb = 0;
 
-        fseek(mat->fp,fpos,SEEK_SET);
+        if ( NULL != elems && matvar->data_size > 0 )
+            nmemb = matvar->nbytes / matvar->data_size;
+        for ( i = 0; i < nmemb; i++ ) {
+            if ( NULL != elems[i] )
+                Mat_VarSetReadFlags(elems[i],opt);
+        }
+    } else if ( NULL != matvar->data ) {
+        /* The layout of data that was already read can not change */
+        return 1;
     }
-    return matvar;
+    matvar->internal->read_flags = opt &
+        (MAT_F_ROW_MAJOR | MAT_F_COMPLEX_INTERLEAVED);
+
+    return 0;
 }
 
-/** @brief Reads the variable with the given name from a MAT file
+/** @brief Sets the chunk shape of a variable written to a v7.3 MAT file
  *
- * Reads the next variable in the Matlab MAT file
+ * Sets the shape and size of the HDF5 chunks used by Mat_VarWrite to store
+ * the variable in a version 7.3 MAT file.  Chunks should match the slabs that
+ * will be read: MAT_CHUNK_COLUMN stores whole columns together for column
+ * reads, and MAT_CHUNK_TILE uses chunks of equal extent in each dimension for
+ * blocks and for rows and columns alike.  A chunked layout is used even if
+ * the variable is not compressed.  The hint applies to the elements of cell
+ * arrays and structures as well, and is ignored for other file versions.
  * @ingroup MAT
- * @param mat Pointer to the MAT file
- * @param name Name of the variable to read
- * @return Pointer to the @ref matvar_t structure containing the MAT
- * variable information
+ * @param matvar MAT variable
+ * @param shape Chunk shape hint
+ * @param chunk_bytes Target size of a chunk in bytes, 0 for the default of
+ *        one column with MAT_CHUNK_COLUMN and 4096 elements otherwise
+ * @retval 0 on success
  */
-matvar_t *
-Mat_VarRead( mat_t *mat, const char *name )
+int
+Mat_VarSetChunking(matvar_t *matvar,enum matio_chunking shape,
+    size_t chunk_bytes)
 {
-    long  fpos = 0;
-    matvar_t *matvar = NULL;;
+    if ( NULL == matvar )
+        return 1;
 
-    if ( (mat == NULL) || (name == NULL) )
-        return NULL;
+    switch ( shape ) {
+        case MAT_CHUNK_DEFAULT:
+        case MAT_CHUNK_COLUMN:
+        case MAT_CHUNK_TILE:
+            break;
+        default:
+            return 1;
+    }
 
-    if ( MAT_FT_MAT73 != mat->version )
-        fpos = ftell(mat->fp);
+    if ( MAT_C_CELL == matvar->class_type ||
+         MAT_C_STRUCT == matvar->class_type ) {
+        matvar_t **elems = matvar->data;
+        size_t i, nmemb = 0;
 
-    matvar = Mat_VarReadInfo(mat,name);
-    if ( matvar )
-        ReadData(mat,matvar);
+        if ( NULL != elems && matvar->data_size > 0 )
+            nmemb = matvar->nbytes / matvar->data_size;
+        for ( i = 0; i < nmemb; i++ ) {
+            if ( NULL != elems[i] )
+                Mat_VarSetChunking(elems[i],shape,chunk_bytes);
+        }
+    }
+    matvar->internal->chunk_shape = shape;
+    matvar->internal->chunk_bytes = chunk_bytes;
 
-    if ( MAT_FT_MAT73 != mat->version )
-        fseek(mat->fp,fpos,SEEK_SET);
-    return matvar;
+    return 0;
 }
 
-/** @brief Reads the next variable in a MAT file
+/** @brief Applies a scale and offset to the data of a variable when read
  *
- * Reads the next variable in the Matlab MAT file
+ * Sets an affine transform @c v*scale+offset that is applied to each element
+ * of the variable as it is decoded by Mat_VarReadDataAll, Mat_VarReadData and
+ * Mat_VarReadDataLinear.  The data is converted to the floating-point class
+ * @c class_type in the same pass, so integer-encoded measurements do not need
+ * a separate conversion loop.  The variable must have been read by
+ * Mat_VarReadInfo and its data must not have been read yet.  On success, the
+ * class of @c matvar is changed to @c class_type, so buffers passed to the
+ * slab routines must be sized accordingly.
  * @ingroup MAT
- * @param mat Pointer to the MAT file
- * @return Pointer to the @ref matvar_t structure containing the MAT
- * variable information
+ * @param matvar MAT variable information
+ * @param scale Scale factor applied to each element
+ * @param offset Offset added to each element after scaling
+ * @param class_type Class of the scaled data (MAT_C_DOUBLE or MAT_C_SINGLE)
+ * @retval 0 on success
  */
-matvar_t *
-Mat_VarReadNext( mat_t *mat )
+int
+Mat_VarSetScaling(matvar_t *matvar,double scale,double offset,
+    enum matio_classes class_type)
 {
-    long fpos = 0;
-    matvar_t *matvar = NULL;
+    if ( NULL == matvar || NULL != matvar->data )
+        return 1;
+    else if ( matvar->isComplex )
+        return 1;
 
-    if ( mat->version != MAT_FT_MAT73 ) {
-        if ( feof(((FILE *)mat->fp)) )
-            return NULL;
-        /* Read position so we can reset the file position if an error occurs */
-        fpos = ftell(mat->fp);
+    switch ( matvar->class_type ) {
+        case MAT_C_DOUBLE:
+        case MAT_C_SINGLE:
+        case MAT_C_INT64:
+        case MAT_C_UINT64:
+        case MAT_C_INT32:
+        case MAT_C_UINT32:
+        case MAT_C_INT16:
+        case MAT_C_UINT16:
+        case MAT_C_INT8:
+        case MAT_C_UINT8:
+            break;
+        default:
+            return 1;
     }
-    matvar = Mat_VarReadNextInfo(mat);
-    if ( matvar )
-        ReadData(mat,matvar);
-    else if (mat->version != MAT_FT_MAT73 )
-        fseek(mat->fp,fpos,SEEK_SET);
-    return matvar;
+
+    if ( MAT_C_DOUBLE != class_type && MAT_C_SINGLE != class_type ) {
+        return 1;
+    } else if ( MAT_C_SINGLE == class_type && NULL != matvar->internal->fp &&
+                MAT_FT_MAT4 == matvar->internal->fp->version ) {
+        /* Version 4 files are always read as double-precision */
+        return 1;
+    }
+
+    matvar->internal->scaling = 1;
+    matvar->internal->scale   = scale;
+    matvar->internal->offset  = offset;
+    matvar->class_type        = class_type;
+    matvar->data_size         = Mat_SizeOfClass(class_type);
+    matvar->isLogical         = 0;
+
+    return 0;
 }
 
 /** @brief Writes the given MAT variable to a MAT file
@@ -1733,7 +5733,8 @@ Mat_VarWriteInfo(mat_t *mat, matvar_t *matvar )
 {
     if ( mat == NULL || matvar == NULL || mat->fp == NULL )
         return -1;
-    else if ( mat->version != MAT_FT_MAT4 )
+    Mat_AsyncWait5(mat);
+    if ( mat->version != MAT_FT_MAT4 )
         WriteInfo5(mat,matvar);
 #if 0
     else if ( mat->version == MAT_FT_MAT4 )
@@ -1762,6 +5763,7 @@ Mat_VarWriteData(mat_t *mat,matvar_t *matvar,void *data,
 {
     int err = 0, k, N = 1;
 
+    Mat_AsyncWait5(mat);
     fseek(mat->fp,matvar->internal->datapos+8,SEEK_SET);
 
     if ( mat == NULL || matvar == NULL || data == NULL ) {
@@ -1817,7 +5819,9 @@ Mat_VarWriteData(mat_t *mat,matvar_t *matvar,void *data,
 /** @brief Writes the given MAT variable to a MAT file
  *
  * Writes the MAT variable information stored in matvar to the given MAT file.
- * The variable will be written to the end of the file.
+ * The variable will be written to the end of the file.  With asynchronous
+ * writes (see Mat_SetAsyncWrite), the variable is only queued, and whether
+ * it was written is returned by Mat_Flush or Mat_Close.
  * @ingroup MAT
  * @param mat MAT file to write to
  * @param matvar MAT variable information to write
@@ -1830,6 +5834,8 @@ Mat_VarWrite(mat_t *mat,matvar_t *matvar,enum matio_compression compress)
 {
     if ( mat == NULL || matvar == NULL )
         return -1;
+    else if ( mat->version == MAT_FT_MAT5 && NULL != mat->async )
+        return Mat_VarWriteAsync5(mat,matvar,compress);
     else if ( mat->version == MAT_FT_MAT5 )
         Mat_VarWrite5(mat,matvar,compress);
 #if defined(MAT73) && MAT73
@@ -35,6 +35,90 @@
 #include "matio_private.h"
 #include "mat4.h"
 
+/** @if mat_devman
+ * @brief Reads a block of data and stores it at its place in @c data
+ *
+ * @ingroup mat_internal
+ * @param matvar MAT variable pointer
+ * @param data Pointer to the first element of the part in the buffer
+ * @param stride Stride of @c data in elements
+ * @param buf Block of @c n elements just read
+ * @param elem_size Size of each element in bytes
+ * @param first Index of the first element of the block
+ * @param n Number of elements in the block
+ * @endif
+ */
+static void
+StoreBlock4(matvar_t *matvar,void *data,size_t stride,const void *buf,
+    size_t elem_size,size_t first,size_t n)
+{
+    if ( matvar->internal->read_flags & MAT_F_ROW_MAJOR )
+        Mat_ScatterRowMajor(data,stride,buf,1,elem_size,matvar->rank,
+                            matvar->dims,first,n);
+    else
+        Mat_CopyStrided((char*)data+first*stride*elem_size,stride,buf,1,
+                        elem_size,n);
+}
+
+/** @if mat_devman
+ * @brief Reads one part of the numeric data of a variable
+ *
+ * Reads the part directly into @c data, unless it is stored at every second
+ * element of an interleaved buffer or in row-major order.  Then the part is
+ * read a block at a time and each block is stored at its place in @c data.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar MAT variable pointer
+ * @param data Pointer to the first element of the part in the buffer
+ * @param stride Stride of @c data in elements
+ * @param N Number of elements in the part
+ * @endif
+ */
+static void
+ReadDoubleData4(mat_t *mat,matvar_t *matvar,double *data,size_t stride,
+    unsigned int N)
+{
+    double buf[MAT_INTERLEAVE_BLOCK];
+    unsigned int i, n;
+
+    if ( 1 == stride && !(matvar->internal->read_flags & MAT_F_ROW_MAJOR) ) {
+        ReadDoubleData(mat,data,matvar->data_type,N);
+        return;
+    }
+    for ( i = 0; i < N; i += n ) {
+        n = (N-i < MAT_INTERLEAVE_BLOCK) ? N-i : MAT_INTERLEAVE_BLOCK;
+        ReadDoubleData(mat,buf,matvar->data_type,n);
+        StoreBlock4(matvar,data,stride,buf,sizeof(double),i,n);
+    }
+}
+
+/** @if mat_devman
+ * @brief Reads the character data of a variable
+ *
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar MAT variable pointer
+ * @param data Pointer to store the data
+ * @param N Number of elements
+ * @endif
+ */
+static void
+ReadCharData4(mat_t *mat,matvar_t *matvar,mat_uint8_t *data,unsigned int N)
+{
+    mat_uint8_t buf[8*MAT_INTERLEAVE_BLOCK];
+    unsigned int i, n;
+
+    if ( !(matvar->internal->read_flags & MAT_F_ROW_MAJOR) ) {
+        ReadUInt8Data(mat,data,matvar->data_type,N);
+        return;
+    }
+    for ( i = 0; i < N; i += n ) {
+        n = (N-i < sizeof(buf)) ? N-i : sizeof(buf);
+        ReadUInt8Data(mat,buf,matvar->data_type,n);
+        StoreBlock4(matvar,data,1,buf,1,i,n);
+    }
+}
+
 /** @if mat_devman
  * @brief Reads the data of a version 4 MAT file variable
  *
@@ -54,24 +138,34 @@ Read4(mat_t *mat,matvar_t *matvar)
     switch ( matvar->class_type ) {
         case MAT_C_DOUBLE:
             matvar->data_size = sizeof(double);
-            if ( matvar->isComplex ) {
+            if ( MAT_IS_INTERLEAVED(matvar) ) {
+                double *data;
+
+                matvar->nbytes = N*sizeof(double);
+                data           = Mat_VarDataAlloc(matvar,2*matvar->nbytes);
+                matvar->data   = data;
+                if ( data != NULL ) {
+                    ReadDoubleData4(mat,matvar,data,2,N);
+                    ReadDoubleData4(mat,matvar,data+1,2,N);
+                }
+            } else if ( matvar->isComplex ) {
                 mat_complex_split_t *complex_data;
 
                 matvar->nbytes   = N*sizeof(double);
-                complex_data     = malloc(sizeof(*complex_data));
-                complex_data->Re = malloc(matvar->nbytes);
-                complex_data->Im = malloc(matvar->nbytes);
+                complex_data     = Mat_VarMemAlloc(matvar,sizeof(*complex_data));
+                complex_data->Re = Mat_VarDataAlloc(matvar,matvar->nbytes);
+                complex_data->Im = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 matvar->data     = complex_data;
                 if ( complex_data != NULL &&
                     complex_data->Re != NULL && complex_data->Im != NULL ) {
-                    ReadDoubleData(mat, complex_data->Re, matvar->data_type, N);
-                    ReadDoubleData(mat, complex_data->Im, matvar->data_type, N);
+                    ReadDoubleData4(mat,matvar,complex_data->Re,1,N);
+                    ReadDoubleData4(mat,matvar,complex_data->Im,1,N);
                 }
             } else {
                 matvar->nbytes = N*sizeof(double);
-                matvar->data   = malloc(matvar->nbytes);
+                matvar->data   = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 if ( matvar->data != NULL )
-                    ReadDoubleData(mat, matvar->data, matvar->data_type, N);
+                    ReadDoubleData4(mat,matvar,matvar->data,1,N);
             }
             /* Update data type to match format of matvar->data */
             matvar->data_type = MAT_T_DOUBLE;
@@ -79,11 +173,11 @@ Read4(mat_t *mat,matvar_t *matvar)
         case MAT_C_CHAR:
             matvar->data_size = 1;
             matvar->nbytes = N;
-            matvar->data = malloc(matvar->nbytes);
+            matvar->data = Mat_VarDataAlloc(matvar,matvar->nbytes);
             if ( NULL == matvar->data )
                 Mat_Critical("Memory allocation failure");
             else
-                ReadUInt8Data(mat,matvar->data,matvar->data_type,N);
+                ReadCharData4(mat,matvar,matvar->data,N);
             matvar->data_type = MAT_T_UINT8;
             break;
         default:
@@ -139,6 +233,9 @@ ReadData4(mat_t *mat,matvar_t *matvar,void *data,
         default:
             return 1;
     }
+    /* Scaled data is converted to the class requested by Mat_VarSetScaling */
+    if ( matvar->internal->scaling )
+        class_type = matvar->class_type;
 
     if ( matvar->rank == 2 ) {
         if ( stride[0]*(edge[0]-1)+start[0]+1 > matvar->dims[0] )
@@ -249,7 +346,7 @@ Mat_VarReadNextInfo4(mat_t *mat)
 
     if ( mat == NULL || mat->fp == NULL )
         return NULL;
-    else if ( NULL == (matvar = Mat_VarCalloc()) )
+    else if ( NULL == (matvar = Mat_VarCallocMem(mat->allocator,NULL)) )
         return NULL;
 
     matvar->internal->fp   = mat;
@@ -337,7 +434,7 @@ Mat_VarReadNextInfo4(mat_t *mat)
             return NULL;
     }
     matvar->rank = 2;
-    matvar->dims = malloc(2*sizeof(*matvar->dims));
+    matvar->dims = Mat_VarMemAlloc(matvar,2*sizeof(*matvar->dims));
     if ( NULL == matvar->dims ) {
         Mat_VarFree(matvar);
         return NULL;
@@ -376,7 +473,7 @@ Mat_VarReadNextInfo4(mat_t *mat)
         Mat_VarFree(matvar);
         return NULL;
     }
-    matvar->name = malloc(tmp);
+    matvar->name = Mat_VarMemAlloc(matvar,tmp);
     if ( NULL == matvar->name ) {
         Mat_VarFree(matvar);
         return NULL;
@@ -38,13 +38,97 @@
 #include <time.h>
 #include "matio_private.h"
 #include "mat5.h"
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+#   include <pthread.h>
+#endif
 
 #define TYPE_FROM_TAG(a)          (enum matio_types)((a) & 0x000000ff)
 #define CLASS_FROM_ARRAY_FLAGS(a) (enum matio_classes)((a) & 0x000000ff)
 #define CLASS_TYPE_MASK           0x000000ff
+/* Position n of an encoding buffer, NULL when only computing sizes */
+#define ENCODE_PTR(buf,n)         (NULL == (buf) ? NULL : (buf)+(n))
+
+static size_t GetStructFieldBufSize(matvar_t *matvar);
+static size_t GetCellArrayFieldBufSize(matvar_t *matvar);
+static int WriteEmptyCharData(mat_t *mat, int N, enum matio_types data_type);
+static int WriteEmptyData(mat_t *mat,int N,enum matio_types data_type);
+static int ReadNumericData5(mat_t *mat,matvar_t *matvar,void *data,
+               enum matio_types packed_type,size_t N);
+static void ReadNumeric5(mat_t *mat,matvar_t *matvar,void *data,size_t N,
+               size_t stride);
+static void ReadInterleaved5(mat_t *mat,matvar_t *matvar,size_t N);
+static int IsContainer5(const matvar_t *matvar);
+static int ReadNextCell( mat_t *mat, matvar_t *matvar );
+static int ReadNextStructField( mat_t *mat, matvar_t *matvar );
+static int ReadNextFunctionHandle(mat_t *mat, matvar_t *matvar);
+static matvar_t *VarCallocArena5(mat_t *mat);
+static int WriteCellArrayFieldInfo(mat_t *mat,matvar_t *matvar);
+static size_t StructColumnElement5(const matvar_t *column,size_t i,
+                  mat_uint8_t *buf);
+static size_t CellStrElement5(const char *str,size_t len,mat_uint8_t *buf);
+static size_t DataElement5(const void *data,size_t N,
+                  enum matio_types data_type,size_t stride,int rank,
+                  const size_t *dims,mat_uint8_t *buf);
+static size_t CharElement5(const void *data,size_t N,
+                  enum matio_types data_type,int rank,const size_t *dims,
+                  mat_uint8_t *buf);
+static size_t ArrayHeader5(mat_uint32_t array_flags,mat_uint32_t nzmax,
+                  int rank,const size_t *dims,const char *name,
+                  mat_uint8_t *buf);
+static size_t MatrixElement5(const matvar_t *matvar,const char *name,
+                  int cell_names,mat_uint8_t *buf);
+static int ReadElementTag5(mat_t *mat,matvar_t *matvar);
+static int ReadElementHeader5(mat_t *mat,matvar_t *matvar,
+               mat_uint32_t *array_flags,mat_uint32_t *dims);
+#if defined(HAVE_ZLIB)
+static int    WriteCompressedBytes5(mat_t *mat,z_stream *z,const void *data,
+                  size_t nbytes);
+static void   WriteCompressedEnd5(mat_t *mat,z_stream *z,long start);
+static int    WriteCompressedVar5(mat_t *mat,const mat_uint8_t *buf,
+                  size_t nbytes);
+#endif
 
 static mat_complex_split_t null_complex_data = {NULL,NULL};
 
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+/** @if mat_devman
+ * @brief Variable encoded by Mat_VarWrite and waiting for the background
+ *        writer
+ * @ingroup mat_internal
+ * @endif
+ */
+struct mat_write_job {
+    mat_uint8_t *buf;             /**< Encoded variable */
+    size_t nbytes;                /**< Size of @c buf in bytes */
+    int    compress;              /**< Option to compress the variable */
+    struct mat_write_job *next;   /**< Next variable in the queue */
+};
+
+/** @if mat_devman
+ * @brief Queue of the variables encoded by the calling thread and appended
+ *        to the file by the background writer
+ * @ingroup mat_internal
+ * @endif
+ */
+struct mat_write_queue {
+    mat_t *mat;                   /**< MAT file written */
+    const mat_allocator_t *allocator; /**< Allocator of the queue, its
+                                           variables and their buffers */
+    struct mat_write_job *head;   /**< Variable being or next written */
+    struct mat_write_job *tail;   /**< Last variable queued */
+    size_t bytes;                 /**< Bytes of the variables queued */
+    size_t max_bytes;             /**< Bound on @c bytes, 0 for none */
+    long   end;                   /**< End of the file after the queued
+                                       variables, -1 if unknown */
+    int    stop;                  /**< 1 when the writer must exit */
+    int    err;                   /**< Non-zero if a variable failed */
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  not_empty;
+    pthread_cond_t  not_full;
+};
+#endif
+
 /*
  * -------------------------------------------------------------
  *   Private Functions
@@ -289,178 +373,6 @@ GetCellArrayFieldBufSize(matvar_t *matvar)
     return nBytes;
 }
 
-/** @brief determines the number of bytes needed to store the given variable
- *
- * @ingroup mat_internal
- * @param matvar MAT variable
- * @return the number of bytes needed to store the variable
- */
-static size_t
-GetEmptyMatrixMaxBufSize(const char *name,int rank)
-{
-    size_t nBytes = 0, len;
-    size_t tag_size = 8, array_flags_size = 8;
-
-    /* Add the Array Flags tag and space to the number of bytes */
-    nBytes += tag_size + array_flags_size;
-
-    /* Get size of variable name, pad it to an 8 byte block, and add it to nBytes */
-    if ( NULL != name )
-        len = strlen(name);
-    else
-        len = 4;
-
-    if ( len <= 4 ) {
-        nBytes += tag_size;
-    } else {
-        if ( len % 8 )
-            len = len + (8 - len % 8);
-        nBytes += tag_size + len;
-    }
-
-    /* Add rank and dimensions, padded to an 8 byte block */
-    if ( rank % 2 )
-        nBytes += tag_size + rank*4 + 4;
-    else
-        nBytes += tag_size + rank*4;
-
-    /* Data tag */
-    nBytes += tag_size;
-
-    return nBytes;
-}
-
-/** @brief determines the number of bytes needed to store the given variable
- *
- * @ingroup mat_internal
- * @param matvar MAT variable
- * @return the number of bytes needed to store the variable
- */
-static size_t
-GetMatrixMaxBufSize(matvar_t *matvar)
-{
-    size_t nBytes = 0, len, data_bytes;
-    size_t tag_size = 8, array_flags_size = 8;
-    int    nmemb = 1, i;
-
-    if ( matvar == NULL )
-        return nBytes;
-
-    /* Add the Array Flags tag and space to the number of bytes */
-    nBytes += tag_size + array_flags_size;
-
-    /* Get size of variable name, pad it to an 8 byte block, and add it to nBytes */
-    if ( NULL != matvar->name )
-        len = strlen(matvar->name);
-    else
-        len=4;
-
-    if ( len <= 4 ) {
-        nBytes += tag_size;
-    } else {
-        if ( len % 8 )
-            len = len + (8 - len % 8);
-        nBytes += tag_size + len;
-    }
-
-    /* Add rank and dimensions, padded to an 8 byte block */
-    for ( i = 0, len = 0; i < matvar->rank; i++ )
-        nmemb *= matvar->dims[i];
-    if ( matvar->rank % 2 )
-        nBytes += tag_size + matvar->rank*4 + 4;
-    else
-        nBytes += tag_size + matvar->rank*4;
-
-    switch ( matvar->class_type ) {
-    case MAT_C_STRUCT:
-    {
-        matvar_t **fields = matvar->data;
-        int i, nfields = 0;
-        size_t maxlen = 0;
-
-        nfields = matvar->internal->num_fields;
-        for ( i = 0; i < nfields; i++ ) {
-            char *fieldname = matvar->internal->fieldnames[i];
-            if ( NULL != fieldname && strlen(fieldname) > maxlen )
-                maxlen = strlen(fieldname);
-        }
-        maxlen++;
-        while ( nfields*maxlen % 8 != 0 )
-            maxlen++;
-
-        nBytes += tag_size + tag_size + maxlen*nfields;
-
-        /* FIXME: Add bytes for the fieldnames */
-        if ( NULL != fields && nfields > 0 ) {
-            for ( i = 0; i < nfields*nmemb; i++ )
-                nBytes += tag_size + GetStructFieldBufSize(fields[i]);
-        }
-        break;
-    }
-    case MAT_C_CELL:
-    {
-        matvar_t **cells = matvar->data;
-        int i, ncells;
-
-        if ( matvar->nbytes == 0 || matvar->data_size == 0 )
-            break;
-
-        ncells = matvar->nbytes / matvar->data_size;
-
-        if ( NULL != cells && ncells > 0 ) {
-            for ( i = 0; i < ncells; i++ )
-                nBytes += tag_size + GetCellArrayFieldBufSize(cells[i]);
-        }
-        break;
-    }
-    case MAT_C_SPARSE:
-    {
-        mat_sparse_t *sparse = matvar->data;
-
-        data_bytes = sparse->nir*sizeof(mat_int32_t);
-        if ( data_bytes % 8 )
-            data_bytes += (8 - (data_bytes % 8));
-        nBytes += tag_size + data_bytes;
-
-        data_bytes = sparse->njc*sizeof(mat_int32_t);
-        if ( data_bytes % 8 )
-            data_bytes += (8 - (data_bytes % 8));
-        nBytes += tag_size + data_bytes;
-
-        data_bytes = sparse->ndata*Mat_SizeOf(matvar->data_type);
-        if ( data_bytes % 8 )
-            data_bytes += (8 - (data_bytes % 8));
-        nBytes += tag_size + data_bytes;
-
-        if ( matvar->isComplex )
-            nBytes += tag_size + data_bytes;
-
-        break;
-    }
-    case MAT_C_CHAR:
-        if ( MAT_T_UINT8 == matvar->data_type ||
-            MAT_T_INT8 == matvar->data_type )
-            data_bytes = nmemb*Mat_SizeOf(MAT_T_UINT16);
-        else
-            data_bytes = nmemb*Mat_SizeOf(matvar->data_type);
-        if ( data_bytes % 8 )
-            data_bytes += (8 - (data_bytes % 8));
-        nBytes += tag_size + data_bytes;
-        if ( matvar->isComplex )
-            nBytes += tag_size + data_bytes;
-        break;
-    default:
-        data_bytes = nmemb*Mat_SizeOf(matvar->data_type);
-        if ( data_bytes % 8 )
-            data_bytes += (8 - (data_bytes % 8));
-        nBytes += tag_size + data_bytes;
-        if ( matvar->isComplex )
-            nBytes += tag_size + data_bytes;
-    } /* switch ( matvar->class_type ) */
-
-    return nBytes;
-}
-
 /** @if mat_devman
  * @brief Creates a new Matlab MAT version 5 file
  *
@@ -505,6 +417,24 @@ Mat_Create5(const char *matname,const char *hdr_str)
     mat->mode             = 0;
     mat->bof              = 0;
     mat->next_index       = 0;
+    mat->dir              = NULL;
+    mat->dir_types        = NULL;
+    mat->scaling          = 0;
+    mat->scale            = 1.0;
+    mat->offset           = 0.0;
+    mat->nthreads         = 1;
+    mat->lazy             = 0;
+    mat->lazy_max_bytes   = 0;
+    mat->lazy_bytes       = 0;
+    mat->lazy_head        = NULL;
+    mat->lazy_tail        = NULL;
+    mat->lazy_unread      = NULL;
+    mat->shallow          = 0;
+    mat->arena            = 0;
+    mat->allocator        = Mat_GetDefaultAllocator();
+    mat->async            = NULL;
+    mat->scratch          = NULL;
+    mat->scratch_size     = 0;
 
     t = time(NULL);
     mat->fp = fp;
@@ -619,168 +549,6 @@ WriteCharData(mat_t *mat, void *data, int N,enum matio_types data_type)
 }
 
 #if defined(HAVE_ZLIB)
-/** @brief Writes @c data as compressed character data
- *
- * This function uses the knowledge that the data is part of a character class
- * to avoid some pitfalls with Matlab listed below.
- *   @li Matlab character data cannot be unsigned 8-bit integers, it needs at
- *       least unsigned 16-bit integers
- *
- * @ingroup mat_internal
- * @param mat MAT file pointer
- * @param z pointer to the zlib compression stream
- * @param data character data to write
- * @param N Number of elements to write
- * @param data_type character data type (enum matio_types)
- * @return number of bytes written
- */
-static size_t
-WriteCompressedCharData(mat_t *mat,z_stream *z,void *data,int N,
-    enum matio_types data_type)
-{
-    int data_size, data_tag[2], err, byteswritten = 0;
-    int buf_size = 1024, i;
-    mat_uint8_t   buf[1024], pad[8] = {0,};
-
-    if ((mat == NULL) || (mat->fp == NULL))
-        return 0;
-
-    switch ( data_type ) {
-        case MAT_T_UINT16:
-        {
-            data_size = 2;
-            data_tag[0]  = MAT_T_UINT16;
-            data_tag[1]  = N*data_size;
-            z->next_in   = ZLIB_BYTE_PTR(data_tag);
-            z->avail_in  = 8;
-            z->next_out  = buf;
-            z->avail_out = buf_size;
-            err = deflate(z,Z_NO_FLUSH);
-            byteswritten += fwrite(buf,1,buf_size-z->avail_out,mat->fp);
-
-            /* exit early if this is a empty data */
-            if ( NULL == data || N < 1 )
-                break;
-
-            z->next_in   = data;
-            z->avail_in  = data_size*N;
-            do {
-                z->next_out  = buf;
-                z->avail_out = buf_size;
-                err = deflate(z,Z_NO_FLUSH);
-                byteswritten += fwrite(buf,1,buf_size-z->avail_out,mat->fp);
-            } while ( z->avail_out == 0 );
-            /* Add/Compress padding to pad to 8-byte boundary */
-            if ( N*data_size % 8 ) {
-                z->next_in   = pad;
-                z->avail_in  = 8 - (N*data_size % 8);
-                z->next_out  = buf;
-                z->avail_out = buf_size;
-                err = deflate(z,Z_NO_FLUSH);
-                byteswritten += fwrite(buf,1,buf_size-z->avail_out,mat->fp);
-            }
-            break;
-        }
-        case MAT_T_INT8:
-        case MAT_T_UINT8:
-        {
-            mat_uint8_t *ptr;
-            mat_uint16_t c;
-
-            /* Matlab can't read MAT_C_CHAR as uint8, needs uint16 */
-            data_size    = 2;
-            data_tag[0]  = MAT_T_UINT16;
-            data_tag[1]  = N*data_size;
-            z->next_in   = ZLIB_BYTE_PTR(data_tag);
-            z->avail_in  = 8;
-            z->next_out  = buf;
-            z->avail_out = buf_size;
-            err = deflate(z,Z_NO_FLUSH);
-            byteswritten += fwrite(buf,1,buf_size-z->avail_out,mat->fp);
-
-            /* exit early if this is a empty data */
-            if ( NULL == data || N < 1 )
-                break;
-
-            z->next_in   = data;
-            z->avail_in  = data_size*N;
-            ptr = data;
-            for ( i = 0; i < N; i++ ) {
-                c = (mat_uint16_t)*(char *)ptr;
-                z->next_in   = ZLIB_BYTE_PTR(&c);
-                z->avail_in  = 2;
-                z->next_out  = buf;
-                z->avail_out = buf_size;
-                err = deflate(z,Z_NO_FLUSH);
-                byteswritten += fwrite(buf,1,buf_size-z->avail_out,mat->fp);
-                ptr++;
-            }
-            /* Add/Compress padding to pad to 8-byte boundary */
-            if ( N*data_size % 8 ) {
-                z->next_in   = pad;
-                z->avail_in  = 8 - (N*data_size % 8);
-                z->next_out  = buf;
-                z->avail_out = buf_size;
-                err = deflate(z,Z_NO_FLUSH);
-                byteswritten += fwrite(buf,1,buf_size-z->avail_out,mat->fp);
-            }
-            break;
-        }
-        case MAT_T_UTF8:
-        {
-            data_size = 1;
-            data_tag[0]  = MAT_T_UTF8;
-            data_tag[1]  = N*data_size;
-            z->next_in   = ZLIB_BYTE_PTR(data_tag);
-            z->avail_in  = 8;
-            z->next_out  = buf;
-            z->avail_out = buf_size;
-            err = deflate(z,Z_NO_FLUSH);
-            byteswritten += fwrite(buf,1,buf_size-z->avail_out,mat->fp);
-
-            /* exit early if this is a empty data */
-            if ( NULL == data || N < 1 )
-                break;
-
-            z->next_in   = data;
-            z->avail_in  = data_size*N;
-            do {
-                z->next_out  = buf;
-                z->avail_out = buf_size;
-                err = deflate(z,Z_NO_FLUSH);
-                byteswritten += fwrite(buf,1,buf_size-z->avail_out,mat->fp);
-            } while ( z->avail_out == 0 );
-            /* Add/Compress padding to pad to 8-byte boundary */
-            if ( N*data_size % 8 ) {
-                z->next_in   = pad;
-                z->avail_in  = 8 - (N*data_size % 8);
-                z->next_out  = buf;
-                z->avail_out = buf_size;
-                err = deflate(z,Z_NO_FLUSH);
-                byteswritten += fwrite(buf,1,buf_size-z->avail_out,mat->fp);
-            }
-            break;
-        }
-        case MAT_T_UNKNOWN:
-        {
-            /* Sometimes empty char data will have MAT_T_UNKNOWN, so just write
-             * a data tag
-             */
-            data_size = 2;
-            data_tag[0]  = MAT_T_UINT16;
-            data_tag[1]  = N*data_size;
-            z->next_in   = ZLIB_BYTE_PTR(data_tag);
-            z->avail_in  = 8;
-            z->next_out  = buf;
-            z->avail_out = buf_size;
-            err = deflate(z,Z_NO_FLUSH);
-            byteswritten += fwrite(buf,1,buf_size-z->avail_out,mat->fp);
-        }
-        default:
-            break;
-    }
-    return byteswritten;
-}
 #endif
 
 /** @if mat_devman
@@ -993,192 +761,39 @@ WriteEmptyData(mat_t *mat,int N,enum matio_types data_type)
 }
 
 #if defined(HAVE_ZLIB)
-static int
-WriteCompressedEmptyData(mat_t *mat,z_stream *z,int N,
-    enum matio_types data_type)
+#endif
+
+/** @if mat_devman
+ * @param Writes a 2-D slab of data to the MAT file
+ *
+ * @ingroup mat_internal
+ * @fixme should return the number of bytes written, but currently returns 0
+ * @param mat MAT file pointer
+ * @param data pointer to the slab of data
+ * @param data_type data type of the data (enum matio_types)
+ * @param dims dimensions of the dataset
+ * @param start index to start writing the data in each dimension
+ * @param stride write data every @c stride elements
+ * @param edge number of elements to write in each dimension
+ * @return number of byteswritten
+ * @endif
+ */
+int
+WriteDataSlab2(mat_t *mat,void *data,enum matio_types data_type,size_t *dims,
+    int *start,int *stride,int *edge)
 {
-    int nBytes = 0, data_size, i, err, byteswritten = 0;
+    int nBytes = 0, data_size, i, j;
+    long pos, row_stride, col_stride;
 
-    if ( (mat == NULL) || (mat->fp == NULL) )
+    if ( (mat   == NULL) || (data   == NULL) || (mat->fp == NULL) ||
+         (start == NULL) || (stride == NULL) || (edge    == NULL) ) {
         return 0;
+    }
 
     switch ( data_type ) {
         case MAT_T_DOUBLE:
         {
-            mat_uint32_t uncomp_buf[32] = {0,};
-            mat_uint32_t comp_buf[32] = {0,};
-            double data_uncomp_buf[4] = {0.0,};
-
-            data_size = sizeof(double);
-            nBytes = N*data_size;
-            uncomp_buf[0] = data_type;
-            uncomp_buf[1] = 0;
-            z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-            z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-            z->avail_out = 32*sizeof(*comp_buf);
-            z->avail_in  = 8;
-            err = deflate(z,Z_NO_FLUSH);
-            byteswritten += fwrite(comp_buf,1,32*sizeof(*comp_buf)-z->avail_out,mat->fp);
-            for ( i = 0; i < N; i++ ) {
-                z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-                z->next_in   = ZLIB_BYTE_PTR(data_uncomp_buf);
-                z->avail_out = 32*sizeof(*comp_buf);
-                z->avail_in  = 8;
-                err = deflate(z,Z_NO_FLUSH);
-                byteswritten += fwrite(comp_buf,32*sizeof(*comp_buf)-z->avail_out,1,mat->fp);
-            }
-            break;
-        }
-        case MAT_T_SINGLE:
-        {
-            float f = 0.0;
-
-            data_size = sizeof(float);
-            nBytes = N*data_size;
-            fwrite(&data_type,4,1,mat->fp);
-            fwrite(&nBytes,4,1,mat->fp);
-            for ( i = 0; i < N; i++ )
-                fwrite(&f,data_size,1,mat->fp);
-            break;
-        }
-        case MAT_T_INT8:
-        {
-            mat_int8_t i8 = 0;
-
-            data_size = sizeof(mat_int8_t);
-            nBytes = N*data_size;
-            fwrite(&data_type,4,1,mat->fp);
-            fwrite(&nBytes,4,1,mat->fp);
-            for ( i = 0; i < N; i++ )
-                fwrite(&i8,data_size,1,mat->fp);
-            break;
-        }
-        case MAT_T_UINT8:
-        {
-            mat_uint8_t ui8 = 0;
-
-            data_size = sizeof(mat_uint8_t);
-            nBytes = N*data_size;
-            fwrite(&data_type,4,1,mat->fp);
-            fwrite(&nBytes,4,1,mat->fp);
-            for ( i = 0; i < N; i++ )
-                fwrite(&ui8,data_size,1,mat->fp);
-            break;
-        }
-        case MAT_T_INT16:
-        {
-            mat_int16_t i16 = 0;
-
-            data_size = sizeof(mat_int16_t);
-            nBytes = N*data_size;
-            fwrite(&data_type,4,1,mat->fp);
-            fwrite(&nBytes,4,1,mat->fp);
-            for ( i = 0; i < N; i++ )
-                fwrite(&i16,data_size,1,mat->fp);
-            break;
-        }
-        case MAT_T_UINT16:
-        {
-            mat_uint16_t ui16 = 0;
-
-            data_size = sizeof(mat_uint16_t);
-            nBytes = N*data_size;
-            fwrite(&data_type,4,1,mat->fp);
-            fwrite(&nBytes,4,1,mat->fp);
-            for ( i = 0; i < N; i++ )
-                fwrite(&ui16,data_size,1,mat->fp);
-            break;
-        }
-        case MAT_T_INT32:
-        {
-            mat_int32_t i32 = 0;
-
-            data_size = sizeof(mat_int32_t);
-            nBytes = N*data_size;
-            fwrite(&data_type,4,1,mat->fp);
-            fwrite(&nBytes,4,1,mat->fp);
-            for ( i = 0; i < N; i++ )
-                fwrite(&i32,data_size,1,mat->fp);
-            break;
-        }
-        case MAT_T_UINT32:
-        {
-            mat_uint32_t ui32 = 0;
-
-            data_size = sizeof(mat_uint32_t);
-            nBytes = N*data_size;
-            fwrite(&data_type,4,1,mat->fp);
-            fwrite(&nBytes,4,1,mat->fp);
-            for ( i = 0; i < N; i++ )
-                fwrite(&ui32,data_size,1,mat->fp);
-            break;
-        }
-#ifdef HAVE_MAT_INT64_T
-        case MAT_T_INT64:
-        {
-            mat_int64_t i64 = 0;
-
-            data_size = sizeof(mat_int64_t);
-            nBytes = N*data_size;
-            fwrite(&data_type,4,1,mat->fp);
-            fwrite(&nBytes,4,1,mat->fp);
-            for ( i = 0; i < N; i++ )
-                fwrite(&i64,data_size,1,mat->fp);
-            break;
-        }
-#endif
-#ifdef HAVE_MAT_UINT64_T
-        case MAT_T_UINT64:
-        {
-            mat_uint64_t ui64 = 0;
-
-            data_size = sizeof(mat_uint64_t);
-            nBytes = N*data_size;
-            fwrite(&data_type,4,1,mat->fp);
-            fwrite(&nBytes,4,1,mat->fp);
-            for ( i = 0; i < N; i++ )
-                fwrite(&ui64,data_size,1,mat->fp);
-            break;
-        }
-#endif
-        default:
-            nBytes = 0;
-    }
-    return byteswritten;
-}
-#endif
-
-/** @if mat_devman
- * @param Writes a 2-D slab of data to the MAT file
- *
- * @ingroup mat_internal
- * @fixme should return the number of bytes written, but currently returns 0
- * @param mat MAT file pointer
- * @param data pointer to the slab of data
- * @param data_type data type of the data (enum matio_types)
- * @param dims dimensions of the dataset
- * @param start index to start writing the data in each dimension
- * @param stride write data every @c stride elements
- * @param edge number of elements to write in each dimension
- * @return number of byteswritten
- * @endif
- */
-int
-WriteDataSlab2(mat_t *mat,void *data,enum matio_types data_type,size_t *dims,
-    int *start,int *stride,int *edge)
-{
-    int nBytes = 0, data_size, i, j;
-    long pos, row_stride, col_stride;
-
-    if ( (mat   == NULL) || (data   == NULL) || (mat->fp == NULL) ||
-         (start == NULL) || (stride == NULL) || (edge    == NULL) ) {
-        return 0;
-    }
-
-    switch ( data_type ) {
-        case MAT_T_DOUBLE:
-        {
-            double *ptr;
+            double *ptr;
 
             data_size = sizeof(double);
             ptr = (double *)data;
@@ -1542,53 +1157,9 @@ WriteData(mat_t *mat,void *data,int N,enum matio_types data_type)
 }
 
 #if defined(HAVE_ZLIB)
-/* Compresses the data buffer and writes it to the file */
-static size_t
-WriteCompressedData(mat_t *mat,z_stream *z,void *data,int N,
-    enum matio_types data_type)
-{
-    int nBytes = 0, data_size, data_tag[2], err, byteswritten = 0;
-    int buf_size = 1024;
-    mat_uint8_t   buf[1024], pad[8] = {0,};
-
-    if ((mat == NULL) || (mat->fp == NULL))
-        return 0;
-
-    data_size = Mat_SizeOf(data_type);
+#endif
 
-    data_tag[0]  = data_type;
-    data_tag[1]  = data_size*N;
-    z->next_in   = ZLIB_BYTE_PTR(data_tag);
-    z->avail_in  = 8;
-    z->next_out  = buf;
-    z->avail_out = buf_size;
-    err = deflate(z,Z_NO_FLUSH);
-    byteswritten += fwrite(buf,1,buf_size-z->avail_out,mat->fp);
-
-    /* exit early if this is a empty data */
-    if ( NULL == data || N < 1 )
-        return byteswritten;
-
-    z->next_in   = data;
-    z->avail_in  = N*data_size;
-    do {
-        z->next_out  = buf;
-        z->avail_out = buf_size;
-        err = deflate(z,Z_NO_FLUSH);
-        byteswritten += fwrite(buf,1,buf_size-z->avail_out,mat->fp);
-    } while ( z->avail_out == 0 );
-    /* Add/Compress padding to pad to 8-byte boundary */
-    if ( N*data_size % 8 ) {
-        z->next_in   = pad;
-        z->avail_in  = 8 - (N*data_size % 8);
-        z->next_out  = buf;
-        z->avail_out = buf_size;
-        err = deflate(z,Z_NO_FLUSH);
-        byteswritten += fwrite(buf,1,buf_size-z->avail_out,mat->fp);
-    }
-    nBytes = byteswritten;
-    return nBytes;
-}
+#if defined(HAVE_ZLIB)
 #endif
 
 /** @brief Reads the next cell of the cell array in @c matvar
@@ -1609,7 +1180,7 @@ ReadNextCell( mat_t *mat, matvar_t *matvar )
         ncells *= matvar->dims[i];
     matvar->data_size = sizeof(matvar_t *);
     matvar->nbytes    = ncells*matvar->data_size;
-    matvar->data      = malloc(matvar->nbytes);
+    matvar->data      = Mat_VarMemAlloc(matvar,matvar->nbytes);
     if ( !matvar->data ) {
         Mat_Critical("Couldn't allocate memory for %s->data",matvar->name);
         return bytesread;
@@ -1624,7 +1195,7 @@ ReadNextCell( mat_t *mat, matvar_t *matvar )
         int err;
 
         for ( i = 0; i < ncells; i++ ) {
-            cells[i] = Mat_VarCalloc();
+            cells[i] = Mat_VarCallocElement(matvar);
             if ( NULL == cells[i] ) {
                 Mat_Critical("Couldn't allocate memory for cell %d", i);
                 continue;
@@ -1688,7 +1259,8 @@ ReadNextCell( mat_t *mat, matvar_t *matvar )
                 cells[i]->rank = uncomp_buf[1];
                 nbytes -= cells[i]->rank;
                 cells[i]->rank /= 4;
-                cells[i]->dims = malloc(cells[i]->rank*sizeof(*cells[i]->dims));
+                cells[i]->dims = Mat_VarMemAlloc(matvar,
+                    cells[i]->rank*sizeof(*cells[i]->dims));
                 if ( mat->byteswap ) {
                     for ( j = 0; j < cells[i]->rank; j++ )
                         cells[i]->dims[j] = Mat_uint32Swap(uncomp_buf+2+j);
@@ -1714,7 +1286,7 @@ ReadNextCell( mat_t *mat, matvar_t *matvar )
 
                     if ( len % 8 > 0 )
                         len = len+(8-(len % 8));
-                    cells[i]->name = malloc(len+1);
+                    cells[i]->name = Mat_VarMemAlloc(matvar,len+1);
                     /* Inflate variable name */
                     bytesread += InflateVarName(mat,matvar,cells[i]->name,len);
                     cells[i]->name[len] = '\0';
@@ -1723,12 +1295,12 @@ ReadNextCell( mat_t *mat, matvar_t *matvar )
                            ((uncomp_buf[0] & 0xffff0000) != 0x00) ) {
                     /* Name packed in tag */
                     len = (uncomp_buf[0] & 0xffff0000) >> 16;
-                    cells[i]->name = malloc(len+1);
+                    cells[i]->name = Mat_VarMemAlloc(matvar,len+1);
                     memcpy(cells[i]->name,uncomp_buf+1,len);
                     cells[i]->name[len] = '\0';
                 }
             }
-            cells[i]->internal->z = calloc(1,sizeof(z_stream));
+            cells[i]->internal->z = Mat_VarStreamCalloc(matvar);
             err = inflateCopy(cells[i]->internal->z,matvar->internal->z);
             if ( err != Z_OK )
                 Mat_Critical("inflateCopy returned error %d",err);
@@ -1751,7 +1323,7 @@ ReadNextCell( mat_t *mat, matvar_t *matvar )
 
         for ( i = 0; i < ncells; i++ ) {
             int cell_bytes_read,name_len;
-            cells[i] = Mat_VarCalloc();
+            cells[i] = Mat_VarCallocElement(matvar);
             if ( !cells[i] ) {
                 Mat_Critical("Couldn't allocate memory for cell %d", i);
                 continue;
@@ -1815,7 +1387,8 @@ ReadNextCell( mat_t *mat, matvar_t *matvar )
                 nBytes-=nbytes;
 
                 cells[i]->rank = nbytes / 4;
-                cells[i]->dims = malloc(cells[i]->rank*sizeof(*cells[i]->dims));
+                cells[i]->dims = Mat_VarMemAlloc(matvar,
+                    cells[i]->rank*sizeof(*cells[i]->dims));
 
                 /* Assumes rank <= 16 */
                 if ( cells[i]->rank % 2 != 0 ) {
@@ -1865,7 +1438,8 @@ ReadNextCell( mat_t *mat, matvar_t *matvar )
 /** @brief Reads the next struct field of the structure in @c matvar
  *
  * Reads the next struct fields (fieldname length,names,data headers for all
- * the fields
+ * the fields.  Only the field names are read if the file reads top-level
+ * information only (see Mat_SetShallowInfo).
  * @ingroup mat_internal
  * @param mat MAT file pointer
  * @param matvar MAT variable pointer
@@ -1915,36 +1489,43 @@ ReadNextStructField( mat_t *mat, matvar_t *matvar )
         else
             i = 0;
         if ( nfields ) {
-            ptr = malloc(nfields*fieldname_size+i);
+            ptr = Mat_Malloc(mat->allocator,nfields*fieldname_size+i);
             bytesread += InflateFieldNames(mat,matvar,ptr,nfields,fieldname_size,i);
             matvar->internal->num_fields = nfields;
             matvar->internal->fieldnames =
-                calloc(nfields,sizeof(*matvar->internal->fieldnames));
+                Mat_VarMemCalloc(matvar,nfields,
+                                 sizeof(*matvar->internal->fieldnames));
             for ( i = 0; i < nfields; i++ ) {
-                matvar->internal->fieldnames[i] = malloc(fieldname_size);
+                matvar->internal->fieldnames[i] =
+                    Mat_VarMemAlloc(matvar,fieldname_size);
                 memcpy(matvar->internal->fieldnames[i],ptr+i*fieldname_size,
                        fieldname_size);
                 matvar->internal->fieldnames[i][fieldname_size-1] = '\0';
             }
-            free(ptr);
+            Mat_Free(mat->allocator,ptr);
+            Mat_VarIndexStructFields(matvar);
         } else {
             matvar->internal->num_fields = 0;
             matvar->internal->fieldnames = NULL;
         }
 
+        if ( mat->shallow )
+            return bytesread;
+
         matvar->nbytes = nmemb*nfields*matvar->data_size;
         if ( !matvar->nbytes )
             return bytesread;
 
-        matvar->data = malloc(matvar->nbytes);
+        matvar->data = Mat_VarMemAlloc(matvar,matvar->nbytes);
         if ( !matvar->data )
             return bytesread;
 
         fields = matvar->data;
         for ( i = 0; i < nmemb; i++ ) {
             for ( j = 0; j < nfields; j++ ) {
-                fields[i*nfields+j] = Mat_VarCalloc();
-                fields[i*nfields+j]->name = strdup(matvar->internal->fieldnames[j]);
+                fields[i*nfields+j] = Mat_VarCallocElement(matvar);
+                Mat_VarShareName(fields[i*nfields+j],
+                    matvar->internal->fieldnames[j]);
             }
         }
 
@@ -2004,7 +1585,7 @@ ReadNextStructField( mat_t *mat, matvar_t *matvar )
                 fields[i]->rank = uncomp_buf[1];
                 nbytes -= fields[i]->rank;
                 fields[i]->rank /= 4;
-                fields[i]->dims = malloc(fields[i]->rank*
+                fields[i]->dims = Mat_VarMemAlloc(matvar,fields[i]->rank*
                                          sizeof(*fields[i]->dims));
                 if ( mat->byteswap ) {
                     for ( j = 0; j < fields[i]->rank; j++ )
@@ -2018,7 +1599,7 @@ ReadNextStructField( mat_t *mat, matvar_t *matvar )
             }
             bytesread += InflateVarNameTag(mat,matvar,uncomp_buf);
             nbytes -= 8;
-            fields[i]->internal->z = calloc(1,sizeof(z_stream));
+            fields[i]->internal->z = Mat_VarStreamCalloc(matvar);
             err = inflateCopy(fields[i]->internal->z,matvar->internal->z);
             if ( err != Z_OK ) {
                 Mat_Critical("inflateCopy returned error %d",err);
@@ -2062,12 +1643,15 @@ ReadNextStructField( mat_t *mat, matvar_t *matvar )
         if ( nfields ) {
             matvar->internal->num_fields = nfields;
             matvar->internal->fieldnames =
-                calloc(nfields,sizeof(*matvar->internal->fieldnames));
+                Mat_VarMemCalloc(matvar,nfields,
+                                 sizeof(*matvar->internal->fieldnames));
             for ( i = 0; i < nfields; i++ ) {
-                matvar->internal->fieldnames[i] = malloc(fieldname_size);
+                matvar->internal->fieldnames[i] =
+                    Mat_VarMemAlloc(matvar,fieldname_size);
                 bytesread+=fread(matvar->internal->fieldnames[i],1,fieldname_size,mat->fp);
                 matvar->internal->fieldnames[i][fieldname_size-1] = '\0';
             }
+            Mat_VarIndexStructFields(matvar);
         } else {
             matvar->internal->num_fields = 0;
             matvar->internal->fieldnames = NULL;
@@ -2078,19 +1662,23 @@ ReadNextStructField( mat_t *mat, matvar_t *matvar )
             bytesread+=8-((nfields*fieldname_size) % 8);
         }
 
+        if ( mat->shallow )
+            return bytesread;
+
         matvar->nbytes = nmemb*nfields*matvar->data_size;
         if ( !matvar->nbytes )
             return bytesread;
 
-        matvar->data = malloc(matvar->nbytes);
+        matvar->data = Mat_VarMemAlloc(matvar,matvar->nbytes);
         if ( !matvar->data )
             return bytesread;
 
         fields = matvar->data;
         for ( i = 0; i < nmemb; i++ ) {
             for ( j = 0; j < nfields; j++ ) {
-                fields[i*nfields+j] = Mat_VarCalloc();
-                fields[i*nfields+j]->name = strdup(matvar->internal->fieldnames[j]);
+                fields[i*nfields+j] = Mat_VarCallocElement(matvar);
+                Mat_VarShareName(fields[i*nfields+j],
+                    matvar->internal->fieldnames[j]);
             }
         }
 
@@ -2150,7 +1738,7 @@ ReadNextStructField( mat_t *mat, matvar_t *matvar )
                 nBytes-=nbytes;
 
                 fields[i]->rank = nbytes / 4;
-                fields[i]->dims = malloc(fields[i]->rank*
+                fields[i]->dims = Mat_VarMemAlloc(matvar,fields[i]->rank*
                                          sizeof(*fields[i]->dims));
 
                 /* Assumes rank <= 16 */
@@ -2199,7 +1787,8 @@ ReadNextFunctionHandle(mat_t *mat, matvar_t *matvar)
     for ( i = 0; i < matvar->rank; i++ )
         nfunctions *= matvar->dims[i];
 
-    matvar->data = malloc(nfunctions*sizeof(matvar_t *));
+    matvar->data = Mat_VarMemAlloc(matvar,
+                                   nfunctions*sizeof(matvar_t *));
     if ( matvar->data != NULL ) {
         matvar->data_size = sizeof(matvar_t *);
         matvar->nbytes    = nfunctions*matvar->data_size;
@@ -2358,771 +1947,425 @@ WriteCellArrayFieldInfo(mat_t *mat,matvar_t *matvar)
     return 0;
 }
 
-/** @brief Writes the header and data for an element of a cell array
+#if defined(HAVE_ZLIB)
+#endif
+
+#if defined(HAVE_ZLIB)
+#endif
+
+#if defined(HAVE_ZLIB)
+/** @brief Compresses a buffer and writes it to the file
  *
  * @ingroup mat_internal
  * @param mat MAT file pointer
- * @param matvar pointer to the mat variable
+ * @param z pointer to the zlib compression stream
+ * @param data Buffer to compress
+ * @param nbytes Number of bytes of @c data
  * @retval 0 on success
  */
 static int
-WriteCellArrayField(mat_t *mat,matvar_t *matvar )
+WriteCompressedBytes5(mat_t *mat,z_stream *z,const void *data,size_t nbytes)
 {
-    mat_uint32_t array_flags = 0x0;
-    mat_int16_t  array_name_type = MAT_T_INT8,fieldname_type = MAT_T_INT32,fieldname_data_size=4;
-    int      array_flags_type = MAT_T_UINT32, dims_array_type = MAT_T_INT32;
-    int      array_flags_size = 8, pad4 = 0, matrix_type = MAT_T_MATRIX;
-    mat_int8_t   pad1 = 0;
-    int      nBytes, i, nmemb = 1, nzmax = 0;
-    long     start = 0, end = 0;
+    mat_uint8_t buf[1024];
+    size_t n;
+    int err = 0;
 
-    if ((matvar == NULL) || (mat == NULL))
-        return 1;
+    z->next_in  = ZLIB_BYTE_PTR(data);
+    z->avail_in = nbytes;
+    do {
+        z->next_out  = buf;
+        z->avail_out = sizeof(buf);
+        if ( Z_STREAM_ERROR == deflate(z,Z_NO_FLUSH) )
+            return 1;
+        n = sizeof(buf)-z->avail_out;
+        if ( fwrite(buf,1,n,mat->fp) != n )
+            err = 1;
+    } while ( z->avail_out == 0 );
+    return err;
+}
 
-#if 0
-    nBytes = GetMatrixMaxBufSize(matvar);
+/** @brief Ends a compressed variable written by WriteCompressedBytes5
+ *
+ * Flushes and frees the compression stream and writes the number of bytes
+ * of the compressed data in the tag before @c start.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param z zlib compression stream returned by Mat_DeflateInit
+ * @param start Position of the file after the tag of the compressed data
+ */
+static void
+WriteCompressedEnd5(mat_t *mat,z_stream *z,long start)
+{
+    mat_uint8_t  comp_buf[1024];
+    mat_uint32_t nbytes;
+    long end;
+    int  zerr;
+
+    z->avail_in = 0;
+    z->next_in  = NULL;
+    do {
+        z->next_out  = comp_buf;
+        z->avail_out = sizeof(comp_buf);
+        zerr = deflate(z,Z_FINISH);
+        fwrite(comp_buf,1,sizeof(comp_buf)-z->avail_out,mat->fp);
+    } while ( zerr != Z_STREAM_END && zerr != Z_STREAM_ERROR );
+    Mat_DeflateEnd(mat->allocator,z);
+
+    end = ftell(mat->fp);
+    nbytes = end-start;
+    fseek(mat->fp,start-4,SEEK_SET);
+    fwrite(&nbytes,4,1,mat->fp);
+    fseek(mat->fp,end,SEEK_SET);
+}
 #endif
 
-    fwrite(&matrix_type,4,1,mat->fp);
-    fwrite(&pad4,4,1,mat->fp);
-    start = ftell(mat->fp);
+/** @brief Encodes a field of a structure array written from a column
+ *
+ * Encodes row i of @c column (see Mat_VarGetColumnRow) as the field of
+ * element i of a structure array, starting with the tag of the field.  8-bit
+ * character data is widened to 16 bits as in WriteCharData.
+ * @ingroup mat_internal
+ * @param column Column of the field
+ * @param i 0-relative index of the element
+ * @param buf Buffer to store the encoded field, or NULL to only compute its
+ *            size
+ * @return Number of bytes of the encoded field
+ */
+static size_t
+StructColumnElement5(const matvar_t *column,size_t i,mat_uint8_t *buf)
+{
+    mat_uint32_t tag[14];
+    enum matio_types data_type = column->data_type;
+    size_t j, n, data_size, nbytes;
 
-    /* Array Flags */
-    array_flags = matvar->class_type & CLASS_TYPE_MASK;
-    if ( matvar->isComplex )
-        array_flags |= MAT_F_COMPLEX;
-    if ( matvar->isGlobal )
-        array_flags |= MAT_F_GLOBAL;
-    if ( matvar->isLogical )
-        array_flags |= MAT_F_LOGICAL;
-    if ( matvar->class_type == MAT_C_SPARSE )
-        nzmax = ((mat_sparse_t *)matvar->data)->nzmax;
+    /* Matlab can't read MAT_C_CHAR as uint8, needs uint16 */
+    if ( MAT_C_CHAR == column->class_type && MAT_T_UTF8 != data_type )
+        data_type = MAT_T_UINT16;
+    data_size = Mat_SizeOf(data_type);
 
-    if ( mat->byteswap )
-        array_flags = Mat_int32Swap((mat_int32_t*)&array_flags);
-    fwrite(&array_flags_type,4,1,mat->fp);
-    fwrite(&array_flags_size,4,1,mat->fp);
-    fwrite(&array_flags,4,1,mat->fp);
-    fwrite(&nzmax,4,1,mat->fp);
-    /* Rank and Dimension */
-    nBytes = matvar->rank * 4;
-    fwrite(&dims_array_type,4,1,mat->fp);
-    fwrite(&nBytes,4,1,mat->fp);
-    for ( i = 0; i < matvar->rank; i++ ) {
-        mat_int32_t dim;
-        dim = matvar->dims[i];
-        nmemb *= dim;
-        fwrite(&dim,4,1,mat->fp);
+    n = Mat_VarGetColumnRow(column,i,NULL == buf ? NULL : buf+sizeof(tag));
+    nbytes = n*data_size;
+    if ( nbytes % 8 )
+        nbytes += 8-(nbytes % 8);
+    if ( NULL == buf )
+        return sizeof(tag)+nbytes;
+
+    if ( data_size > Mat_SizeOf(column->data_type) ) {
+        mat_uint8_t  *c8  = buf+sizeof(tag);
+        mat_uint16_t *c16 = (mat_uint16_t*)c8;
+
+        for ( j = n; j > 0; j-- )
+            c16[j-1] = c8[j-1];
     }
-    if ( matvar->rank % 2 != 0 )
-        fwrite(&pad4,4,1,mat->fp);
-    /* Name of variable */
-    if ( !matvar->name ) {
-        fwrite(&array_name_type,2,1,mat->fp);
-        fwrite(&pad1,1,1,mat->fp);
-        fwrite(&pad1,1,1,mat->fp);
-        fwrite(&pad4,4,1,mat->fp);
-    } else if ( strlen(matvar->name) <= 4 ) {
-        mat_int16_t array_name_len = (mat_int16_t)strlen(matvar->name);
-        mat_int8_t  pad1 = 0;
-        fwrite(&array_name_type,2,1,mat->fp);
-        fwrite(&array_name_len,2,1,mat->fp);
-        fwrite(matvar->name,1,array_name_len,mat->fp);
-        for ( i = array_name_len; i < 4; i++ )
-            fwrite(&pad1,1,1,mat->fp);
-    } else {
-        mat_int32_t array_name_len = (mat_int32_t)strlen(matvar->name);
-        mat_int8_t  pad1 = 0;
+    memset(buf+sizeof(tag)+n*data_size,0,nbytes-n*data_size);
 
-        fwrite(&array_name_type,2,1,mat->fp);
-        fwrite(&pad1,1,1,mat->fp);
-        fwrite(&pad1,1,1,mat->fp);
-        fwrite(&array_name_len,4,1,mat->fp);
-        fwrite(matvar->name,1,array_name_len,mat->fp);
-        if ( array_name_len % 8 )
-            for ( i = array_name_len % 8; i < 8; i++ )
-                fwrite(&pad1,1,1,mat->fp);
-    }
-
-    switch ( matvar->class_type ) {
-        case MAT_C_DOUBLE:
-        case MAT_C_SINGLE:
-        case MAT_C_INT64:
-        case MAT_C_UINT64:
-        case MAT_C_INT32:
-        case MAT_C_UINT32:
-        case MAT_C_INT16:
-        case MAT_C_UINT16:
-        case MAT_C_INT8:
-        case MAT_C_UINT8:
-        {
-            if ( matvar->isComplex ) {
-                mat_complex_split_t *complex_data = matvar->data;
-
-                if ( NULL == matvar->data )
-                    complex_data = &null_complex_data;
-
-                nBytes=WriteData(mat,complex_data->Re,nmemb,matvar->data_type);
-                if ( nBytes % 8 )
-                    for ( i = nBytes % 8; i < 8; i++ )
-                        fwrite(&pad1,1,1,mat->fp);
-                nBytes=WriteData(mat,complex_data->Im,nmemb,matvar->data_type);
-                if ( nBytes % 8 )
-                    for ( i = nBytes % 8; i < 8; i++ )
-                        fwrite(&pad1,1,1,mat->fp);
-            } else {
-                nBytes = WriteData(mat,matvar->data,nmemb,matvar->data_type);
-                if ( nBytes % 8 )
-                    for ( i = nBytes % 8; i < 8; i++ )
-                        fwrite(&pad1,1,1,mat->fp);
-            }
-            break;
-        }
-        case MAT_C_CHAR:
-            WriteCharData(mat,matvar->data,nmemb,matvar->data_type);
-            break;
-        case MAT_C_CELL:
-        {
-            int        ncells;
-            matvar_t **cells = (matvar_t **)matvar->data;
-
-            /* Check for an empty cell array */
-            if ( matvar->nbytes == 0 || matvar->data_size == 0 ||
-                 matvar->data   == NULL )
-                break;
-            ncells  = matvar->nbytes / matvar->data_size;
-
-            for ( i = 0; i < ncells; i++ )
-                WriteCellArrayField(mat,cells[i]);
-            break;
-        }
-        case MAT_C_STRUCT:
-        {
-            char  *padzero;
-            int    fieldname_size, nfields;
-            size_t maxlen = 0;
-            matvar_t **fields = (matvar_t **)matvar->data;
-            unsigned fieldname;
-
-            nfields = matvar->internal->num_fields;
-
-            for ( i = 0; i < nfields; i++ ) {
-                size_t len = strlen(matvar->internal->fieldnames[i]);
-                if ( len > maxlen )
-                    maxlen = len;
-            }
-            maxlen++;
-            fieldname_size = maxlen;
-            while ( nfields*fieldname_size % 8 != 0 )
-                fieldname_size++;
-#if 0
-            fwrite(&fieldname_type,2,1,mat->fp);
-            fwrite(&fieldname_data_size,2,1,mat->fp);
-#else
-            fieldname = (fieldname_data_size<<16) | fieldname_type;
-            fwrite(&fieldname,4,1,mat->fp);
-#endif
-            fwrite(&fieldname_size,4,1,mat->fp);
-            fwrite(&array_name_type,2,1,mat->fp);
-            fwrite(&pad1,1,1,mat->fp);
-            fwrite(&pad1,1,1,mat->fp);
-            nBytes = nfields*fieldname_size;
-            fwrite(&nBytes,4,1,mat->fp);
-            padzero = calloc(fieldname_size,1);
-            for ( i = 0; i < nfields; i++ ) {
-                size_t len = strlen(matvar->internal->fieldnames[i]);
-                fwrite(matvar->internal->fieldnames[i],1,len,mat->fp);
-                fwrite(padzero,1,fieldname_size-len,mat->fp);
-            }
-            free(padzero);
-            for ( i = 0; i < nmemb*nfields; i++ )
-                WriteStructField(mat,fields[i]);
-            break;
-        }
-        case MAT_C_SPARSE:
-        {
-            mat_sparse_t *sparse = matvar->data;
+    tag[0]  = MAT_T_MATRIX;
+    tag[1]  = sizeof(tag)-8+nbytes;
+    /* Array Flags */
+    tag[2]  = MAT_T_UINT32;
+    tag[3]  = 8;
+    tag[4]  = column->class_type & CLASS_TYPE_MASK;
+    if ( column->isLogical )
+        tag[4] |= MAT_F_LOGICAL;
+    tag[5]  = 0;
+    /* Rank and Dimension, an empty string is 0x0 */
+    tag[6]  = MAT_T_INT32;
+    tag[7]  = 8;
+    tag[8]  = (MAT_C_CHAR == column->class_type && 0 == n) ? 0 : 1;
+    tag[9]  = n;
+    /* In a struct field, the name is just a tag with 0 bytes */
+    tag[10] = MAT_T_INT8;
+    tag[11] = 0;
+    tag[12] = data_type;
+    tag[13] = n*data_size;
+    memcpy(buf,tag,sizeof(tag));
 
-            nBytes = WriteData(mat,sparse->ir,sparse->nir,MAT_T_INT32);
-            if ( nBytes % 8 )
-                for ( i = nBytes % 8; i < 8; i++ )
-                    fwrite(&pad1,1,1,mat->fp);
-            nBytes = WriteData(mat,sparse->jc,sparse->njc,MAT_T_INT32);
-            if ( nBytes % 8 )
-                for ( i = nBytes % 8; i < 8; i++ )
-                    fwrite(&pad1,1,1,mat->fp);
-            if ( matvar->isComplex ) {
-                mat_complex_split_t *complex_data = sparse->data;
-                nBytes = WriteData(mat,complex_data->Re,sparse->ndata,
-                                   matvar->data_type);
-                if ( nBytes % 8 )
-                    for ( i = nBytes % 8; i < 8; i++ )
-                        fwrite(&pad1,1,1,mat->fp);
-                nBytes = WriteData(mat,complex_data->Im,sparse->ndata,
-                                   matvar->data_type);
-                if ( nBytes % 8 )
-                    for ( i = nBytes % 8; i < 8; i++ )
-                        fwrite(&pad1,1,1,mat->fp);
-            } else {
-                nBytes = WriteData(mat,sparse->data,sparse->ndata,
-                                   matvar->data_type);
-                if ( nBytes % 8 )
-                    for ( i = nBytes % 8; i < 8; i++ )
-                        fwrite(&pad1,1,1,mat->fp);
-            }
-        }
-        case MAT_C_FUNCTION:
-        case MAT_C_OBJECT:
-        case MAT_C_EMPTY:
-            break;
-    }
-    end = ftell(mat->fp);
-    nBytes = (int)(end-start);
-    fseek(mat->fp,(long)-(nBytes+4),SEEK_CUR);
-    fwrite(&nBytes,4,1,mat->fp);
-    fseek(mat->fp,end,SEEK_SET);
-    return 0;
+    return sizeof(tag)+nbytes;
 }
 
-#if defined(HAVE_ZLIB)
-/** @brief Writes the header and data for a field of a compressed cell array
+/** @brief Encodes a string of a cell array of strings
  *
+ * Encodes a UTF-8 string as a 1-by-n cell of 16-bit characters, starting
+ * with the tag of the cell.
  * @ingroup mat_internal
- * @param mat MAT file pointer
- * @param matvar pointer to the mat variable
- * @return number of bytes written to the MAT file
+ * @param str UTF-8 string
+ * @param len Number of bytes of @c str
+ * @param buf Buffer to store the encoded cell, or NULL to only compute its
+ *            size
+ * @return Number of bytes of the encoded cell
  */
 static size_t
-WriteCompressedCellArrayField(mat_t *mat,matvar_t *matvar,z_stream *z)
+CellStrElement5(const char *str,size_t len,mat_uint8_t *buf)
 {
-    mat_uint32_t array_flags = 0x0;
-    mat_int16_t  array_name_type     = MAT_T_INT8;
-    mat_int16_t  fieldname_type      = MAT_T_INT32;
-    mat_int16_t  fieldname_data_size = 4;
-    int      array_flags_type = MAT_T_UINT32, dims_array_type = MAT_T_INT32;
-    int      array_flags_size = 8, pad4 = 0;
-    int      nBytes, i, nmemb = 1, nzmax = 0;
-    long     start = 0;
-
-    mat_uint32_t comp_buf[512];
-    mat_uint32_t uncomp_buf[512] = {0,};
-    int buf_size = 512, err;
-    size_t byteswritten = 0;
-
-    if ( NULL == matvar || NULL == mat || NULL == z)
-        return 0;
-
-    start = ftell(mat->fp);
-
+    mat_uint32_t tag[14];
+    size_t n, nbytes;
+
+    n = Mat_Utf8ToUtf16(NULL == buf ? NULL : (mat_uint16_t*)(buf+sizeof(tag)),
+                        str,len);
+    nbytes = 2*n;
+    if ( nbytes % 8 )
+        nbytes += 8-(nbytes % 8);
+    if ( NULL == buf )
+        return sizeof(tag)+nbytes;
+    memset(buf+sizeof(tag)+2*n,0,nbytes-2*n);
+
+    tag[0]  = MAT_T_MATRIX;
+    tag[1]  = sizeof(tag)-8+nbytes;
     /* Array Flags */
-    array_flags = matvar->class_type & CLASS_TYPE_MASK;
-    if ( matvar->isComplex )
-        array_flags |= MAT_F_COMPLEX;
-    if ( matvar->isGlobal )
-        array_flags |= MAT_F_GLOBAL;
-    if ( matvar->isLogical )
-        array_flags |= MAT_F_LOGICAL;
-    if ( matvar->class_type == MAT_C_SPARSE )
-        nzmax = ((mat_sparse_t *)matvar->data)->nzmax;
-
-    uncomp_buf[0] = MAT_T_MATRIX;
-    uncomp_buf[1] = (int)GetCellArrayFieldBufSize(matvar);
-    z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-    z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-    z->avail_out = buf_size*sizeof(*comp_buf);
-    z->avail_in  = 8;
-    err = deflate(z,Z_NO_FLUSH);
-    byteswritten += fwrite(comp_buf,1,buf_size*sizeof(*comp_buf)-z->avail_out,
-        mat->fp);
-    uncomp_buf[0] = array_flags_type;
-    uncomp_buf[1] = array_flags_size;
-    uncomp_buf[2] = array_flags;
-    uncomp_buf[3] = nzmax;
-    /* Rank and Dimension */
-    nBytes = matvar->rank * 4;
-    uncomp_buf[4] = dims_array_type;
-    uncomp_buf[5] = nBytes;
-    for ( i = 0; i < matvar->rank; i++ ) {
-        mat_int32_t dim;
-        dim = matvar->dims[i];
-        nmemb *= dim;
-        uncomp_buf[6+i] = dim;
-    }
-    if ( matvar->rank % 2 != 0 ) {
-        uncomp_buf[6+i] = pad4;
-        i++;
-    }
-
-    z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-    z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-    z->avail_out = buf_size*sizeof(*comp_buf);
-    z->avail_in  = (6+i)*sizeof(*uncomp_buf);
-    err = deflate(z,Z_NO_FLUSH);
-    byteswritten += fwrite(comp_buf,1,buf_size*sizeof(*comp_buf)-z->avail_out,
-        mat->fp);
-    /* Name of variable */
-    uncomp_buf[0] = array_name_type;
-    uncomp_buf[1] = 0;
-    z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-    z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-    z->avail_out = buf_size*sizeof(*comp_buf);
-    z->avail_in  = 8;
-    err = deflate(z,Z_NO_FLUSH);
-    byteswritten += fwrite(comp_buf,1,buf_size*sizeof(*comp_buf)-z->avail_out,
-        mat->fp);
-
-    matvar->internal->datapos = ftell(mat->fp);
-    switch ( matvar->class_type ) {
-        case MAT_C_DOUBLE:
-        case MAT_C_SINGLE:
-        case MAT_C_INT64:
-        case MAT_C_UINT64:
-        case MAT_C_INT32:
-        case MAT_C_UINT32:
-        case MAT_C_INT16:
-        case MAT_C_UINT16:
-        case MAT_C_INT8:
-        case MAT_C_UINT8:
-        {
-            /* WriteCompressedData makes sure uncomressed data is aligned
-             * on an 8-byte boundary */
-            if ( matvar->isComplex ) {
-                mat_complex_split_t *complex_data = matvar->data;
-
-                if ( NULL == matvar->data )
-                    complex_data = &null_complex_data;
-
-                byteswritten += WriteCompressedData(mat,z,
-                    complex_data->Re,nmemb,matvar->data_type);
-                byteswritten += WriteCompressedData(mat,z,
-                    complex_data->Im,nmemb,matvar->data_type);
-            } else {
-                byteswritten += WriteCompressedData(mat,z,
-                    matvar->data,nmemb,matvar->data_type);
-            }
-            break;
-        }
-        case MAT_C_CHAR:
-        {
-            byteswritten += WriteCompressedCharData(mat,z,matvar->data,
-                nmemb,matvar->data_type);
-            break;
-        }
-        case MAT_C_CELL:
-        {
-            int        ncells;
-            matvar_t **cells = (matvar_t **)matvar->data;
+    tag[2]  = MAT_T_UINT32;
+    tag[3]  = 8;
+    tag[4]  = MAT_C_CHAR;
+    tag[5]  = 0;
+    /* Rank and Dimension, an empty string is 0x0 */
+    tag[6]  = MAT_T_INT32;
+    tag[7]  = 8;
+    tag[8]  = n > 0;
+    tag[9]  = n;
+    /* In a cell, the name is just a tag with 0 bytes */
+    tag[10] = MAT_T_INT8;
+    tag[11] = 0;
+    tag[12] = MAT_T_UINT16;
+    tag[13] = 2*n;
+    memcpy(buf,tag,sizeof(tag));
+
+    return sizeof(tag)+nbytes;
+}
 
-            /* Check for an empty cell array */
-            if ( matvar->nbytes == 0 || matvar->data_size == 0 ||
-                 matvar->data   == NULL )
-                break;
-            ncells  = matvar->nbytes / matvar->data_size;
-            for ( i = 0; i < ncells; i++ )
-                WriteCompressedCellArrayField(mat,cells[i],z);
-            break;
-        }
-        case MAT_C_STRUCT:
-        {
-            unsigned char *padzero;
-            int        fieldname_size, nfields;
-            size_t     maxlen = 0;
-            mat_int32_t array_name_type = MAT_T_INT8;
-            matvar_t **fields = (matvar_t **)matvar->data;
+/** @brief Encodes a data element
+ *
+ * Encodes the tag and @c N elements of @c data padded to an 8 byte
+ * boundary.
+ * @ingroup mat_internal
+ * @param data Pointer to the first element, or NULL to encode zeros
+ * @param N Number of elements
+ * @param data_type Data type of the elements
+ * @param stride Distance between the elements of @c data in elements, 2 for
+ *               one part of interleaved complex data
+ * @param rank Rank of a row-major array
+ * @param dims Dimensions of a row-major array, or NULL if @c data is in
+ *             column-major order.  Row-major data is transposed as it is
+ *             encoded.
+ * @param buf Buffer to store the encoded element, or NULL to only compute
+ *            its size
+ * @return Number of bytes of the encoded element
+ */
+static size_t
+DataElement5(const void *data,size_t N,enum matio_types data_type,
+    size_t stride,int rank,const size_t *dims,mat_uint8_t *buf)
+{
+    mat_uint32_t tag[2];
+    size_t data_size = Mat_SizeOf(data_type), nbytes = N*data_size;
+
+    if ( nbytes % 8 )
+        nbytes += 8-(nbytes % 8);
+    if ( NULL == buf )
+        return 8+nbytes;
+
+    tag[0] = data_type;
+    tag[1] = N*data_size;
+    memcpy(buf,tag,sizeof(tag));
+    if ( NULL == data )
+        memset(buf+8,0,nbytes);
+    else if ( NULL != dims )
+        Mat_GatherRowMajor(buf+8,1,data,stride,data_size,rank,dims,0,N);
+    else if ( 1 == stride )
+        memcpy(buf+8,data,N*data_size);
+    else
+        Mat_CopyStrided(buf+8,1,data,stride,data_size,N);
+    if ( NULL != data )
+        memset(buf+8+N*data_size,0,nbytes-N*data_size);
 
-            /* Check for a structure with no fields */
-            if ( matvar->nbytes == 0 || matvar->data_size == 0 ||
-                 matvar->data   == NULL ) {
-                fieldname_size = 1;
-                uncomp_buf[0] = (fieldname_data_size << 16) |
-                                 fieldname_type;
-                uncomp_buf[1] = 1;
-                uncomp_buf[2] = array_name_type;
-                uncomp_buf[3] = 0;
-                z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-                z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-                z->avail_out = buf_size*sizeof(*comp_buf);
-                z->avail_in  = 16;
-                err = deflate(z,Z_NO_FLUSH);
-                byteswritten += fwrite(comp_buf,1,buf_size*
-                    sizeof(*comp_buf)-z->avail_out,mat->fp);
-                break;
-            }
+    return 8+nbytes;
+}
 
-            nfields = matvar->internal->num_fields;
+/** @brief Encodes the character data element of a variable
+ *
+ * 8-bit character data is widened to 16 bits as in WriteCharData.  UTF data
+ * is stored as is with the size of its code units, and character data of
+ * unknown type as zeros.
+ * @ingroup mat_internal
+ * @param data Character data, or NULL to encode zeros
+ * @param N Number of characters
+ * @param data_type Data type of the characters
+ * @param rank Rank of a row-major array
+ * @param dims Dimensions of a row-major array, or NULL if @c data is in
+ *             column-major order
+ * @param buf Buffer to store the encoded element, or NULL to only compute
+ *            its size
+ * @return Number of bytes of the encoded element
+ */
+static size_t
+CharElement5(const void *data,size_t N,enum matio_types data_type,
+    int rank,const size_t *dims,mat_uint8_t *buf)
+{
+    const char   *c8 = data;
+    mat_uint16_t *c16;
+    mat_uint32_t  tag;
+    size_t i, nbytes, data_size;
 
-            for ( i = 0; i < nfields; i++ ) {
-                size_t len = strlen(matvar->internal->fieldnames[i]);
-                if ( len > maxlen )
-                    maxlen = len;
-            }
-            maxlen++;
-            fieldname_size = maxlen;
-            while ( nfields*fieldname_size % 8 != 0 )
-                fieldname_size++;
-            uncomp_buf[0] = (fieldname_data_size << 16) | fieldname_type;
-            uncomp_buf[1] = fieldname_size;
-            uncomp_buf[2] = array_name_type;
-            uncomp_buf[3] = nfields*fieldname_size;
-
-            padzero = calloc(fieldname_size,1);
-            z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-            z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-            z->avail_out = buf_size*sizeof(*comp_buf);
-            z->avail_in  = 16;
-            err = deflate(z,Z_NO_FLUSH);
-            byteswritten += fwrite(comp_buf,1,
-                    buf_size*sizeof(*comp_buf)-z->avail_out,mat->fp);
-            for ( i = 0; i < nfields; i++ ) {
-                memset(padzero,'\0',fieldname_size);
-                memcpy(padzero,matvar->internal->fieldnames[i],
-                       strlen(matvar->internal->fieldnames[i]));
-                z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-                z->next_in   = ZLIB_BYTE_PTR(padzero);
-                z->avail_out = buf_size*sizeof(*comp_buf);
-                z->avail_in  = fieldname_size;
-                err = deflate(z,Z_NO_FLUSH);
-                byteswritten += fwrite(comp_buf,1,
-                        buf_size*sizeof(*comp_buf)-z->avail_out,mat->fp);
-            }
-            free(padzero);
-            for ( i = 0; i < nmemb*nfields; i++ )
-                byteswritten +=
-                    WriteCompressedStructField(mat,fields[i],z);
+    switch ( data_type ) {
+        case MAT_T_INT8:
+        case MAT_T_UINT8:
             break;
-        }
-        case MAT_C_SPARSE:
-        {
-            mat_sparse_t *sparse = matvar->data;
+        case MAT_T_UTF8:
+        case MAT_T_UTF16:
+        case MAT_T_UTF32:
+            /* Mat_SizeOf does not know the size of UTF code units */
+            data_size = MAT_T_UTF8 == data_type ? 1 :
+                        (MAT_T_UTF16 == data_type ? 2 : 4);
+            nbytes = DataElement5(NULL == dims ? data : NULL,N*data_size,
+                                  MAT_T_UINT8,1,0,NULL,buf);
+            if ( NULL != buf && NULL != data && NULL != dims ) {
+                /* Transpose whole code units */
+                Mat_GatherRowMajor(buf+8,1,data,1,data_size,rank,dims,0,N);
+            }
+            if ( NULL != buf ) {
+                tag = data_type;
+                memcpy(buf,&tag,sizeof(tag));
+            }
+            return nbytes;
+        case MAT_T_UNKNOWN:
+            /* Sometimes empty char data will have MAT_T_UNKNOWN */
+            return DataElement5(NULL,N,MAT_T_UINT16,1,0,NULL,buf);
+        default:
+            return DataElement5(data,N,data_type,1,rank,dims,buf);
+    }
 
-            byteswritten += WriteCompressedData(mat,z,sparse->ir,
-                sparse->nir,MAT_T_INT32);
-            byteswritten += WriteCompressedData(mat,z,sparse->jc,
-                sparse->njc,MAT_T_INT32);
-            if ( matvar->isComplex ) {
-                mat_complex_split_t *complex_data = sparse->data;
-                byteswritten += WriteCompressedData(mat,z,
-                    complex_data->Re,sparse->ndata,matvar->data_type);
-                byteswritten += WriteCompressedData(mat,z,
-                    complex_data->Im,sparse->ndata,matvar->data_type);
-            } else {
-                byteswritten += WriteCompressedData(mat,z,
-                    sparse->data,sparse->ndata,matvar->data_type);
-            }
-            break;
+    /* Matlab can't read MAT_C_CHAR as uint8, needs uint16 */
+    nbytes = DataElement5(NULL,N,MAT_T_UINT16,1,0,NULL,buf);
+    if ( NULL != buf && NULL != c8 ) {
+        c16 = (mat_uint16_t*)(buf+8);
+        if ( NULL != dims ) {
+            /* Gather the characters into the upper half of the element and
+             * widen them from the front, which never overwrites a character
+             * that is still to be read */
+            Mat_GatherRowMajor(buf+8+N,1,c8,1,1,rank,dims,0,N);
+            c8 = (const char*)buf+8+N;
         }
-        case MAT_C_FUNCTION:
-        case MAT_C_OBJECT:
-        case MAT_C_EMPTY:
-            break;
+        for ( i = 0; i < N; i++ )
+            c16[i] = (mat_uint16_t)c8[i];
     }
-    return byteswritten;
+    return nbytes;
 }
-#endif
 
-/** @brief Writes the header and data for a field of a struct array
+/** @brief Encodes the header of an array element
  *
+ * Encodes the tag, array flags, dimensions and name of an array.  The
+ * number of bytes in the tag is left 0 to be set once the data is encoded.
  * @ingroup mat_internal
- * @param mat MAT file pointer
- * @param matvar pointer to the mat variable
- * @retval 0 on success
+ * @param array_flags Class and flags of the array
+ * @param nzmax Maximum number of non-zero elements of a sparse array
+ * @param rank Rank of the array
+ * @param dims Dimensions of the array
+ * @param name Name of the array, or NULL for an element of a cell or
+ *             structure array
+ * @param buf Buffer to store the encoded header, or NULL to only compute
+ *            its size
+ * @return Number of bytes of the encoded header
  */
-static int
-WriteStructField(mat_t *mat,matvar_t *matvar)
+static size_t
+ArrayHeader5(mat_uint32_t array_flags,mat_uint32_t nzmax,int rank,
+    const size_t *dims,const char *name,mat_uint8_t *buf)
 {
-    mat_uint32_t array_flags = 0x0;
-    mat_int16_t  fieldname_type = MAT_T_INT32,fieldname_data_size=4;
-    mat_int32_t  array_name_type = MAT_T_INT8;
-    int      array_flags_type = MAT_T_UINT32, dims_array_type = MAT_T_INT32;
-    int      array_flags_size = 8, pad4 = 0, matrix_type = MAT_T_MATRIX;
-    mat_int8_t   pad1 = 0;
-    int      nBytes, i, nmemb = 1, nzmax = 0;
-    long     start = 0, end = 0;
-
-    if ( mat == NULL )
-        return 1;
-
-    if ( NULL == matvar ) {
-        size_t dims[2] = {0,0};
-        Mat_WriteEmptyVariable5(mat, NULL, 2, dims);
-        return 0;
-    }
-
-    fwrite(&matrix_type,4,1,mat->fp);
-    fwrite(&pad4,4,1,mat->fp);
-    start = ftell(mat->fp);
-
+    mat_uint32_t tag[8];
+    size_t len, name_size, dims_size, nbytes;
+    int    k;
+
+    len       = NULL == name ? 0 : strlen(name);
+    name_size = len <= 4 ? 0 : len;
+    if ( name_size % 8 )
+        name_size += 8-(name_size % 8);
+    dims_size = 4*rank;
+    if ( dims_size % 8 )
+        dims_size += 8-(dims_size % 8);
+    nbytes = 40+dims_size+name_size;
+    if ( NULL == buf )
+        return nbytes;
+
+    memset(buf,0,nbytes);
+    tag[0] = MAT_T_MATRIX;
+    tag[1] = 0;
     /* Array Flags */
-    array_flags = matvar->class_type & CLASS_TYPE_MASK;
-    if ( matvar->isComplex )
-        array_flags |= MAT_F_COMPLEX;
-    if ( matvar->isGlobal )
-        array_flags |= MAT_F_GLOBAL;
-    if ( matvar->isLogical )
-        array_flags |= MAT_F_LOGICAL;
-    if ( matvar->class_type == MAT_C_SPARSE )
-        nzmax = ((mat_sparse_t *)matvar->data)->nzmax;
-
-    if ( mat->byteswap )
-        array_flags = Mat_int32Swap((mat_int32_t*)&array_flags);
-    fwrite(&array_flags_type,4,1,mat->fp);
-    fwrite(&array_flags_size,4,1,mat->fp);
-    fwrite(&array_flags,4,1,mat->fp);
-    fwrite(&nzmax,4,1,mat->fp);
+    tag[2] = MAT_T_UINT32;
+    tag[3] = 8;
+    tag[4] = array_flags;
+    tag[5] = nzmax;
     /* Rank and Dimension */
-    nBytes = matvar->rank * 4;
-    fwrite(&dims_array_type,4,1,mat->fp);
-    fwrite(&nBytes,4,1,mat->fp);
-    for ( i = 0; i < matvar->rank; i++ ) {
-        mat_int32_t dim;
-        dim = matvar->dims[i];
-        nmemb *= dim;
-        fwrite(&dim,4,1,mat->fp);
+    tag[6] = MAT_T_INT32;
+    tag[7] = 4*rank;
+    memcpy(buf,tag,sizeof(tag));
+    for ( k = 0; k < rank; k++ ) {
+        mat_uint32_t dim = dims[k];
+        memcpy(buf+32+4*k,&dim,4);
     }
-    if ( matvar->rank % 2 != 0 )
-        fwrite(&pad4,4,1,mat->fp);
-
     /* Name of variable */
-    fwrite(&array_name_type,4,1,mat->fp);
-    fwrite(&pad4,4,1,mat->fp);
-
-    switch ( matvar->class_type ) {
-        case MAT_C_DOUBLE:
-        case MAT_C_SINGLE:
-        case MAT_C_INT64:
-        case MAT_C_UINT64:
-        case MAT_C_INT32:
-        case MAT_C_UINT32:
-        case MAT_C_INT16:
-        case MAT_C_UINT16:
-        case MAT_C_INT8:
-        case MAT_C_UINT8:
-        {
-            if ( matvar->isComplex ) {
-                mat_complex_split_t *complex_data = matvar->data;
-
-                if ( NULL == matvar->data )
-                    complex_data = &null_complex_data;
-
-                nBytes=WriteData(mat,complex_data->Re,nmemb,matvar->data_type);
-                if ( nBytes % 8 )
-                    for ( i = nBytes % 8; i < 8; i++ )
-                        fwrite(&pad1,1,1,mat->fp);
-                nBytes=WriteData(mat,complex_data->Im,nmemb,matvar->data_type);
-                if ( nBytes % 8 )
-                    for ( i = nBytes % 8; i < 8; i++ )
-                        fwrite(&pad1,1,1,mat->fp);
-            } else {
-                nBytes=WriteData(mat,matvar->data,nmemb,matvar->data_type);
-                if ( nBytes % 8 )
-                    for ( i = nBytes % 8; i < 8; i++ )
-                        fwrite(&pad1,1,1,mat->fp);
-            }
-            break;
-        }
-        case MAT_C_CHAR:
-            nBytes=WriteCharData(mat,matvar->data,nmemb,matvar->data_type);
-            break;
-        case MAT_C_CELL:
-        {
-            int        ncells;
-            matvar_t **cells = (matvar_t **)matvar->data;
-
-            /* Check for an empty cell array */
-            if ( matvar->nbytes == 0 || matvar->data_size == 0 ||
-                 matvar->data   == NULL )
-                break;
-            ncells  = matvar->nbytes / matvar->data_size;
-
-            for ( i = 0; i < ncells; i++ )
-                WriteCellArrayField(mat,cells[i]);
-            break;
-        }
-        case MAT_C_STRUCT:
-        {
-            char  *padzero;
-            int    fieldname_size, nfields = 0;
-            size_t maxlen = 0;
-            matvar_t **fields = (matvar_t **)matvar->data;
-            unsigned fieldname;
-
-            /* nmemb*matvar->data_size can be zero when saving a struct that
-             * contains an empty struct in one of its fields
-             * (e.g. x.y = struct('z', {})). If it's zero, we would divide
-             * by zero.
-             */
-            nfields = matvar->internal->num_fields;
-
-            for ( i = 0; i < nfields; i++ ) {
-                size_t len = strlen(matvar->internal->fieldnames[i]);
-                if ( len > maxlen )
-                    maxlen = len;
-            }
-            maxlen++;
-            fieldname_size = maxlen;
-            while ( nfields*fieldname_size % 8 != 0 )
-                fieldname_size++;
-#if 0
-            fwrite(&fieldname_type,2,1,mat->fp);
-            fwrite(&fieldname_data_size,2,1,mat->fp);
-#else
-            fieldname = (fieldname_data_size<<16) | fieldname_type;
-            fwrite(&fieldname,4,1,mat->fp);
-#endif
-            fwrite(&fieldname_size,4,1,mat->fp);
-            fwrite(&array_name_type,4,1,mat->fp);
-            nBytes = nfields*fieldname_size;
-            fwrite(&nBytes,4,1,mat->fp);
-            padzero = calloc(fieldname_size,1);
-            for ( i = 0; i < nfields; i++ ) {
-                size_t len = strlen(matvar->internal->fieldnames[i]);
-                fwrite(matvar->internal->fieldnames[i],1,len,mat->fp);
-                fwrite(padzero,1,fieldname_size-len,mat->fp);
-            }
-            free(padzero);
-            for ( i = 0; i < nmemb*nfields; i++ )
-                WriteStructField(mat,fields[i]);
-            break;
-        }
-        case MAT_C_SPARSE:
-        {
-            mat_sparse_t *sparse = matvar->data;
-
-            nBytes = WriteData(mat,sparse->ir,sparse->nir,MAT_T_INT32);
-            if ( nBytes % 8 )
-                for ( i = nBytes % 8; i < 8; i++ )
-                    fwrite(&pad1,1,1,mat->fp);
-            nBytes = WriteData(mat,sparse->jc,sparse->njc,MAT_T_INT32);
-            if ( nBytes % 8 )
-                for ( i = nBytes % 8; i < 8; i++ )
-                    fwrite(&pad1,1,1,mat->fp);
-            if ( matvar->isComplex ) {
-                mat_complex_split_t *complex_data = sparse->data;
-                nBytes = WriteData(mat,complex_data->Re,sparse->ndata,
-                                   matvar->data_type);
-                if ( nBytes % 8 )
-                    for ( i = nBytes % 8; i < 8; i++ )
-                        fwrite(&pad1,1,1,mat->fp);
-                nBytes = WriteData(mat,complex_data->Im,sparse->ndata,
-                                   matvar->data_type);
-                if ( nBytes % 8 )
-                    for ( i = nBytes % 8; i < 8; i++ )
-                        fwrite(&pad1,1,1,mat->fp);
-            } else {
-                nBytes = WriteData(mat,sparse->data,sparse->ndata,
-                                   matvar->data_type);
-                if ( nBytes % 8 )
-                    for ( i = nBytes % 8; i < 8; i++ )
-                        fwrite(&pad1,1,1,mat->fp);
-            }
-        }
-        case MAT_C_FUNCTION:
-        case MAT_C_OBJECT:
-        case MAT_C_EMPTY:
-            break;
+    if ( len <= 4 ) {
+        tag[0] = (len << 16) | MAT_T_INT8;
+        memcpy(buf+32+dims_size,tag,4);
+        if ( len > 0 )
+            memcpy(buf+36+dims_size,name,len);
+    } else {
+        tag[0] = MAT_T_INT8;
+        tag[1] = len;
+        memcpy(buf+32+dims_size,tag,8);
+        memcpy(buf+40+dims_size,name,len);
     }
-    end = ftell(mat->fp);
-    nBytes = (int)(end-start);
-    fseek(mat->fp,(long)-(nBytes+4),SEEK_CUR);
-    fwrite(&nBytes,4,1,mat->fp);
-    fseek(mat->fp,end,SEEK_SET);
-    return 0;
+
+    return nbytes;
 }
 
-#if defined(HAVE_ZLIB)
-/** @brief Writes the header and data for a field of a compressed struct array
+/** @brief Encodes a variable and its elements
  *
+ * Encodes the variable as a matrix element, including the elements of cell
+ * and structure arrays.  A NULL element is encoded as an empty double.
  * @ingroup mat_internal
- * @fixme Currently does not work for cell arrays or sparse data
- * @param mat MAT file pointer
- * @param matvar pointer to the mat variable
- * @return number of bytes written to the MAT file
+ * @param matvar Variable to encode, or NULL
+ * @param name Name of the variable, or NULL for a field of a structure
+ * @param cell_names 1 to encode the names of the elements of cell arrays,
+ *                   which compressed variables have always omitted
+ * @param buf Buffer to store the encoded variable, or NULL to only compute
+ *            its size
+ * @return Number of bytes of the encoded variable
  */
 static size_t
-WriteCompressedStructField(mat_t *mat,matvar_t *matvar,z_stream *z)
+MatrixElement5(const matvar_t *matvar,const char *name,int cell_names,
+    mat_uint8_t *buf)
 {
-    mat_uint32_t array_flags = 0x0;
-    mat_int16_t  array_name_type     = MAT_T_INT8;
-    mat_int16_t  fieldname_type      = MAT_T_INT32;
-    mat_int16_t  fieldname_data_size = 4;
-    int      array_flags_type = MAT_T_UINT32, dims_array_type = MAT_T_INT32;
-    int      array_flags_size = 8, pad4 = 0;
-    int      nBytes, i, nmemb = 1, nzmax = 0;
-    long     start = 0;
-
-    mat_uint32_t comp_buf[512];
-    mat_uint32_t uncomp_buf[512] = {0,};
-    int buf_size = 512, err;
-    size_t byteswritten = 0;
-
-    if ( NULL == mat || NULL == z)
-        return 1;
+    mat_uint32_t array_flags, nzmax = 0, tag[4];
+    size_t i, nmemb = 1, nbytes, data_size;
+    const size_t *row_dims;
+    int    k;
 
     if ( NULL == matvar ) {
         size_t dims[2] = {0,0};
-        byteswritten = Mat_WriteCompressedEmptyVariable5(mat, NULL, 2, dims, z);
-        return byteswritten;
-    }
-    start = ftell(mat->fp);
-
-    /* Array Flags */
-    array_flags = matvar->class_type & CLASS_TYPE_MASK;
-    if ( matvar->isComplex )
-        array_flags |= MAT_F_COMPLEX;
-    if ( matvar->isGlobal )
-        array_flags |= MAT_F_GLOBAL;
-    if ( matvar->isLogical )
-        array_flags |= MAT_F_LOGICAL;
-    if ( matvar->class_type == MAT_C_SPARSE )
-        nzmax = ((mat_sparse_t *)matvar->data)->nzmax;
-
-    uncomp_buf[0] = MAT_T_MATRIX;
-    uncomp_buf[1] = (int)GetStructFieldBufSize(matvar);
-    z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-    z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-    z->avail_out = buf_size*sizeof(*comp_buf);
-    z->avail_in  = 8;
-    err = deflate(z,Z_NO_FLUSH);
-    byteswritten += fwrite(comp_buf,1,buf_size*sizeof(*comp_buf)-z->avail_out,
-        mat->fp);
-    uncomp_buf[0] = array_flags_type;
-    uncomp_buf[1] = array_flags_size;
-    uncomp_buf[2] = array_flags;
-    uncomp_buf[3] = nzmax;
-    /* Rank and Dimension */
-    nBytes = matvar->rank * 4;
-    uncomp_buf[4] = dims_array_type;
-    uncomp_buf[5] = nBytes;
-    for ( i = 0; i < matvar->rank; i++ ) {
-        mat_int32_t dim;
-        dim = matvar->dims[i];
-        nmemb *= dim;
-        uncomp_buf[6+i] = dim;
-    }
-    if ( matvar->rank % 2 != 0 ) {
-        uncomp_buf[6+i] = pad4;
-        i++;
-    }
 
-    z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-    z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-    z->avail_out = buf_size*sizeof(*comp_buf);
-    z->avail_in  = (6+i)*sizeof(*uncomp_buf);
-    err = deflate(z,Z_NO_FLUSH);
-    byteswritten += fwrite(comp_buf,1,buf_size*sizeof(*comp_buf)-z->avail_out,
-        mat->fp);
-    /* Name of variable */
-    uncomp_buf[0] = array_name_type;
-    uncomp_buf[1] = 0;
-    z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-    z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-    z->avail_out = buf_size*sizeof(*comp_buf);
-    z->avail_in  = 8;
-    err = deflate(z,Z_NO_FLUSH);
-    byteswritten += fwrite(comp_buf,1,buf_size*sizeof(*comp_buf)-z->avail_out,
-        mat->fp);
+        nbytes  = ArrayHeader5(MAT_C_DOUBLE,0,2,dims,NULL,buf);
+        nbytes += DataElement5(NULL,0,MAT_T_DOUBLE,1,0,NULL,
+                               ENCODE_PTR(buf,nbytes));
+        if ( NULL != buf ) {
+            tag[0] = nbytes-8;
+            memcpy(buf+4,tag,4);
+        }
+        return nbytes;
+    }
 
-    matvar->internal->datapos = ftell(mat->fp);
+    array_flags = matvar->class_type & CLASS_TYPE_MASK;
+    if ( matvar->isComplex )
+        array_flags |= MAT_F_COMPLEX;
+    if ( matvar->isGlobal )
+        array_flags |= MAT_F_GLOBAL;
+    if ( matvar->isLogical )
+        array_flags |= MAT_F_LOGICAL;
+    if ( matvar->class_type == MAT_C_SPARSE && NULL != matvar->data )
+        nzmax = ((mat_sparse_t *)matvar->data)->nzmax;
+    for ( k = 0; k < matvar->rank; k++ )
+        nmemb *= matvar->dims[k];
+
+    nbytes = ArrayHeader5(array_flags,nzmax,matvar->rank,matvar->dims,name,
+                          buf);
+    data_size = Mat_SizeOf(matvar->data_type);
+    row_dims  = (matvar->internal->read_flags & MAT_F_ROW_MAJOR) ?
+                matvar->dims : NULL;
     switch ( matvar->class_type ) {
         case MAT_C_DOUBLE:
         case MAT_C_SINGLE:
@@ -3134,384 +2377,200 @@ WriteCompressedStructField(mat_t *mat,matvar_t *matvar,z_stream *z)
         case MAT_C_UINT16:
         case MAT_C_INT8:
         case MAT_C_UINT8:
-        {
-            /* WriteCompressedData makes sure uncomressed data is aligned
-             * on an 8-byte boundary */
-            if ( matvar->isComplex ) {
-                mat_complex_split_t *complex_data = matvar->data;
-
-                if ( NULL == matvar->data )
+            if ( MAT_IS_INTERLEAVED(matvar) ) {
+                const char *re = matvar->data;
+
+                nbytes += DataElement5(re,nmemb,matvar->data_type,2,
+                              matvar->rank,row_dims,ENCODE_PTR(buf,nbytes));
+                nbytes += DataElement5(NULL == re ? NULL : re+data_size,nmemb,
+                              matvar->data_type,2,matvar->rank,row_dims,
+                              ENCODE_PTR(buf,nbytes));
+            } else if ( matvar->isComplex ) {
+                const mat_complex_split_t *complex_data = matvar->data;
+
+                if ( NULL == complex_data )
                     complex_data = &null_complex_data;
-
-                byteswritten += WriteCompressedData(mat,z,
-                    complex_data->Re,nmemb,matvar->data_type);
-                byteswritten += WriteCompressedData(mat,z,
-                    complex_data->Im,nmemb,matvar->data_type);
+                nbytes += DataElement5(complex_data->Re,nmemb,
+                              matvar->data_type,1,matvar->rank,row_dims,
+                              ENCODE_PTR(buf,nbytes));
+                nbytes += DataElement5(complex_data->Im,nmemb,
+                              matvar->data_type,1,matvar->rank,row_dims,
+                              ENCODE_PTR(buf,nbytes));
             } else {
-                byteswritten += WriteCompressedData(mat,z,
-                    matvar->data,nmemb,matvar->data_type);
+                nbytes += DataElement5(matvar->data,nmemb,matvar->data_type,1,
+                              matvar->rank,row_dims,ENCODE_PTR(buf,nbytes));
             }
             break;
-        }
         case MAT_C_CHAR:
-        {
-            byteswritten += WriteCompressedCharData(mat,z,matvar->data,
-                nmemb,matvar->data_type);
+            nbytes += CharElement5(matvar->data,nmemb,matvar->data_type,
+                                   matvar->rank,row_dims,
+                                   ENCODE_PTR(buf,nbytes));
             break;
-        }
         case MAT_C_CELL:
         {
-            int        ncells;
-            matvar_t **cells = (matvar_t **)matvar->data;
+            matvar_t **cells = matvar->data;
+            size_t ncells;
 
             /* Check for an empty cell array */
             if ( matvar->nbytes == 0 || matvar->data_size == 0 ||
-                 matvar->data   == NULL )
+                 NULL == cells )
                 break;
-            ncells  = matvar->nbytes / matvar->data_size;
+            ncells = matvar->nbytes / matvar->data_size;
             for ( i = 0; i < ncells; i++ )
-                WriteCompressedCellArrayField(mat,cells[i],z);
+                nbytes += MatrixElement5(cells[i],
+                              cell_names && NULL != cells[i] ?
+                              cells[i]->name : NULL,cell_names,
+                              ENCODE_PTR(buf,nbytes));
             break;
         }
         case MAT_C_STRUCT:
         {
-            unsigned char *padzero;
-            int        fieldname_size, nfields;
-            size_t     maxlen = 0;
-            mat_int32_t array_name_type = MAT_T_INT8;
-            matvar_t **fields = (matvar_t **)matvar->data;
+            matvar_t **fields = matvar->data;
+            char **fieldnames = matvar->internal->fieldnames;
+            size_t nfields = matvar->internal->num_fields;
+            size_t len, fieldname_size = 0;
 
-            nfields = matvar->internal->num_fields;
-            /* Check for a structure with no fields */
-            if ( nfields < 1 ) {
-                fieldname_size = 1;
-                uncomp_buf[0] = (fieldname_data_size << 16) |
-                                 fieldname_type;
-                uncomp_buf[1] = 1;
-                uncomp_buf[2] = array_name_type;
-                uncomp_buf[3] = 0;
-                z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-                z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-                z->avail_out = buf_size*sizeof(*comp_buf);
-                z->avail_in  = 16;
-                err = deflate(z,Z_NO_FLUSH);
-                byteswritten += fwrite(comp_buf,1,buf_size*
-                    sizeof(*comp_buf)-z->avail_out,mat->fp);
-                break;
-            }
             for ( i = 0; i < nfields; i++ ) {
-                size_t len = strlen(matvar->internal->fieldnames[i]);
-                if ( len > maxlen )
-                    maxlen = len;
+                len = NULL == fieldnames[i] ? 0 : strlen(fieldnames[i]);
+                if ( len > fieldname_size )
+                    fieldname_size = len;
             }
-            maxlen++;
-            fieldname_size = maxlen;
+            fieldname_size++;
             while ( nfields*fieldname_size % 8 != 0 )
                 fieldname_size++;
-            uncomp_buf[0] = (fieldname_data_size << 16) | fieldname_type;
-            uncomp_buf[1] = fieldname_size;
-            uncomp_buf[2] = array_name_type;
-            uncomp_buf[3] = nfields*fieldname_size;
-
-            padzero = calloc(fieldname_size,1);
-            z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-            z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-            z->avail_out = buf_size*sizeof(*comp_buf);
-            z->avail_in  = 16;
-            err = deflate(z,Z_NO_FLUSH);
-            byteswritten += fwrite(comp_buf,1,
-                    buf_size*sizeof(*comp_buf)-z->avail_out,mat->fp);
-            for ( i = 0; i < nfields; i++ ) {
-                size_t len = strlen(matvar->internal->fieldnames[i]);
-                memset(padzero,'\0',fieldname_size);
-                memcpy(padzero,matvar->internal->fieldnames[i],len);
-                z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-                z->next_in   = ZLIB_BYTE_PTR(padzero);
-                z->avail_out = buf_size*sizeof(*comp_buf);
-                z->avail_in  = fieldname_size;
-                err = deflate(z,Z_NO_FLUSH);
-                byteswritten += fwrite(comp_buf,1,
-                        buf_size*sizeof(*comp_buf)-z->avail_out,mat->fp);
+            if ( NULL != buf ) {
+                tag[0] = (4 << 16) | MAT_T_INT32;
+                tag[1] = fieldname_size;
+                tag[2] = MAT_T_INT8;
+                tag[3] = nfields*fieldname_size;
+                memcpy(buf+nbytes,tag,sizeof(tag));
+                memset(buf+nbytes+16,0,nfields*fieldname_size);
+                for ( i = 0; i < nfields; i++ ) {
+                    if ( NULL != fieldnames[i] )
+                        memcpy(buf+nbytes+16+i*fieldname_size,fieldnames[i],
+                               strlen(fieldnames[i]));
+                }
             }
-            free(padzero);
+            nbytes += 16+nfields*fieldname_size;
             for ( i = 0; i < nmemb*nfields; i++ )
-                byteswritten +=
-                    WriteCompressedStructField(mat,fields[i],z);
+                nbytes += MatrixElement5(NULL == fields ? NULL : fields[i],
+                              NULL,cell_names,ENCODE_PTR(buf,nbytes));
             break;
         }
         case MAT_C_SPARSE:
         {
-            mat_sparse_t *sparse = matvar->data;
+            const mat_sparse_t *sparse = matvar->data;
 
-            byteswritten += WriteCompressedData(mat,z,sparse->ir,
-                sparse->nir,MAT_T_INT32);
-            byteswritten += WriteCompressedData(mat,z,sparse->jc,
-                sparse->njc,MAT_T_INT32);
+            if ( NULL == sparse )
+                break;
+            nbytes += DataElement5(sparse->ir,sparse->nir,MAT_T_INT32,1,0,
+                                   NULL,ENCODE_PTR(buf,nbytes));
+            nbytes += DataElement5(sparse->jc,sparse->njc,MAT_T_INT32,1,0,
+                                   NULL,ENCODE_PTR(buf,nbytes));
             if ( matvar->isComplex ) {
-                mat_complex_split_t *complex_data = sparse->data;
-                byteswritten += WriteCompressedData(mat,z,
-                    complex_data->Re,sparse->ndata,matvar->data_type);
-                byteswritten += WriteCompressedData(mat,z,
-                    complex_data->Im,sparse->ndata,matvar->data_type);
+                const mat_complex_split_t *complex_data = sparse->data;
+
+                nbytes += DataElement5(complex_data->Re,sparse->ndata,
+                              matvar->data_type,1,0,NULL,
+                              ENCODE_PTR(buf,nbytes));
+                nbytes += DataElement5(complex_data->Im,sparse->ndata,
+                              matvar->data_type,1,0,NULL,
+                              ENCODE_PTR(buf,nbytes));
             } else {
-                byteswritten += WriteCompressedData(mat,z,
-                    sparse->data,sparse->ndata,matvar->data_type);
+                nbytes += DataElement5(sparse->data,sparse->ndata,
+                              matvar->data_type,1,0,NULL,
+                              ENCODE_PTR(buf,nbytes));
             }
             break;
         }
+        case MAT_C_EMPTY:
         case MAT_C_FUNCTION:
         case MAT_C_OBJECT:
-        case MAT_C_EMPTY:
             break;
     }
-
-    return byteswritten;
-}
-#endif
-
-static size_t
-Mat_WriteEmptyVariable5(mat_t *mat,const char *name,int rank,size_t *dims)
-{
-    mat_uint32_t array_flags = 0x0;
-    mat_int32_t  array_name_type = MAT_T_INT8, matrix_type = MAT_T_MATRIX;
-    int          array_flags_type = MAT_T_UINT32, dims_array_type = MAT_T_INT32;
-    int          array_flags_size = 8, pad4 = 0, nBytes, i, nmemb = 1;
-    mat_int8_t   pad1 = 0;
-    size_t       byteswritten = 0;
-    long         start = 0, end = 0;
-
-    fwrite(&matrix_type,4,1,mat->fp);
-    fwrite(&pad4,4,1,mat->fp);
-
-    start = ftell(mat->fp);
-    /* Array Flags */
-    array_flags = MAT_C_DOUBLE;
-
-    if ( mat->byteswap )
-        array_flags = Mat_int32Swap((mat_int32_t*)&array_flags);
-    byteswritten += fwrite(&array_flags_type,4,1,mat->fp);
-    byteswritten += fwrite(&array_flags_size,4,1,mat->fp);
-    byteswritten += fwrite(&array_flags,4,1,mat->fp);
-    byteswritten += fwrite(&pad4,4,1,mat->fp);
-    /* Rank and Dimension */
-    nBytes = rank * 4;
-    byteswritten += fwrite(&dims_array_type,4,1,mat->fp);
-    byteswritten += fwrite(&nBytes,4,1,mat->fp);
-    for ( i = 0; i < rank; i++ ) {
-        mat_int32_t dim;
-        dim = dims[i];
-        nmemb *= dim;
-        byteswritten += fwrite(&dim,4,1,mat->fp);
-    }
-    if ( rank % 2 != 0 )
-        byteswritten += fwrite(&pad4,4,1,mat->fp);
-
-    if ( NULL == name ) {
-        /* Name of variable */
-        byteswritten += fwrite(&array_name_type,4,1,mat->fp);
-        byteswritten += fwrite(&pad4,4,1,mat->fp);
-    } else {
-        mat_int32_t  array_name_type = MAT_T_INT8;
-        mat_int32_t  array_name_len   = strlen(name);
-        /* Name of variable */
-        if ( array_name_len <= 4 ) {
-            mat_int8_t  pad1 = 0;
-            array_name_type = (array_name_len << 16) | array_name_type;
-            byteswritten += fwrite(&array_name_type,4,1,mat->fp);
-            byteswritten += fwrite(name,1,array_name_len,mat->fp);
-            for ( i = array_name_len; i < 4; i++ )
-                byteswritten += fwrite(&pad1,1,1,mat->fp);
-        } else {
-            byteswritten += fwrite(&array_name_type,4,1,mat->fp);
-            byteswritten += fwrite(&array_name_len,4,1,mat->fp);
-            byteswritten += fwrite(name,1,array_name_len,mat->fp);
-            if ( array_name_len % 8 )
-                for ( i = array_name_len % 8; i < 8; i++ )
-                    byteswritten += fwrite(&pad1,1,1,mat->fp);
-        }
+    if ( NULL != buf ) {
+        tag[0] = nbytes-8;
+        memcpy(buf+4,tag,4);
     }
 
-    nBytes = WriteData(mat,NULL,0,MAT_T_DOUBLE);
-    byteswritten += nBytes;
-    if ( nBytes % 8 )
-        for ( i = nBytes % 8; i < 8; i++ )
-            byteswritten += fwrite(&pad1,1,1,mat->fp);
-
-    end = ftell(mat->fp);
-    nBytes = (int)(end-start);
-    fseek(mat->fp,(long)-(nBytes+4),SEEK_CUR);
-    fwrite(&nBytes,4,1,mat->fp);
-    fseek(mat->fp,end,SEEK_SET);
-
-    return byteswritten;
+    return nbytes;
 }
 
 #if defined(HAVE_ZLIB)
-static size_t
-Mat_WriteCompressedEmptyVariable5(mat_t *mat,const char *name,int rank,
-                                  size_t *dims,z_stream *z)
+/** @brief Compresses an encoded variable and writes it to the file
+ *
+ * The variable is compressed with a single call into a buffer large enough
+ * for the compressed data, which is written with the tag of the compressed
+ * data.  If that buffer cannot be allocated, the compressed data is written
+ * as it is produced.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param buf Variable encoded by MatrixElement5
+ * @param nbytes Number of bytes of @c buf
+ * @retval 0 on success
+ */
+static int
+WriteCompressedVar5(mat_t *mat,const mat_uint8_t *buf,size_t nbytes)
 {
-    mat_uint32_t array_flags = 0x0;
-    mat_int16_t  array_name_type     = MAT_T_INT8;
-    int      array_flags_type = MAT_T_UINT32, dims_array_type = MAT_T_INT32;
-    int      array_flags_size = 8, pad4 = 0;
-    int      nBytes, i, nmemb = 1;
-
-    mat_uint32_t comp_buf[512];
-    mat_uint32_t uncomp_buf[512] = {0,};
-    int buf_size = 512, err;
-    size_t byteswritten = 0, buf_size_bytes;
-
-    if ( NULL == mat || NULL == z)
+    mat_uint32_t tag[2];
+    mat_uint8_t *comp_buf = NULL;
+    z_stream    *z;
+    uLong        bound;
+    long         start;
+    int          err;
+
+    z = Mat_DeflateInit(mat->allocator);
+    if ( NULL == z )
         return 1;
-
-    buf_size_bytes = buf_size*sizeof(*comp_buf);
-
-    /* Array Flags */
-    array_flags = MAT_C_DOUBLE;
-
-    uncomp_buf[0] = MAT_T_MATRIX;
-    uncomp_buf[1] = (int)GetEmptyMatrixMaxBufSize(name,rank);
-    z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-    z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-    z->avail_out = buf_size_bytes;
-    z->avail_in  = 8;
-    err = deflate(z,Z_NO_FLUSH);
-    byteswritten += fwrite(comp_buf,1,buf_size_bytes-z->avail_out,mat->fp);
-    uncomp_buf[0] = array_flags_type;
-    uncomp_buf[1] = array_flags_size;
-    uncomp_buf[2] = array_flags;
-    uncomp_buf[3] = 0;
-    /* Rank and Dimension */
-    nBytes = rank * 4;
-    uncomp_buf[4] = dims_array_type;
-    uncomp_buf[5] = nBytes;
-    for ( i = 0; i < rank; i++ ) {
-        mat_int32_t dim;
-        dim = dims[i];
-        nmemb *= dim;
-        uncomp_buf[6+i] = dim;
-    }
-    if ( rank % 2 != 0 ) {
-        uncomp_buf[6+i] = pad4;
-        i++;
+    bound = deflateBound(z,nbytes);
+    if ( bound <= 0xffffffffUL )
+        comp_buf = Mat_Malloc(mat->allocator,8+bound);
+    if ( NULL == comp_buf ) {
+        tag[0] = MAT_T_COMPRESSED;
+        tag[1] = 0;
+        fwrite(tag,4,2,mat->fp);
+        start = ftell(mat->fp);
+        err = WriteCompressedBytes5(mat,z,buf,nbytes);
+        WriteCompressedEnd5(mat,z,start);
+        return err;
     }
 
-    z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-    z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-    z->avail_out = buf_size_bytes;
-    z->avail_in  = (6+i)*sizeof(*uncomp_buf);
-    err = deflate(z,Z_NO_FLUSH);
-    byteswritten += fwrite(comp_buf,1,buf_size_bytes-z->avail_out,mat->fp);
-    /* Name of variable */
-    if ( NULL == name ) {
-        uncomp_buf[0] = array_name_type;
-        uncomp_buf[1] = 0;
-        z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-        z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-        z->avail_out = buf_size_bytes;
-        z->avail_in  = 8;
-        err = deflate(z,Z_NO_FLUSH);
-        byteswritten += fwrite(comp_buf,1,buf_size_bytes-z->avail_out,mat->fp);
-    } else {
-        if ( strlen(name) <= 4 ) {
-            mat_int16_t array_name_len = (mat_int16_t)strlen(name);
-            mat_int16_t array_name_type = MAT_T_INT8;
-
-            memset(uncomp_buf,0,8);
-            uncomp_buf[0] = (array_name_len << 16) | array_name_type;
-            memcpy(uncomp_buf+1,name,array_name_len);
-            if ( array_name_len % 4 )
-                array_name_len += 4-(array_name_len % 4);
-
-            z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-            z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-            z->avail_out = buf_size_bytes;
-            z->avail_in  = 8;
-            err = deflate(z,Z_NO_FLUSH);
-            byteswritten += fwrite(comp_buf,1,buf_size_bytes-z->avail_out,
-                                   mat->fp);
-        } else {
-            mat_int32_t array_name_len = (mat_int32_t)strlen(name);
-            mat_int32_t array_name_type = MAT_T_INT8;
-
-            memset(uncomp_buf,0,buf_size*sizeof(*uncomp_buf));
-            uncomp_buf[0] = array_name_type;
-            uncomp_buf[1] = array_name_len;
-            memcpy(uncomp_buf+2,name,array_name_len);
-            if ( array_name_len % 8 )
-                array_name_len += 8-(array_name_len % 8);
-            z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-            z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-            z->avail_out = buf_size_bytes;
-            z->avail_in  = 8+array_name_len;
-            err = deflate(z,Z_NO_FLUSH);
-            byteswritten += fwrite(comp_buf,1,buf_size_bytes-z->avail_out,
-                                   mat->fp);
-        }
+    z->next_in   = ZLIB_BYTE_PTR(buf);
+    z->avail_in  = nbytes;
+    z->next_out  = comp_buf+8;
+    z->avail_out = bound;
+    err = deflate(z,Z_FINISH) != Z_STREAM_END;
+    if ( !err ) {
+        tag[0] = MAT_T_COMPRESSED;
+        tag[1] = z->total_out;
+        memcpy(comp_buf,tag,sizeof(tag));
+        nbytes = 8+z->total_out;
+        err = fwrite(comp_buf,1,nbytes,mat->fp) != nbytes;
     }
+    Mat_DeflateEnd(mat->allocator,z);
+    Mat_Free(mat->allocator,comp_buf);
 
-    byteswritten += WriteCompressedData(mat,z,NULL,0,MAT_T_DOUBLE);
-    return byteswritten;
+    return err;
 }
 #endif
 
 /** @if mat_devman
- * @brief Reads a data element including tag and data
+ * @brief Decodes @c N elements of numeric data to the class of @c matvar
  *
  * @ingroup mat_internal
  * @param mat MAT file pointer
  * @param matvar MAT variable pointer
  * @param data Pointer to store the data
- * @param N number of data elements allocated for the pointer
+ * @param packed_type Data type of the data in the file
+ * @param N number of data elements to read
+ * @return number of bytes read from the file
  * @endif
  */
-void
-Mat_VarReadNumeric5(mat_t *mat,matvar_t *matvar,void *data,size_t N)
+static int
+ReadNumericData5(mat_t *mat,matvar_t *matvar,void *data,
+    enum matio_types packed_type,size_t N)
 {
-    int nBytes = 0, data_in_tag = 0;
-    enum matio_types packed_type = MAT_T_UNKNOWN;
-    mat_uint32_t tag[2];
-
-    if ( matvar->compression ) {
-#if defined(HAVE_ZLIB)
-        matvar->internal->z->avail_in = 0;
-        InflateDataType(mat,matvar->internal->z,tag);
-        if ( mat->byteswap )
-            (void)Mat_uint32Swap(tag);
-
-        packed_type = TYPE_FROM_TAG(tag[0]);
-        if ( tag[0] & 0xffff0000 ) { /* Data is in the tag */
-            data_in_tag = 1;
-            nBytes = (tag[0] & 0xffff0000) >> 16;
-        } else {
-            data_in_tag = 0;
-            InflateDataType(mat,matvar->internal->z,tag+1);
-            if ( mat->byteswap )
-                (void)Mat_uint32Swap(tag+1);
-            nBytes = tag[1];
-        }
-#endif
-    } else {
-        fread(tag,4,1,mat->fp);
-        if ( mat->byteswap )
-            (void)Mat_uint32Swap(tag);
-        packed_type = TYPE_FROM_TAG(tag[0]);
-        if ( tag[0] & 0xffff0000 ) { /* Data is in the tag */
-            data_in_tag = 1;
-            nBytes = (tag[0] & 0xffff0000) >> 16;
-        } else {
-            data_in_tag = 0;
-            fread(tag+1,4,1,mat->fp);
-            if ( mat->byteswap )
-                (void)Mat_uint32Swap(tag+1);
-            nBytes = tag[1];
-        }
-    }
-    if ( nBytes == 0 ) {
-        matvar->nbytes = 0;
-        return;
-    }
+    int nBytes = 0;
 
     if ( matvar->compression == MAT_COMPRESSION_NONE) {
         switch ( matvar->class_type ) {
@@ -3552,14 +2611,6 @@ Mat_VarReadNumeric5(mat_t *mat,matvar_t *matvar,void *data,size_t N)
             default:
                 break;
         }
-        /*
-         * If the data was in the tag we started on a 4-byte
-         * boundary so add 4 to make it an 8-byte
-         */
-        if ( data_in_tag )
-            nBytes+=4;
-        if ( (nBytes % 8) != 0 )
-            fseek(mat->fp,8-(nBytes % 8),SEEK_CUR);
 #if defined(HAVE_ZLIB)
     } else if ( matvar->compression == MAT_COMPRESSION_ZLIB ) {
         switch ( matvar->class_type ) {
@@ -3610,16 +2661,218 @@ Mat_VarReadNumeric5(mat_t *mat,matvar_t *matvar,void *data,size_t N)
             default:
                 break;
         }
-        /*
-         * If the data was in the tag we started on a 4-byte
-         * boundary so add 4 to make it an 8-byte
-         */
-        if ( data_in_tag )
-            nBytes+=4;
-        if ( (nBytes % 8) != 0 )
-            InflateSkip(mat,matvar->internal->z,8-(nBytes % 8));
 #endif
     }
+
+    return nBytes;
+}
+
+/** @if mat_devman
+ * @brief Reads a data element including tag and data
+ *
+ * Stores element @c k of the data at element @c k*stride of @c data.  If
+ * MAT_F_ROW_MAJOR was set with Mat_VarSetReadFlags, the elements are stored
+ * in the row-major order of @c matvar->dims instead.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar MAT variable pointer
+ * @param data Pointer to store the data
+ * @param N number of data elements to read
+ * @param stride Stride of @c data in elements
+ * @endif
+ */
+static void
+ReadNumeric5(mat_t *mat,matvar_t *matvar,void *data,size_t N,size_t stride)
+{
+    int nBytes = 0, data_in_tag = 0;
+    enum matio_types packed_type = MAT_T_UNKNOWN;
+    mat_uint32_t tag[2];
+
+    if ( matvar->compression ) {
+#if defined(HAVE_ZLIB)
+        matvar->internal->z->avail_in = 0;
+        InflateDataType(mat,matvar->internal->z,tag);
+        if ( mat->byteswap )
+            (void)Mat_uint32Swap(tag);
+
+        packed_type = TYPE_FROM_TAG(tag[0]);
+        if ( tag[0] & 0xffff0000 ) { /* Data is in the tag */
+            data_in_tag = 1;
+            nBytes = (tag[0] & 0xffff0000) >> 16;
+        } else {
+            data_in_tag = 0;
+            InflateDataType(mat,matvar->internal->z,tag+1);
+            if ( mat->byteswap )
+                (void)Mat_uint32Swap(tag+1);
+            nBytes = tag[1];
+        }
+#endif
+    } else {
+        fread(tag,4,1,mat->fp);
+        if ( mat->byteswap )
+            (void)Mat_uint32Swap(tag);
+        packed_type = TYPE_FROM_TAG(tag[0]);
+        if ( tag[0] & 0xffff0000 ) { /* Data is in the tag */
+            data_in_tag = 1;
+            nBytes = (tag[0] & 0xffff0000) >> 16;
+        } else {
+            data_in_tag = 0;
+            fread(tag+1,4,1,mat->fp);
+            if ( mat->byteswap )
+                (void)Mat_uint32Swap(tag+1);
+            nBytes = tag[1];
+        }
+    }
+    if ( nBytes == 0 ) {
+        matvar->nbytes = 0;
+        return;
+    }
+
+    if ( stride > 1 || (matvar->internal->read_flags & MAT_F_ROW_MAJOR) ) {
+        /* Decode a block at a time and store it at its place in data */
+        double buf[MAT_INTERLEAVE_BLOCK];
+        size_t i, n, block = sizeof(buf)/matvar->data_size;
+
+        nBytes = 0;
+        for ( i = 0; i < N; i += n ) {
+            n = (N-i < block) ? N-i : block;
+            nBytes += ReadNumericData5(mat,matvar,buf,packed_type,n);
+            if ( matvar->internal->read_flags & MAT_F_ROW_MAJOR )
+                Mat_ScatterRowMajor(data,stride,buf,1,matvar->data_size,
+                                    matvar->rank,matvar->dims,i,n);
+            else
+                Mat_CopyStrided((char*)data+i*stride*matvar->data_size,
+                                stride,buf,1,matvar->data_size,n);
+        }
+    } else {
+        nBytes = ReadNumericData5(mat,matvar,data,packed_type,N);
+    }
+
+    if ( matvar->compression == MAT_COMPRESSION_NONE) {
+        /*
+         * If the data was in the tag we started on a 4-byte
+         * boundary so add 4 to make it an 8-byte
+         */
+        if ( data_in_tag )
+            nBytes+=4;
+        if ( (nBytes % 8) != 0 )
+            fseek(mat->fp,8-(nBytes % 8),SEEK_CUR);
+#if defined(HAVE_ZLIB)
+    } else if ( matvar->compression == MAT_COMPRESSION_ZLIB ) {
+        /*
+         * If the data was in the tag we started on a 4-byte
+         * boundary so add 4 to make it an 8-byte
+         */
+        if ( data_in_tag )
+            nBytes+=4;
+        if ( (nBytes % 8) != 0 )
+            InflateSkip(mat,matvar->internal->z,8-(nBytes % 8));
+#endif
+    }
+}
+
+/** @if mat_devman
+ * @brief Reads a data element including tag and data
+ *
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar MAT variable pointer
+ * @param data Pointer to store the data
+ * @param N number of data elements allocated for the pointer
+ * @endif
+ */
+void
+Mat_VarReadNumeric5(mat_t *mat,matvar_t *matvar,void *data,size_t N)
+{
+    ReadNumeric5(mat,matvar,data,N,1);
+}
+
+/** @if mat_devman
+ * @brief Reads the parts of complex numeric data to an interleaved buffer
+ *
+ * Each part is decoded directly into every second element of the buffer, so
+ * no split copy of the data is made.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar MAT variable pointer with @c nbytes set to the size of a part
+ * @param N number of elements in each part
+ * @endif
+ */
+static void
+ReadInterleaved5(mat_t *mat,matvar_t *matvar,size_t N)
+{
+    char *data;
+
+    data = Mat_VarDataAlloc(matvar,2*matvar->nbytes);
+    if ( NULL == data ) {
+        Mat_Critical("Failed to allocate %d bytes",2*matvar->nbytes);
+        return;
+    }
+    ReadNumeric5(mat,matvar,data,N,2);
+    ReadNumeric5(mat,matvar,data+matvar->data_size,N,2);
+    matvar->data = data;
+}
+
+/** @if mat_devman
+ * @brief Reads the character data of a variable
+ *
+ * If MAT_F_ROW_MAJOR was set with Mat_VarSetReadFlags, the data is decoded
+ * a block at a time and each block is stored at its row-major place.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar MAT variable pointer
+ * @param data Pointer to store the data
+ * @param packed_type Data type of the data in the file
+ * @param len Number of elements
+ * @return Number of bytes read
+ * @endif
+ */
+static int
+ReadChar5(mat_t *mat,matvar_t *matvar,char *data,
+    enum matio_types packed_type,int len)
+{
+    char buf[8*MAT_INTERLEAVE_BLOCK], *out;
+    int i, n, nBytes = 0;
+
+    for ( i = 0; i < len; i += n ) {
+        n = len-i;
+        if ( matvar->internal->read_flags & MAT_F_ROW_MAJOR ) {
+            out = buf;
+            if ( n > (int)sizeof(buf) )
+                n = sizeof(buf);
+        } else {
+            out = data+i;
+        }
+        if ( matvar->compression == MAT_COMPRESSION_NONE )
+            nBytes += ReadCharData(mat,out,packed_type,n);
+#if defined(HAVE_ZLIB)
+        else
+            nBytes += ReadCompressedCharData(mat,matvar->internal->z,out,
+                                             packed_type,n);
+#endif
+        if ( out == buf )
+            Mat_ScatterRowMajor(data,1,buf,1,1,matvar->rank,matvar->dims,i,n);
+    }
+
+    return nBytes;
+}
+
+/** @if mat_devman
+ * @brief Checks if the data of an element is read with its parent
+ *
+ * Cell arrays and structures are read with their parent so that their own
+ * elements can be left unread by a lazy read, as are empty elements.
+ * @ingroup mat_internal
+ * @param matvar Element of a cell array or structure
+ * @retval 1 if the element is always read with its parent, 0 otherwise
+ * @endif
+ */
+static int
+IsContainer5(const matvar_t *matvar)
+{
+    return MAT_C_CELL == matvar->class_type ||
+           MAT_C_STRUCT == matvar->class_type ||
+           MAT_C_EMPTY == matvar->class_type || 0 == matvar->rank;
 }
 
 /** @if mat_devman
@@ -3637,11 +2890,13 @@ Read5(mat_t *mat, matvar_t *matvar)
     enum matio_types packed_type = MAT_T_UNKNOWN;
     long fpos;
     mat_uint32_t tag[2];
+    struct mat_arena *arena;
 
     if ( matvar == NULL )
         return;
     else if ( matvar->rank == 0 )        /* An empty data set */
         return;
+    arena = matvar->internal->arena;
 
     fpos = ftell(mat->fp);
     len = 1;
@@ -3655,7 +2910,8 @@ Read5(mat_t *mat, matvar_t *matvar)
             matvar->data_type = MAT_T_DOUBLE;
             matvar->class_type = MAT_C_EMPTY;
             matvar->rank = 2;
-            matvar->dims = malloc(matvar->rank*sizeof(*(matvar->dims)));
+            matvar->dims = Mat_VarMemAlloc(matvar,
+                               matvar->rank*sizeof(*(matvar->dims)));
             matvar->dims[0] = 0;
             matvar->dims[1] = 0;
             break;
@@ -3663,23 +2919,26 @@ Read5(mat_t *mat, matvar_t *matvar)
             fseek(mat->fp,matvar->internal->datapos,SEEK_SET);
             matvar->data_size = sizeof(double);
             matvar->data_type = MAT_T_DOUBLE;
-            if ( matvar->isComplex ) {
+            if ( MAT_IS_INTERLEAVED(matvar) ) {
+                matvar->nbytes = len*matvar->data_size;
+                ReadInterleaved5(mat,matvar,len);
+            } else if ( matvar->isComplex ) {
                 mat_complex_split_t *complex_data;
 
                 matvar->nbytes = len*matvar->data_size;
-                complex_data = malloc(sizeof(*complex_data));
+                complex_data = Mat_VarMemAlloc(matvar,sizeof(*complex_data));
                 if ( NULL == complex_data ) {
                     Mat_Critical("Failed to allocate %d bytes",sizeof(*complex_data));
                     break;
                 }
-                complex_data->Re = malloc(matvar->nbytes);
-                complex_data->Im = malloc(matvar->nbytes);
+                complex_data->Re = Mat_VarDataAlloc(matvar,matvar->nbytes);
+                complex_data->Im = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 if ( NULL == complex_data->Re || NULL == complex_data->Im ) {
                     if ( NULL != complex_data->Re )
-                        free(complex_data->Re);
+                        Mat_VarDataFree(matvar,complex_data->Re);
                     if ( NULL != complex_data->Im )
-                        free(complex_data->Im);
-                    free(complex_data);
+                        Mat_VarDataFree(matvar,complex_data->Im);
+                    Mat_VarMemFree(matvar,complex_data);
                     Mat_Critical("Failed to allocate %d bytes",2*matvar->nbytes);
                     break;
                 }
@@ -3688,7 +2947,7 @@ Read5(mat_t *mat, matvar_t *matvar)
                 matvar->data = complex_data;
             } else {
                 matvar->nbytes = len*matvar->data_size;
-                matvar->data   = malloc(matvar->nbytes);
+                matvar->data   = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 if ( !matvar->data ) {
                     Mat_Critical("Failed to allocate %d bytes",matvar->nbytes);
                     break;
@@ -3700,23 +2959,26 @@ Read5(mat_t *mat, matvar_t *matvar)
             fseek(mat->fp,matvar->internal->datapos,SEEK_SET);
             matvar->data_size = sizeof(float);
             matvar->data_type = MAT_T_SINGLE;
-            if ( matvar->isComplex ) {
+            if ( MAT_IS_INTERLEAVED(matvar) ) {
+                matvar->nbytes = len*matvar->data_size;
+                ReadInterleaved5(mat,matvar,len);
+            } else if ( matvar->isComplex ) {
                 mat_complex_split_t *complex_data;
 
                 matvar->nbytes = len*matvar->data_size;
-                complex_data = malloc(sizeof(*complex_data));
+                complex_data = Mat_VarMemAlloc(matvar,sizeof(*complex_data));
                 if ( NULL == complex_data ) {
                     Mat_Critical("Failed to allocate %d bytes",sizeof(*complex_data));
                     break;
                 }
-                complex_data->Re = malloc(matvar->nbytes);
-                complex_data->Im = malloc(matvar->nbytes);
+                complex_data->Re = Mat_VarDataAlloc(matvar,matvar->nbytes);
+                complex_data->Im = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 if ( NULL == complex_data->Re || NULL == complex_data->Im ) {
                     if ( NULL != complex_data->Re )
-                        free(complex_data->Re);
+                        Mat_VarDataFree(matvar,complex_data->Re);
                     if ( NULL != complex_data->Im )
-                        free(complex_data->Im);
-                    free(complex_data);
+                        Mat_VarDataFree(matvar,complex_data->Im);
+                    Mat_VarMemFree(matvar,complex_data);
                     Mat_Critical("Failed to allocate %d bytes",2*matvar->nbytes);
                     break;
                 }
@@ -3725,7 +2987,7 @@ Read5(mat_t *mat, matvar_t *matvar)
                 matvar->data = complex_data;
             } else {
                 matvar->nbytes = len*matvar->data_size;
-                matvar->data   = malloc(matvar->nbytes);
+                matvar->data   = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 if ( !matvar->data ) {
                     Mat_Critical("Failed to allocate %d bytes",matvar->nbytes);
                     break;
@@ -3738,23 +3000,26 @@ Read5(mat_t *mat, matvar_t *matvar)
             fseek(mat->fp,matvar->internal->datapos,SEEK_SET);
             matvar->data_size = sizeof(mat_int64_t);
             matvar->data_type = MAT_T_INT64;
-            if ( matvar->isComplex ) {
+            if ( MAT_IS_INTERLEAVED(matvar) ) {
+                matvar->nbytes = len*matvar->data_size;
+                ReadInterleaved5(mat,matvar,len);
+            } else if ( matvar->isComplex ) {
                 mat_complex_split_t *complex_data;
 
                 matvar->nbytes = len*matvar->data_size;
-                complex_data = malloc(sizeof(*complex_data));
+                complex_data = Mat_VarMemAlloc(matvar,sizeof(*complex_data));
                 if ( NULL == complex_data ) {
                     Mat_Critical("Failed to allocate %d bytes",sizeof(*complex_data));
                     break;
                 }
-                complex_data->Re = malloc(matvar->nbytes);
-                complex_data->Im = malloc(matvar->nbytes);
+                complex_data->Re = Mat_VarDataAlloc(matvar,matvar->nbytes);
+                complex_data->Im = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 if ( NULL == complex_data->Re || NULL == complex_data->Im ) {
                     if ( NULL != complex_data->Re )
-                        free(complex_data->Re);
+                        Mat_VarDataFree(matvar,complex_data->Re);
                     if ( NULL != complex_data->Im )
-                        free(complex_data->Im);
-                    free(complex_data);
+                        Mat_VarDataFree(matvar,complex_data->Im);
+                    Mat_VarMemFree(matvar,complex_data);
                     Mat_Critical("Failed to allocate %d bytes",2*matvar->nbytes);
                     break;
                 }
@@ -3763,7 +3028,7 @@ Read5(mat_t *mat, matvar_t *matvar)
                 matvar->data = complex_data;
             } else {
                 matvar->nbytes = len*matvar->data_size;
-                matvar->data   = malloc(matvar->nbytes);
+                matvar->data   = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 if ( !matvar->data ) {
                     Mat_Critical("Failed to allocate %d bytes",matvar->nbytes);
                     break;
@@ -3777,23 +3042,26 @@ Read5(mat_t *mat, matvar_t *matvar)
             fseek(mat->fp,matvar->internal->datapos,SEEK_SET);
             matvar->data_size = sizeof(mat_uint64_t);
             matvar->data_type = MAT_T_UINT64;
-            if ( matvar->isComplex ) {
+            if ( MAT_IS_INTERLEAVED(matvar) ) {
+                matvar->nbytes = len*matvar->data_size;
+                ReadInterleaved5(mat,matvar,len);
+            } else if ( matvar->isComplex ) {
                 mat_complex_split_t *complex_data;
 
                 matvar->nbytes = len*matvar->data_size;
-                complex_data = malloc(sizeof(*complex_data));
+                complex_data = Mat_VarMemAlloc(matvar,sizeof(*complex_data));
                 if ( NULL == complex_data ) {
                     Mat_Critical("Failed to allocate %d bytes",sizeof(*complex_data));
                     break;
                 }
-                complex_data->Re = malloc(matvar->nbytes);
-                complex_data->Im = malloc(matvar->nbytes);
+                complex_data->Re = Mat_VarDataAlloc(matvar,matvar->nbytes);
+                complex_data->Im = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 if ( NULL == complex_data->Re || NULL == complex_data->Im ) {
                     if ( NULL != complex_data->Re )
-                        free(complex_data->Re);
+                        Mat_VarDataFree(matvar,complex_data->Re);
                     if ( NULL != complex_data->Im )
-                        free(complex_data->Im);
-                    free(complex_data);
+                        Mat_VarDataFree(matvar,complex_data->Im);
+                    Mat_VarMemFree(matvar,complex_data);
                     Mat_Critical("Failed to allocate %d bytes",2*matvar->nbytes);
                     break;
                 }
@@ -3802,7 +3070,7 @@ Read5(mat_t *mat, matvar_t *matvar)
                 matvar->data = complex_data;
             } else {
                 matvar->nbytes = len*matvar->data_size;
-                matvar->data   = malloc(matvar->nbytes);
+                matvar->data   = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 if ( !matvar->data ) {
                     Mat_Critical("Failed to allocate %d bytes",matvar->nbytes);
                     break;
@@ -3815,23 +3083,26 @@ Read5(mat_t *mat, matvar_t *matvar)
             fseek(mat->fp,matvar->internal->datapos,SEEK_SET);
             matvar->data_size = sizeof(mat_int32_t);
             matvar->data_type = MAT_T_INT32;
-            if ( matvar->isComplex ) {
+            if ( MAT_IS_INTERLEAVED(matvar) ) {
+                matvar->nbytes = len*matvar->data_size;
+                ReadInterleaved5(mat,matvar,len);
+            } else if ( matvar->isComplex ) {
                 mat_complex_split_t *complex_data;
 
                 matvar->nbytes = len*matvar->data_size;
-                complex_data = malloc(sizeof(*complex_data));
+                complex_data = Mat_VarMemAlloc(matvar,sizeof(*complex_data));
                 if ( NULL == complex_data ) {
                     Mat_Critical("Failed to allocate %d bytes",sizeof(*complex_data));
                     break;
                 }
-                complex_data->Re = malloc(matvar->nbytes);
-                complex_data->Im = malloc(matvar->nbytes);
+                complex_data->Re = Mat_VarDataAlloc(matvar,matvar->nbytes);
+                complex_data->Im = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 if ( NULL == complex_data->Re || NULL == complex_data->Im ) {
                     if ( NULL != complex_data->Re )
-                        free(complex_data->Re);
+                        Mat_VarDataFree(matvar,complex_data->Re);
                     if ( NULL != complex_data->Im )
-                        free(complex_data->Im);
-                    free(complex_data);
+                        Mat_VarDataFree(matvar,complex_data->Im);
+                    Mat_VarMemFree(matvar,complex_data);
                     Mat_Critical("Failed to allocate %d bytes",2*matvar->nbytes);
                     break;
                 }
@@ -3840,7 +3111,7 @@ Read5(mat_t *mat, matvar_t *matvar)
                 matvar->data = complex_data;
             } else {
                 matvar->nbytes = len*matvar->data_size;
-                matvar->data   = malloc(matvar->nbytes);
+                matvar->data   = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 if ( !matvar->data ) {
                     Mat_Critical("Failed to allocate %d bytes",matvar->nbytes);
                     break;
@@ -3852,23 +3123,26 @@ Read5(mat_t *mat, matvar_t *matvar)
             fseek(mat->fp,matvar->internal->datapos,SEEK_SET);
             matvar->data_size = sizeof(mat_uint32_t);
             matvar->data_type = MAT_T_UINT32;
-            if ( matvar->isComplex ) {
+            if ( MAT_IS_INTERLEAVED(matvar) ) {
+                matvar->nbytes = len*matvar->data_size;
+                ReadInterleaved5(mat,matvar,len);
+            } else if ( matvar->isComplex ) {
                 mat_complex_split_t *complex_data;
 
                 matvar->nbytes = len*matvar->data_size;
-                complex_data = malloc(sizeof(*complex_data));
+                complex_data = Mat_VarMemAlloc(matvar,sizeof(*complex_data));
                 if ( NULL == complex_data ) {
                     Mat_Critical("Failed to allocate %d bytes",sizeof(*complex_data));
                     break;
                 }
-                complex_data->Re = malloc(matvar->nbytes);
-                complex_data->Im = malloc(matvar->nbytes);
+                complex_data->Re = Mat_VarDataAlloc(matvar,matvar->nbytes);
+                complex_data->Im = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 if ( NULL == complex_data->Re || NULL == complex_data->Im ) {
                     if ( NULL != complex_data->Re )
-                        free(complex_data->Re);
+                        Mat_VarDataFree(matvar,complex_data->Re);
                     if ( NULL != complex_data->Im )
-                        free(complex_data->Im);
-                    free(complex_data);
+                        Mat_VarDataFree(matvar,complex_data->Im);
+                    Mat_VarMemFree(matvar,complex_data);
                     Mat_Critical("Failed to allocate %d bytes",2*matvar->nbytes);
                     break;
                 }
@@ -3877,7 +3151,7 @@ Read5(mat_t *mat, matvar_t *matvar)
                 matvar->data = complex_data;
             } else {
                 matvar->nbytes = len*matvar->data_size;
-                matvar->data   = malloc(matvar->nbytes);
+                matvar->data   = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 if ( !matvar->data ) {
                     Mat_Critical("Failed to allocate %d bytes",matvar->nbytes);
                     break;
@@ -3889,23 +3163,26 @@ Read5(mat_t *mat, matvar_t *matvar)
             fseek(mat->fp,matvar->internal->datapos,SEEK_SET);
             matvar->data_size = sizeof(mat_int16_t);
             matvar->data_type = MAT_T_INT16;
-            if ( matvar->isComplex ) {
+            if ( MAT_IS_INTERLEAVED(matvar) ) {
+                matvar->nbytes = len*matvar->data_size;
+                ReadInterleaved5(mat,matvar,len);
+            } else if ( matvar->isComplex ) {
                 mat_complex_split_t *complex_data;
 
                 matvar->nbytes = len*matvar->data_size;
-                complex_data = malloc(sizeof(*complex_data));
+                complex_data = Mat_VarMemAlloc(matvar,sizeof(*complex_data));
                 if ( NULL == complex_data ) {
                     Mat_Critical("Failed to allocate %d bytes",sizeof(*complex_data));
                     break;
                 }
-                complex_data->Re = malloc(matvar->nbytes);
-                complex_data->Im = malloc(matvar->nbytes);
+                complex_data->Re = Mat_VarDataAlloc(matvar,matvar->nbytes);
+                complex_data->Im = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 if ( NULL == complex_data->Re || NULL == complex_data->Im ) {
                     if ( NULL != complex_data->Re )
-                        free(complex_data->Re);
+                        Mat_VarDataFree(matvar,complex_data->Re);
                     if ( NULL != complex_data->Im )
-                        free(complex_data->Im);
-                    free(complex_data);
+                        Mat_VarDataFree(matvar,complex_data->Im);
+                    Mat_VarMemFree(matvar,complex_data);
                     Mat_Critical("Failed to allocate %d bytes",2*matvar->nbytes);
                     break;
                 }
@@ -3914,7 +3191,7 @@ Read5(mat_t *mat, matvar_t *matvar)
                 matvar->data = complex_data;
             } else {
                 matvar->nbytes = len*matvar->data_size;
-                matvar->data   = malloc(matvar->nbytes);
+                matvar->data   = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 if ( !matvar->data ) {
                     Mat_Critical("Failed to allocate %d bytes",matvar->nbytes);
                     break;
@@ -3926,23 +3203,26 @@ Read5(mat_t *mat, matvar_t *matvar)
             fseek(mat->fp,matvar->internal->datapos,SEEK_SET);
             matvar->data_size = sizeof(mat_uint16_t);
             matvar->data_type = MAT_T_UINT16;
-            if ( matvar->isComplex ) {
+            if ( MAT_IS_INTERLEAVED(matvar) ) {
+                matvar->nbytes = len*matvar->data_size;
+                ReadInterleaved5(mat,matvar,len);
+            } else if ( matvar->isComplex ) {
                 mat_complex_split_t *complex_data;
 
                 matvar->nbytes = len*matvar->data_size;
-                complex_data = malloc(sizeof(*complex_data));
+                complex_data = Mat_VarMemAlloc(matvar,sizeof(*complex_data));
                 if ( NULL == complex_data ) {
                     Mat_Critical("Failed to allocate %d bytes",sizeof(*complex_data));
                     break;
                 }
-                complex_data->Re = malloc(matvar->nbytes);
-                complex_data->Im = malloc(matvar->nbytes);
+                complex_data->Re = Mat_VarDataAlloc(matvar,matvar->nbytes);
+                complex_data->Im = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 if ( NULL == complex_data->Re || NULL == complex_data->Im ) {
                     if ( NULL != complex_data->Re )
-                        free(complex_data->Re);
+                        Mat_VarDataFree(matvar,complex_data->Re);
                     if ( NULL != complex_data->Im )
-                        free(complex_data->Im);
-                    free(complex_data);
+                        Mat_VarDataFree(matvar,complex_data->Im);
+                    Mat_VarMemFree(matvar,complex_data);
                     Mat_Critical("Failed to allocate %d bytes",2*matvar->nbytes);
                     break;
                 }
@@ -3951,7 +3231,7 @@ Read5(mat_t *mat, matvar_t *matvar)
                 matvar->data = complex_data;
             } else {
                 matvar->nbytes = len*matvar->data_size;
-                matvar->data   = malloc(matvar->nbytes);
+                matvar->data   = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 if ( !matvar->data ) {
                     Mat_Critical("Failed to allocate %d bytes",matvar->nbytes);
                     break;
@@ -3963,23 +3243,26 @@ Read5(mat_t *mat, matvar_t *matvar)
             fseek(mat->fp,matvar->internal->datapos,SEEK_SET);
             matvar->data_size = sizeof(mat_int8_t);
             matvar->data_type = MAT_T_INT8;
-            if ( matvar->isComplex ) {
+            if ( MAT_IS_INTERLEAVED(matvar) ) {
+                matvar->nbytes = len*matvar->data_size;
+                ReadInterleaved5(mat,matvar,len);
+            } else if ( matvar->isComplex ) {
                 mat_complex_split_t *complex_data;
 
                 matvar->nbytes = len*matvar->data_size;
-                complex_data = malloc(sizeof(*complex_data));
+                complex_data = Mat_VarMemAlloc(matvar,sizeof(*complex_data));
                 if ( NULL == complex_data ) {
                     Mat_Critical("Failed to allocate %d bytes",sizeof(*complex_data));
                     break;
                 }
-                complex_data->Re = malloc(matvar->nbytes);
-                complex_data->Im = malloc(matvar->nbytes);
+                complex_data->Re = Mat_VarDataAlloc(matvar,matvar->nbytes);
+                complex_data->Im = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 if ( NULL == complex_data->Re || NULL == complex_data->Im ) {
                     if ( NULL != complex_data->Re )
-                        free(complex_data->Re);
+                        Mat_VarDataFree(matvar,complex_data->Re);
                     if ( NULL != complex_data->Im )
-                        free(complex_data->Im);
-                    free(complex_data);
+                        Mat_VarDataFree(matvar,complex_data->Im);
+                    Mat_VarMemFree(matvar,complex_data);
                     Mat_Critical("Failed to allocate %d bytes",2*matvar->nbytes);
                     break;
                 }
@@ -3988,7 +3271,7 @@ Read5(mat_t *mat, matvar_t *matvar)
                 matvar->data = complex_data;
             } else {
                 matvar->nbytes = len*matvar->data_size;
-                matvar->data   = malloc(matvar->nbytes);
+                matvar->data   = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 if ( !matvar->data ) {
                     Mat_Critical("Failed to allocate %d bytes",matvar->nbytes);
                     break;
@@ -4000,23 +3283,26 @@ Read5(mat_t *mat, matvar_t *matvar)
             fseek(mat->fp,matvar->internal->datapos,SEEK_SET);
             matvar->data_size = sizeof(mat_uint8_t);
             matvar->data_type = MAT_T_UINT8;
-            if ( matvar->isComplex ) {
+            if ( MAT_IS_INTERLEAVED(matvar) ) {
+                matvar->nbytes = len*matvar->data_size;
+                ReadInterleaved5(mat,matvar,len);
+            } else if ( matvar->isComplex ) {
                 mat_complex_split_t *complex_data;
 
                 matvar->nbytes = len*matvar->data_size;
-                complex_data = malloc(sizeof(*complex_data));
+                complex_data = Mat_VarMemAlloc(matvar,sizeof(*complex_data));
                 if ( NULL == complex_data ) {
                     Mat_Critical("Failed to allocate %d bytes",sizeof(*complex_data));
                     break;
                 }
-                complex_data->Re = malloc(matvar->nbytes);
-                complex_data->Im = malloc(matvar->nbytes);
+                complex_data->Re = Mat_VarDataAlloc(matvar,matvar->nbytes);
+                complex_data->Im = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 if ( NULL == complex_data->Re || NULL == complex_data->Im ) {
                     if ( NULL != complex_data->Re )
-                        free(complex_data->Re);
+                        Mat_VarDataFree(matvar,complex_data->Re);
                     if ( NULL != complex_data->Im )
-                        free(complex_data->Im);
-                    free(complex_data);
+                        Mat_VarDataFree(matvar,complex_data->Im);
+                    Mat_VarMemFree(matvar,complex_data);
                     Mat_Critical("Failed to allocate %d bytes",2*matvar->nbytes);
                     break;
                 }
@@ -4025,7 +3311,7 @@ Read5(mat_t *mat, matvar_t *matvar)
                 matvar->data = complex_data;
             } else {
                 matvar->nbytes = len*matvar->data_size;
-                matvar->data   = malloc(matvar->nbytes);
+                matvar->data   = Mat_VarDataAlloc(matvar,matvar->nbytes);
                 if ( !matvar->data ) {
                     Mat_Critical("Failed to allocate %d bytes",matvar->nbytes);
                     break;
@@ -4079,13 +3365,14 @@ Read5(mat_t *mat, matvar_t *matvar)
             /* FIXME: */
             matvar->data_type = MAT_T_UINT8;
             matvar->nbytes = len*matvar->data_size;
-            matvar->data   = calloc(matvar->nbytes+1,1);
+            matvar->data   = Mat_VarDataAlloc(matvar,matvar->nbytes+1);
             if ( !matvar->data ) {
                 Mat_Critical("Failed to allocate %d bytes",matvar->nbytes);
                 break;
             }
+            memset(matvar->data,0,matvar->nbytes+1);
             if ( matvar->compression == MAT_COMPRESSION_NONE) {
-                nBytes = ReadCharData(mat,(char*)matvar->data,packed_type,len);
+                nBytes = ReadChar5(mat,matvar,matvar->data,packed_type,len);
                     /*
                      * If the data was in the tag we started on a 4-byte
                      * boundary so add 4 to make it an 8-byte
@@ -4096,8 +3383,7 @@ Read5(mat_t *mat, matvar_t *matvar)
                     fseek(mat->fp,8-(nBytes % 8),SEEK_CUR);
 #if defined(HAVE_ZLIB)
             } else if ( matvar->compression == MAT_COMPRESSION_ZLIB) {
-                nBytes = ReadCompressedCharData(mat,matvar->internal->z,
-                             (char*)matvar->data,packed_type,len);
+                nBytes = ReadChar5(mat,matvar,matvar->data,packed_type,len);
                     /*
                      * If the data was in the tag we started on a 4-byte
                      * boundary so add 4 to make it an 8-byte
@@ -4121,7 +3407,10 @@ Read5(mat_t *mat, matvar_t *matvar)
             fields = (matvar_t **)matvar->data;
             for ( i = 0; i < len*nfields; i++ ) {
                 fields[i]->internal->fp = mat;
-                Read5(mat,fields[i]);
+                if ( mat->lazy && NULL == arena && !IsContainer5(fields[i]) )
+                    Mat_VarSetLazy(mat,fields[i]);
+                else
+                    Read5(mat,fields[i]);
             }
             break;
         }
@@ -4136,7 +3425,10 @@ Read5(mat_t *mat, matvar_t *matvar)
             cells = (matvar_t **)matvar->data;
             for ( i = 0; i < len; i++ ) {
                 cells[i]->internal->fp = mat;
-                Read5(mat,cells[i]);
+                if ( mat->lazy && NULL == arena && !IsContainer5(cells[i]) )
+                    Mat_VarSetLazy(mat,cells[i]);
+                else
+                    Read5(mat,cells[i]);
             }
             /* FIXME: */
             matvar->data_type = MAT_T_CELL;
@@ -4148,7 +3440,7 @@ Read5(mat_t *mat, matvar_t *matvar)
             mat_sparse_t *data;
 
             matvar->data_size = sizeof(mat_sparse_t);
-            matvar->data      = malloc(matvar->data_size);
+            matvar->data      = Mat_VarMemAlloc(matvar,matvar->data_size);
             if ( matvar->data == NULL ) {
                 Mat_Critical("ReadData: Allocation of data pointer failed");
                 break;
@@ -4190,7 +3482,7 @@ Read5(mat_t *mat, matvar_t *matvar)
                 }
             }
             data->nir = N / 4;
-            data->ir = malloc(data->nir*sizeof(mat_int32_t));
+            data->ir = Mat_VarDataAlloc(matvar,data->nir*sizeof(mat_int32_t));
             if ( data->ir != NULL ) {
                 if ( matvar->compression == MAT_COMPRESSION_NONE) {
                     nBytes = ReadInt32Data(mat,data->ir,packed_type,data->nir);
@@ -4253,7 +3545,7 @@ Read5(mat_t *mat, matvar_t *matvar)
                 }
             }
             data->njc = N / 4;
-            data->jc = malloc(data->njc*sizeof(mat_int32_t));
+            data->jc = Mat_VarDataAlloc(matvar,data->njc*sizeof(mat_int32_t));
             if ( data->jc != NULL ) {
                 if ( matvar->compression == MAT_COMPRESSION_NONE) {
                     nBytes = ReadInt32Data(mat,data->jc,packed_type,data->njc);
@@ -4330,21 +3622,21 @@ Read5(mat_t *mat, matvar_t *matvar)
             if ( matvar->isComplex ) {
                 mat_complex_split_t *complex_data;
 
-                complex_data = malloc(sizeof(*complex_data));
+                complex_data = Mat_VarMemAlloc(matvar,sizeof(*complex_data));
                 if ( NULL == complex_data ) {
                     Mat_Critical("Failed to allocate %d bytes",sizeof(*complex_data));
                     break;
                 }
-                complex_data->Re = malloc(data->ndata*
+                complex_data->Re = Mat_VarDataAlloc(matvar,data->ndata*
                                           Mat_SizeOf(matvar->data_type));
-                complex_data->Im = malloc(data->ndata*
+                complex_data->Im = Mat_VarDataAlloc(matvar,data->ndata*
                                           Mat_SizeOf(matvar->data_type));
                 if ( NULL == complex_data->Re || NULL == complex_data->Im ) {
                     if ( NULL != complex_data->Re )
-                        free(complex_data->Re);
+                        Mat_VarDataFree(matvar,complex_data->Re);
                     if ( NULL != complex_data->Im )
-                        free(complex_data->Im);
-                    free(complex_data);
+                        Mat_VarDataFree(matvar,complex_data->Im);
+                    Mat_VarMemFree(matvar,complex_data);
                     Mat_Critical("Failed to allocate %d bytes",
                                  data->ndata* Mat_SizeOf(matvar->data_type));
                     break;
@@ -4621,7 +3913,8 @@ Read5(mat_t *mat, matvar_t *matvar)
                 }
                 data->data = complex_data;
             } else { /* isComplex */
-                data->data = malloc(data->ndata*Mat_SizeOf(matvar->data_type));
+                data->data = Mat_VarDataAlloc(matvar,
+                    data->ndata*Mat_SizeOf(matvar->data_type));
                 if ( data->data == NULL ) {
                     Mat_Critical("Failed to allocate %d bytes",
                                  data->ndata*Mat_SizeOf(MAT_T_DOUBLE));
@@ -4776,6 +4069,442 @@ Read5(mat_t *mat, matvar_t *matvar)
     return;
 }
 
+/** @if mat_devman
+ * @brief Reads the data of an element of a version 5 cell array or structure
+ *
+ * Reads the data of an element left unread by a lazy read.  The element
+ * keeps the position of its data from the read of the information of its
+ * parent.  For compressed variables, the data is inflated from a copy of the
+ * stream state saved with the element, so the data can be read again after
+ * it was freed.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar Element of a cell array or structure
+ * @endif
+ */
+void
+Mat_VarReadLazy5(mat_t *mat,matvar_t *matvar)
+{
+#if defined(HAVE_ZLIB)
+    z_stream *z = matvar->internal->z, z_copy;
+
+    if ( NULL != z ) {
+        if ( inflateCopy(&z_copy,z) != Z_OK ) {
+            Mat_Critical("inflateCopy returned error");
+            return;
+        }
+        matvar->internal->z = &z_copy;
+    }
+#endif
+    Read5(mat,matvar);
+#if defined(HAVE_ZLIB)
+    if ( NULL != z ) {
+        inflateEnd(&z_copy);
+        matvar->internal->z = z;
+    }
+#endif
+}
+
+/** @if mat_devman
+ * @brief Reads the tag of an element of a cell or structure array
+ *
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar Cell or structure array, whose stream is used if compressed
+ * @return Number of bytes of the element, or -1 if the element is not
+ *         MAT_T_MATRIX
+ * @endif
+ */
+static int
+ReadElementTag5(mat_t *mat,matvar_t *matvar)
+{
+    mat_uint32_t buf[2];
+
+    if ( matvar->compression ) {
+#if defined(HAVE_ZLIB)
+        InflateVarTag(mat,matvar,buf);
+#endif
+    } else {
+        fread(buf,4,2,mat->fp);
+    }
+    if ( mat->byteswap ) {
+        (void)Mat_uint32Swap(buf);
+        (void)Mat_uint32Swap(buf+1);
+    }
+    return buf[0] == MAT_T_MATRIX ? (int)buf[1] : -1;
+}
+
+/** @if mat_devman
+ * @brief Reads the header of a non-empty element of a cell or structure array
+ *
+ * Reads the array flags, the dimensions and the empty name of the element
+ * following its tag, which take 32+8*((rank+1)/2) bytes.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar Cell or structure array, whose stream is used if compressed
+ * @param array_flags Pointer to store the array flags
+ * @param dims Array of 16 elements to store the dimensions, which are not
+ *             stored if there are more of them
+ * @return Rank of the element
+ * @endif
+ */
+static int
+ReadElementHeader5(mat_t *mat,matvar_t *matvar,mat_uint32_t *array_flags,
+    mat_uint32_t *dims)
+{
+    mat_uint32_t buf[32];
+    int j, rank = 0;
+
+    *array_flags = 0;
+    if ( matvar->compression ) {
+#if defined(HAVE_ZLIB)
+        InflateArrayFlags(mat,matvar,buf);
+        if ( mat->byteswap ) {
+            (void)Mat_uint32Swap(buf);
+            (void)Mat_uint32Swap(buf+2);
+        }
+        if ( buf[0] == MAT_T_UINT32 )
+            *array_flags = buf[2];
+        InflateDimensions(mat,matvar,buf);
+        if ( mat->byteswap ) {
+            (void)Mat_uint32Swap(buf);
+            (void)Mat_uint32Swap(buf+1);
+        }
+        if ( buf[0] == MAT_T_INT32 )
+            rank = buf[1] / 4;
+        for ( j = 0; j < rank && j < 16; j++ )
+            dims[j] = mat->byteswap ? Mat_uint32Swap(buf+2+j) : buf[2+j];
+        InflateVarNameTag(mat,matvar,buf);
+#endif
+    } else {
+        fread(buf,4,6,mat->fp);
+        if ( mat->byteswap ) {
+            (void)Mat_uint32Swap(buf);
+            (void)Mat_uint32Swap(buf+2);
+            (void)Mat_uint32Swap(buf+4);
+            (void)Mat_uint32Swap(buf+5);
+        }
+        if ( buf[0] == MAT_T_UINT32 )
+            *array_flags = buf[2];
+        if ( buf[4] == MAT_T_INT32 )
+            rank = buf[5] / 4;
+        if ( rank <= 16 )
+            fread(buf,4,rank+(rank % 2),mat->fp);
+        for ( j = 0; j < rank && j < 16; j++ )
+            dims[j] = mat->byteswap ? Mat_uint32Swap(buf+j) : buf[j];
+        /* Variable name tag */
+        fread(buf,1,8,mat->fp);
+    }
+    return rank;
+}
+
+/** @if mat_devman
+ * @brief Reads fields of a version 5 structure array into columns
+ *
+ * Reads the elements of the structure array in the order they are stored,
+ * starting after the field names.  The data of the field of column @c k in
+ * element i is decoded to row i of @c columns[k], and the other elements are
+ * skipped, so the elements need no variables of their own and a compressed
+ * variable is inflated once.  The columns are created from the first
+ * element of the structure array.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar Structure array read without its elements (see
+ *               Mat_SetShallowInfo)
+ * @param ncolumns Number of columns
+ * @param field_index 0-relative index of the field of each column
+ * @param columns Array of @c ncolumns pointers to store the new columns
+ * @retval 0 on success
+ * @endif
+ */
+int
+Mat_VarReadStructColumns5(mat_t *mat,matvar_t *matvar,int ncolumns,
+    const int *field_index,matvar_t **columns)
+{
+    int err = 0, k, nfields = matvar->internal->num_fields;
+    size_t i, j, nmemb = 1;
+    mat_uint32_t dims[16];
+    matvar_t *field;
+#if defined(HAVE_ZLIB)
+    z_stream *z = matvar->internal->z, z_copy;
+#endif
+
+    for ( i = 0; i < matvar->rank; i++ )
+        nmemb *= matvar->dims[i];
+
+    field = Mat_VarCallocMem(mat->allocator,NULL);
+    if ( NULL == field )
+        return 1;
+    field->compression = matvar->compression;
+    if ( matvar->compression ) {
+#if defined(HAVE_ZLIB)
+        if ( NULL == z || inflateCopy(&z_copy,z) != Z_OK ) {
+            Mat_Critical("inflateCopy returned error");
+            field->compression = MAT_COMPRESSION_NONE;
+            Mat_VarFree(field);
+            return 1;
+        }
+        z_copy.avail_in = 0;
+        matvar->internal->z = &z_copy;
+        field->internal->z  = &z_copy;
+#else
+        Mat_VarFree(field);
+        return 1;
+#endif
+    }
+    fseek(mat->fp,matvar->internal->datapos,SEEK_SET);
+
+    for ( i = 0; i < nmemb*nfields && !err; i++ ) {
+        int nbytes, rank = 0;
+        long elem_end = 0;
+        size_t numel = 1;
+        mat_uint32_t array_flags = 0;
+
+        for ( k = 0; k < ncolumns; k++ ) {
+            if ( (size_t)field_index[k] == i % nfields )
+                break;
+        }
+
+        /* Tag of the element */
+        nbytes = ReadElementTag5(mat,matvar);
+        if ( !matvar->compression )
+            elem_end = ftell(mat->fp)+nbytes;
+        if ( nbytes < 0 ) {
+            Mat_Critical("fields[%d] not MAT_T_MATRIX",(int)i);
+            err = 1;
+            break;
+        } else if ( k == ncolumns ) {
+            /* Skip the fields that are not read */
+            if ( matvar->compression ) {
+#if defined(HAVE_ZLIB)
+                InflateSkip(mat,&z_copy,nbytes);
+#endif
+            } else {
+                fseek(mat->fp,elem_end,SEEK_SET);
+            }
+            continue;
+        }
+
+        /* Array flags, dimensions, and name */
+        if ( nbytes > 0 ) {
+            rank = ReadElementHeader5(mat,matvar,&array_flags,dims);
+            for ( j = 0; j < rank && j < 16; j++ )
+                numel *= dims[j];
+        }
+
+        field->class_type = CLASS_FROM_ARRAY_FLAGS(array_flags);
+        field->isComplex  = array_flags & MAT_F_COMPLEX;
+        field->isLogical  = array_flags & MAT_F_LOGICAL;
+        field->data_size  = Mat_SizeOfClass(field->class_type);
+        if ( nbytes == 0 || rank > 16 || field->isComplex ||
+             field->class_type < MAT_C_DOUBLE ||
+             field->class_type > MAT_C_UINT64 ) {
+            err = 1;
+        } else if ( NULL == columns[k] ) {
+            columns[k] = Mat_VarCreateColumn(
+                matvar->internal->fieldnames[field_index[k]],field,nmemb,
+                numel);
+            if ( NULL == columns[k] )
+                err = 1;
+        } else if ( numel != columns[k]->dims[1] ||
+                    field->class_type != columns[k]->class_type ||
+                    field->isLogical != columns[k]->isLogical ) {
+            err = 1;
+        }
+        if ( err ) {
+            Mat_Critical("Field %s of %s is not a real numeric array of the "
+                         "same class and size in every element",
+                         matvar->internal->fieldnames[field_index[k]],
+                         matvar->name);
+            break;
+        }
+
+        if ( numel > 0 ) {
+            ReadNumeric5(mat,field,
+                (char*)columns[k]->data+(i/nfields)*field->data_size,numel,
+                nmemb);
+        } else if ( matvar->compression ) {
+#if defined(HAVE_ZLIB)
+            InflateSkip(mat,&z_copy,nbytes-(int)(24+8*((rank+1)/2)+8));
+#endif
+        }
+        if ( !matvar->compression )
+            fseek(mat->fp,elem_end,SEEK_SET);
+    }
+    /* A field read into more than one column is read into the first one */
+    for ( k = 0; k < ncolumns && !err; k++ ) {
+        if ( NULL == columns[k] ) {
+            int l;
+            for ( l = 0; l < k; l++ ) {
+                if ( field_index[l] == field_index[k] )
+                    break;
+            }
+            if ( l < k )
+                columns[k] = Mat_VarDuplicate(columns[l],1);
+            else
+                columns[k] = Mat_VarCreateColumn(
+                    matvar->internal->fieldnames[field_index[k]],NULL,nmemb,0);
+            if ( NULL == columns[k] )
+                err = 1;
+        }
+    }
+
+#if defined(HAVE_ZLIB)
+    if ( matvar->compression ) {
+        inflateEnd(&z_copy);
+        matvar->internal->z = z;
+        field->internal->z  = NULL;
+        field->compression  = MAT_COMPRESSION_NONE;
+    }
+#endif
+    Mat_VarFree(field);
+    return err;
+}
+
+/** @if mat_devman
+ * @brief Reads a version 5 cell array of strings into a string pool
+ *
+ * Reads the cells in the order they are stored, starting after the name of
+ * the cell array, and converts the character data of each cell to UTF-8
+ * directly in the pool, so the cells need no variables of their own and a
+ * compressed variable is inflated once.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar Cell array read without its cells (see Mat_SetShallowInfo)
+ * @param cellstr Cell array of strings with the dimensions of @c matvar and
+ *                @c offsets[0] set
+ * @retval 0 on success
+ * @endif
+ */
+int
+Mat_VarReadCellStr5(mat_t *mat,matvar_t *matvar,mat_cellstr_t *cellstr)
+{
+    int err = 0;
+    size_t i, j, pool_size = 0, buf_size = 0;
+    mat_uint32_t tag[2], dims[16];
+    mat_uint8_t *buf = NULL;
+#if defined(HAVE_ZLIB)
+    z_stream *z = matvar->internal->z, z_copy;
+#endif
+
+    if ( matvar->compression ) {
+#if defined(HAVE_ZLIB)
+        if ( NULL == z || inflateCopy(&z_copy,z) != Z_OK ) {
+            Mat_Critical("inflateCopy returned error");
+            return 1;
+        }
+        z_copy.avail_in = 0;
+        matvar->internal->z = &z_copy;
+#else
+        return 1;
+#endif
+    }
+    fseek(mat->fp,matvar->internal->datapos,SEEK_SET);
+
+    for ( i = 0; i < cellstr->nstrings && !err; i++ ) {
+        int nbytes, consumed, rank = 0;
+        long elem_end = 0;
+        size_t n = 0, numel = 1, data_bytes = 0;
+        mat_uint32_t array_flags = 0;
+        enum matio_types data_type = MAT_T_UINT8;
+        const void *data = NULL;
+
+        nbytes = ReadElementTag5(mat,matvar);
+        if ( !matvar->compression )
+            elem_end = ftell(mat->fp)+nbytes;
+        if ( nbytes < 0 ) {
+            Mat_Critical("cells[%d] not MAT_T_MATRIX",(int)i);
+            err = 1;
+            break;
+        } else if ( nbytes > 0 ) {
+            rank = ReadElementHeader5(mat,matvar,&array_flags,dims);
+            for ( j = 0; j < rank && j < 16; j++ )
+                numel *= dims[j];
+        }
+        consumed = nbytes > 0 ? 32+8*((rank+1)/2) : 0;
+
+        /* An empty cell of any class is an empty string */
+        if ( rank > 16 || (numel > 0 &&
+             (MAT_C_CHAR != CLASS_FROM_ARRAY_FLAGS(array_flags) ||
+              dims[0] != 1)) ) {
+            err = 1;
+        } else if ( numel > 0 ) {
+            /* Data tag, the data of short strings is packed in the tag */
+            if ( matvar->compression ) {
+#if defined(HAVE_ZLIB)
+                InflateDataTag(mat,matvar,tag);
+#endif
+            } else {
+                fread(tag,4,2,mat->fp);
+            }
+            if ( mat->byteswap )
+                (void)Mat_uint32Swap(tag);
+            if ( tag[0] & 0xffff0000 ) {
+                data_type  = TYPE_FROM_TAG(tag[0]);
+                data_bytes = tag[0] >> 16;
+                data       = tag+1;
+                consumed  += 8;
+            } else {
+                data_type  = TYPE_FROM_TAG(tag[0]);
+                data_bytes = mat->byteswap ? Mat_uint32Swap(tag+1) : tag[1];
+                consumed  += 8+data_bytes;
+                if ( data_bytes > buf_size ) {
+                    mat_uint8_t *tmp = Mat_Realloc(mat->allocator,buf,data_bytes);
+                    if ( NULL == tmp ) {
+                        err = 1;
+                        break;
+                    }
+                    buf      = tmp;
+                    buf_size = data_bytes;
+                }
+                if ( data_bytes == 0 ) {
+                    /* No data to read */
+                } else if ( matvar->compression ) {
+#if defined(HAVE_ZLIB)
+                    InflateData(mat,&z_copy,buf,data_bytes);
+#endif
+                } else if ( fread(buf,1,data_bytes,mat->fp) != data_bytes ) {
+                    err = 1;
+                }
+                data = buf;
+            }
+            if ( Mat_SizeOf(data_type) < 1 || Mat_SizeOf(data_type) > 2 )
+                err = 1;
+            else
+                n = data_bytes/Mat_SizeOf(data_type);
+            if ( !err && 2 == Mat_SizeOf(data_type) && mat->byteswap ) {
+                mat_uint16_t *c16 = (mat_uint16_t*)data;
+                for ( j = 0; j < n; j++ )
+                    (void)Mat_uint16Swap(c16+j);
+            }
+        }
+        if ( err ) {
+            Mat_Critical("%s is not a cell array of strings",matvar->name);
+            break;
+        }
+        err = Mat_CellStrAppend(cellstr,i,&pool_size,data,n,data_type);
+
+        /* Skip the padding and anything else of the cell */
+        if ( matvar->compression ) {
+#if defined(HAVE_ZLIB)
+            if ( nbytes > consumed )
+                InflateSkip(mat,&z_copy,nbytes-consumed);
+#endif
+        } else {
+            fseek(mat->fp,elem_end,SEEK_SET);
+        }
+    }
+
+#if defined(HAVE_ZLIB)
+    if ( matvar->compression ) {
+        inflateEnd(&z_copy);
+        matvar->internal->z = z;
+    }
+#endif
+    Mat_Free(mat->allocator,buf);
+    return err;
+}
+
 /** @if mat_devman
  * @brief Reads a slab of data from the mat variable @c matvar
  *
@@ -5197,27 +4926,22 @@ Mat_VarReadDataLinear5(mat_t *mat,matvar_t *matvar,void *data,int start,
 /** @if mat_devman
  * @brief Writes a matlab variable to a version 5 matlab file
  *
+ * The whole variable is encoded into one buffer, which is written or
+ * compressed with a single call.
  * @ingroup mat_internal
  * @param mat MAT file pointer
  * @param matvar pointer to the mat variable
  * @param compress option to compress the variable
- *                 (only works for numeric types)
  * @retval 0 on success
+ * @retval 1 if the variable is too large or the buffer cannot be allocated
  * @endif
  */
 int
 Mat_VarWrite5(mat_t *mat,matvar_t *matvar,int compress)
 {
-    mat_uint32_t array_flags = 0x0;
-    mat_int16_t  fieldname_type = MAT_T_INT32,fieldname_data_size=4;
-    mat_int8_t  pad1 = 0;
-    int      array_flags_type = MAT_T_UINT32, dims_array_type = MAT_T_INT32;
-    int      array_flags_size = 8, pad4 = 0, matrix_type = MAT_T_MATRIX;
-    int      nBytes, i, nmemb = 1,nzmax = 0;
-    long     start = 0, end = 0;
-
-    /* FIXME: SEEK_END is not Guaranteed by the C standard */
-    fseek(mat->fp,0,SEEK_END);         /* Always write at end of file */
+    mat_uint8_t *buf;
+    size_t nbytes;
+    int    err;
 
 #if !defined(HAVE_ZLIB)
     compress = MAT_COMPRESSION_NONE;
@@ -5226,494 +4950,614 @@ Mat_VarWrite5(mat_t *mat,matvar_t *matvar,int compress)
     if ( NULL == mat || NULL == matvar || NULL == matvar->name )
         return -1;
 
-    if ( compress == MAT_COMPRESSION_NONE ) {
-        fwrite(&matrix_type,4,1,mat->fp);
-        fwrite(&pad4,4,1,mat->fp);
-        start = ftell(mat->fp);
+    nbytes = MatrixElement5(matvar,matvar->name,
+                            compress == MAT_COMPRESSION_NONE,NULL);
+    if ( nbytes > 0xffffffffUL ) {
+        Mat_Critical("%s is too large for a version 5 MAT file",matvar->name);
+        return 1;
+    }
+    buf = Mat_Malloc(mat->allocator,nbytes);
+    if ( NULL == buf ) {
+        Mat_Critical("Couldn't allocate memory for %s",matvar->name);
+        return 1;
+    }
+    MatrixElement5(matvar,matvar->name,compress == MAT_COMPRESSION_NONE,buf);
 
-        /* Array Flags */
+    /* FIXME: SEEK_END is not Guaranteed by the C standard */
+    fseek(mat->fp,0,SEEK_END);         /* Always write at end of file */
+#if defined(HAVE_ZLIB)
+    if ( compress == MAT_COMPRESSION_ZLIB ) {
+        err = WriteCompressedVar5(mat,buf,nbytes);
+    } else
+#endif
+    {
+        matvar->internal->datapos = ftell(mat->fp)+ArrayHeader5(0,0,
+            matvar->rank,matvar->dims,matvar->name,NULL);
+        err = fwrite(buf,1,nbytes,mat->fp) != nbytes;
+    }
+    Mat_Free(mat->allocator,buf);
 
-        array_flags = matvar->class_type & CLASS_TYPE_MASK;
-        if ( matvar->isComplex )
-            array_flags |= MAT_F_COMPLEX;
-        if ( matvar->isGlobal )
-            array_flags |= MAT_F_GLOBAL;
-        if ( matvar->isLogical )
-            array_flags |= MAT_F_LOGICAL;
-        if ( matvar->class_type == MAT_C_SPARSE )
-            nzmax = ((mat_sparse_t *)matvar->data)->nzmax;
+    return err;
+}
 
-        fwrite(&array_flags_type,4,1,mat->fp);
-        fwrite(&array_flags_size,4,1,mat->fp);
-        fwrite(&array_flags,4,1,mat->fp);
-        fwrite(&nzmax,4,1,mat->fp);
-        /* Rank and Dimension */
-        nBytes = matvar->rank * 4;
-        fwrite(&dims_array_type,4,1,mat->fp);
-        fwrite(&nBytes,4,1,mat->fp);
-        for ( i = 0; i < matvar->rank; i++ ) {
-            mat_int32_t dim;
-            dim = matvar->dims[i];
-            nmemb *= dim;
-            fwrite(&dim,4,1,mat->fp);
-        }
-        if ( matvar->rank % 2 != 0 )
-            fwrite(&pad4,4,1,mat->fp);
-        /* Name of variable */
-        if ( strlen(matvar->name) <= 4 ) {
-            mat_int32_t  array_name_type = MAT_T_INT8;
-            mat_int32_t array_name_len   = strlen(matvar->name);
-            mat_int8_t  pad1 = 0;
-#if 0
-            fwrite(&array_name_type,2,1,mat->fp);
-            fwrite(&array_name_len,2,1,mat->fp);
-#else
-            array_name_type = (array_name_len << 16) | array_name_type;
-            fwrite(&array_name_type,4,1,mat->fp);
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+/** @if mat_devman
+ * @brief Appends the queued variables to the file in order
+ *
+ * @ingroup mat_internal
+ * @param arg Pointer to the mat_write_queue
+ * @returns NULL
+ * @endif
+ */
+static void *
+WriteWorker5(void *arg)
+{
+    struct mat_write_queue *queue = arg;
+    struct mat_write_job *job;
+    mat_t *mat = queue->mat;
+    int    err;
+
+    for ( ;; ) {
+        pthread_mutex_lock(&queue->lock);
+        while ( NULL == queue->head && !queue->stop )
+            pthread_cond_wait(&queue->not_empty,&queue->lock);
+        job = queue->head;
+        pthread_mutex_unlock(&queue->lock);
+        if ( NULL == job )
+            break;
+
+        /* FIXME: SEEK_END is not Guaranteed by the C standard */
+        fseek(mat->fp,0,SEEK_END);         /* Always write at end of file */
+#if defined(HAVE_ZLIB)
+        if ( job->compress == MAT_COMPRESSION_ZLIB )
+            err = WriteCompressedVar5(mat,job->buf,job->nbytes);
+        else
 #endif
-            fwrite(matvar->name,1,array_name_len,mat->fp);
-            for ( i = array_name_len; i < 4; i++ )
-                fwrite(&pad1,1,1,mat->fp);
-        } else {
-            mat_int32_t array_name_type = MAT_T_INT8;
-            mat_int32_t array_name_len  = (mat_int32_t)strlen(matvar->name);
-            mat_int8_t  pad1 = 0;
+            err = fwrite(job->buf,1,job->nbytes,mat->fp) != job->nbytes;
+        Mat_Free(queue->allocator,job->buf);
+
+        /* The variable leaves the queue once it is written */
+        pthread_mutex_lock(&queue->lock);
+        queue->head = job->next;
+        if ( NULL == queue->head )
+            queue->tail = NULL;
+        queue->bytes -= job->nbytes;
+        if ( err && !queue->err )
+            queue->err = err;
+        pthread_cond_broadcast(&queue->not_full);
+        pthread_mutex_unlock(&queue->lock);
+        Mat_Free(queue->allocator,job);
+    }
 
-            fwrite(&array_name_type,4,1,mat->fp);
-            fwrite(&array_name_len,4,1,mat->fp);
-            fwrite(matvar->name,1,array_name_len,mat->fp);
-            if ( array_name_len % 8 )
-                for ( i = array_name_len % 8; i < 8; i++ )
-                    fwrite(&pad1,1,1,mat->fp);
-        }
+    return NULL;
+}
+#endif
 
-        matvar->internal->datapos = ftell(mat->fp);
-        switch ( matvar->class_type ) {
-            case MAT_C_DOUBLE:
-            case MAT_C_SINGLE:
-            case MAT_C_INT64:
-            case MAT_C_UINT64:
-            case MAT_C_INT32:
-            case MAT_C_UINT32:
-            case MAT_C_INT16:
-            case MAT_C_UINT16:
-            case MAT_C_INT8:
-            case MAT_C_UINT8:
-            {
-                if ( matvar->isComplex ) {
-                    mat_complex_split_t *complex_data = matvar->data;
+/** @if mat_devman
+ * @brief Queues a matlab variable for the background writer of a version 5
+ *        matlab file
+ *
+ * The variable is encoded into one buffer by the calling thread, so it can be
+ * modified or freed as soon as this function returns, and the buffer is
+ * written or compressed by the background writer.  If the encoded variables
+ * waiting in the queue would exceed the bound of the queue, the calling
+ * thread first waits for the writer.  The position of the data of an
+ * uncompressed variable is computed from the end of the file and the
+ * variables before it in the queue.  If a compressed variable is still
+ * waiting, the calling thread first waits for the writer.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar pointer to the mat variable
+ * @param compress option to compress the variable
+ * @retval 0 on success
+ * @endif
+ */
+int
+Mat_VarWriteAsync5(mat_t *mat,matvar_t *matvar,int compress)
+{
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+    struct mat_write_queue *queue;
+    struct mat_write_job *job;
+    mat_uint8_t *buf;
+    size_t nbytes;
 
-                    if ( NULL == complex_data )
-                        complex_data = &null_complex_data;
+#if !defined(HAVE_ZLIB)
+    compress = MAT_COMPRESSION_NONE;
+#endif
 
-                    nBytes = WriteData(mat,complex_data->Re,nmemb,
-                        matvar->data_type);
-                    if ( nBytes % 8 )
-                        for ( i = nBytes % 8; i < 8; i++ )
-                            fwrite(&pad1,1,1,mat->fp);
-                    nBytes = WriteData(mat,complex_data->Im,nmemb,
-                        matvar->data_type);
-                    if ( nBytes % 8 )
-                        for ( i = nBytes % 8; i < 8; i++ )
-                            fwrite(&pad1,1,1,mat->fp);
-                } else {
-                    nBytes=WriteData(mat,matvar->data,nmemb,matvar->data_type);
-                    if ( nBytes % 8 )
-                        for ( i = nBytes % 8; i < 8; i++ )
-                            fwrite(&pad1,1,1,mat->fp);
-                }
-                break;
-            }
-            case MAT_C_CHAR:
-            {
-                WriteCharData(mat,matvar->data,nmemb,matvar->data_type);
-                break;
-            }
-            case MAT_C_CELL:
-            {
-                int        ncells;
-                matvar_t **cells = (matvar_t **)matvar->data;
+    if ( NULL == mat || NULL == matvar || NULL == matvar->name )
+        return -1;
+    queue = mat->async;
+    if ( NULL == queue )
+        return Mat_VarWrite5(mat,matvar,compress);
+
+    nbytes = MatrixElement5(matvar,matvar->name,
+                            compress == MAT_COMPRESSION_NONE,NULL);
+    if ( nbytes > 0xffffffffUL ) {
+        Mat_Critical("%s is too large for a version 5 MAT file",matvar->name);
+        return 1;
+    }
 
-                /* Check for an empty cell array */
-                if ( matvar->nbytes == 0 || matvar->data_size == 0 ||
-                     matvar->data   == NULL )
-                    break;
-                ncells  = matvar->nbytes / matvar->data_size;
-                for ( i = 0; i < ncells; i++ )
-                    WriteCellArrayField(mat,cells[i]);
-                break;
-            }
-            case MAT_C_STRUCT:
-            {
-                char      *padzero;
-                int        fieldname_size, nfields;
-                size_t     maxlen = 0;
-                matvar_t **fields = (matvar_t **)matvar->data;
-                mat_int32_t array_name_type = MAT_T_INT8;
-                unsigned   fieldname;
+    /* Reserve room in the queue before allocating the buffer */
+    pthread_mutex_lock(&queue->lock);
+    while ( queue->max_bytes > 0 && queue->bytes > 0 &&
+            queue->bytes+nbytes > queue->max_bytes )
+        pthread_cond_wait(&queue->not_full,&queue->lock);
+    queue->bytes += nbytes;
+    pthread_mutex_unlock(&queue->lock);
+
+    job = Mat_Malloc(queue->allocator,sizeof(*job));
+    buf = Mat_Malloc(queue->allocator,nbytes);
+    if ( NULL == job || NULL == buf ) {
+        Mat_Free(queue->allocator,job);
+        Mat_Free(queue->allocator,buf);
+        pthread_mutex_lock(&queue->lock);
+        queue->bytes -= nbytes;
+        pthread_cond_broadcast(&queue->not_full);
+        pthread_mutex_unlock(&queue->lock);
+        Mat_Critical("Couldn't allocate memory for %s",matvar->name);
+        return 1;
+    }
+    MatrixElement5(matvar,matvar->name,compress == MAT_COMPRESSION_NONE,buf);
+    job->buf      = buf;
+    job->nbytes   = nbytes;
+    job->compress = compress;
+    job->next     = NULL;
 
-                /* Check for a structure with no fields */
-                if ( matvar->internal->num_fields < 1 ) {
-#if 0
-                    fwrite(&fieldname_type,2,1,mat->fp);
-                    fwrite(&fieldname_data_size,2,1,mat->fp);
+    pthread_mutex_lock(&queue->lock);
+    if ( compress == MAT_COMPRESSION_NONE ) {
+        /* The size of a compressed variable is known once it is written */
+        while ( NULL != queue->head && queue->end < 0 )
+            pthread_cond_wait(&queue->not_full,&queue->lock);
+        if ( NULL == queue->head ) {
+            /* FIXME: SEEK_END is not Guaranteed by the C standard */
+            fseek(mat->fp,0,SEEK_END);
+            queue->end = ftell(mat->fp);
+        }
+        matvar->internal->datapos = queue->end+ArrayHeader5(0,0,
+            matvar->rank,matvar->dims,matvar->name,NULL);
+        queue->end += nbytes;
+    } else {
+        queue->end = -1;
+    }
+    if ( NULL == queue->tail )
+        queue->head = job;
+    else
+        queue->tail->next = job;
+    queue->tail = job;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+
+    return 0;
 #else
-                    fieldname = (fieldname_data_size<<16) | fieldname_type;
-                    fwrite(&fieldname,4,1,mat->fp);
+    return Mat_VarWrite5(mat,matvar,compress);
 #endif
-                    fieldname_size = 1;
-                    fwrite(&fieldname_size,4,1,mat->fp);
-                    fwrite(&array_name_type,4,1,mat->fp);
-                    nBytes = 0;
-                    fwrite(&nBytes,4,1,mat->fp);
-                    break;
-                }
-                nfields = matvar->internal->num_fields;
-                for ( i = 0; i < nfields; i++ ) {
-                    size_t len = strlen(matvar->internal->fieldnames[i]);
-                    if ( len > maxlen )
-                        maxlen = len;
-                }
-                maxlen++;
-                fieldname_size = maxlen;
-                while ( nfields*fieldname_size % 8 != 0 )
-                    fieldname_size++;
-#if 0
-                fwrite(&fieldname_type,2,1,mat->fp);
-                fwrite(&fieldname_data_size,2,1,mat->fp);
+}
+
+/** @if mat_devman
+ * @brief Starts the background writer of a version 5 matlab file
+ *
+ * If the writer is already running, only its bound is changed.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param max_bytes Bound on the encoded variables in the queue, 0 for none
+ * @retval 0 on success
+ * @retval 1 if matio was built without threads or the thread failed
+ * @endif
+ */
+int
+Mat_AsyncStart5(mat_t *mat,size_t max_bytes)
+{
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+    struct mat_write_queue *queue;
+
+    if ( NULL == mat )
+        return 1;
+    queue = mat->async;
+    if ( NULL != queue ) {
+        pthread_mutex_lock(&queue->lock);
+        queue->max_bytes = max_bytes;
+        pthread_cond_broadcast(&queue->not_full);
+        pthread_mutex_unlock(&queue->lock);
+        return 0;
+    }
+
+    queue = Mat_Calloc(mat->allocator,1,sizeof(*queue));
+    if ( NULL == queue )
+        return 1;
+    queue->mat       = mat;
+    queue->allocator = mat->allocator;
+    queue->max_bytes = max_bytes;
+    queue->end       = -1;
+    pthread_mutex_init(&queue->lock,NULL);
+    pthread_cond_init(&queue->not_empty,NULL);
+    pthread_cond_init(&queue->not_full,NULL);
+    if ( 0 != pthread_create(&queue->thread,NULL,WriteWorker5,queue) ) {
+        pthread_cond_destroy(&queue->not_full);
+        pthread_cond_destroy(&queue->not_empty);
+        pthread_mutex_destroy(&queue->lock);
+        Mat_Free(queue->allocator,queue);
+        return 1;
+    }
+    mat->async = queue;
+
+    return 0;
 #else
-                fieldname = (fieldname_data_size<<16) | fieldname_type;
-                fwrite(&fieldname,4,1,mat->fp);
+    return 1;
 #endif
-                fwrite(&fieldname_size,4,1,mat->fp);
-                fwrite(&array_name_type,4,1,mat->fp);
-                nBytes = nfields*fieldname_size;
-                fwrite(&nBytes,4,1,mat->fp);
-                padzero = calloc(fieldname_size,1);
-                for ( i = 0; i < nfields; i++ ) {
-                    size_t len = strlen(matvar->internal->fieldnames[i]);
-                    fwrite(matvar->internal->fieldnames[i],1,len,mat->fp);
-                    fwrite(padzero,1,fieldname_size-len,mat->fp);
-                }
-                free(padzero);
-                for ( i = 0; i < nmemb*nfields; i++ )
-                    WriteStructField(mat,fields[i]);
-                break;
-            }
-            case MAT_C_SPARSE:
-            {
-                mat_sparse_t *sparse = matvar->data;
+}
 
-                nBytes = WriteData(mat,sparse->ir,sparse->nir,MAT_T_INT32);
-                if ( nBytes % 8 )
-                    for ( i = nBytes % 8; i < 8; i++ )
-                        fwrite(&pad1,1,1,mat->fp);
-                nBytes = WriteData(mat,sparse->jc,sparse->njc,MAT_T_INT32);
-                if ( nBytes % 8 )
-                    for ( i = nBytes % 8; i < 8; i++ )
-                        fwrite(&pad1,1,1,mat->fp);
-                if ( matvar->isComplex ) {
-                    mat_complex_split_t *complex_data = sparse->data;
-                    nBytes = WriteData(mat,complex_data->Re,sparse->ndata,
-                        matvar->data_type);
-                    if ( nBytes % 8 )
-                        for ( i = nBytes % 8; i < 8; i++ )
-                            fwrite(&pad1,1,1,mat->fp);
-                    nBytes = WriteData(mat,complex_data->Im,sparse->ndata,
-                        matvar->data_type);
-                    if ( nBytes % 8 )
-                        for ( i = nBytes % 8; i < 8; i++ )
-                            fwrite(&pad1,1,1,mat->fp);
-                } else {
-                    nBytes = WriteData(mat,sparse->data,sparse->ndata,matvar->data_type);
-                    if ( nBytes % 8 )
-                        for ( i = nBytes % 8; i < 8; i++ )
-                            fwrite(&pad1,1,1,mat->fp);
-                }
-            }
-            case MAT_C_EMPTY:
-            case MAT_C_FUNCTION:
-            case MAT_C_OBJECT:
-                break;
-        }
-#if defined(HAVE_ZLIB)
-    } else if ( compress == MAT_COMPRESSION_ZLIB ) {
-        mat_uint32_t comp_buf[512];
-        mat_uint32_t uncomp_buf[512] = {0,};
-        int buf_size = 512, err;
-        size_t byteswritten = 0;
+/** @if mat_devman
+ * @brief Waits until the background writer wrote all the queued variables
+ *
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @endif
+ */
+void
+Mat_AsyncWait5(mat_t *mat)
+{
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+    struct mat_write_queue *queue;
 
-        matvar->internal->z         = calloc(1,sizeof(*matvar->internal->z));
-        matvar->internal->z->zalloc = Z_NULL;
-        matvar->internal->z->zfree  = Z_NULL;
-        err = deflateInit(matvar->internal->z,Z_DEFAULT_COMPRESSION);
+    if ( NULL == mat || NULL == (queue = mat->async) )
+        return;
+    pthread_mutex_lock(&queue->lock);
+    while ( NULL != queue->head )
+        pthread_cond_wait(&queue->not_full,&queue->lock);
+    pthread_mutex_unlock(&queue->lock);
+#endif
+}
+
+/** @if mat_devman
+ * @brief Waits for the background writer and returns its first error
+ *
+ * The error is cleared, so it is reported only once.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @retval 0 if all the queued variables were written
+ * @endif
+ */
+int
+Mat_AsyncFlush5(mat_t *mat)
+{
+    int err = 0;
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+    struct mat_write_queue *queue;
 
-        matrix_type = MAT_T_COMPRESSED;
-        fwrite(&matrix_type,4,1,mat->fp);
-        fwrite(&pad4,4,1,mat->fp);
-        start = ftell(mat->fp);
+    if ( NULL == mat || NULL == (queue = mat->async) )
+        return 0;
+    pthread_mutex_lock(&queue->lock);
+    while ( NULL != queue->head )
+        pthread_cond_wait(&queue->not_full,&queue->lock);
+    err = queue->err;
+    queue->err = 0;
+    pthread_mutex_unlock(&queue->lock);
+#endif
+    return err;
+}
 
-        /* Array Flags */
-        array_flags = matvar->class_type & CLASS_TYPE_MASK;
-        if ( matvar->isComplex )
-            array_flags |= MAT_F_COMPLEX;
-        if ( matvar->isGlobal )
-            array_flags |= MAT_F_GLOBAL;
-        if ( matvar->isLogical )
-            array_flags |= MAT_F_LOGICAL;
-        if ( matvar->class_type == MAT_C_SPARSE )
-            nzmax = ((mat_sparse_t *)matvar->data)->nzmax;
+/** @if mat_devman
+ * @brief Writes the queued variables and stops the background writer
+ *
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @retval 0 if all the queued variables were written
+ * @endif
+ */
+int
+Mat_AsyncStop5(mat_t *mat)
+{
+    int err = 0;
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD
+    struct mat_write_queue *queue;
 
-        uncomp_buf[0] = MAT_T_MATRIX;
-        uncomp_buf[1] = (int)GetMatrixMaxBufSize(matvar);
-        matvar->internal->z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-        matvar->internal->z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-        matvar->internal->z->avail_out = buf_size*sizeof(*comp_buf);
-        matvar->internal->z->avail_in  = 8;
-        err = deflate(matvar->internal->z,Z_NO_FLUSH);
-        byteswritten += fwrite(comp_buf,1,
-            buf_size*sizeof(*comp_buf)-matvar->internal->z->avail_out,mat->fp);
-        uncomp_buf[0] = array_flags_type;
-        uncomp_buf[1] = array_flags_size;
-        uncomp_buf[2] = array_flags;
-        uncomp_buf[3] = nzmax;
-        /* Rank and Dimension */
-        nBytes = matvar->rank * 4;
-        uncomp_buf[4] = dims_array_type;
-        uncomp_buf[5] = nBytes;
-        for ( i = 0; i < matvar->rank; i++ ) {
-            mat_int32_t dim;
-            dim = matvar->dims[i];
-            nmemb *= dim;
-            uncomp_buf[6+i] = dim;
-        }
-        if ( matvar->rank % 2 != 0 ) {
-            uncomp_buf[6+i] = pad4;
-            i++;
-        }
+    if ( NULL == mat || NULL == (queue = mat->async) )
+        return 0;
+    err = Mat_AsyncFlush5(mat);
+    pthread_mutex_lock(&queue->lock);
+    queue->stop = 1;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    pthread_join(queue->thread,NULL);
+    pthread_cond_destroy(&queue->not_full);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_mutex_destroy(&queue->lock);
+    Mat_Free(queue->allocator,queue);
+    mat->async = NULL;
+#endif
+    return err;
+}
 
-        matvar->internal->z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-        matvar->internal->z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-        matvar->internal->z->avail_out = buf_size*sizeof(*comp_buf);
-        matvar->internal->z->avail_in  = (6+i)*sizeof(*uncomp_buf);
-        err = deflate(matvar->internal->z,Z_NO_FLUSH);
-        byteswritten += fwrite(comp_buf,1,
-                buf_size*sizeof(*comp_buf)-matvar->internal->z->avail_out,mat->fp);
-        /* Name of variable */
-        if ( strlen(matvar->name) <= 4 ) {
-            mat_int16_t array_name_len = (mat_int16_t)strlen(matvar->name);
-            mat_int16_t array_name_type = MAT_T_INT8;
+/** @if mat_devman
+ * @brief Writes columns as the fields of a structure array to a version 5
+ *        matlab file
+ *
+ * The header of the structure array and then each field of each element are
+ * encoded from the columns into one buffer, which is written or compressed
+ * directly, so no variable is created for the elements.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param name Name of the structure array
+ * @param ncolumns Number of fields
+ * @param field_names Array of @c ncolumns field names
+ * @param columns Array of @c ncolumns columns with the same number of rows
+ * @param compress option to compress the variable
+ * @retval 0 on success
+ * @endif
+ */
+int
+Mat_VarWriteStructColumns5(mat_t *mat,const char *name,int ncolumns,
+    const char * const *field_names,matvar_t * const *columns,int compress)
+{
+    mat_uint32_t  tag[10];
+    mat_uint8_t  *buf;
+    size_t i, nmemb, len, name_len, name_size, fieldname_size = 0;
+    size_t hdr_size, buf_size, nbytes;
+    int    k, err = 0;
+#if defined(HAVE_ZLIB)
+    z_stream *z = NULL;
+    long      start = 0;
+#endif
 
-            memset(uncomp_buf,0,8);
-            uncomp_buf[0] = (array_name_len << 16) | array_name_type;
-            memcpy(uncomp_buf+1,matvar->name,array_name_len);
-            if ( array_name_len % 4 )
-                array_name_len += 4-(array_name_len % 4);
+#if !defined(HAVE_ZLIB)
+    compress = MAT_COMPRESSION_NONE;
+#endif
 
-            matvar->internal->z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-            matvar->internal->z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-            matvar->internal->z->avail_out = buf_size*sizeof(*comp_buf);
-            matvar->internal->z->avail_in  = 8;
-            err = deflate(matvar->internal->z,Z_NO_FLUSH);
-            byteswritten += fwrite(comp_buf,1,
-                    buf_size*sizeof(*comp_buf)-matvar->internal->z->avail_out,mat->fp);
+    nmemb    = columns[0]->dims[0];
+    name_len = strlen(name);
+    name_size = name_len <= 4 ? 0 : name_len;
+    if ( name_size % 8 )
+        name_size += 8-(name_size % 8);
+    for ( k = 0; k < ncolumns; k++ ) {
+        len = strlen(field_names[k]);
+        if ( len >= fieldname_size )
+            fieldname_size = len+1;
+    }
+    while ( ncolumns*fieldname_size % 8 != 0 )
+        fieldname_size++;
+    hdr_size = 64+name_size+ncolumns*fieldname_size;
+
+    /* The size of the structure array is needed before the elements */
+    nbytes   = hdr_size-8;
+    buf_size = hdr_size;
+    for ( k = 0; k < ncolumns; k++ ) {
+        const matvar_t *column = columns[k];
+        size_t elem_size;
+
+        if ( MAT_C_CHAR == column->class_type ) {
+            for ( i = 0; i < nmemb; i++ )
+                nbytes += StructColumnElement5(column,i,NULL);
+            elem_size = 2*column->dims[1];
+            if ( elem_size % 8 )
+                elem_size += 8-(elem_size % 8);
+            elem_size += 56;
         } else {
-            mat_int32_t array_name_len = (mat_int32_t)strlen(matvar->name);
-            mat_int32_t array_name_type = MAT_T_INT8;
+            elem_size = StructColumnElement5(column,0,NULL);
+            nbytes += nmemb*elem_size;
+        }
+        if ( elem_size > buf_size )
+            buf_size = elem_size;
+    }
+    if ( nbytes > 0xffffffffUL ) {
+        Mat_Critical("%s is too large for a version 5 MAT file",name);
+        return 1;
+    }
+    buf = Mat_Calloc(mat->allocator,buf_size,1);
+    if ( NULL == buf )
+        return 1;
 
-            memset(uncomp_buf,0,buf_size*sizeof(*uncomp_buf));
-            uncomp_buf[0] = array_name_type;
-            uncomp_buf[1] = array_name_len;
-            memcpy(uncomp_buf+2,matvar->name,array_name_len);
-            if ( array_name_len % 8 )
-                array_name_len += 8-(array_name_len % 8);
-            matvar->internal->z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-            matvar->internal->z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-            matvar->internal->z->avail_out = buf_size*sizeof(*comp_buf);
-            matvar->internal->z->avail_in  = 8+array_name_len;
-            err = deflate(matvar->internal->z,Z_NO_FLUSH);
-            byteswritten += fwrite(comp_buf,1,
-                    buf_size*sizeof(*comp_buf)-matvar->internal->z->avail_out,mat->fp);
+    tag[0] = MAT_T_MATRIX;
+    tag[1] = nbytes;
+    /* Array Flags */
+    tag[2] = MAT_T_UINT32;
+    tag[3] = 8;
+    tag[4] = MAT_C_STRUCT;
+    tag[5] = 0;
+    /* Rank and Dimension */
+    tag[6] = MAT_T_INT32;
+    tag[7] = 8;
+    tag[8] = nmemb;
+    tag[9] = 1;
+    memcpy(buf,tag,sizeof(tag));
+    /* Name of variable */
+    if ( name_len <= 4 ) {
+        tag[0] = (name_len << 16) | MAT_T_INT8;
+        memcpy(buf+40,tag,4);
+        memcpy(buf+44,name,name_len);
+    } else {
+        tag[0] = MAT_T_INT8;
+        tag[1] = name_len;
+        memcpy(buf+40,tag,8);
+        memcpy(buf+48,name,name_len);
+    }
+    /* Field names */
+    tag[0] = (4 << 16) | MAT_T_INT32;
+    tag[1] = fieldname_size;
+    tag[2] = MAT_T_INT8;
+    tag[3] = ncolumns*fieldname_size;
+    memcpy(buf+48+name_size,tag,16);
+    for ( k = 0; k < ncolumns; k++ )
+        memcpy(buf+64+name_size+k*fieldname_size,field_names[k],
+               strlen(field_names[k]));
+
+    /* FIXME: SEEK_END is not Guaranteed by the C standard */
+    fseek(mat->fp,0,SEEK_END);         /* Always write at end of file */
+#if defined(HAVE_ZLIB)
+    if ( compress == MAT_COMPRESSION_ZLIB ) {
+        z = Mat_DeflateInit(mat->allocator);
+        if ( NULL == z ) {
+            Mat_Free(mat->allocator,buf);
+            return 1;
         }
-        matvar->internal->datapos = ftell(mat->fp);
-        switch ( matvar->class_type ) {
-            case MAT_C_DOUBLE:
-            case MAT_C_SINGLE:
-            case MAT_C_INT64:
-            case MAT_C_UINT64:
-            case MAT_C_INT32:
-            case MAT_C_UINT32:
-            case MAT_C_INT16:
-            case MAT_C_UINT16:
-            case MAT_C_INT8:
-            case MAT_C_UINT8:
-            {
-                /* WriteCompressedData makes sure uncomressed data is aligned
-                 * on an 8-byte boundary */
-                if ( matvar->isComplex ) {
-                    mat_complex_split_t *complex_data = matvar->data;
+        tag[0] = MAT_T_COMPRESSED;
+        tag[1] = 0;
+        fwrite(tag,4,2,mat->fp);
+        start = ftell(mat->fp);
+    }
+#endif
+
+#if defined(HAVE_ZLIB)
+    if ( NULL != z )
+        err = WriteCompressedBytes5(mat,z,buf,hdr_size);
+    else
+#endif
+    err = fwrite(buf,1,hdr_size,mat->fp) != hdr_size;
+    for ( i = 0; i < nmemb && !err; i++ ) {
+        for ( k = 0; k < ncolumns && !err; k++ ) {
+            nbytes = StructColumnElement5(columns[k],i,buf);
+#if defined(HAVE_ZLIB)
+            if ( NULL != z )
+                err = WriteCompressedBytes5(mat,z,buf,nbytes);
+            else
+#endif
+            err = fwrite(buf,1,nbytes,mat->fp) != nbytes;
+        }
+    }
 
-                    if ( NULL == matvar->data )
-                        complex_data = &null_complex_data;
+#if defined(HAVE_ZLIB)
+    if ( NULL != z )
+        WriteCompressedEnd5(mat,z,start);
+#endif
+    Mat_Free(mat->allocator,buf);
 
-                    byteswritten += WriteCompressedData(mat,matvar->internal->z,
-                        complex_data->Re,nmemb,matvar->data_type);
-                    byteswritten += WriteCompressedData(mat,matvar->internal->z,
-                        complex_data->Im,nmemb,matvar->data_type);
-                } else {
-                    byteswritten += WriteCompressedData(mat,matvar->internal->z,
-                        matvar->data,nmemb,matvar->data_type);
-                }
-                break;
-            }
-            case MAT_C_CHAR:
-            {
-                byteswritten += WriteCompressedCharData(mat,matvar->internal->z,
-                    matvar->data,nmemb,matvar->data_type);
-                break;
-            }
-            case MAT_C_CELL:
-            {
-                int        ncells;
-                matvar_t **cells = (matvar_t **)matvar->data;
+    return err;
+}
 
-                /* Check for an empty cell array */
-                if ( matvar->nbytes == 0 || matvar->data_size == 0 ||
-                     matvar->data   == NULL )
-                    break;
-                ncells  = matvar->nbytes / matvar->data_size;
-                for ( i = 0; i < ncells; i++ )
-                    WriteCompressedCellArrayField(mat,cells[i],matvar->internal->z);
-                break;
-            }
-            case MAT_C_STRUCT:
-            {
-                unsigned char *padzero;
-                int        fieldname_size, nfields;
-                size_t     maxlen = 0;
-                mat_int32_t array_name_type = MAT_T_INT8;
-                matvar_t **fields = (matvar_t **)matvar->data;
+/** @if mat_devman
+ * @brief Writes a cell array of strings to a version 5 matlab file
+ *
+ * The header of the cell array and then each string are encoded from the
+ * pool into one buffer, which is written or compressed directly, so no
+ * variable is created for the cells.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param name Name of the cell array
+ * @param cellstr Cell array of strings with at least one string
+ * @param compress option to compress the variable
+ * @retval 0 on success
+ * @endif
+ */
+int
+Mat_VarWriteCellStr5(mat_t *mat,const char *name,const mat_cellstr_t *cellstr,
+    int compress)
+{
+    mat_uint32_t  tag[6];
+    mat_uint8_t  *buf;
+    const char   *str;
+    size_t i, len, name_len, name_size, dims_size;
+    size_t hdr_size, buf_size, nbytes;
+    int    k, err = 0;
+#if defined(HAVE_ZLIB)
+    z_stream *z = NULL;
+    long      start = 0;
+#endif
 
-                /* Check for a structure with no fields */
-                if ( matvar->internal->num_fields < 1 ) {
-                    fieldname_size = 1;
-                    uncomp_buf[0] = (fieldname_data_size << 16) |
-                                     fieldname_type;
-                    uncomp_buf[1] = 1;
-                    uncomp_buf[2] = array_name_type;
-                    uncomp_buf[3] = 0;
-                    matvar->internal->z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-                    matvar->internal->z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-                    matvar->internal->z->avail_out = buf_size*sizeof(*comp_buf);
-                    matvar->internal->z->avail_in  = 16;
-                    err = deflate(matvar->internal->z,Z_NO_FLUSH);
-                    byteswritten += fwrite(comp_buf,1,buf_size*
-                        sizeof(*comp_buf)-matvar->internal->z->avail_out,mat->fp);
-                    break;
-                }
-                nfields = matvar->internal->num_fields;
-                for ( i = 0; i < nfields; i++ ) {
-                    size_t len = strlen(matvar->internal->fieldnames[i]);
-                    if ( len > maxlen )
-                        maxlen = len;
-                }
-                maxlen++;
-                fieldname_size = maxlen;
-                while ( nfields*fieldname_size % 8 != 0 )
-                    fieldname_size++;
-                uncomp_buf[0] = (fieldname_data_size << 16) | fieldname_type;
-                uncomp_buf[1] = fieldname_size;
-                uncomp_buf[2] = array_name_type;
-                uncomp_buf[3] = nfields*fieldname_size;
-
-                padzero = calloc(fieldname_size,1);
-                matvar->internal->z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-                matvar->internal->z->next_in   = ZLIB_BYTE_PTR(uncomp_buf);
-                matvar->internal->z->avail_out = buf_size*sizeof(*comp_buf);
-                matvar->internal->z->avail_in  = 16;
-                err = deflate(matvar->internal->z,Z_NO_FLUSH);
-                byteswritten += fwrite(comp_buf,1,
-                        buf_size*sizeof(*comp_buf)-matvar->internal->z->avail_out,mat->fp);
-                for ( i = 0; i < nfields; i++ ) {
-                    size_t len = strlen(matvar->internal->fieldnames[i]);
-                    memset(padzero,'\0',fieldname_size);
-                    memcpy(padzero,matvar->internal->fieldnames[i],len);
-                    matvar->internal->z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-                    matvar->internal->z->next_in   = ZLIB_BYTE_PTR(padzero);
-                    matvar->internal->z->avail_out = buf_size*sizeof(*comp_buf);
-                    matvar->internal->z->avail_in  = fieldname_size;
-                    err = deflate(matvar->internal->z,Z_NO_FLUSH);
-                    byteswritten += fwrite(comp_buf,1,
-                            buf_size*sizeof(*comp_buf)-matvar->internal->z->avail_out,
-                            mat->fp);
-                }
-                free(padzero);
-                for ( i = 0; i < nmemb*nfields; i++ )
-                    byteswritten +=
-                        WriteCompressedStructField(mat,fields[i],matvar->internal->z);
-                break;
-            }
-            case MAT_C_SPARSE:
-            {
-                mat_sparse_t *sparse = matvar->data;
+#if !defined(HAVE_ZLIB)
+    compress = MAT_COMPRESSION_NONE;
+#endif
 
-                byteswritten += WriteCompressedData(mat,matvar->internal->z,sparse->ir,
-                    sparse->nir,MAT_T_INT32);
-                byteswritten += WriteCompressedData(mat,matvar->internal->z,sparse->jc,
-                    sparse->njc,MAT_T_INT32);
-                if ( matvar->isComplex ) {
-                    mat_complex_split_t *complex_data = sparse->data;
-                    byteswritten += WriteCompressedData(mat,matvar->internal->z,
-                        complex_data->Re,sparse->ndata,matvar->data_type);
-                    byteswritten += WriteCompressedData(mat,matvar->internal->z,
-                        complex_data->Im,sparse->ndata,matvar->data_type);
-                } else {
-                    byteswritten += WriteCompressedData(mat,matvar->internal->z,
-                        sparse->data,sparse->ndata,matvar->data_type);
-                }
-                break;
-            }
-            case MAT_C_EMPTY:
-            case MAT_C_FUNCTION:
-            case MAT_C_OBJECT:
-                break;
-        }
-        matvar->internal->z->avail_in  = 0;
-        matvar->internal->z->next_in   = NULL;
-        matvar->internal->z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-        matvar->internal->z->avail_out = buf_size*sizeof(*comp_buf);
+    name_len  = strlen(name);
+    name_size = name_len <= 4 ? 0 : name_len;
+    if ( name_size % 8 )
+        name_size += 8-(name_size % 8);
+    dims_size = 4*cellstr->rank;
+    if ( dims_size % 8 )
+        dims_size += 8-(dims_size % 8);
+    hdr_size = 40+dims_size+name_size;
+
+    /* The size of the cell array is needed before the cells */
+    nbytes   = hdr_size-8;
+    buf_size = hdr_size;
+    for ( i = 0; i < cellstr->nstrings; i++ ) {
+        size_t elem_size;
+
+        str = Mat_CellStrGet(cellstr,i,&len);
+        elem_size = CellStrElement5(str,len,NULL);
+        nbytes += elem_size;
+        if ( elem_size > buf_size )
+            buf_size = elem_size;
+    }
+    for ( k = 0; k < cellstr->rank; k++ ) {
+        if ( cellstr->dims[k] > 0x7fffffffUL )
+            break;
+    }
+    if ( k < cellstr->rank || nbytes > 0xffffffffUL ) {
+        Mat_Critical("%s is too large for a version 5 MAT file",name);
+        return 1;
+    }
+    buf = Mat_Calloc(mat->allocator,buf_size,1);
+    if ( NULL == buf )
+        return 1;
 
-        err = deflate(matvar->internal->z,Z_FINISH);
-        byteswritten += fwrite(comp_buf,1,
-            buf_size*sizeof(*comp_buf)-matvar->internal->z->avail_out,mat->fp);
-        while ( err != Z_STREAM_END && !matvar->internal->z->avail_out ) {
-            matvar->internal->z->next_out  = ZLIB_BYTE_PTR(comp_buf);
-            matvar->internal->z->avail_out = buf_size*sizeof(*comp_buf);
+    tag[0] = MAT_T_MATRIX;
+    tag[1] = nbytes;
+    /* Array Flags */
+    tag[2] = MAT_T_UINT32;
+    tag[3] = 8;
+    tag[4] = MAT_C_CELL;
+    tag[5] = 0;
+    memcpy(buf,tag,sizeof(tag));
+    /* Rank and Dimension */
+    tag[0] = MAT_T_INT32;
+    tag[1] = 4*cellstr->rank;
+    memcpy(buf+24,tag,8);
+    for ( k = 0; k < cellstr->rank; k++ ) {
+        mat_uint32_t dim = cellstr->dims[k];
+        memcpy(buf+32+4*k,&dim,4);
+    }
+    /* Name of variable */
+    if ( name_len <= 4 ) {
+        tag[0] = (name_len << 16) | MAT_T_INT8;
+        memcpy(buf+32+dims_size,tag,4);
+        memcpy(buf+36+dims_size,name,name_len);
+    } else {
+        tag[0] = MAT_T_INT8;
+        tag[1] = name_len;
+        memcpy(buf+32+dims_size,tag,8);
+        memcpy(buf+40+dims_size,name,name_len);
+    }
 
-            err = deflate(matvar->internal->z,Z_FINISH);
-            byteswritten += fwrite(comp_buf,1,
-                buf_size*sizeof(*comp_buf)-matvar->internal->z->avail_out,mat->fp);
+    /* FIXME: SEEK_END is not Guaranteed by the C standard */
+    fseek(mat->fp,0,SEEK_END);         /* Always write at end of file */
+#if defined(HAVE_ZLIB)
+    if ( compress == MAT_COMPRESSION_ZLIB ) {
+        z = Mat_DeflateInit(mat->allocator);
+        if ( NULL == z ) {
+            Mat_Free(mat->allocator,buf);
+            return 1;
         }
-        /* End the compression and set to NULL so Mat_VarFree doesn't try
-         * to free matvar->internal->z with inflateEnd
-         */
-#if 0
-        if ( byteswritten % 8 )
-            for ( i = 0; i < 8-(byteswritten % 8); i++ )
-                fwrite(&pad1,1,1,mat->fp);
+        tag[0] = MAT_T_COMPRESSED;
+        tag[1] = 0;
+        fwrite(tag,4,2,mat->fp);
+        start = ftell(mat->fp);
+    }
 #endif
-        err = deflateEnd(matvar->internal->z);
-        free(matvar->internal->z);
-        matvar->internal->z = NULL;
+
+#if defined(HAVE_ZLIB)
+    if ( NULL != z )
+        err = WriteCompressedBytes5(mat,z,buf,hdr_size);
+    else
+#endif
+    err = fwrite(buf,1,hdr_size,mat->fp) != hdr_size;
+    for ( i = 0; i < cellstr->nstrings && !err; i++ ) {
+        str    = Mat_CellStrGet(cellstr,i,&len);
+        nbytes = CellStrElement5(str,len,buf);
+#if defined(HAVE_ZLIB)
+        if ( NULL != z )
+            err = WriteCompressedBytes5(mat,z,buf,nbytes);
+        else
 #endif
+        err = fwrite(buf,1,nbytes,mat->fp) != nbytes;
     }
-    end = ftell(mat->fp);
-    nBytes = (int)(end-start);
-    fseek(mat->fp,(long)-(nBytes+4),SEEK_CUR);
-    fwrite(&nBytes,4,1,mat->fp);
-    fseek(mat->fp,end,SEEK_SET);
 
-    return 0;
+#if defined(HAVE_ZLIB)
+    if ( NULL != z )
+        WriteCompressedEnd5(mat,z,start);
+#endif
+    Mat_Free(mat->allocator,buf);
+
+    return err;
 }
 
 /** @if mat_devman
@@ -5867,13 +5711,13 @@ WriteInfo5(mat_t *mat, matvar_t *matvar)
                 fwrite(&array_name_type,4,1,mat->fp);
                 nBytes = nfields*fieldname_size;
                 fwrite(&nBytes,4,1,mat->fp);
-                padzero = calloc(fieldname_size,1);
+                padzero = Mat_Calloc(mat->allocator,fieldname_size,1);
                 for ( i = 0; i < nfields; i++ ) {
                     size_t len = strlen(matvar->internal->fieldnames[i]);
                     fwrite(matvar->internal->fieldnames[i],1,len,mat->fp);
                     fwrite(padzero,1,fieldname_size-len,mat->fp);
                 }
-                free(padzero);
+                Mat_Free(mat->allocator,padzero);
                 for ( i = 0; i < nfields; i++ )
                     WriteInfo5(mat,fields[i]);
                 break;
@@ -5895,9 +5739,9 @@ WriteInfo5(mat_t *mat, matvar_t *matvar)
         int buf_size = 512, err;
         size_t byteswritten = 0;
 
-        matvar->internal->z         = malloc(sizeof(*matvar->internal->z));
-        matvar->internal->z->zalloc = Z_NULL;
-        matvar->internal->z->zfree  = Z_NULL;
+        matvar->internal->z         = Mat_Malloc(mat->allocator,
+                                          sizeof(*matvar->internal->z));
+        Mat_SetStreamAllocator(matvar->internal->z,mat->allocator);
         err = deflateInit(matvar->internal->z,Z_DEFAULT_COMPRESSION);
 
         matrix_type = MAT_T_COMPRESSED;
@@ -6019,7 +5863,7 @@ WriteInfo5(mat_t *mat, matvar_t *matvar)
         fprintf(stderr,"deflateEnd: err = %d\n",err);
 #if 1
         err = deflateEnd(matvar->internal->z);
-        free(matvar->internal->z);
+        Mat_Free(mat->allocator,matvar->internal->z);
         matvar->internal->z = NULL;
 #else
         memcpy(matvar->internal->z,&z_save,sizeof(*matvar->internal->z));
@@ -6034,6 +5878,33 @@ WriteInfo5(mat_t *mat, matvar_t *matvar)
     fseek(mat->fp,end,SEEK_SET);
 }
 
+/** @if mat_devman
+ * @brief Allocates a variable to read from a version 5 MAT file
+ *
+ * The variable uses the allocator of the file.  With arena allocation enabled
+ * (see Mat_SetArenaAllocation), the variable is the root of a new arena
+ * holding the tree read into it.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @return A newly allocated matvar_t, or NULL on error
+ * @endif
+ */
+static matvar_t *
+VarCallocArena5(mat_t *mat)
+{
+    struct mat_arena *arena = NULL;
+    matvar_t *matvar;
+
+    if ( mat->arena && NULL == (arena = Mat_ArenaCreate(mat->allocator)) )
+        return NULL;
+    matvar = Mat_VarCallocMem(mat->allocator,arena);
+    if ( NULL == matvar )
+        Mat_ArenaDestroy(arena);
+    else if ( NULL != arena )
+        arena->root = matvar;
+    return matvar;
+}
+
 /** @if mat_devman
  * @brief Reads the header information for the next MAT variable
  *
@@ -6070,7 +5941,7 @@ Mat_VarReadNextInfo5( mat_t *mat )
             int      nbytes;
             long     bytesread = 0;
 
-            matvar               = Mat_VarCalloc();
+            matvar               = VarCallocArena5(mat);
             matvar->name         = NULL;
             matvar->data         = NULL;
             matvar->dims         = NULL;
@@ -6083,18 +5954,12 @@ Mat_VarReadNextInfo5( mat_t *mat )
 
             matvar->internal->fp = mat;
             matvar->internal->fpos         = fpos;
-            matvar->internal->z = calloc(1,sizeof(z_stream));
-            matvar->internal->z->zalloc    = NULL;
-            matvar->internal->z->zfree     = NULL;
-            matvar->internal->z->opaque    = NULL;
-            matvar->internal->z->next_in   = NULL;
-            matvar->internal->z->next_out  = NULL;
-            matvar->internal->z->avail_in  = 0;
-            matvar->internal->z->avail_out = 0;
-            err = inflateInit(matvar->internal->z);
-            if ( err != Z_OK ) {
-                Mat_Critical("inflateInit2 returned %d",err);
+            matvar->internal->z = Mat_VarInflateInit(matvar);
+            if ( NULL == matvar->internal->z ) {
+                Mat_Critical("Couldn't initialize the zlib stream");
+                fseek(mat->fp,nBytes,SEEK_CUR);
                 Mat_VarFree(matvar);
+                matvar = NULL;
                 break;
             }
 
@@ -6141,7 +6006,8 @@ Mat_VarReadNextInfo5( mat_t *mat )
             if ( uncomp_buf[0] == MAT_T_INT32 ) {
                 nbytes = uncomp_buf[1];
                 matvar->rank = nbytes / 4;
-                matvar->dims = malloc(matvar->rank*sizeof(*matvar->dims));
+                matvar->dims = Mat_VarMemAlloc(matvar,
+                                   matvar->rank*sizeof(*matvar->dims));
                 if ( mat->byteswap ) {
                     for ( i = 0; i < matvar->rank; i++ )
                         matvar->dims[i] = Mat_uint32Swap(&(uncomp_buf[2+i]));
@@ -6166,7 +6032,7 @@ Mat_VarReadNextInfo5( mat_t *mat )
                     i = len;
                 else
                     i = len+(8-(len % 8));
-                matvar->name = malloc(i+1);
+                matvar->name = Mat_VarMemAlloc(matvar,i+1);
                 /* Inflate variable name */
                 bytesread += InflateVarName(mat,matvar,matvar->name,i);
                 matvar->name[len] = '\0';
@@ -6175,13 +6041,13 @@ Mat_VarReadNextInfo5( mat_t *mat )
                 /* Name packed in tag */
                 int len;
                 len = (uncomp_buf[0] & 0xffff0000) >> 16;
-                matvar->name = malloc(len+1);
+                matvar->name = Mat_VarMemAlloc(matvar,len+1);
                 memcpy(matvar->name,uncomp_buf+1,len);
                 matvar->name[len] = '\0';
             }
             if ( matvar->class_type == MAT_C_STRUCT )
                 ReadNextStructField(mat,matvar);
-            else if ( matvar->class_type == MAT_C_CELL )
+            else if ( matvar->class_type == MAT_C_CELL && !mat->shallow )
                 ReadNextCell(mat,matvar);
             fseek(mat->fp,-(int)matvar->internal->z->avail_in,SEEK_CUR);
             matvar->internal->datapos = ftell(mat->fp);
@@ -6200,7 +6066,7 @@ Mat_VarReadNextInfo5( mat_t *mat )
             mat_uint32_t buf[32];
             size_t   bytesread = 0;
 
-            matvar = Mat_VarCalloc();
+            matvar = VarCallocArena5(mat);
             matvar->internal->fpos = fpos;
             matvar->internal->fp   = mat;
 
@@ -6231,7 +6097,8 @@ Mat_VarReadNextInfo5( mat_t *mat )
                 nbytes = buf[5];
 
                 matvar->rank = nbytes / 4;
-                matvar->dims = malloc(matvar->rank*sizeof(*matvar->dims));
+                matvar->dims = Mat_VarMemAlloc(matvar,
+                                   matvar->rank*sizeof(*matvar->dims));
 
                 /* Assumes rank <= 16 */
                 if ( matvar->rank % 2 != 0 )
@@ -6265,7 +6132,7 @@ Mat_VarReadNextInfo5( mat_t *mat )
                     i = len+(8-(len % 8));
                 bytesread+=fread(buf,1,i,mat->fp);
 
-                matvar->name = malloc(len+1);
+                matvar->name = Mat_VarMemAlloc(matvar,len+1);
                 memcpy(matvar->name,buf,len);
                 matvar->name[len] = '\0';
             } else if ( ((buf[0] & 0x0000ffff) == MAT_T_INT8) &&
@@ -6274,13 +6141,13 @@ Mat_VarReadNextInfo5( mat_t *mat )
                 int len;
 
                 len = (buf[0] & 0xffff0000) >> 16;
-                matvar->name = malloc(len+1);
+                matvar->name = Mat_VarMemAlloc(matvar,len+1);
                 memcpy(matvar->name,buf+1,len);
                 matvar->name[len] = '\0';
             }
             if ( matvar->class_type == MAT_C_STRUCT )
                 (void)ReadNextStructField(mat,matvar);
-            else if ( matvar->class_type == MAT_C_CELL )
+            else if ( matvar->class_type == MAT_C_CELL && !mat->shallow )
                 (void)ReadNextCell(mat,matvar);
             else if ( matvar->class_type == MAT_C_FUNCTION )
                 (void)ReadNextFunctionHandle(mat,matvar);
@@ -34,45 +34,31 @@
 #   define EXTERN extern
 #endif
 
-static size_t GetStructFieldBufSize(matvar_t *matvar);
-static size_t GetCellArrayFieldBufSize(matvar_t *matvar);
-static size_t GetMatrixMaxBufSize(matvar_t *matvar);
-static size_t GetEmptyMatrixMaxBufSize(const char *name,int rank);
-static int WriteEmptyCharData(mat_t *mat, int N, enum matio_types data_type);
-static int WriteEmptyData(mat_t *mat,int N,enum matio_types data_type);
-static int ReadNextCell( mat_t *mat, matvar_t *matvar );
-static int ReadNextStructField( mat_t *mat, matvar_t *matvar );
-static int ReadNextFunctionHandle(mat_t *mat, matvar_t *matvar);
-static int WriteCellArrayFieldInfo(mat_t *mat,matvar_t *matvar);
-static int WriteCellArrayField(mat_t *mat,matvar_t *matvar );
-static int WriteStructField(mat_t *mat,matvar_t *matvar);
-static size_t Mat_WriteEmptyVariable5(mat_t *mat,const char *name,int rank,
-                  size_t *dims);
-#if defined(HAVE_ZLIB)
-static size_t WriteCompressedCharData(mat_t *mat,z_stream *z,void *data,int N,
-                  enum matio_types data_type);
-static int    WriteCompressedEmptyData(mat_t *mat,z_stream *z,int N,
-                  enum matio_types data_type);
-static size_t WriteCompressedData(mat_t *mat,z_stream *z,void *data,int N,
-                  enum matio_types data_type);
-static size_t WriteCompressedCellArrayField(mat_t *mat,matvar_t *matvar,
-                  z_stream *z);
-static size_t WriteCompressedStructField(mat_t *mat,matvar_t *matvar,
-                  z_stream *z);
-static size_t Mat_WriteCompressedEmptyVariable5(mat_t *mat,const char *name,
-                  int rank,size_t *dims,z_stream *z);
-#endif
-
 /*   mat5.c    */
 EXTERN mat_t *Mat_Create5(const char *matname,const char *hdr_str);
 
 matvar_t *Mat_VarReadNextInfo5( mat_t *mat );
 void      Read5(mat_t *mat, matvar_t *matvar);
+void      Mat_VarReadLazy5(mat_t *mat,matvar_t *matvar);
+int       Mat_VarReadStructColumns5(mat_t *mat,matvar_t *matvar,int ncolumns,
+              const int *field_index,matvar_t **columns);
+int       Mat_VarReadCellStr5(mat_t *mat,matvar_t *matvar,
+              mat_cellstr_t *cellstr);
 int       ReadData5(mat_t *mat,matvar_t *matvar,void *data, 
               int *start,int *stride,int *edge);
 int       Mat_VarReadDataLinear5(mat_t *mat,matvar_t *matvar,void *data,
               int start,int stride,int edge);
 int       Mat_VarWrite5(mat_t *mat,matvar_t *matvar,int compress);
+int       Mat_VarWriteAsync5(mat_t *mat,matvar_t *matvar,int compress);
+int       Mat_AsyncStart5(mat_t *mat,size_t max_bytes);
+void      Mat_AsyncWait5(mat_t *mat);
+int       Mat_AsyncFlush5(mat_t *mat);
+int       Mat_AsyncStop5(mat_t *mat);
+int       Mat_VarWriteStructColumns5(mat_t *mat,const char *name,int ncolumns,
+              const char * const *field_names,matvar_t * const *columns,
+              int compress);
+int       Mat_VarWriteCellStr5(mat_t *mat,const char *name,
+              const mat_cellstr_t *cellstr,int compress);
 int       WriteCharDataSlab2(mat_t *mat,void *data,enum matio_types data_type,
               size_t *dims,int *start,int *stride,int *edge);
 int       WriteData(mat_t *mat,void *data,int N,enum matio_types data_type);
@@ -41,6 +41,75 @@
 
 #include "mat73.h"
 
+#if defined(HAVE_PTHREAD) && HAVE_PTHREAD && defined(HAVE_ZLIB) && \
+    H5_VERSION_GE(1,10,2)
+#   define MAT_H5_PARALLEL_CHUNKS 1
+#   include <pthread.h>
+#else
+#   define MAT_H5_PARALLEL_CHUNKS 0
+#endif
+
+/* Size in bytes of the blocks read by a row-major read */
+#define MAT_H5_ROW_MAJOR_BLOCK 1048576
+
+#if MAT_H5_PARALLEL_CHUNKS
+/** @if mat_devman
+ * @brief Regular selection of a dataset read by chunks
+ *
+ * The dimensions are in HDF5 order, and the selected elements are stored
+ * contiguously in @c data in the same order.
+ * @ingroup mat_internal
+ * @endif
+ */
+struct mat_h5_chunk_sel {
+    int      rank;            /**< Rank of the dataset */
+    size_t   elem_size;       /**< Size of an element in bytes */
+    hsize_t  chunk_dims[10];  /**< Dimensions of a chunk */
+    hsize_t  start[10];       /**< First element selected */
+    hsize_t  stride[10];      /**< Stride between selected elements */
+    hsize_t  edge[10];        /**< Number of elements selected */
+    char    *data;            /**< Buffer of the selected elements */
+    char    *fill;            /**< Fill value of unallocated chunks */
+};
+
+/** @if mat_devman
+ * @brief Raw chunk of a dataset as stored in the file
+ * @ingroup mat_internal
+ * @endif
+ */
+struct mat_h5_chunk {
+    hsize_t  offset[10];      /**< Offset of the chunk in the dataset */
+    void    *raw;             /**< Compressed chunk, NULL if not allocated */
+    size_t   raw_size;        /**< Size of @c raw in bytes */
+    uint32_t filters;         /**< Mask of the filters that were skipped */
+};
+
+/** @if mat_devman
+ * @brief Queue of raw chunks read by the calling thread and inflated by the
+ *        worker threads, or deflated by the worker threads and written by
+ *        the calling thread
+ * @ingroup mat_internal
+ * @endif
+ */
+struct mat_h5_chunk_queue {
+    const struct mat_h5_chunk_sel *sel;
+    struct mat_h5_chunk *chunks;  /**< Ring buffer of chunks */
+    size_t size;                  /**< Capacity of the ring buffer */
+    size_t head;                  /**< Index of the next chunk to inflate,
+                                       or to write */
+    size_t count;                 /**< Number of chunks in the queue */
+    int    done;                  /**< 1 when all the chunks were queued */
+    int    err;                   /**< Non-zero if a chunk failed */
+    size_t next;                  /**< Index of the next chunk to deflate */
+    size_t nchunks;               /**< Number of chunks to deflate */
+    hsize_t grid[10];             /**< Number of chunks in each dimension */
+    int    level;                 /**< Deflate compression level */
+    pthread_mutex_t lock;
+    pthread_cond_t  not_empty;
+    pthread_cond_t  not_full;
+};
+#endif
+
 static const char *Mat_class_names[] = {
     "",
     "cell",
@@ -69,22 +138,58 @@ static enum matio_classes Mat_class_str_to_id(const char *name);
 static hid_t Mat_class_type_to_hid_t(enum matio_classes class_type);
 static hid_t Mat_data_type_to_hid_t(enum matio_types data_type);
 static hid_t Mat_dims_type_to_hid_t(void);
-static void  Mat_H5GetChunkSize(size_t rank,hsize_t *dims,hsize_t *chunk_dims);
+static hid_t Mat_H5CreateReadPlist(matvar_t *matvar);
+#if MAT_H5_PARALLEL_CHUNKS
+static int   Mat_H5ChunkSelection(const struct mat_h5_chunk_sel *sel,
+                  const hsize_t *offset,hsize_t *first,hsize_t *count);
+static void  Mat_H5CopyChunk(const struct mat_h5_chunk_sel *sel,
+                  const hsize_t *offset,char *chunk,int to_chunk);
+static void *Mat_H5ChunkWorker(void *arg);
+static int   Mat_H5ReadChunks(int nthreads,hid_t dset_id,hid_t mem_type_id,
+                  hid_t mem_space,hid_t file_space,void *buf);
+static void *Mat_H5DeflateWorker(void *arg);
+static int   Mat_H5WriteChunks(int nthreads,hid_t dset_id,hid_t mem_type_id,
+                  const void *buf);
+#endif
+static herr_t Mat_H5Dread(mat_t *mat,hid_t dset_id,hid_t mem_type_id,
+                  hid_t mem_space,hid_t file_space,hid_t plist_id,void *buf);
+static herr_t Mat_H5Dwrite(mat_t *mat,hid_t dset_id,hid_t mem_type_id,
+                  const void *buf);
+static hid_t Mat_H5ComplexType(hid_t base_type_id);
+static herr_t Mat_H5ReadComplex(mat_t *mat,hid_t dset_id,hid_t base_type_id,
+                  hid_t mem_space,hid_t file_space,size_t nmemb,
+                  mat_complex_split_t *complex_data);
+static herr_t Mat_H5WriteComplex(mat_t *mat,hid_t dset_id,hid_t base_type_id,
+                  size_t nmemb,const mat_complex_split_t *complex_data);
+static void  Mat_H5GetChunkSize(matvar_t *matvar,size_t elem_size,size_t rank,
+                  hsize_t *dims,hsize_t *chunk_dims);
+static hid_t Mat_H5CreateWritePlist(matvar_t *matvar,size_t elem_size,
+                  hsize_t *dims);
 static void  Mat_H5ReadClassType(matvar_t *matvar,hid_t dset_id);
 static void  Mat_H5ReadDatasetInfo(mat_t *mat,matvar_t *matvar,hid_t dset_id);
 static void  Mat_H5ReadGroupInfo(mat_t *mat,matvar_t *matvar,hid_t dset_id);
 static void  Mat_H5ReadNextReferenceInfo(hid_t ref_id,matvar_t *matvar,mat_t *mat);
 static void  Mat_H5ReadNextReferenceData(hid_t ref_id,matvar_t *matvar,mat_t *mat);
+static void  Mat_H5SetLazy(mat_t *mat,matvar_t **elems,size_t nelems);
+static hid_t Mat_H5OpenData(mat_t *mat,matvar_t *matvar);
+static herr_t Mat_H5ReadDirIter(hid_t group_id,const char *name,
+                  const H5L_info_t *info,void *op_data);
+static int   Mat_H5ReadDir(mat_t *mat);
+static matvar_t *Mat_H5ReadVarInfo(mat_t *mat,const char *name,hid_t obj_id);
+static hid_t Mat_H5OpenRefs(mat_t *mat,hid_t id);
+static int   Mat_H5WriteRef(mat_t *mat,matvar_t *matvar,int compression,
+                 hobj_ref_t *ref);
 static int   Mat_VarWriteCell73(hid_t id,matvar_t *matvar,const char *name,
-                                hid_t *refs_id);
+                                mat_t *mat);
 static int   Mat_VarWriteChar73(hid_t id,matvar_t *matvar,const char *name);
 static int   Mat_WriteEmptyVariable73(hid_t id,const char *name,hsize_t rank,
                  size_t *dims);
-static int   Mat_VarWriteNumeric73(hid_t id,matvar_t *matvar,const char *name);
+static int   Mat_VarWriteNumeric73(hid_t id,matvar_t *matvar,const char *name,
+                                   mat_t *mat);
 static int   Mat_VarWriteStruct73(hid_t id,matvar_t *matvar,const char *name,
-                                  hid_t *refs_id);
+                                  mat_t *mat);
 static int   Mat_VarWriteNext73(hid_t id,matvar_t *matvar,const char *name,
-                                hid_t *refs_id);
+                                mat_t *mat);
 
 static enum matio_classes
 Mat_class_str_to_id(const char *name)
@@ -424,184 +529,1355 @@ Mat_dims_type_to_hid_t(void)
         return -1;
 }
 
+/** @if mat_devman
+ * @brief Creates the dataset transfer property list used to read @c matvar
+ *
+ * If a scale and offset were set on the variable by Mat_VarSetScaling, the
+ * returned property list applies them as an HDF5 data transform so they are
+ * computed during the type conversion of H5Dread.
+ * @ingroup mat_internal
+ * @param matvar MAT variable pointer
+ * @returns transfer property list, or H5P_DEFAULT if no transform is needed
+ * @endif
+ */
+static hid_t
+Mat_H5CreateReadPlist(matvar_t *matvar)
+{
+    hid_t plist_id;
+    char  expr[128];
+
+    if ( !matvar->internal->scaling )
+        return H5P_DEFAULT;
+
+    plist_id = H5Pcreate(H5P_DATASET_XFER);
+    mat_snprintf(expr,sizeof(expr),"x*(%.17g)+(%.17g)",
+                 matvar->internal->scale,matvar->internal->offset);
+    if ( 0 > H5Pset_data_transform(plist_id,expr) ) {
+        Mat_Critical("Unable to set the data transform \"%s\"",expr);
+        H5Pclose(plist_id);
+        plist_id = H5P_DEFAULT;
+    }
+    return plist_id;
+}
+
+#if MAT_H5_PARALLEL_CHUNKS
+/** @if mat_devman
+ * @brief Computes the elements of a selection that lie in a chunk
+ *
+ * @ingroup mat_internal
+ * @param sel Selection of the dataset
+ * @param offset Offset of the chunk in the dataset
+ * @param first Index in the selection of the first element in the chunk
+ * @param count Number of selected elements in the chunk
+ * @retval 0 if no element of the selection is in the chunk
+ * @endif
+ */
+static int
+Mat_H5ChunkSelection(const struct mat_h5_chunk_sel *sel,const hsize_t *offset,
+    hsize_t *first,hsize_t *count)
+{
+    hsize_t lo, hi, end;
+    int d;
+
+    for ( d = 0; d < sel->rank; d++ ) {
+        end = offset[d]+sel->chunk_dims[d];
+        if ( end <= sel->start[d] )
+            return 0;
+        lo = 0;
+        if ( offset[d] > sel->start[d] )
+            lo = (offset[d]-sel->start[d]+sel->stride[d]-1)/sel->stride[d];
+        hi = (end-1-sel->start[d])/sel->stride[d];
+        if ( hi >= sel->edge[d] )
+            hi = sel->edge[d]-1;
+        if ( lo > hi )
+            return 0;
+        first[d] = lo;
+        count[d] = hi-lo+1;
+    }
+    return 1;
+}
+
+/** @if mat_devman
+ * @brief Copies the selected elements between a chunk and the data buffer
+ *
+ * Chunks do not overlap, so the threads copy chunks concurrently.
+ * @ingroup mat_internal
+ * @param sel Selection of the dataset
+ * @param offset Offset of the chunk in the dataset
+ * @param chunk Uncompressed chunk
+ * @param to_chunk 1 to gather the elements of the chunk from the data buffer,
+ *        0 to scatter the elements of the chunk to the data buffer
+ * @endif
+ */
 static void
-Mat_H5GetChunkSize(size_t rank,hsize_t *dims,hsize_t *chunk_dims)
+Mat_H5CopyChunk(const struct mat_h5_chunk_sel *sel,const hsize_t *offset,
+    char *chunk,int to_chunk)
 {
-    hsize_t  i, j, chunk_size = 1;
+    hsize_t first[10], count[10], k[10], cstride[10], ostride[10];
+    size_t  src, dst, es = sel->elem_size;
+    int     d, r = sel->rank;
+
+    if ( !Mat_H5ChunkSelection(sel,offset,first,count) )
+        return;
 
-    for ( i = 0; i < rank; i++ ) {
-        chunk_dims[i] = 1;
-        for ( j = 4096/chunk_size; j > 1; j >>= 1 ) {
-            if ( dims[i] >= j ) {
-                chunk_dims[i] = j;
+    cstride[r-1] = 1;
+    ostride[r-1] = 1;
+    for ( d = r-1; d > 0; d-- ) {
+        cstride[d-1] = cstride[d]*sel->chunk_dims[d];
+        ostride[d-1] = ostride[d]*sel->edge[d];
+    }
+    for ( d = 0; d < r; d++ )
+        k[d] = 0;
+
+    /* Copy the selected elements one row of the last dimension at a time */
+    do {
+        src = 0;
+        dst = 0;
+        for ( d = 0; d < r; d++ ) {
+            src += (sel->start[d]+(first[d]+k[d])*sel->stride[d]-offset[d])*
+                   cstride[d];
+            dst += (first[d]+k[d])*ostride[d];
+        }
+        if ( to_chunk )
+            Mat_CopyStrided(chunk+src*es,sel->stride[r-1],sel->data+dst*es,1,
+                            es,count[r-1]);
+        else
+            Mat_CopyStrided(sel->data+dst*es,1,chunk+src*es,sel->stride[r-1],
+                            es,count[r-1]);
+        for ( d = r-2; d >= 0; d-- ) {
+            if ( ++k[d] < count[d] )
                 break;
-            }
+            k[d] = 0;
         }
-        chunk_size *= chunk_dims[i];
-    }
+    } while ( d >= 0 );
 }
 
-static void
-Mat_H5ReadClassType(matvar_t *matvar,hid_t dset_id)
+/** @if mat_devman
+ * @brief Inflates the chunks of a queue and scatters them to the output
+ *
+ * @ingroup mat_internal
+ * @param arg Pointer to the mat_h5_chunk_queue
+ * @returns NULL
+ * @endif
+ */
+static void *
+Mat_H5ChunkWorker(void *arg)
 {
-    hid_t attr_id, type_id;
-    attr_id = H5Aopen_name(dset_id,"MATLAB_class");
-    type_id  = H5Aget_type(attr_id);
-    if ( H5T_STRING == H5Tget_class(type_id) ) {
-        char *class_str = calloc(H5Tget_size(type_id)+1,1);
-        if ( NULL != class_str ) {
-            hid_t class_id = H5Tcopy(H5T_C_S1);
-            H5Tset_size(class_id,H5Tget_size(type_id));
-            H5Aread(attr_id,class_id,class_str);
-            H5Tclose(class_id);
-            matvar->class_type = Mat_class_str_to_id(class_str);
-            if ( MAT_C_EMPTY == matvar->class_type ) {
-                /* Check if this is a logical variable */
-                if ( !strcmp(class_str, "logical") ) {
-                    int int_decode = 0;
-                    hid_t attr_id2;
-                    matvar->isLogical = MAT_F_LOGICAL;
-                    attr_id2 = H5Aopen_name(dset_id,"MATLAB_int_decode");
-                    /* FIXME: Check that dataspace is scalar */
-                    if ( -1 < attr_id2 ) {
-                        H5Aread(attr_id2,H5T_NATIVE_INT,&int_decode);
-                        H5Aclose(attr_id2);
-                    }
-                    switch (int_decode) {
-                        case 1:
-                            matvar->class_type = MAT_C_UINT8;
-                            break;
-                        case 2:
-                            matvar->class_type = MAT_C_UINT16;
-                            break;
-                        case 4:
-                            matvar->class_type = MAT_C_UINT32;
-                            break;
-                        default:
-                            break;
-                    }
-                }
-            }
+    struct mat_h5_chunk_queue *queue = arg;
+    const struct mat_h5_chunk_sel *sel = queue->sel;
+    struct mat_h5_chunk chunk;
+    size_t nbytes = sel->elem_size, i;
+    uLongf len;
+    char  *buf;
+    int    d, err;
+
+    for ( d = 0; d < sel->rank; d++ )
+        nbytes *= sel->chunk_dims[d];
+    buf = malloc(nbytes);
+
+    for ( ;; ) {
+        pthread_mutex_lock(&queue->lock);
+        while ( 0 == queue->count && !queue->done )
+            pthread_cond_wait(&queue->not_empty,&queue->lock);
+        if ( 0 == queue->count ) {
+            pthread_mutex_unlock(&queue->lock);
+            break;
+        }
+        chunk = queue->chunks[queue->head];
+        queue->head = (queue->head+1) % queue->size;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+        pthread_mutex_unlock(&queue->lock);
 
-            matvar->data_type  = Mat_ClassToType73(matvar->class_type);
-            free(class_str);
+        err = 0;
+        if ( NULL == buf ) {
+            err = 1;
+        } else if ( NULL == chunk.raw ) {
+            for ( i = 0; i < nbytes; i += sel->elem_size )
+                memcpy(buf+i,sel->fill,sel->elem_size);
+        } else if ( chunk.filters & 0x01 ) {
+            /* The deflate filter was skipped for this chunk */
+            if ( chunk.raw_size < nbytes )
+                err = 1;
+            else
+                memcpy(buf,chunk.raw,nbytes);
+        } else {
+            len = nbytes;
+            if ( Z_OK != uncompress((Bytef*)buf,&len,chunk.raw,
+                                    chunk.raw_size) || len != nbytes )
+                err = 1;
+        }
+        if ( !err )
+            Mat_H5CopyChunk(sel,chunk.offset,buf,0);
+        free(chunk.raw);
+        if ( err ) {
+            pthread_mutex_lock(&queue->lock);
+            queue->err = 1;
+            pthread_mutex_unlock(&queue->lock);
         }
     }
-    H5Tclose(type_id);
-    H5Aclose(attr_id);
+    free(buf);
+
+    return NULL;
 }
 
-static void
-Mat_H5ReadDatasetInfo(mat_t *mat,matvar_t *matvar,hid_t dset_id)
+/** @if mat_devman
+ * @brief Reads a deflated dataset by inflating its chunks in parallel
+ *
+ * The calling thread reads the raw chunks with H5Dread_chunk, since the HDF5
+ * library may not be thread-safe, and @c nthreads worker threads inflate them
+ * and scatter the selected elements to @c buf.  Only datasets whose only
+ * filter is deflate, whose file type equals the memory type, and regular
+ * hyperslab selections to a contiguous buffer are supported.
+ * @ingroup mat_internal
+ * @param nthreads Number of worker threads
+ * @param dset_id HDF5 dataset
+ * @param mem_type_id HDF5 memory type
+ * @param mem_space memory dataspace or H5S_ALL
+ * @param file_space file dataspace selection or H5S_ALL
+ * @param buf Buffer of the selected elements
+ * @retval 0 on success
+ * @retval 1 if the dataset or selection is not supported and nothing was read
+ * @retval -1 on error
+ * @endif
+ */
+static int
+Mat_H5ReadChunks(int nthreads,hid_t dset_id,hid_t mem_type_id,
+    hid_t mem_space,hid_t file_space,void *buf)
 {
-    ssize_t  name_len;
-    /* FIXME */
-    hsize_t  dims[10];
-    hid_t   attr_id,type_id,space_id;
-    H5E_auto_t efunc;
-    void       *client_data;
-
-#if 0
-    matvar->fp = mat;
-    name_len = H5Gget_objname_by_idx(fid,mat->next_index,NULL,0);
-    matvar->name = malloc(1+name_len);
-    if ( matvar->name ) {
-        name_len = H5Gget_objname_by_idx(fid,mat->next_index,
-                                         matvar->name,1+name_len);
-        matvar->name[name_len] = '\0';
+    struct mat_h5_chunk_sel   sel;
+    struct mat_h5_chunk_queue queue;
+    struct mat_h5_chunk       chunk;
+    hsize_t   dims[10], block[10], first[10], count[10], nmemb = 1;
+    hsize_t   chunk_lo[10], chunk_hi[10], chunk_k[10];
+    hid_t     dcpl_id, type_id, space_id;
+    pthread_t *threads;
+    unsigned  flags, filter_config;
+    size_t    cd_nelmts = 0;
+    hsize_t   raw_size;
+    int       d, k, nstarted = 0, supported = 1, err = 0;
+
+    /* Check that the chunks can be inflated without the HDF5 library */
+    dcpl_id = H5Dget_create_plist(dset_id);
+    if ( H5D_CHUNKED != H5Pget_layout(dcpl_id) || 1 != H5Pget_nfilters(dcpl_id) ||
+         H5Z_FILTER_DEFLATE != H5Pget_filter2(dcpl_id,0,&flags,&cd_nelmts,NULL,
+                                              0,NULL,&filter_config) ) {
+        H5Pclose(dcpl_id);
+        return 1;
     }
-    dset_id = H5Dopen(fid,matvar->name);
-#endif
+    type_id = H5Dget_type(dset_id);
+    if ( 0 >= H5Tequal(type_id,mem_type_id) )
+        supported = 0;
+    H5Tclose(type_id);
+    space_id = H5Dget_space(dset_id);
+    sel.rank = H5Sget_simple_extent_ndims(space_id);
+    if ( !supported || sel.rank < 1 || sel.rank > 10 ||
+         sel.rank != H5Pget_chunk(dcpl_id,10,sel.chunk_dims) ) {
+        H5Sclose(space_id);
+        H5Pclose(dcpl_id);
+        return 1;
+    }
+    H5Sget_simple_extent_dims(space_id,dims,NULL);
+    H5Sclose(space_id);
 
-    /* Get the HDF5 name of the variable */
-    name_len = H5Iget_name(dset_id,NULL,0);
-    if ( name_len > 0 ) {
-        matvar->internal->hdf5_name = malloc(name_len+1);
-        (void)H5Iget_name(dset_id,matvar->internal->hdf5_name,name_len+1);
+    /* Get the selection as a start, stride and edge in each dimension */
+    if ( H5S_ALL == file_space || H5S_SEL_ALL == H5Sget_select_type(file_space) ) {
+        for ( d = 0; d < sel.rank; d++ ) {
+            sel.start[d]  = 0;
+            sel.stride[d] = 1;
+            sel.edge[d]   = dims[d];
+        }
+    } else if ( H5S_SEL_HYPERSLABS == H5Sget_select_type(file_space) &&
+                0 < H5Sis_regular_hyperslab(file_space) ) {
+        H5Sget_regular_hyperslab(file_space,sel.start,sel.stride,sel.edge,
+                                 block);
+        for ( d = 0; d < sel.rank; d++ ) {
+            if ( 1 != block[d] )
+                supported = 0;
+        }
     } else {
-        /* Can not get an internal name, so leave the identifier open */
-        matvar->internal->id = dset_id;
+        supported = 0;
+    }
+    for ( d = 0; d < sel.rank; d++ ) {
+        nmemb *= sel.edge[d];
+        if ( sel.stride[d] < 1 )
+            supported = 0;
+    }
+    if ( H5S_ALL != mem_space &&
+         (H5S_SEL_ALL != H5Sget_select_type(mem_space) ||
+          nmemb != (hsize_t)H5Sget_select_npoints(mem_space)) )
+        supported = 0;
+    if ( !supported || 0 == nmemb ) {
+        H5Pclose(dcpl_id);
+        return 0 == nmemb ? 0 : 1;
     }
 
-    space_id     = H5Dget_space(dset_id);
-    matvar->rank = H5Sget_simple_extent_ndims(space_id);
-    matvar->dims = malloc(matvar->rank*sizeof(*matvar->dims));
-    if ( NULL != matvar->dims ) {
-        int k;
-        H5Sget_simple_extent_dims(space_id,dims,NULL);
-        for ( k = 0; k < matvar->rank; k++ )
-            matvar->dims[k] = dims[matvar->rank - k - 1];
+    sel.elem_size = H5Tget_size(mem_type_id);
+    sel.data      = buf;
+    sel.fill      = calloc(1,sel.elem_size);
+    if ( NULL != sel.fill )
+        H5Pget_fill_value(dcpl_id,mem_type_id,sel.fill);
+    H5Pclose(dcpl_id);
+
+    queue.sel    = &sel;
+    queue.size   = 4*nthreads;
+    queue.chunks = malloc(queue.size*sizeof(*queue.chunks));
+    queue.head   = 0;
+    queue.count  = 0;
+    queue.done   = 0;
+    queue.err    = 0;
+    threads = malloc(nthreads*sizeof(*threads));
+    if ( NULL == sel.fill || NULL == queue.chunks || NULL == threads ) {
+        free(sel.fill);
+        free(queue.chunks);
+        free(threads);
+        return 1;
+    }
+    pthread_mutex_init(&queue.lock,NULL);
+    pthread_cond_init(&queue.not_empty,NULL);
+    pthread_cond_init(&queue.not_full,NULL);
+    for ( k = 0; k < nthreads; k++ ) {
+        if ( 0 != pthread_create(threads+k,NULL,Mat_H5ChunkWorker,&queue) )
+            break;
+        nstarted++;
     }
-    H5Sclose(space_id);
 
-    Mat_H5ReadClassType(matvar, dset_id);
+    if ( nstarted > 0 ) {
+        /* Queue the chunks that contain selected elements */
+        for ( d = 0; d < sel.rank; d++ ) {
+            chunk_lo[d] = sel.start[d]/sel.chunk_dims[d];
+            chunk_hi[d] = (sel.start[d]+(sel.edge[d]-1)*sel.stride[d])/
+                          sel.chunk_dims[d];
+            chunk_k[d]  = chunk_lo[d];
+        }
+        do {
+            for ( d = 0; d < sel.rank; d++ )
+                chunk.offset[d] = chunk_k[d]*sel.chunk_dims[d];
+            if ( Mat_H5ChunkSelection(&sel,chunk.offset,first,count) ) {
+                chunk.raw      = NULL;
+                chunk.raw_size = 0;
+                chunk.filters  = 0;
+                if ( 0 <= H5Dget_chunk_storage_size(dset_id,chunk.offset,
+                                                    &raw_size) &&
+                     raw_size > 0 ) {
+                    chunk.raw      = malloc(raw_size);
+                    chunk.raw_size = raw_size;
+                    if ( NULL == chunk.raw ||
+                         0 > H5Dread_chunk(dset_id,H5P_DEFAULT,chunk.offset,
+                                           &chunk.filters,chunk.raw) ) {
+                        free(chunk.raw);
+                        err = 1;
+                        break;
+                    }
+                }
+                pthread_mutex_lock(&queue.lock);
+                while ( queue.count == queue.size )
+                    pthread_cond_wait(&queue.not_full,&queue.lock);
+                queue.chunks[(queue.head+queue.count) % queue.size] = chunk;
+                queue.count++;
+                pthread_cond_signal(&queue.not_empty);
+                pthread_mutex_unlock(&queue.lock);
+            }
+            for ( d = sel.rank-1; d >= 0; d-- ) {
+                if ( ++chunk_k[d] <= chunk_hi[d] )
+                    break;
+                chunk_k[d] = chunk_lo[d];
+            }
+        } while ( d >= 0 );
+
+        pthread_mutex_lock(&queue.lock);
+        queue.done = 1;
+        pthread_cond_broadcast(&queue.not_empty);
+        pthread_mutex_unlock(&queue.lock);
+        for ( k = 0; k < nstarted; k++ )
+            pthread_join(threads[k],NULL);
+        if ( queue.err )
+            err = 1;
+    }
 
-    /* Turn off error printing so testing for attributes doesn't print
-     * error stacks
-     */
-    H5Eget_auto(H5E_DEFAULT,&efunc,&client_data);
-    H5Eset_auto(H5E_DEFAULT,(H5E_auto_t)0,NULL);
+    pthread_cond_destroy(&queue.not_full);
+    pthread_cond_destroy(&queue.not_empty);
+    pthread_mutex_destroy(&queue.lock);
+    free(threads);
+    free(queue.chunks);
+    free(sel.fill);
+
+    if ( 0 == nstarted )
+        return 1;
+    else if ( err )
+        Mat_Critical("Error inflating the chunks of a dataset");
+    return err ? -1 : 0;
+}
 
-    attr_id = H5Aopen_name(dset_id,"MATLAB_global");
-    /* FIXME: Check that dataspace is scalar */
-    if ( -1 < attr_id ) {
-        H5Aread(attr_id,H5T_NATIVE_INT,&matvar->isGlobal);
-        H5Aclose(attr_id);
-    }
+/** @if mat_devman
+ * @brief Gathers and deflates the chunks of a dataset
+ *
+ * @ingroup mat_internal
+ * @param arg Pointer to the mat_h5_chunk_queue
+ * @returns NULL
+ * @endif
+ */
+static void *
+Mat_H5DeflateWorker(void *arg)
+{
+    struct mat_h5_chunk_queue *queue = arg;
+    const struct mat_h5_chunk_sel *sel = queue->sel;
+    struct mat_h5_chunk chunk;
+    size_t nbytes = sel->elem_size, i, slot;
+    uLongf len;
+    char  *buf;
+    int    d, err, partial;
+
+    for ( d = 0; d < sel->rank; d++ )
+        nbytes *= sel->chunk_dims[d];
+    buf = malloc(nbytes);
+
+    for ( ;; ) {
+        /* Deflate at most one ring buffer of chunks ahead of the writer */
+        pthread_mutex_lock(&queue->lock);
+        while ( queue->next < queue->nchunks &&
+                queue->next >= queue->head+queue->size && !queue->err )
+            pthread_cond_wait(&queue->not_full,&queue->lock);
+        if ( queue->err || queue->next >= queue->nchunks ) {
+            pthread_mutex_unlock(&queue->lock);
+            break;
+        }
+        i = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        slot = i % queue->size;
+
+        partial = 0;
+        for ( d = sel->rank-1; d >= 0; d-- ) {
+            chunk.offset[d] = (i % queue->grid[d])*sel->chunk_dims[d];
+            i /= queue->grid[d];
+            if ( chunk.offset[d]+sel->chunk_dims[d] > sel->edge[d] )
+                partial = 1;
+        }
+        chunk.filters  = 0;
+        chunk.raw_size = 0;
+        chunk.raw      = NULL;
+        err = 1;
+        if ( NULL != buf ) {
+            /* Edge chunks are padded with the default fill value */
+            if ( partial )
+                memset(buf,0,nbytes);
+            Mat_H5CopyChunk(sel,chunk.offset,buf,1);
+            len = compressBound(nbytes);
+            chunk.raw = malloc(len);
+            if ( NULL != chunk.raw &&
+                 Z_OK == compress2(chunk.raw,&len,(Bytef*)buf,nbytes,
+                                   queue->level) ) {
+                chunk.raw_size = len;
+                err = 0;
+            }
+        }
 
-    /* Check for attribute that indicates an empty array */
-    attr_id = H5Aopen_name(dset_id,"MATLAB_empty");
-    /* FIXME: Check that dataspace is scalar */
-    if ( -1 < attr_id ) {
-        int empty = 0;
-        H5Aread(attr_id,H5T_NATIVE_INT,&empty);
-        H5Aclose(attr_id);
-        if ( empty ) {
-            matvar->rank = matvar->dims[0];
-            matvar->dims = calloc(matvar->rank,sizeof(*matvar->dims));
-            H5Dread(dset_id,Mat_dims_type_to_hid_t(),H5S_ALL,H5S_ALL,
-                    H5P_DEFAULT,matvar->dims);
+        pthread_mutex_lock(&queue->lock);
+        if ( err ) {
+            free(chunk.raw);
+            queue->err = 1;
+            pthread_cond_broadcast(&queue->not_full);
+        } else {
+            queue->chunks[slot] = chunk;
         }
+        pthread_cond_signal(&queue->not_empty);
+        pthread_mutex_unlock(&queue->lock);
     }
+    free(buf);
 
-    H5Eset_auto(H5E_DEFAULT,efunc,client_data);
+    return NULL;
+}
 
-    /* Test if dataset type is compound and if so if it's complex */
-    type_id = H5Dget_type(dset_id);
-    if ( H5T_COMPOUND == H5Tget_class(type_id) ) {
-        /* FIXME: Any more checks? */
-        matvar->isComplex = MAT_F_COMPLEX;
+/** @if mat_devman
+ * @brief Writes a deflated dataset by deflating its chunks in parallel
+ *
+ * @c nthreads worker threads gather the chunks from @c buf and deflate them,
+ * and the calling thread writes them in order with H5Dwrite_chunk, so the
+ * dataset is stored as if it were written by H5Dwrite.  Only datasets whose only filter
+ * is deflate and whose file type equals the memory type are supported.
+ * @ingroup mat_internal
+ * @param nthreads Number of worker threads
+ * @param dset_id HDF5 dataset
+ * @param mem_type_id HDF5 memory type
+ * @param buf Data of the whole dataset
+ * @retval 0 on success
+ * @retval 1 if the dataset is not supported and nothing was written
+ * @retval -1 on error
+ * @endif
+ */
+static int
+Mat_H5WriteChunks(int nthreads,hid_t dset_id,hid_t mem_type_id,
+    const void *buf)
+{
+    struct mat_h5_chunk_sel   sel;
+    struct mat_h5_chunk_queue queue;
+    struct mat_h5_chunk       chunk;
+    hid_t     dcpl_id, type_id, space_id;
+    pthread_t *threads;
+    unsigned  flags, filter_config, cd_values[1] = {6};
+    size_t    cd_nelmts = 1, i;
+    int       d, k, nstarted = 0, supported = 1, err = 0;
+
+    dcpl_id = H5Dget_create_plist(dset_id);
+    if ( H5D_CHUNKED != H5Pget_layout(dcpl_id) || 1 != H5Pget_nfilters(dcpl_id) ||
+         H5Z_FILTER_DEFLATE != H5Pget_filter2(dcpl_id,0,&flags,&cd_nelmts,
+                                              cd_values,0,NULL,
+                                              &filter_config) ) {
+        H5Pclose(dcpl_id);
+        return 1;
     }
+    type_id = H5Dget_type(dset_id);
+    if ( 0 >= H5Tequal(type_id,mem_type_id) )
+        supported = 0;
     H5Tclose(type_id);
+    space_id = H5Dget_space(dset_id);
+    sel.rank = H5Sget_simple_extent_ndims(space_id);
+    if ( !supported || sel.rank < 1 || sel.rank > 10 ||
+         sel.rank != H5Pget_chunk(dcpl_id,10,sel.chunk_dims) ) {
+        H5Sclose(space_id);
+        H5Pclose(dcpl_id);
+        return 1;
+    }
+    H5Sget_simple_extent_dims(space_id,sel.edge,NULL);
+    H5Sclose(space_id);
+    H5Pclose(dcpl_id);
+
+    sel.elem_size = H5Tget_size(mem_type_id);
+    sel.data      = (char*)buf;
+    sel.fill      = NULL;
+    queue.nchunks = 1;
+    for ( d = 0; d < sel.rank; d++ ) {
+        sel.start[d]  = 0;
+        sel.stride[d] = 1;
+        queue.grid[d] = (sel.edge[d]+sel.chunk_dims[d]-1)/sel.chunk_dims[d];
+        queue.nchunks *= queue.grid[d];
+    }
+    if ( 0 == queue.nchunks )
+        return 1;
+
+    queue.sel     = &sel;
+    queue.size    = 4*nthreads;
+    queue.chunks  = malloc(queue.size*sizeof(*queue.chunks));
+    queue.head    = 0;
+    queue.count   = 0;
+    queue.done    = 0;
+    queue.err     = 0;
+    queue.next    = 0;
+    queue.level   = cd_nelmts > 0 ? (int)cd_values[0] : 6;
+    threads = malloc(nthreads*sizeof(*threads));
+    if ( NULL == queue.chunks || NULL == threads ) {
+        free(queue.chunks);
+        free(threads);
+        return 1;
+    }
+    /* A slot holds a deflated chunk once its raw data is set */
+    for ( i = 0; i < queue.size; i++ )
+        queue.chunks[i].raw = NULL;
+    pthread_mutex_init(&queue.lock,NULL);
+    pthread_cond_init(&queue.not_empty,NULL);
+    pthread_cond_init(&queue.not_full,NULL);
+    for ( k = 0; k < nthreads; k++ ) {
+        if ( 0 != pthread_create(threads+k,NULL,Mat_H5DeflateWorker,&queue) )
+            break;
+        nstarted++;
+    }
 
-    /* If the dataset is a cell array read the info of the cells */
-    if ( MAT_C_CELL == matvar->class_type ) {
-        matvar_t **cells;
-        int i,ncells = 1;
-        hobj_ref_t *ref_ids;
+    /* Write the chunks in order, so the file does not depend on which
+     * thread deflates a chunk first */
+    while ( nstarted > 0 && queue.head < queue.nchunks ) {
+        struct mat_h5_chunk *next;
+
+        pthread_mutex_lock(&queue.lock);
+        next = queue.chunks+queue.head % queue.size;
+        while ( NULL == next->raw && !queue.err )
+            pthread_cond_wait(&queue.not_empty,&queue.lock);
+        if ( queue.err ) {
+            pthread_mutex_unlock(&queue.lock);
+            break;
+        }
+        chunk = *next;
+        next->raw = NULL;
+        queue.head++;
+        pthread_cond_broadcast(&queue.not_full);
+        pthread_mutex_unlock(&queue.lock);
+
+        if ( 0 > H5Dwrite_chunk(dset_id,H5P_DEFAULT,chunk.filters,
+                                chunk.offset,chunk.raw_size,chunk.raw) ) {
+            pthread_mutex_lock(&queue.lock);
+            queue.err = 1;
+            pthread_cond_broadcast(&queue.not_full);
+            pthread_mutex_unlock(&queue.lock);
+        }
+        free(chunk.raw);
+    }
 
-        for ( i = 0; i < matvar->rank; i++ )
-            ncells *= matvar->dims[i];
-        matvar->data_size = sizeof(matvar_t**);
-        matvar->nbytes    = ncells*matvar->data_size;
-        matvar->data      = malloc(matvar->nbytes);
-        cells  = matvar->data;
+    for ( k = 0; k < nstarted; k++ )
+        pthread_join(threads[k],NULL);
+    err = queue.err;
+    for ( i = 0; i < queue.size; i++ )
+        free(queue.chunks[i].raw);
+
+    pthread_cond_destroy(&queue.not_full);
+    pthread_cond_destroy(&queue.not_empty);
+    pthread_mutex_destroy(&queue.lock);
+    free(threads);
+    free(queue.chunks);
+
+    if ( 0 == nstarted )
+        return 1;
+    else if ( err )
+        Mat_Critical("Error deflating the chunks of a dataset");
+    return err ? -1 : 0;
+}
+#endif
 
-        if ( ncells ) {
-            ref_ids = malloc(ncells*sizeof(*ref_ids));
-            H5Dread(dset_id,H5T_STD_REF_OBJ,H5S_ALL,H5S_ALL,H5P_DEFAULT,
-                    ref_ids);
-            for ( i = 0; i < ncells; i++ ) {
-                hid_t ref_id;
-                cells[i] = Mat_VarCalloc();
-                cells[i]->internal->hdf5_ref = ref_ids[i];
-                /* Closing of ref_id is done in Mat_H5ReadNextReferenceInfo */
-                ref_id = H5Rdereference(dset_id,H5R_OBJECT,ref_ids+i);
-                cells[i]->internal->id = ref_id;
-                cells[i]->internal->fp = matvar->internal->fp;
-                Mat_H5ReadNextReferenceInfo(ref_id,cells[i],mat);
-            }
-            free(ref_ids);
+/** @if mat_devman
+ * @brief Reads a dataset, inflating its chunks in parallel when possible
+ *
+ * Calls H5Dread, unless more than one thread was set with Mat_SetNumThreads
+ * and the dataset is supported by Mat_H5ReadChunks.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param dset_id HDF5 dataset
+ * @param mem_type_id HDF5 memory type
+ * @param mem_space memory dataspace or H5S_ALL
+ * @param file_space file dataspace selection or H5S_ALL
+ * @param plist_id transfer property list
+ * @param buf Buffer of the selected elements
+ * @returns negative on error
+ * @endif
+ */
+static herr_t
+Mat_H5Dread(mat_t *mat,hid_t dset_id,hid_t mem_type_id,hid_t mem_space,
+    hid_t file_space,hid_t plist_id,void *buf)
+{
+#if MAT_H5_PARALLEL_CHUNKS
+    if ( NULL != mat && mat->nthreads > 1 && H5P_DEFAULT == plist_id ) {
+        int err = Mat_H5ReadChunks(mat->nthreads,dset_id,mem_type_id,
+                                   mem_space,file_space,buf);
+        if ( err < 1 )
+            return err;
+    }
+#endif
+    return H5Dread(dset_id,mem_type_id,mem_space,file_space,plist_id,buf);
+}
+
+/** @if mat_devman
+ * @brief Writes a dataset, deflating its chunks in parallel when possible
+ *
+ * Calls H5Dwrite, unless more than one thread was set with Mat_SetNumThreads
+ * and the dataset is supported by Mat_H5WriteChunks.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param dset_id HDF5 dataset
+ * @param mem_type_id HDF5 memory type
+ * @param buf Data of the whole dataset
+ * @returns negative on error
+ * @endif
+ */
+static herr_t
+Mat_H5Dwrite(mat_t *mat,hid_t dset_id,hid_t mem_type_id,const void *buf)
+{
+#if MAT_H5_PARALLEL_CHUNKS
+    if ( NULL != mat && mat->nthreads > 1 ) {
+        int err = Mat_H5WriteChunks(mat->nthreads,dset_id,mem_type_id,buf);
+        if ( err < 1 )
+            return err;
+    }
+#endif
+    return H5Dwrite(dset_id,mem_type_id,H5S_ALL,H5S_ALL,H5P_DEFAULT,buf);
+}
+
+/** @if mat_devman
+ * @brief Creates the compound type of a complex dataset
+ *
+ * @ingroup mat_internal
+ * @param base_type_id HDF5 type of the real and imaginary parts
+ * @returns compound type with "real" and "imag" fields, to be closed with
+ *          H5Tclose
+ * @endif
+ */
+static hid_t
+Mat_H5ComplexType(hid_t base_type_id)
+{
+    hid_t  h5_complex;
+    size_t size = H5Tget_size(base_type_id);
+
+    h5_complex = H5Tcreate(H5T_COMPOUND,2*size);
+    H5Tinsert(h5_complex,"real",0,base_type_id);
+    H5Tinsert(h5_complex,"imag",size,base_type_id);
+
+    return h5_complex;
+}
+
+/** @if mat_devman
+ * @brief Reads both parts of a complex dataset in a single pass
+ *
+ * Reads the selection through the full compound type to an interleaved
+ * buffer and splits it into @c complex_data, so each chunk of the dataset
+ * is read and decompressed only once.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param dset_id HDF5 dataset
+ * @param base_type_id HDF5 memory type of the real and imaginary parts
+ * @param mem_space memory dataspace or H5S_ALL
+ * @param file_space file dataspace selection or H5S_ALL
+ * @param nmemb number of elements selected
+ * @param complex_data Split buffers of at least @c nmemb elements each
+ * @returns negative on error
+ * @endif
+ */
+static herr_t
+Mat_H5ReadComplex(mat_t *mat,hid_t dset_id,hid_t base_type_id,hid_t mem_space,
+    hid_t file_space,size_t nmemb,mat_complex_split_t *complex_data)
+{
+    size_t size = H5Tget_size(base_type_id);
+    hid_t  h5_complex;
+    herr_t herr;
+    char  *buf;
+
+    if ( nmemb < 1 )
+        return 0;
+    buf = Mat_Malloc(mat->allocator,2*nmemb*size);
+    if ( NULL == buf ) {
+        Mat_Critical("Couldn't allocate memory for the data");
+        return -1;
+    }
+    h5_complex = Mat_H5ComplexType(base_type_id);
+    herr = Mat_H5Dread(mat,dset_id,h5_complex,mem_space,file_space,H5P_DEFAULT,
+                       buf);
+    H5Tclose(h5_complex);
+    if ( 0 <= herr ) {
+        Mat_CopyStrided(complex_data->Re,1,buf,2,size,nmemb);
+        Mat_CopyStrided(complex_data->Im,1,buf+size,2,size,nmemb);
+    }
+    Mat_Free(mat->allocator,buf);
+
+    return herr;
+}
+
+/** @if mat_devman
+ * @brief Transfers a dataset selection from or to row-major order a block
+ *        at a time
+ *
+ * The dimensions of a dataset are those of the variable reversed, so
+ * consecutive indices of the first dataset dimension hold a contiguous range
+ * of the column-major elements.  The selection is transferred in blocks of
+ * such ranges of at most MAT_H5_ROW_MAJOR_BLOCK bytes, rounded to whole
+ * chunks of the dataset.  A block read is stored at its row-major place, and
+ * a block to write is collected from its row-major place, so no column-major
+ * copy of the whole selection is made.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer, or NULL
+ * @param dset_id HDF5 dataset
+ * @param mem_type_id HDF5 memory type, or the type of each part if
+ *        @c complex_data is not NULL
+ * @param plist_id transfer property list
+ * @param start index of the selection in each dataset dimension, or NULL
+ *        for the whole dataset
+ * @param stride stride of the selection in each dataset dimension
+ * @param edge number of elements selected in each dataset dimension
+ * @param data Buffer of the selection, or NULL for a split complex dataset
+ * @param complex_data Split buffers of a complex dataset, or NULL
+ * @param write 1 to write the selection, 0 to read it
+ * @returns negative on error
+ * @endif
+ */
+static herr_t
+Mat_H5RowMajor(mat_t *mat,hid_t dset_id,hid_t mem_type_id,hid_t plist_id,
+    const hsize_t *start,const hsize_t *stride,const hsize_t *edge,void *data,
+    mat_complex_split_t *complex_data,int write)
+{
+    const mat_allocator_t *allocator = NULL == mat ? NULL : mat->allocator;
+    hsize_t *h, *count, *offset, *step, *idx, *chunk, nblock, n;
+    size_t *dims, elem_size, block, inner = 1, nmemb = 1, first, part;
+    hid_t file_space, mem_space, dcpl_id, type_id = mem_type_id;
+    herr_t herr = 0;
+    char *buf;
+    int k, s, rank;
+
+    file_space = H5Dget_space(dset_id);
+    rank = H5Sget_simple_extent_ndims(file_space);
+    if ( rank < 1 ) {
+        H5Sclose(file_space);
+        return -1;
+    }
+    h    = Mat_Malloc(allocator,6*rank*sizeof(*h));
+    dims = Mat_Malloc(allocator,rank*sizeof(*dims));
+    if ( NULL == h || NULL == dims ) {
+        Mat_Free(allocator,h);
+        Mat_Free(allocator,dims);
+        H5Sclose(file_space);
+        return -1;
+    }
+    count  = h+rank;
+    offset = h+2*rank;
+    step   = h+3*rank;
+    idx    = h+4*rank;
+    chunk  = h+5*rank;
+    if ( NULL == start )
+        H5Sget_simple_extent_dims(file_space,h,NULL);
+    for ( k = 0; k < rank; k++ ) {
+        if ( NULL != start )
+            h[k] = edge[k];
+        step[k]  = NULL == start ? 1 : stride[k];
+        idx[k]   = 0;
+        chunk[k] = 1;
+        dims[rank-k-1] = h[k];
+        nmemb *= h[k];
+    }
+    dcpl_id = H5Dget_create_plist(dset_id);
+    if ( H5D_CHUNKED == H5Pget_layout(dcpl_id) )
+        H5Pget_chunk(dcpl_id,rank,chunk);
+    H5Pclose(dcpl_id);
+
+    if ( NULL != complex_data )
+        type_id = Mat_H5ComplexType(mem_type_id);
+    elem_size = H5Tget_size(type_id);
+    part      = elem_size/2;
+    block = MAT_H5_ROW_MAJOR_BLOCK / elem_size;
+    if ( block < 1 )
+        block = 1;
+    /* A block spans the dimensions after s and part of dimension s */
+    for ( s = rank-1; s > 0 && inner*h[s] <= block; s-- )
+        inner *= h[s];
+    for ( k = 0; k < rank; k++ )
+        count[k] = k < s ? 1 : h[k];
+    if ( block/inner < h[s] ) {
+        /* Round to whole chunks, so no chunk is split between two blocks
+         * when the selection is contiguous */
+        count[s] = block/inner;
+        if ( NULL == start && chunk[s] > 1 ) {
+            if ( count[s] < chunk[s] )
+                count[s] = chunk[s] < h[s] ? chunk[s] : h[s];
+            else
+                count[s] -= count[s] % chunk[s];
+        }
+    }
+
+    nblock = count[s];
+    buf = nmemb > 0 ? Mat_Malloc(allocator,nblock*inner*elem_size) : NULL;
+    if ( nmemb > 0 && NULL == buf )
+        herr = -1;
+    for ( first = 0; first < nmemb && 0 <= herr; first += n*inner ) {
+        n = h[s]-idx[s];
+        if ( n > nblock )
+            n = nblock;
+        for ( k = 0; k < rank; k++ )
+            offset[k] = (NULL == start ? 0 : start[k]) + idx[k]*step[k];
+        count[s]  = n;
+        mem_space = H5Screate_simple(rank,count,NULL);
+        H5Sselect_hyperslab(file_space,H5S_SELECT_SET,offset,step,count,NULL);
+        if ( write ) {
+            if ( NULL != complex_data ) {
+                Mat_GatherRowMajor(buf,2,complex_data->Re,1,part,rank,dims,
+                                   first,n*inner);
+                Mat_GatherRowMajor(buf+part,2,complex_data->Im,1,part,rank,
+                                   dims,first,n*inner);
+            } else {
+                Mat_GatherRowMajor(buf,1,data,1,elem_size,rank,dims,first,
+                                   n*inner);
+            }
+            herr = H5Dwrite(dset_id,type_id,mem_space,file_space,plist_id,
+                            buf);
+        } else {
+            herr = Mat_H5Dread(mat,dset_id,type_id,mem_space,file_space,
+                               plist_id,buf);
+            if ( 0 <= herr && NULL != complex_data ) {
+                Mat_ScatterRowMajor(complex_data->Re,1,buf,2,part,rank,dims,
+                                    first,n*inner);
+                Mat_ScatterRowMajor(complex_data->Im,1,buf+part,2,part,rank,
+                                    dims,first,n*inner);
+            } else if ( 0 <= herr ) {
+                Mat_ScatterRowMajor(data,1,buf,1,elem_size,rank,dims,first,
+                                    n*inner);
+            }
+        }
+        H5Sclose(mem_space);
+        /* Advance to the next block */
+        idx[s] += n;
+        for ( k = s; k > 0 && idx[k] >= h[k]; k-- ) {
+            idx[k] = 0;
+            idx[k-1]++;
+        }
+    }
+    if ( NULL != complex_data )
+        H5Tclose(type_id);
+    Mat_Free(allocator,buf);
+    Mat_Free(allocator,dims);
+    Mat_Free(allocator,h);
+    H5Sclose(file_space);
+
+    return herr;
+}
+
+/** @if mat_devman
+ * @brief Reads a dataset selection to row-major order a block at a time
+ *
+ * See Mat_H5RowMajor.
+ * @ingroup mat_internal
+ * @endif
+ */
+static herr_t
+Mat_H5ReadRowMajor(mat_t *mat,hid_t dset_id,hid_t mem_type_id,hid_t plist_id,
+    const hsize_t *start,const hsize_t *stride,const hsize_t *edge,void *data,
+    mat_complex_split_t *complex_data)
+{
+    return Mat_H5RowMajor(mat,dset_id,mem_type_id,plist_id,start,stride,edge,
+                          data,complex_data,0);
+}
+
+/** @if mat_devman
+ * @brief Allocates and reads the data of a numeric or character variable
+ *
+ * The data is stored in the layout set by Mat_VarSetReadFlags.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar MAT variable pointer with @c nbytes set to the size of the
+ *        data, or of each part of complex data
+ * @param dset_id HDF5 dataset
+ * @param type_id HDF5 memory type of the data, or of each part of complex
+ *        data
+ * @param numel Number of elements
+ * @endif
+ */
+static void
+Mat_H5ReadVarData(mat_t *mat,matvar_t *matvar,hid_t dset_id,hid_t type_id,
+    size_t numel)
+{
+    int row_major = matvar->internal->read_flags & MAT_F_ROW_MAJOR;
+
+    if ( !matvar->isComplex ) {
+        matvar->data = Mat_VarDataAlloc(matvar,matvar->nbytes);
+        if ( NULL != matvar->data ) {
+            hid_t plist_id = Mat_H5CreateReadPlist(matvar);
+            if ( row_major )
+                Mat_H5ReadRowMajor(mat,dset_id,type_id,plist_id,NULL,NULL,
+                                   NULL,matvar->data,NULL);
+            else
+                Mat_H5Dread(mat,dset_id,type_id,H5S_ALL,H5S_ALL,plist_id,
+                            matvar->data);
+            if ( H5P_DEFAULT != plist_id )
+                H5Pclose(plist_id);
+        }
+    } else if ( MAT_IS_INTERLEAVED(matvar) ) {
+        hid_t h5_complex;
+
+        /* Read both parts in one pass to the interleaved buffer */
+        matvar->data = Mat_VarDataAlloc(matvar,2*matvar->nbytes);
+        if ( NULL != matvar->data ) {
+            h5_complex = Mat_H5ComplexType(type_id);
+            if ( row_major )
+                Mat_H5ReadRowMajor(mat,dset_id,h5_complex,H5P_DEFAULT,NULL,
+                                   NULL,NULL,matvar->data,NULL);
+            else
+                Mat_H5Dread(mat,dset_id,h5_complex,H5S_ALL,H5S_ALL,
+                            H5P_DEFAULT,matvar->data);
+            H5Tclose(h5_complex);
+        }
+    } else {
+        mat_complex_split_t *complex_data;
+
+        complex_data     = Mat_VarMemAlloc(matvar,sizeof(*complex_data));
+        complex_data->Re = Mat_VarDataAlloc(matvar,matvar->nbytes);
+        complex_data->Im = Mat_VarDataAlloc(matvar,matvar->nbytes);
+        if ( row_major )
+            Mat_H5ReadRowMajor(mat,dset_id,type_id,H5P_DEFAULT,NULL,NULL,NULL,
+                               NULL,complex_data);
+        else
+            Mat_H5ReadComplex(mat,dset_id,type_id,H5S_ALL,H5S_ALL,numel,
+                              complex_data);
+        matvar->data = complex_data;
+    }
+}
+
+/** @if mat_devman
+ * @brief Writes both parts of a complex dataset in a single pass
+ *
+ * Interleaves @c complex_data into a buffer and writes it through the full
+ * compound type, so each chunk of the dataset is compressed only once.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer, or NULL
+ * @param dset_id HDF5 dataset
+ * @param base_type_id HDF5 memory type of the real and imaginary parts
+ * @param nmemb number of elements in the dataset
+ * @param complex_data Split buffers of @c nmemb elements each
+ * @returns negative on error
+ * @endif
+ */
+static herr_t
+Mat_H5WriteComplex(mat_t *mat,hid_t dset_id,hid_t base_type_id,size_t nmemb,
+    const mat_complex_split_t *complex_data)
+{
+    const mat_allocator_t *allocator = NULL == mat ? NULL : mat->allocator;
+    size_t size = H5Tget_size(base_type_id);
+    hid_t  h5_complex;
+    herr_t herr;
+    char  *buf;
+
+    if ( nmemb < 1 )
+        return 0;
+    buf = Mat_Malloc(allocator,2*nmemb*size);
+    if ( NULL == buf ) {
+        Mat_Critical("Couldn't allocate memory for the data");
+        return -1;
+    }
+    Mat_CopyStrided(buf,2,complex_data->Re,1,size,nmemb);
+    Mat_CopyStrided(buf+size,2,complex_data->Im,1,size,nmemb);
+    h5_complex = Mat_H5ComplexType(base_type_id);
+    herr = Mat_H5Dwrite(mat,dset_id,h5_complex,buf);
+    H5Tclose(h5_complex);
+    Mat_Free(allocator,buf);
+
+    return herr;
+}
+
+/** @if mat_devman
+ * @brief Writes the data of a numeric, logical or character variable
+ *
+ * Row-major data (see Mat_VarCreate) is transposed a block at a time as it
+ * is written.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer, or NULL
+ * @param matvar MAT variable pointer
+ * @param dset_id HDF5 dataset
+ * @param type_id HDF5 memory type of the data, or of each part of complex
+ *        data
+ * @param numel Number of elements
+ * @returns negative on error
+ * @endif
+ */
+static herr_t
+Mat_H5WriteVarData(mat_t *mat,matvar_t *matvar,hid_t dset_id,hid_t type_id,
+    size_t numel)
+{
+    int row_major = matvar->internal->read_flags & MAT_F_ROW_MAJOR;
+    hid_t  h5_complex;
+    herr_t herr;
+
+    if ( !matvar->isComplex ) {
+        if ( row_major )
+            herr = Mat_H5RowMajor(mat,dset_id,type_id,H5P_DEFAULT,NULL,NULL,
+                                  NULL,matvar->data,NULL,1);
+        else
+            herr = Mat_H5Dwrite(mat,dset_id,type_id,matvar->data);
+    } else if ( MAT_IS_INTERLEAVED(matvar) ) {
+        /* Write both parts in one pass from the interleaved buffer */
+        h5_complex = Mat_H5ComplexType(type_id);
+        if ( row_major )
+            herr = Mat_H5RowMajor(mat,dset_id,h5_complex,H5P_DEFAULT,NULL,
+                                  NULL,NULL,matvar->data,NULL,1);
+        else
+            herr = Mat_H5Dwrite(mat,dset_id,h5_complex,matvar->data);
+        H5Tclose(h5_complex);
+    } else if ( row_major ) {
+        herr = Mat_H5RowMajor(mat,dset_id,type_id,H5P_DEFAULT,NULL,NULL,NULL,
+                              NULL,matvar->data,1);
+    } else {
+        herr = Mat_H5WriteComplex(mat,dset_id,type_id,numel,matvar->data);
+    }
+
+    return herr;
+}
+
+/** @if mat_devman
+ * @brief Computes the chunk dimensions of a dataset
+ *
+ * Uses the chunk shape and size hints set by Mat_VarSetChunking.  Without a
+ * size hint, a MAT_CHUNK_COLUMN chunk holds one whole column, and other
+ * chunks hold at most 4096 elements.  Chunks are kept below the 4 GiB limit
+ * of HDF5.
+ * @ingroup mat_internal
+ * @param matvar MAT variable being written
+ * @param elem_size Size of an element of the dataset in bytes
+ * @param rank Rank of the dataset
+ * @param dims Dimensions of the dataset (in HDF5 order)
+ * @param chunk_dims Chunk dimensions (in HDF5 order)
+ * @endif
+ */
+static void
+Mat_H5GetChunkSize(matvar_t *matvar,size_t elem_size,size_t rank,
+    hsize_t *dims,hsize_t *chunk_dims)
+{
+    hsize_t  i, j, chunk_size = 1, max_elems = 4096;
+    hsize_t  max_bytes = 0xFFFFFFFFUL;
+
+    if ( matvar->internal->chunk_bytes > 0 && elem_size > 0 ) {
+        max_elems = matvar->internal->chunk_bytes / elem_size;
+    } else if ( MAT_CHUNK_COLUMN == matvar->internal->chunk_shape &&
+                rank > 0 ) {
+        /* The column runs along the last dimension of the dataset */
+        max_elems = dims[rank-1];
+    }
+    if ( elem_size > 0 && max_elems > max_bytes / elem_size )
+        max_elems = max_bytes / elem_size;
+    if ( max_elems < 1 )
+        max_elems = 1;
+
+    switch ( matvar->internal->chunk_shape ) {
+        case MAT_CHUNK_COLUMN:
+            /* The dimensions are reversed, so a column of the variable runs
+             * along the last dimension of the dataset */
+            for ( i = rank; i > 0; i-- ) {
+                chunk_dims[i-1] = max_elems / chunk_size;
+                if ( chunk_dims[i-1] > dims[i-1] )
+                    chunk_dims[i-1] = dims[i-1];
+                if ( chunk_dims[i-1] < 1 )
+                    chunk_dims[i-1] = 1;
+                chunk_size *= chunk_dims[i-1];
+            }
+            break;
+        case MAT_CHUNK_TILE:
+        {
+            /* Dimensions shorter than the side of the tile are stored whole
+             * and the remaining size is spread over the other dimensions */
+            hsize_t nfree = rank;
+
+            for ( i = 0; i < rank; i++ )
+                chunk_dims[i] = 0;
+            while ( nfree > 0 ) {
+                hsize_t budget = max_elems / chunk_size, side = budget;
+                hsize_t nwhole = 0;
+
+                if ( nfree > 1 ) {
+                    for ( side = 1; ; side++ ) {
+                        hsize_t n = 1;
+                        for ( j = 0; j < nfree; j++ )
+                            n *= side+1;
+                        if ( n > budget )
+                            break;
+                    }
+                }
+                for ( i = 0; i < rank; i++ ) {
+                    if ( 0 == chunk_dims[i] && dims[i] <= side ) {
+                        chunk_dims[i] = dims[i] > 0 ? dims[i] : 1;
+                        chunk_size *= chunk_dims[i];
+                        nfree--;
+                        nwhole++;
+                    }
+                }
+                if ( 0 == nwhole ) {
+                    for ( i = 0; i < rank; i++ ) {
+                        if ( 0 == chunk_dims[i] )
+                            chunk_dims[i] = side;
+                    }
+                    break;
+                }
+            }
+            break;
+        }
+        default:
+            for ( i = 0; i < rank; i++ ) {
+                chunk_dims[i] = 1;
+                for ( j = max_elems/chunk_size; j > 1; j >>= 1 ) {
+                    if ( dims[i] >= j ) {
+                        chunk_dims[i] = j;
+                        break;
+                    }
+                }
+                chunk_size *= chunk_dims[i];
+            }
+            break;
+    }
+}
+
+/** @if mat_devman
+ * @brief Creates the dataset creation property list of a variable
+ *
+ * Compressed variables and variables with chunking hints are chunked.
+ * @ingroup mat_internal
+ * @param matvar MAT variable being written
+ * @param elem_size Size of an element of the dataset in bytes
+ * @param dims Dimensions of the dataset (in HDF5 order)
+ * @returns property list to be closed with H5Pclose, or H5P_DEFAULT for a
+ *          contiguous dataset
+ * @endif
+ */
+static hid_t
+Mat_H5CreateWritePlist(matvar_t *matvar,size_t elem_size,hsize_t *dims)
+{
+    hsize_t chunk_dims[10];
+    hid_t   plist;
+
+    if ( !matvar->compression && 0 == matvar->internal->chunk_bytes &&
+         MAT_CHUNK_DEFAULT == matvar->internal->chunk_shape )
+        return H5P_DEFAULT;
+
+    Mat_H5GetChunkSize(matvar,elem_size,matvar->rank,dims,chunk_dims);
+    plist = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(plist,matvar->rank,chunk_dims);
+    if ( matvar->compression )
+        H5Pset_deflate(plist,9);
+
+    return plist;
+}
+
+static void
+Mat_H5ReadClassType(matvar_t *matvar,hid_t dset_id)
+{
+    hid_t attr_id, type_id;
+    const mat_allocator_t *allocator;
+
+    allocator = NULL == matvar->internal ? NULL : matvar->internal->allocator;
+    attr_id = H5Aopen_name(dset_id,"MATLAB_class");
+    type_id  = H5Aget_type(attr_id);
+    if ( H5T_STRING == H5Tget_class(type_id) ) {
+        char *class_str = Mat_Calloc(allocator,H5Tget_size(type_id)+1,1);
+        if ( NULL != class_str ) {
+            hid_t class_id = H5Tcopy(H5T_C_S1);
+            H5Tset_size(class_id,H5Tget_size(type_id));
+            H5Aread(attr_id,class_id,class_str);
+            H5Tclose(class_id);
+            matvar->class_type = Mat_class_str_to_id(class_str);
+            if ( MAT_C_EMPTY == matvar->class_type ) {
+                /* Check if this is a logical variable */
+                if ( !strcmp(class_str, "logical") ) {
+                    int int_decode = 0;
+                    hid_t attr_id2;
+                    matvar->isLogical = MAT_F_LOGICAL;
+                    attr_id2 = H5Aopen_name(dset_id,"MATLAB_int_decode");
+                    /* FIXME: Check that dataspace is scalar */
+                    if ( -1 < attr_id2 ) {
+                        H5Aread(attr_id2,H5T_NATIVE_INT,&int_decode);
+                        H5Aclose(attr_id2);
+                    }
+                    switch (int_decode) {
+                        case 1:
+                            matvar->class_type = MAT_C_UINT8;
+                            break;
+                        case 2:
+                            matvar->class_type = MAT_C_UINT16;
+                            break;
+                        case 4:
+                            matvar->class_type = MAT_C_UINT32;
+                            break;
+                        default:
+                            break;
+                    }
+                }
+            }
+
+            matvar->data_type  = Mat_ClassToType73(matvar->class_type);
+            Mat_Free(allocator,class_str);
+        }
+    }
+    H5Tclose(type_id);
+    H5Aclose(attr_id);
+}
+
+static void
+Mat_H5ReadDatasetInfo(mat_t *mat,matvar_t *matvar,hid_t dset_id)
+{
+    ssize_t  name_len;
+    /* FIXME */
+    hsize_t  dims[10];
+    hid_t   attr_id,type_id,space_id;
+    H5E_auto_t efunc;
+    void       *client_data;
+
+#if 0
+    matvar->fp = mat;
+    name_len = H5Gget_objname_by_idx(fid,mat->next_index,NULL,0);
+    matvar->name = malloc(1+name_len);
+    if ( matvar->name ) {
+        name_len = H5Gget_objname_by_idx(fid,mat->next_index,
+                                         matvar->name,1+name_len);
+        matvar->name[name_len] = '\0';
+    }
+    dset_id = H5Dopen(fid,matvar->name);
+#endif
+
+    /* Get the HDF5 name of the variable */
+    name_len = H5Iget_name(dset_id,NULL,0);
+    if ( name_len > 0 ) {
+        matvar->internal->hdf5_name = Mat_VarMemAlloc(matvar,name_len+1);
+        (void)H5Iget_name(dset_id,matvar->internal->hdf5_name,name_len+1);
+    } else {
+        /* Can not get an internal name, so leave the identifier open */
+        matvar->internal->id = dset_id;
+    }
+
+    space_id     = H5Dget_space(dset_id);
+    matvar->rank = H5Sget_simple_extent_ndims(space_id);
+    matvar->dims = Mat_VarMemAlloc(matvar,matvar->rank*sizeof(*matvar->dims));
+    if ( NULL != matvar->dims ) {
+        int k;
+        H5Sget_simple_extent_dims(space_id,dims,NULL);
+        for ( k = 0; k < matvar->rank; k++ )
+            matvar->dims[k] = dims[matvar->rank - k - 1];
+    }
+    H5Sclose(space_id);
+
+    Mat_H5ReadClassType(matvar, dset_id);
+
+    /* Turn off error printing so testing for attributes doesn't print
+     * error stacks
+     */
+    H5Eget_auto(H5E_DEFAULT,&efunc,&client_data);
+    H5Eset_auto(H5E_DEFAULT,(H5E_auto_t)0,NULL);
+
+    attr_id = H5Aopen_name(dset_id,"MATLAB_global");
+    /* FIXME: Check that dataspace is scalar */
+    if ( -1 < attr_id ) {
+        H5Aread(attr_id,H5T_NATIVE_INT,&matvar->isGlobal);
+        H5Aclose(attr_id);
+    }
+
+    /* Check for attribute that indicates an empty array */
+    attr_id = H5Aopen_name(dset_id,"MATLAB_empty");
+    /* FIXME: Check that dataspace is scalar */
+    if ( -1 < attr_id ) {
+        int empty = 0;
+        H5Aread(attr_id,H5T_NATIVE_INT,&empty);
+        H5Aclose(attr_id);
+        if ( empty ) {
+            matvar->rank = matvar->dims[0];
+            Mat_VarMemFree(matvar,matvar->dims);
+            matvar->dims = Mat_VarMemCalloc(matvar,matvar->rank,
+                                            sizeof(*matvar->dims));
+            H5Dread(dset_id,Mat_dims_type_to_hid_t(),H5S_ALL,H5S_ALL,
+                    H5P_DEFAULT,matvar->dims);
+        }
+    }
+
+    H5Eset_auto(H5E_DEFAULT,efunc,client_data);
+
+    /* Test if dataset type is compound and if so if it's complex */
+    type_id = H5Dget_type(dset_id);
+    if ( H5T_COMPOUND == H5Tget_class(type_id) ) {
+        /* FIXME: Any more checks? */
+        matvar->isComplex = MAT_F_COMPLEX;
+    }
+    H5Tclose(type_id);
+
+    /* If the dataset is a cell array read the info of the cells */
+    if ( MAT_C_CELL == matvar->class_type && !mat->shallow ) {
+        matvar_t **cells;
+        int i,ncells = 1;
+        hobj_ref_t *ref_ids;
+
+        for ( i = 0; i < matvar->rank; i++ )
+            ncells *= matvar->dims[i];
+        matvar->data_size = sizeof(matvar_t**);
+        matvar->nbytes    = ncells*matvar->data_size;
+        matvar->data      = Mat_VarMemAlloc(matvar,matvar->nbytes);
+        cells  = matvar->data;
+
+        if ( ncells ) {
+            ref_ids = Mat_Malloc(mat->allocator,ncells*sizeof(*ref_ids));
+            H5Dread(dset_id,H5T_STD_REF_OBJ,H5S_ALL,H5S_ALL,H5P_DEFAULT,
+                    ref_ids);
+            for ( i = 0; i < ncells; i++ ) {
+                hid_t ref_id;
+                cells[i] = Mat_VarCallocElement(matvar);
+                cells[i]->internal->hdf5_ref = ref_ids[i];
+                /* Closing of ref_id is done in Mat_H5ReadNextReferenceInfo */
+                ref_id = H5Rdereference(dset_id,H5R_OBJECT,ref_ids+i);
+                cells[i]->internal->id = ref_id;
+                cells[i]->internal->fp = matvar->internal->fp;
+                Mat_H5ReadNextReferenceInfo(ref_id,cells[i],mat);
+            }
+            Mat_Free(mat->allocator,ref_ids);
         }
     } else if ( MAT_C_STRUCT == matvar->class_type ) {
         /* Empty structures can be a dataset */
@@ -622,25 +1898,28 @@ Mat_H5ReadDatasetInfo(mat_t *mat,matvar_t *matvar,hid_t dset_id)
             space_id = H5Aget_space(attr_id);
             (void)H5Sget_simple_extent_dims(space_id,&nfields,NULL);
             field_id = H5Aget_type(attr_id);
-            fieldnames_vl = malloc(nfields*sizeof(*fieldnames_vl));
+            fieldnames_vl = Mat_Malloc(mat->allocator,
+                                       nfields*sizeof(*fieldnames_vl));
             H5Aread(attr_id,field_id,fieldnames_vl);
 
             matvar->internal->num_fields = nfields;
             matvar->internal->fieldnames =
-            calloc(nfields,sizeof(*matvar->internal->fieldnames));
+            Mat_VarMemCalloc(matvar,nfields,
+                             sizeof(*matvar->internal->fieldnames));
             for ( i = 0; i < nfields; i++ ) {
                 matvar->internal->fieldnames[i] =
-                calloc(fieldnames_vl[i].len+1,1);
+                Mat_VarMemCalloc(matvar,fieldnames_vl[i].len+1,1);
                 memcpy(matvar->internal->fieldnames[i],fieldnames_vl[i].p,
                        fieldnames_vl[i].len);
             }
+            Mat_VarIndexStructFields(matvar);
 
             H5Dvlen_reclaim(field_id,space_id,H5P_DEFAULT,
                             fieldnames_vl);
             H5Sclose(space_id);
             H5Tclose(field_id);
             H5Aclose(attr_id);
-            free(fieldnames_vl);
+            Mat_Free(mat->allocator,fieldnames_vl);
         }
         H5Eset_auto(H5E_DEFAULT,efunc,client_data);
     }
@@ -673,7 +1952,7 @@ Mat_H5ReadGroupInfo(mat_t *mat,matvar_t *matvar,hid_t dset_id)
     /* Get the HDF5 name of the variable */
     name_len = H5Iget_name(dset_id,NULL,0);
     if ( name_len > 0 ) {
-        matvar->internal->hdf5_name = malloc(name_len+1);
+        matvar->internal->hdf5_name = Mat_VarMemAlloc(matvar,name_len+1);
         (void)H5Iget_name(dset_id,matvar->internal->hdf5_name,name_len+1);
     } else {
         /* Can not get an internal name, so leave the identifier open */
@@ -710,7 +1989,8 @@ Mat_H5ReadGroupInfo(mat_t *mat,matvar_t *matvar,hid_t dset_id)
         matvar->class_type = MAT_C_SPARSE;
 
         matvar->rank = 2;
-        matvar->dims = malloc(matvar->rank*sizeof(*matvar->dims));
+        matvar->dims = Mat_VarMemAlloc(matvar,
+                                       matvar->rank*sizeof(*matvar->dims));
         matvar->dims[0] = nrows;
 
         sparse_dset_id = H5Dopen(dset_id,"jc",H5P_DEFAULT);
@@ -741,14 +2021,17 @@ Mat_H5ReadGroupInfo(mat_t *mat,matvar_t *matvar,hid_t dset_id)
         space_id = H5Aget_space(attr_id);
         (void)H5Sget_simple_extent_dims(space_id,&nfields,NULL);
         field_id = H5Aget_type(attr_id);
-        fieldnames_vl = malloc(nfields*sizeof(*fieldnames_vl));
+        fieldnames_vl = Mat_Malloc(mat->allocator,
+                                   nfields*sizeof(*fieldnames_vl));
         H5Aread(attr_id,field_id,fieldnames_vl);
 
         matvar->internal->num_fields = nfields;
         matvar->internal->fieldnames =
-            malloc(nfields*sizeof(*matvar->internal->fieldnames));
+            Mat_VarMemAlloc(matvar,
+                            nfields*sizeof(*matvar->internal->fieldnames));
         for ( k = 0; k < nfields; k++ ) {
-            matvar->internal->fieldnames[k] = calloc(fieldnames_vl[k].len+1,1);
+            matvar->internal->fieldnames[k] =
+                Mat_VarMemCalloc(matvar,fieldnames_vl[k].len+1,1);
             memcpy(matvar->internal->fieldnames[k],fieldnames_vl[k].p,
                    fieldnames_vl[k].len);
         }
@@ -757,14 +2040,15 @@ Mat_H5ReadGroupInfo(mat_t *mat,matvar_t *matvar,hid_t dset_id)
         H5Sclose(space_id);
         H5Tclose(field_id);
         H5Aclose(attr_id);
-        free(fieldnames_vl);
+        Mat_Free(mat->allocator,fieldnames_vl);
     } else {
         hsize_t next_index = 0,num_objs  = 0;
         int     obj_type;
         H5Gget_num_objs(dset_id,&num_objs);
         if ( num_objs > 0 ) {
             matvar->internal->fieldnames =
-                calloc(num_objs,sizeof(*matvar->internal->fieldnames));
+                Mat_VarMemCalloc(matvar,num_objs,
+                                 sizeof(*matvar->internal->fieldnames));
             /* FIXME: follow symlinks, datatypes? */
             while ( next_index < num_objs ) {
                 obj_type = H5Gget_objtype_by_idx(dset_id,next_index);
@@ -774,7 +2058,8 @@ Mat_H5ReadGroupInfo(mat_t *mat,matvar_t *matvar,hid_t dset_id)
                         int len;
                         len = H5Gget_objname_by_idx(dset_id,next_index,NULL,0);
                         matvar->internal->fieldnames[nfields] =
-                            calloc(len+1,sizeof(**matvar->internal->fieldnames));
+                            Mat_VarMemCalloc(matvar,len+1,
+                                sizeof(**matvar->internal->fieldnames));
                         H5Gget_objname_by_idx(dset_id,next_index,
                             matvar->internal->fieldnames[nfields],len+1);
                         nfields++;
@@ -789,7 +2074,7 @@ Mat_H5ReadGroupInfo(mat_t *mat,matvar_t *matvar,hid_t dset_id)
                             int len;
                             len = H5Gget_objname_by_idx(dset_id,next_index,NULL,0);
                             matvar->internal->fieldnames[nfields] =
-                                calloc(len+1,1);
+                                Mat_VarMemCalloc(matvar,len+1,1);
                             H5Gget_objname_by_idx(dset_id,next_index,
                                 matvar->internal->fieldnames[nfields],len+1);
                             nfields++;
@@ -822,14 +2107,16 @@ Mat_H5ReadGroupInfo(mat_t *mat,matvar_t *matvar,hid_t dset_id)
             if ( -1 < attr_id ) {
                 H5Aclose(attr_id);
                 matvar->rank    = 2;
-                matvar->dims    = malloc(2*sizeof(*matvar->dims));
+                matvar->dims    = Mat_VarMemAlloc(matvar,
+                                                  2*sizeof(*matvar->dims));
                 matvar->dims[0] = 1;
                 matvar->dims[1] = 1;
                 numel = 1;
             } else {
                 space_id        = H5Dget_space(field_id);
                 matvar->rank    = H5Sget_simple_extent_ndims(space_id);
-                matvar->dims    = malloc(matvar->rank*sizeof(*matvar->dims));
+                matvar->dims    =
+                    Mat_VarMemAlloc(matvar,matvar->rank*sizeof(*matvar->dims));
                 (void)H5Sget_simple_extent_dims(space_id,dims,NULL);
                 numel = 1;
                 for ( k = 0; k < matvar->rank; k++ ) {
@@ -842,7 +2129,7 @@ Mat_H5ReadGroupInfo(mat_t *mat,matvar_t *matvar,hid_t dset_id)
         } else {
             /* Structure should be a scalar */
             matvar->rank    = 2;
-            matvar->dims    = malloc(2*sizeof(*matvar->dims));
+            matvar->dims    = Mat_VarMemAlloc(matvar,2*sizeof(*matvar->dims));
             matvar->dims[0] = 1;
             matvar->dims[1] = 1;
             numel = 1;
@@ -853,7 +2140,7 @@ Mat_H5ReadGroupInfo(mat_t *mat,matvar_t *matvar,hid_t dset_id)
         /* Structure should be a scalar */
         numel = 1;
         matvar->rank    = 2;
-        matvar->dims    = malloc(2*sizeof(*matvar->dims));
+        matvar->dims    = Mat_VarMemAlloc(matvar,2*sizeof(*matvar->dims));
         matvar->dims[0] = 1;
         matvar->dims[1] = 1;
     }
@@ -864,10 +2151,10 @@ Mat_H5ReadGroupInfo(mat_t *mat,matvar_t *matvar,hid_t dset_id)
     }
 
     H5Eset_auto(H5E_DEFAULT,efunc,client_data);
-    if ( numel < 1 || nfields < 1 )
+    if ( numel < 1 || nfields < 1 || mat->shallow )
         return;
 
-    fields = malloc(nfields*numel*sizeof(*fields));
+    fields = Mat_VarMemAlloc(matvar,nfields*numel*sizeof(*fields));
     matvar->data = fields;
     matvar->data_size = sizeof(*fields);
     matvar->nbytes    = nfields*numel*matvar->data_size;
@@ -879,20 +2166,21 @@ Mat_H5ReadGroupInfo(mat_t *mat,matvar_t *matvar,hid_t dset_id)
                                H5P_DEFAULT);
             if ( -1 < field_id ) {
                 if ( !fields_are_variables ) {
-                    hobj_ref_t *ref_ids = malloc(numel*sizeof(*ref_ids));
+                    hobj_ref_t *ref_ids = Mat_Malloc(mat->allocator,
+                                                     numel*sizeof(*ref_ids));
                     H5Dread(field_id,H5T_STD_REF_OBJ,H5S_ALL,H5S_ALL,
                             H5P_DEFAULT,ref_ids);
                     for ( l = 0; l < numel; l++ ) {
                         hid_t ref_id;
-                        fields[l*nfields+k] = Mat_VarCalloc();
-                        fields[l*nfields+k]->name =
-                            strdup(matvar->internal->fieldnames[k]);
+                        fields[l*nfields+k] = Mat_VarCallocElement(matvar);
+                        Mat_VarShareName(fields[l*nfields+k],
+                            matvar->internal->fieldnames[k]);
                         fields[l*nfields+k]->internal->hdf5_ref=ref_ids[l];
                         /* Get the HDF5 name of the variable */
                         name_len = H5Iget_name(field_id,NULL,0);
                         if ( name_len > 0 ) {
                             fields[l*nfields+k]->internal->hdf5_name =
-                                malloc(name_len+1);
+                                Mat_VarMemAlloc(matvar,name_len+1);
                             (void)H5Iget_name(field_id,
                                 fields[l*nfields+k]->internal->hdf5_name,
                                 name_len+1);
@@ -905,12 +2193,12 @@ Mat_H5ReadGroupInfo(mat_t *mat,matvar_t *matvar,hid_t dset_id)
                         fields[l*nfields+k]->internal->id=ref_id;
                         Mat_H5ReadNextReferenceInfo(ref_id,fields[l*nfields+k],mat);
                     }
-                    free(ref_ids);
+                    Mat_Free(mat->allocator,ref_ids);
                 } else {
-                    fields[k] = Mat_VarCalloc();
+                    fields[k] = Mat_VarCallocElement(matvar);
                     fields[k]->internal->fp   = mat;
-                    fields[k]->name =
-                        strdup(matvar->internal->fieldnames[k]);
+                    Mat_VarShareName(fields[k],
+                        matvar->internal->fieldnames[k]);
                     Mat_H5ReadDatasetInfo(mat,fields[k],field_id);
                 }
                 H5Dclose(field_id);
@@ -918,9 +2206,10 @@ Mat_H5ReadGroupInfo(mat_t *mat,matvar_t *matvar,hid_t dset_id)
                 field_id = H5Gopen(dset_id,matvar->internal->fieldnames[k],
                                    H5P_DEFAULT);
                 if ( -1 < field_id ) {
-                    fields[k] = Mat_VarCalloc();
+                    fields[k] = Mat_VarCallocElement(matvar);
                     fields[k]->internal->fp   = mat;
-                    fields[k]->name = strdup(matvar->internal->fieldnames[k]);
+                    Mat_VarShareName(fields[k],
+                        matvar->internal->fieldnames[k]);
                     Mat_H5ReadGroupInfo(mat,fields[k],field_id);
                     H5Gclose(field_id);
                 }
@@ -959,7 +2248,8 @@ Mat_H5ReadNextReferenceInfo(hid_t ref_id,matvar_t *matvar,mat_t *mat)
             /* Get the rank and dimensions of the data */
             space_id = H5Dget_space(dset_id);
             matvar->rank = H5Sget_simple_extent_ndims(space_id);
-            matvar->dims = malloc(matvar->rank*sizeof(*matvar->dims));
+            matvar->dims = Mat_VarMemAlloc(matvar,
+                                           matvar->rank*sizeof(*matvar->dims));
             if ( NULL == matvar->dims ) {
                 break;
             } else {
@@ -994,8 +2284,9 @@ Mat_H5ReadNextReferenceInfo(hid_t ref_id,matvar_t *matvar,mat_t *mat)
                 H5Aclose(attr_id);
                 if ( empty ) {
                     matvar->rank = matvar->dims[0];
-                    free(matvar->dims);
-                    matvar->dims = calloc(matvar->rank,sizeof(*matvar->dims));
+                    Mat_VarMemFree(matvar,matvar->dims);
+                    matvar->dims = Mat_VarMemCalloc(matvar,matvar->rank,
+                                                    sizeof(*matvar->dims));
                     H5Dread(dset_id,Mat_dims_type_to_hid_t(),H5S_ALL,H5S_ALL,
                             H5P_DEFAULT,matvar->dims);
                 }
@@ -1019,15 +2310,15 @@ Mat_H5ReadNextReferenceInfo(hid_t ref_id,matvar_t *matvar,mat_t *mat)
                     ncells *= matvar->dims[i];
                 matvar->data_size = sizeof(matvar_t**);
                 matvar->nbytes    = ncells*matvar->data_size;
-                matvar->data      = malloc(matvar->nbytes);
+                matvar->data      = Mat_VarMemAlloc(matvar,matvar->nbytes);
                 cells  = matvar->data;
 
-                ref_ids = malloc(ncells*sizeof(*ref_ids));
+                ref_ids = Mat_Malloc(mat->allocator,ncells*sizeof(*ref_ids));
                 H5Dread(dset_id,H5T_STD_REF_OBJ,H5S_ALL,H5S_ALL,H5P_DEFAULT,
                         ref_ids);
                 for ( i = 0; i < ncells; i++ ) {
                     hid_t ref_id;
-                    cells[i] = Mat_VarCalloc();
+                    cells[i] = Mat_VarCallocElement(matvar);
                     cells[i]->internal->hdf5_ref = ref_ids[i];
                     /* Closing of ref_id is done in Mat_H5ReadNextReferenceInfo */
                     ref_id = H5Rdereference(dset_id,H5R_OBJECT,ref_ids+i);
@@ -1035,7 +2326,7 @@ Mat_H5ReadNextReferenceInfo(hid_t ref_id,matvar_t *matvar,mat_t *mat)
                     cells[i]->internal->fp=matvar->internal->fp;
                     Mat_H5ReadNextReferenceInfo(ref_id,cells[i],mat);
                 }
-                free(ref_ids);
+                Mat_Free(mat->allocator,ref_ids);
             } else if ( MAT_C_STRUCT == matvar->class_type ) {
                 /* Empty structures can be a dataset */
 
@@ -1055,15 +2346,17 @@ Mat_H5ReadNextReferenceInfo(hid_t ref_id,matvar_t *matvar,mat_t *mat)
                     space_id = H5Aget_space(attr_id);
                     (void)H5Sget_simple_extent_dims(space_id,&nfields,NULL);
                     field_id = H5Aget_type(attr_id);
-                    fieldnames_vl = malloc(nfields*sizeof(*fieldnames_vl));
+                    fieldnames_vl = Mat_Malloc(mat->allocator,
+                                               nfields*sizeof(*fieldnames_vl));
                     H5Aread(attr_id,field_id,fieldnames_vl);
 
                     matvar->internal->num_fields = nfields;
                     matvar->internal->fieldnames =
-                        malloc(nfields*sizeof(*matvar->internal->fieldnames));
+                        Mat_VarMemAlloc(matvar,
+                            nfields*sizeof(*matvar->internal->fieldnames));
                     for ( i = 0; i < nfields; i++ ) {
                         matvar->internal->fieldnames[i] =
-                            calloc(fieldnames_vl[i].len+1,1);
+                            Mat_VarMemCalloc(matvar,fieldnames_vl[i].len+1,1);
                         memcpy(matvar->internal->fieldnames[i],
                                fieldnames_vl[i].p,fieldnames_vl[i].len);
                     }
@@ -1073,7 +2366,7 @@ Mat_H5ReadNextReferenceInfo(hid_t ref_id,matvar_t *matvar,mat_t *mat)
                     H5Sclose(space_id);
                     H5Tclose(field_id);
                     H5Aclose(attr_id);
-                    free(fieldnames_vl);
+                    Mat_Free(mat->allocator,fieldnames_vl);
                 }
                 H5Eset_auto(H5E_DEFAULT,efunc,client_data);
             }
@@ -1150,36 +2443,7 @@ Mat_H5ReadNextReferenceData(hid_t ref_id,matvar_t *matvar,mat_t *mat)
 
             dset_id = ref_id;
 
-            if ( !matvar->isComplex ) {
-                matvar->data      = malloc(matvar->nbytes);
-                if ( NULL != matvar->data ) {
-                    H5Dread(dset_id,data_type_id,H5S_ALL,H5S_ALL,H5P_DEFAULT,
-                            matvar->data);
-                }
-            } else {
-                mat_complex_split_t *complex_data;
-                hid_t h5_complex_base,h5_complex;
-
-                complex_data     = malloc(sizeof(*complex_data));
-                complex_data->Re = malloc(matvar->nbytes);
-                complex_data->Im = malloc(matvar->nbytes);
-
-                h5_complex_base = data_type_id;
-                h5_complex      = H5Tcreate(H5T_COMPOUND,
-                                            H5Tget_size(h5_complex_base));
-                H5Tinsert(h5_complex,"real",0,h5_complex_base);
-                H5Dread(dset_id,h5_complex,H5S_ALL,H5S_ALL,H5P_DEFAULT,
-                        complex_data->Re);
-                H5Tclose(h5_complex);
-
-                h5_complex      = H5Tcreate(H5T_COMPOUND,
-                                            H5Tget_size(h5_complex_base));
-                H5Tinsert(h5_complex,"imag",0,h5_complex_base);
-                H5Dread(dset_id,h5_complex,H5S_ALL,H5S_ALL,H5P_DEFAULT,
-                        complex_data->Im);
-                H5Tclose(h5_complex);
-                matvar->data = complex_data;
-            }
+            Mat_H5ReadVarData(mat,matvar,dset_id,data_type_id,numel);
             H5Dclose(dset_id);
             break;
         }
@@ -1213,6 +2477,104 @@ Mat_H5ReadNextReferenceData(hid_t ref_id,matvar_t *matvar,mat_t *mat)
     return;
 }
 
+/** @if mat_devman
+ * @brief Marks the elements of a cell array or structure to be read on access
+ *
+ * The elements of nested cell arrays and structures are marked as well.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param elems Elements of the cell array or fields of the structure
+ * @param nelems Number of elements
+ * @endif
+ */
+static void
+Mat_H5SetLazy(mat_t *mat,matvar_t **elems,size_t nelems)
+{
+    size_t i;
+
+    for ( i = 0; i < nelems; i++ ) {
+        matvar_t *elem = elems[i];
+        if ( NULL == elem ) {
+            continue;
+        } else if ( (MAT_C_CELL == elem->class_type ||
+                      MAT_C_STRUCT == elem->class_type) &&
+                    NULL != elem->data && elem->data_size > 0 ) {
+            Mat_H5SetLazy(mat,elem->data,elem->nbytes / elem->data_size);
+        } else if ( !elem->internal->lazy ) {
+            Mat_VarSetLazy(mat,elem);
+        }
+    }
+}
+
+/** @if mat_devman
+ * @brief Opens the /#refs# group of a version 7.3 MAT file
+ *
+ * Opens the group, or creates it if it does not exist, the first time it is
+ * needed and keeps its identifier in mat->refs_id.  The objects in the group
+ * are counted once in mat->num_refs, which names the next reference object
+ * from then on.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param id HDF id of an object in the file
+ * @return HDF id of the /#refs# group, negative on error
+ * @endif
+ */
+static hid_t
+Mat_H5OpenRefs(mat_t *mat,hid_t id)
+{
+    if ( mat->refs_id < 0 ) {
+        H5E_auto_t efunc;
+        void      *client_data;
+        hsize_t    num_objs = 0;
+
+        /* Silence errors if /#refs# does not exist */
+        H5Eget_auto(H5E_DEFAULT,&efunc,&client_data);
+        H5Eset_auto(H5E_DEFAULT,(H5E_auto_t)0,NULL);
+        mat->refs_id = H5Gopen(id,"/#refs#",H5P_DEFAULT);
+        H5Eset_auto(H5E_DEFAULT,efunc,client_data);
+
+        /* If could not open /#refs#, try to create it */
+        if ( mat->refs_id < 0 )
+            mat->refs_id = H5Gcreate(id,"/#refs#",H5P_DEFAULT,
+                                     H5P_DEFAULT,H5P_DEFAULT);
+        else
+            (void)H5Gget_num_objs(mat->refs_id,&num_objs);
+        mat->num_refs = num_objs;
+    }
+    return mat->refs_id;
+}
+
+/** @if mat_devman
+ * @brief Writes an element of a cell or structure array to /#refs#
+ *
+ * The element is written as the next object of the /#refs# group and an
+ * object reference to it is stored in @c ref.  The group must have been
+ * opened by Mat_H5OpenRefs.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar pointer to the element, NULL for an empty element
+ * @param compression compression of the cell or structure array
+ * @param ref pointer to store the object reference to the element
+ * @retval 0 on success
+ * @endif
+ */
+static int
+Mat_H5WriteRef(mat_t *mat,matvar_t *matvar,int compression,hobj_ref_t *ref)
+{
+    char obj_name[64];
+    int  err;
+
+    /* Take the name first, nested elements are named after it */
+    sprintf(obj_name,"%ld",mat->num_refs++);
+    if ( NULL != matvar )
+        matvar->compression = compression;
+    err = Mat_VarWriteNext73(mat->refs_id,matvar,obj_name,mat);
+    if ( H5Rcreate(ref,mat->refs_id,obj_name,H5R_OBJECT,-1) < 0 )
+        err = -1;
+
+    return err;
+}
+
 /** @if mat_devman
  * @brief Writes a cell array matlab variable to the specified HDF id with the
  *        given name
@@ -1221,20 +2583,18 @@ Mat_H5ReadNextReferenceData(hid_t ref_id,matvar_t *matvar,mat_t *mat)
  * @param id HDF id of the parent object
  * @param matvar pointer to the cell array variable
  * @param name Name of the HDF dataset
+ * @param mat MAT file pointer
  * @retval 0 on success
  * @endif
  */
 static int
-Mat_VarWriteCell73(hid_t id,matvar_t *matvar,const char *name,hid_t *refs_id)
+Mat_VarWriteCell73(hid_t id,matvar_t *matvar,const char *name,mat_t *mat)
 {
     unsigned   k;
     hid_t      str_type_id,mspace_id,dset_id,attr_type_id,attr_id,aspace_id;
     hsize_t    nmemb;
     matvar_t **cells;
-    H5E_auto_t efunc;
-    void       *client_data;
-    int        is_ref, err = -1;
-    char       id_name[128] = {'\0',};
+    int        err = -1;
     hsize_t    perm_dims[10];
 
     cells = matvar->data;
@@ -1274,43 +2634,19 @@ Mat_VarWriteCell73(hid_t id,matvar_t *matvar,const char *name,hid_t *refs_id)
 
         err = 0;
     } else {
-        (void)H5Iget_name(id,id_name,127);
-        is_ref = !strcmp(id_name,"/#refs#");
-        if ( *refs_id < 0 ) {
-            /* Turn off error-checking so we don't get messages if opening
-             * group /#refs# fails
-             */
-            H5Eget_auto(H5E_DEFAULT,&efunc,&client_data);
-            H5Eset_auto(H5E_DEFAULT,(H5E_auto_t)0,NULL);
-            *refs_id = H5Gopen(id,"/#refs#",H5P_DEFAULT);
-            if ( *refs_id < 0 )
-                *refs_id = H5Gcreate(id,"/#refs#",H5P_DEFAULT,
-                                     H5P_DEFAULT,H5P_DEFAULT);
-            H5Eset_auto(H5E_DEFAULT,efunc,client_data);
-        }
-
-        if ( *refs_id > -1 ) {
-            char        obj_name[64];
+        if ( Mat_H5OpenRefs(mat,id) > -1 ) {
             hobj_ref_t *refs;
-            hsize_t     num_obj;
 
             for ( k = 0; k < matvar->rank; k++ )
                 perm_dims[k] = matvar->dims[matvar->rank-k-1];
 
-            refs = malloc(nmemb*sizeof(*refs));
+            refs = Mat_Malloc(mat->allocator,nmemb*sizeof(*refs));
             mspace_id=H5Screate_simple(matvar->rank,perm_dims,NULL);
             dset_id = H5Dcreate(id,name,H5T_STD_REF_OBJ,mspace_id,
                                 H5P_DEFAULT,H5P_DEFAULT,H5P_DEFAULT);
 
-            for ( k = 0; k < nmemb; k++ ) {
-                (void)H5Gget_num_objs(*refs_id,&num_obj);
-                sprintf(obj_name,"%lld",num_obj);
-                if ( NULL != cells[k] )
-                    cells[k]->compression = matvar->compression;
-                Mat_VarWriteNext73(*refs_id,cells[k],obj_name,refs_id);
-                sprintf(obj_name,"/#refs#/%lld",num_obj);
-                H5Rcreate(refs+k,id,obj_name,H5R_OBJECT,-1);
-            }
+            for ( k = 0; k < nmemb; k++ )
+                Mat_H5WriteRef(mat,cells[k],matvar->compression,refs+k);
 
             H5Dwrite(dset_id,H5T_STD_REF_OBJ,H5S_ALL,H5S_ALL,
                      H5P_DEFAULT,refs);
@@ -1325,7 +2661,7 @@ Mat_VarWriteCell73(hid_t id,matvar_t *matvar,const char *name,hid_t *refs_id)
             H5Sclose(aspace_id);
             H5Tclose(str_type_id);
             H5Dclose(dset_id);
-            free(refs);
+            Mat_Free(mat->allocator,refs);
             H5Sclose(mspace_id);
 
             err = 0;
@@ -1433,11 +2769,12 @@ Mat_VarWriteChar73(hid_t id,matvar_t *matvar,const char *name)
         attr_id = H5Acreate(dset_id,"MATLAB_int_decode",attr_type_id,
                             aspace_id,H5P_DEFAULT,H5P_DEFAULT);
         H5Awrite(attr_id,attr_type_id,&matlab_int_decode);
+        H5Aclose(attr_id);
         H5Tclose(attr_type_id);
         H5Sclose(aspace_id);
 
-        H5Dwrite(dset_id,Mat_data_type_to_hid_t(matvar->data_type),
-                 H5S_ALL,H5S_ALL,H5P_DEFAULT,matvar->data);
+        Mat_H5WriteVarData(NULL,matvar,dset_id,
+                           Mat_data_type_to_hid_t(matvar->data_type),numel);
         H5Dclose(dset_id);
         H5Sclose(mspace_id);
         err = 0;
@@ -1490,17 +2827,17 @@ Mat_WriteEmptyVariable73(hid_t id,const char *name,hsize_t rank,size_t *dims)
  * @param id HDF id of the parent object
  * @param matvar pointer to the logical variable
  * @param name Name of the HDF dataset
+ * @param mat MAT file pointer
  * @retval 0 on success
  * @endif
  */
 static int
-Mat_VarWriteLogical73(hid_t id,matvar_t *matvar,const char *name)
+Mat_VarWriteLogical73(hid_t id,matvar_t *matvar,const char *name,mat_t *mat)
 {
     int err = -1;
     unsigned long k,numel;
     hid_t mspace_id,dset_id,attr_type_id,attr_id,aspace_id,plist;
     hsize_t perm_dims[10];
-    herr_t herr;
     int int_decode = 1;
 
     numel = 1;
@@ -1509,15 +2846,7 @@ Mat_VarWriteLogical73(hid_t id,matvar_t *matvar,const char *name)
         numel *= perm_dims[k];
     }
 
-    if ( matvar->compression ) {
-        hsize_t chunk_dims[10];
-        Mat_H5GetChunkSize(matvar->rank, perm_dims,chunk_dims);
-        plist = H5Pcreate(H5P_DATASET_CREATE);
-        herr = H5Pset_chunk(plist, matvar->rank, chunk_dims);
-        herr = H5Pset_deflate(plist, 9);
-    } else {
-        plist = H5P_DEFAULT;
-    }
+    plist = Mat_H5CreateWritePlist(matvar,1,perm_dims);
 
     if ( 0 == numel || NULL == matvar->data ) {
         hsize_t rank = matvar->rank;
@@ -1578,8 +2907,8 @@ Mat_VarWriteLogical73(hid_t id,matvar_t *matvar,const char *name)
         H5Sclose(aspace_id);
         H5Aclose(attr_id);
 
-        H5Dwrite(dset_id,Mat_data_type_to_hid_t(matvar->data_type),
-                 H5S_ALL,H5S_ALL,H5P_DEFAULT,matvar->data);
+        Mat_H5WriteVarData(mat,matvar,dset_id,
+                           Mat_data_type_to_hid_t(matvar->data_type),numel);
         H5Dclose(dset_id);
         H5Sclose(mspace_id);
         err = 0;
@@ -1599,17 +2928,17 @@ Mat_VarWriteLogical73(hid_t id,matvar_t *matvar,const char *name)
  * @param id HDF id of the parent object
  * @param matvar pointer to the numeric variable
  * @param name Name of the HDF dataset
+ * @param mat MAT file pointer
  * @retval 0 on success
  * @endif
  */
 static int
-Mat_VarWriteNumeric73(hid_t id,matvar_t *matvar,const char *name)
+Mat_VarWriteNumeric73(hid_t id,matvar_t *matvar,const char *name,mat_t *mat)
 {
     int err = -1;
     unsigned long k,numel;
     hid_t mspace_id,dset_id,attr_type_id,attr_id,aspace_id,plist;
     hsize_t perm_dims[10];
-    herr_t herr;
 
     numel = 1;
     for ( k = 0; k < matvar->rank; k++ ) {
@@ -1617,15 +2946,9 @@ Mat_VarWriteNumeric73(hid_t id,matvar_t *matvar,const char *name)
         numel *= perm_dims[k];
     }
 
-    if ( matvar->compression ) {
-        hsize_t chunk_dims[10];
-        Mat_H5GetChunkSize(matvar->rank, perm_dims,chunk_dims);
-        plist = H5Pcreate(H5P_DATASET_CREATE);
-        herr = H5Pset_chunk(plist, matvar->rank, chunk_dims);
-        herr = H5Pset_deflate(plist, 9);
-    } else {
-        plist = H5P_DEFAULT;
-    }
+    plist = Mat_H5CreateWritePlist(matvar,(matvar->isComplex ? 2 : 1)*
+                                   Mat_SizeOfClass(matvar->class_type),
+                                   perm_dims);
 
     if ( 0 == numel || NULL == matvar->data ) {
         hsize_t rank = matvar->rank;
@@ -1662,11 +2985,7 @@ Mat_VarWriteNumeric73(hid_t id,matvar_t *matvar,const char *name)
         hid_t h5_complex,h5_complex_base;
 
         h5_complex_base = Mat_class_type_to_hid_t(matvar->class_type);
-        h5_complex      = H5Tcreate(H5T_COMPOUND,
-                                    2*H5Tget_size(h5_complex_base));
-        H5Tinsert(h5_complex,"real",0,h5_complex_base);
-        H5Tinsert(h5_complex,"imag",H5Tget_size(h5_complex_base),
-                  h5_complex_base);
+        h5_complex      = Mat_H5ComplexType(h5_complex_base);
         mspace_id = H5Screate_simple(matvar->rank,perm_dims,NULL);
         dset_id = H5Dcreate(id,name,h5_complex,mspace_id,H5P_DEFAULT,
                             plist,H5P_DEFAULT);
@@ -1681,22 +3000,8 @@ Mat_VarWriteNumeric73(hid_t id,matvar_t *matvar,const char *name)
         H5Sclose(aspace_id);
         H5Aclose(attr_id);
         H5Tclose(attr_type_id);
-        H5Tclose(h5_complex);
-
-        /* Write real part of dataset */
-        h5_complex = H5Tcreate(H5T_COMPOUND,
-                               H5Tget_size(h5_complex_base));
-        H5Tinsert(h5_complex,"real",0,h5_complex_base);
-        H5Dwrite(dset_id,h5_complex,H5S_ALL,H5S_ALL,H5P_DEFAULT,
-                 ((mat_complex_split_t*)matvar->data)->Re);
-        H5Tclose(h5_complex);
 
-        /* Write imaginary part of dataset */
-        h5_complex      = H5Tcreate(H5T_COMPOUND,
-                                    H5Tget_size(h5_complex_base));
-        H5Tinsert(h5_complex,"imag",0,h5_complex_base);
-        H5Dwrite(dset_id,h5_complex,H5S_ALL,H5S_ALL,H5P_DEFAULT,
-                 ((mat_complex_split_t*)matvar->data)->Im);
+        Mat_H5WriteVarData(mat,matvar,dset_id,h5_complex_base,numel);
         H5Tclose(h5_complex);
         H5Dclose(dset_id);
         H5Sclose(mspace_id);
@@ -1717,8 +3022,8 @@ Mat_VarWriteNumeric73(hid_t id,matvar_t *matvar,const char *name)
         H5Sclose(aspace_id);
         H5Aclose(attr_id);
         H5Tclose(attr_type_id);
-        H5Dwrite(dset_id,Mat_data_type_to_hid_t(matvar->data_type),
-                 H5S_ALL,H5S_ALL,H5P_DEFAULT,matvar->data);
+        Mat_H5WriteVarData(mat,matvar,dset_id,
+                           Mat_data_type_to_hid_t(matvar->data_type),numel);
         H5Dclose(dset_id);
         H5Sclose(mspace_id);
         err = 0;
@@ -1802,11 +3107,7 @@ Mat_VarWriteSparse73(hid_t id,matvar_t *matvar,const char *name)
             /* Create dataset datatype as compound with real and
              * imaginary fields
              */
-            h5_complex      = H5Tcreate(H5T_COMPOUND,
-                                        2*H5Tget_size(data_type_id));
-            H5Tinsert(h5_complex,"real",0,data_type_id);
-            H5Tinsert(h5_complex,"imag",H5Tget_size(data_type_id),
-                      data_type_id);
+            h5_complex      = Mat_H5ComplexType(data_type_id);
 
             /* Create dataset */
             perm_dims[0] = ndata;
@@ -1815,20 +3116,8 @@ Mat_VarWriteSparse73(hid_t id,matvar_t *matvar,const char *name)
                                 H5P_DEFAULT,H5P_DEFAULT,H5P_DEFAULT);
             H5Tclose(h5_complex);
 
-            /* Write real part of dataset */
-            h5_complex = H5Tcreate(H5T_COMPOUND,
-                                   H5Tget_size(data_type_id));
-            H5Tinsert(h5_complex,"real",0,data_type_id);
-            H5Dwrite(dset_id,h5_complex,H5S_ALL,H5S_ALL,H5P_DEFAULT,
-                     complex_data->Re);
-            H5Tclose(h5_complex);
-
-            /* Write imaginary part of dataset */
-            h5_complex      = H5Tcreate(H5T_COMPOUND,H5Tget_size(data_type_id));
-            H5Tinsert(h5_complex,"imag",0,data_type_id);
-            H5Dwrite(dset_id,h5_complex,H5S_ALL,H5S_ALL,H5P_DEFAULT,
-                     complex_data->Im);
-            H5Tclose(h5_complex);
+            /* Write the real and imaginary parts of the dataset */
+            Mat_H5WriteComplex(NULL,dset_id,data_type_id,ndata,complex_data);
             H5Dclose(dset_id);
             H5Sclose(mspace_id);
         } else { /* if ( matvar->isComplex ) */
@@ -1871,11 +3160,12 @@ Mat_VarWriteSparse73(hid_t id,matvar_t *matvar,const char *name)
  * @param id HDF id of the parent object
  * @param matvar pointer to the structure variable
  * @param name Name of the HDF dataset
+ * @param mat MAT file pointer
  * @retval 0 on success
  * @endif
  */
 static int
-Mat_VarWriteStruct73(hid_t id,matvar_t *matvar,const char *name,hid_t *refs_id)
+Mat_VarWriteStruct73(hid_t id,matvar_t *matvar,const char *name,mat_t *mat)
 {
     int err = -1;
     unsigned   k;
@@ -1884,8 +3174,6 @@ Mat_VarWriteStruct73(hid_t id,matvar_t *matvar,const char *name,hid_t *refs_id)
     hsize_t    nfields,nmemb;
     matvar_t **fields;
     hvl_t     *fieldnames;
-    char       id_name[128] = {'\0',};
-    int        is_ref;
     hsize_t    perm_dims[10];
 
     nmemb = 1;
@@ -1920,7 +3208,7 @@ Mat_VarWriteStruct73(hid_t id,matvar_t *matvar,const char *name,hid_t *refs_id)
         nfields = matvar->internal->num_fields;
         if ( nfields ) {
             str_type_id = H5Tcopy(H5T_C_S1);
-            fieldnames = malloc(nfields*sizeof(*fieldnames));
+            fieldnames = Mat_Malloc(mat->allocator,nfields*sizeof(*fieldnames));
             fields     = matvar->data;
             for ( k = 0; k < nfields; k++ ) {
                 fieldnames[k].len =
@@ -1937,7 +3225,7 @@ Mat_VarWriteStruct73(hid_t id,matvar_t *matvar,const char *name,hid_t *refs_id)
             H5Sclose(aspace_id);
             H5Tclose(fieldnames_id);
             H5Tclose(str_type_id);
-            free(fieldnames);
+            Mat_Free(mat->allocator,fieldnames);
         }
 
         /* Write the dimensions as the data */
@@ -1946,8 +3234,6 @@ Mat_VarWriteStruct73(hid_t id,matvar_t *matvar,const char *name,hid_t *refs_id)
         H5Dclose(dset_id);
         H5Sclose(mspace_id);
     } else {
-        (void)H5Iget_name(id,id_name,127);
-        is_ref = !strcmp(id_name,"/#refs#");
         struct_id = H5Gcreate(id,name,H5P_DEFAULT,H5P_DEFAULT,
                               H5P_DEFAULT);
         if ( struct_id < 0 ) {
@@ -1969,7 +3255,7 @@ Mat_VarWriteStruct73(hid_t id,matvar_t *matvar,const char *name,hid_t *refs_id)
                 return 0;
             }
 
-            fieldnames = malloc(nfields*sizeof(*fieldnames));
+            fieldnames = Mat_Malloc(mat->allocator,nfields*sizeof(*fieldnames));
             fields     = matvar->data;
             for ( k = 0; k < nfields; k++ ) {
                 fieldnames[k].len =
@@ -1986,52 +3272,29 @@ Mat_VarWriteStruct73(hid_t id,matvar_t *matvar,const char *name,hid_t *refs_id)
             H5Sclose(aspace_id);
             H5Tclose(fieldnames_id);
             H5Tclose(str_type_id);
-            free(fieldnames);
+            Mat_Free(mat->allocator,fieldnames);
 
             if ( 1 == nmemb ) {
                 for ( k = 0; k < nfields; k++ ) {
                     if ( NULL != fields[k] )
                         fields[k]->compression = matvar->compression;
                     Mat_VarWriteNext73(struct_id,fields[k],
-                        matvar->internal->fieldnames[k],refs_id);
+                        matvar->internal->fieldnames[k],mat);
                 }
             } else {
-                if ( *refs_id < 0 ) {
-                    H5E_auto_t  efunc;
-                    void       *client_data;
-                    /* Silence errors if /#refs does not exist */
-                    H5Eget_auto(H5E_DEFAULT,&efunc,&client_data);
-                    H5Eset_auto(H5E_DEFAULT,(H5E_auto_t)0,NULL);
-                    *refs_id = H5Gopen(id,"/#refs#",H5P_DEFAULT);
-                    H5Eset_auto(H5E_DEFAULT,efunc,client_data);
-
-                    /* If could not open /#refs#, try to create it */
-                    if ( *refs_id < 0 )
-                        *refs_id = H5Gcreate(id,"/#refs#",H5P_DEFAULT,
-                                             H5P_DEFAULT,H5P_DEFAULT);
-                }
-                if ( *refs_id > -1 ) {
-                    char name[64];
+                if ( Mat_H5OpenRefs(mat,id) > -1 ) {
                     hobj_ref_t **refs;
-                    hsize_t      num_obj;
                     int l;
 
-                    refs = malloc(nfields*sizeof(*refs));
+                    refs = Mat_Malloc(mat->allocator,nfields*sizeof(*refs));
                     for ( l = 0; l < nfields; l++ )
-                        refs[l] = malloc(nmemb*sizeof(*refs[l]));
+                        refs[l] = Mat_Malloc(mat->allocator,
+                                             nmemb*sizeof(*refs[l]));
 
                     for ( k = 0; k < nmemb; k++ ) {
-                        for ( l = 0; l < nfields; l++ ) {
-                            (void)H5Gget_num_objs(*refs_id,&num_obj);
-                            sprintf(name,"%lld",num_obj);
-                            fields[k*nfields+l]->compression =
-                                matvar->compression;
-                            Mat_VarWriteNext73(*refs_id,fields[k*nfields+l],
-                                name,refs_id);
-                            sprintf(name,"/#refs#/%lld",num_obj);
-                            H5Rcreate(refs[l]+k,id,name,
-                                      H5R_OBJECT,-1);
-                        }
+                        for ( l = 0; l < nfields; l++ )
+                            Mat_H5WriteRef(mat,fields[k*nfields+l],
+                                           matvar->compression,refs[l]+k);
                     }
 
                     for ( k = 0; k < matvar->rank; k++ )
@@ -2045,9 +3308,9 @@ Mat_VarWriteStruct73(hid_t id,matvar_t *matvar,const char *name,hid_t *refs_id)
                         H5Dwrite(dset_id,H5T_STD_REF_OBJ,H5S_ALL,
                                  H5S_ALL,H5P_DEFAULT,refs[l]);
                         H5Dclose(dset_id);
-                        free(refs[l]);
+                        Mat_Free(mat->allocator,refs[l]);
                     }
-                    free(refs);
+                    Mat_Free(mat->allocator,refs);
                     H5Sclose(mspace_id);
                 }
             }
@@ -2058,14 +3321,14 @@ Mat_VarWriteStruct73(hid_t id,matvar_t *matvar,const char *name,hid_t *refs_id)
 }
 
 static int
-Mat_VarWriteNext73(hid_t id,matvar_t *matvar,const char *name,hid_t *refs_id)
+Mat_VarWriteNext73(hid_t id,matvar_t *matvar,const char *name,mat_t *mat)
 {
     int err = -1;
     if ( NULL == matvar ) {
         size_t dims[2] = {0,0};
         return Mat_WriteEmptyVariable73(id,name,2,dims);
     } else if ( matvar->isLogical ) {
-        return Mat_VarWriteLogical73(id,matvar,name);
+        return Mat_VarWriteLogical73(id,matvar,name,mat);
     }
 
     switch ( matvar->class_type ) {
@@ -2079,16 +3342,16 @@ Mat_VarWriteNext73(hid_t id,matvar_t *matvar,const char *name,hid_t *refs_id)
         case MAT_C_UINT16:
         case MAT_C_INT8:
         case MAT_C_UINT8:
-            err = Mat_VarWriteNumeric73(id,matvar,name);
+            err = Mat_VarWriteNumeric73(id,matvar,name,mat);
             break;
         case MAT_C_CHAR:
             err = Mat_VarWriteChar73(id,matvar,name);
             break;
         case MAT_C_STRUCT:
-            err = Mat_VarWriteStruct73(id,matvar,name,refs_id);
+            err = Mat_VarWriteStruct73(id,matvar,name,mat);
             break;
         case MAT_C_CELL:
-            err = Mat_VarWriteCell73(id,matvar,name,refs_id);
+            err = Mat_VarWriteCell73(id,matvar,name,mat);
             break;
         case MAT_C_SPARSE:
             err = Mat_VarWriteSparse73(id,matvar,name);
@@ -2101,6 +3364,127 @@ Mat_VarWriteNext73(hid_t id,matvar_t *matvar,const char *name,hid_t *refs_id)
     return err;
 }
 
+/** @if mat_devman
+ * @brief Adds a link of the root group to the listing of the variables
+ *
+ * H5Literate callback for Mat_H5ReadDir.  Hard links to datasets and to
+ * groups other than /#refs# are appended to mat->dir.
+ * @ingroup mat_internal
+ * @param group_id HDF5 identifier of the root group
+ * @param name Name of the link
+ * @param info Information of the link
+ * @param op_data MAT file pointer
+ * @retval 0 to continue the iteration, negative on error
+ * @endif
+ */
+static herr_t
+Mat_H5ReadDirIter(hid_t group_id,const char *name,const H5L_info_t *info,
+                  void *op_data)
+{
+    mat_t     *mat = (mat_t*)op_data;
+    H5G_stat_t statbuf;
+
+    if ( H5L_TYPE_HARD != info->type || !strcmp(name,"#refs#") )
+        return 0;
+    if ( H5Gget_objinfo(group_id,name,0,&statbuf) < 0 )
+        return -1;
+    if ( H5G_DATASET != statbuf.type && H5G_GROUP != statbuf.type )
+        return 0;
+
+    mat->dir[mat->num_datasets] = strdup_printf("%s",name);
+    if ( NULL == mat->dir[mat->num_datasets] )
+        return -1;
+    mat->dir_types[mat->num_datasets++] = statbuf.type;
+
+    return 0;
+}
+
+/** @if mat_devman
+ * @brief Lists the variables of a version 7.3 MAT file
+ *
+ * Caches the names and object types of the variables in mat->dir and
+ * mat->dir_types with a single pass over the links of the root group, in
+ * the same name order as the index-based H5G functions.  The listing is
+ * kept until the file is closed or a variable is written.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @retval 0 on success
+ * @endif
+ */
+static int
+Mat_H5ReadDir(mat_t *mat)
+{
+    hid_t   fid;
+    hsize_t num_objs = 0, idx = 0;
+
+    if ( NULL != mat->dir )
+        return 0;
+
+    fid = *(hid_t*)mat->fp;
+    if ( H5Gget_num_objs(fid,&num_objs) < 0 )
+        return -1;
+
+    mat->num_datasets = 0;
+    mat->dir       = malloc((num_objs+1)*sizeof(*mat->dir));
+    mat->dir_types = malloc((num_objs+1)*sizeof(*mat->dir_types));
+    if ( NULL == mat->dir || NULL == mat->dir_types ) {
+        Mat_FreeDir73(mat);
+        Mat_Critical("Couldn't allocate memory for the variable names");
+        return -1;
+    }
+
+    if ( H5Literate(fid,H5_INDEX_NAME,H5_ITER_INC,&idx,Mat_H5ReadDirIter,
+                    mat) < 0 ) {
+        Mat_FreeDir73(mat);
+        return -1;
+    }
+
+    return 0;
+}
+
+/** @if mat_devman
+ * @brief Reads the header information of a variable of the root group
+ *
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param name Name of the variable
+ * @param obj_id HDF5 identifier of the dataset or group of the variable.
+ *               The identifier is closed unless it is kept in the variable.
+ * @return pointer to the MAT variable or NULL
+ * @endif
+ */
+static matvar_t *
+Mat_H5ReadVarInfo(mat_t *mat,const char *name,hid_t obj_id)
+{
+    matvar_t *matvar;
+
+    if ( NULL == (matvar = Mat_VarCallocMem(mat->allocator,NULL)) ) {
+        H5Oclose(obj_id);
+        return NULL;
+    }
+
+    matvar->internal->fp = mat;
+    matvar->name = Mat_VarMemStrdup(matvar,name);
+
+    switch ( H5Iget_type(obj_id) ) {
+        case H5I_DATASET:
+            Mat_H5ReadDatasetInfo(mat,matvar,obj_id);
+            break;
+        case H5I_GROUP:
+            Mat_H5ReadGroupInfo(mat,matvar,obj_id);
+            break;
+        default:
+            Mat_VarFree(matvar);
+            matvar = NULL;
+            break;
+    }
+
+    if ( NULL == matvar || matvar->internal->id != obj_id )
+        H5Oclose(obj_id);
+
+    return matvar;
+}
+
 /** @if mat_devman
  * @brief Creates a new Matlab MAT version 7.3 file
  *
@@ -2155,6 +3539,25 @@ Mat_Create73(const char *matname,const char *hdr_str)
     mat->bof              = 0;
     mat->next_index       = 0;
     mat->refs_id          = -1;
+    mat->num_refs         = 0;
+    mat->dir              = NULL;
+    mat->dir_types        = NULL;
+    mat->scaling          = 0;
+    mat->scale            = 1.0;
+    mat->offset           = 0.0;
+    mat->nthreads         = 1;
+    mat->lazy             = 0;
+    mat->lazy_max_bytes   = 0;
+    mat->lazy_bytes       = 0;
+    mat->lazy_head        = NULL;
+    mat->lazy_tail        = NULL;
+    mat->lazy_unread      = NULL;
+    mat->shallow          = 0;
+    mat->arena            = 0;
+    mat->allocator        = Mat_GetDefaultAllocator();
+    mat->async            = NULL;
+    mat->scratch          = NULL;
+    mat->scratch_size     = 0;
 
     t = time(NULL);
     mat->filename = strdup_printf("%s",matname);
@@ -2229,6 +3632,7 @@ Mat_VarRead73(mat_t *mat,matvar_t *matvar)
             numel = 1;
             for ( k = 0; k < matvar->rank; k++ )
                 numel *= matvar->dims[k];
+            matvar->data_type = Mat_ClassToType73(matvar->class_type);
             matvar->data_size = Mat_SizeOfClass(matvar->class_type);
             matvar->nbytes    = numel*matvar->data_size;
 
@@ -2244,36 +3648,9 @@ Mat_VarRead73(mat_t *mat,matvar_t *matvar)
                 break;
             }
 
-            if ( !matvar->isComplex ) {
-                matvar->data      = malloc(matvar->nbytes);
-                if ( NULL != matvar->data ) {
-                    H5Dread(dset_id,Mat_class_type_to_hid_t(matvar->class_type),
-                            H5S_ALL,H5S_ALL,H5P_DEFAULT,matvar->data);
-                }
-            } else {
-                mat_complex_split_t *complex_data;
-                hid_t h5_complex_base,h5_complex;
-
-                complex_data     = malloc(sizeof(*complex_data));
-                complex_data->Re = malloc(matvar->nbytes);
-                complex_data->Im = malloc(matvar->nbytes);
-
-                h5_complex_base = Mat_class_type_to_hid_t(matvar->class_type);
-                h5_complex      = H5Tcreate(H5T_COMPOUND,
-                                            H5Tget_size(h5_complex_base));
-                H5Tinsert(h5_complex,"real",0,h5_complex_base);
-                H5Dread(dset_id,h5_complex,H5S_ALL,H5S_ALL,H5P_DEFAULT,
-                        complex_data->Re);
-                H5Tclose(h5_complex);
-
-                h5_complex      = H5Tcreate(H5T_COMPOUND,
-                                            H5Tget_size(h5_complex_base));
-                H5Tinsert(h5_complex,"imag",0,h5_complex_base);
-                H5Dread(dset_id,h5_complex,H5S_ALL,H5S_ALL,H5P_DEFAULT,
-                        complex_data->Im);
-                H5Tclose(h5_complex);
-                matvar->data = complex_data;
-            }
+            Mat_H5ReadVarData(mat,matvar,dset_id,
+                              Mat_class_type_to_hid_t(matvar->class_type),
+                              numel);
             H5Dclose(dset_id);
             break;
         case MAT_C_CHAR:
@@ -2290,11 +3667,8 @@ Mat_VarRead73(mat_t *mat,matvar_t *matvar)
                 dset_id = matvar->internal->id;
                 H5Iinc_ref(dset_id);
             }
-            matvar->data = malloc(matvar->nbytes);
-            if ( NULL != matvar->data ) {
-                H5Dread(dset_id,Mat_data_type_to_hid_t(matvar->data_type),
-                        H5S_ALL,H5S_ALL,H5P_DEFAULT,matvar->data);
-            }
+            Mat_H5ReadVarData(mat,matvar,dset_id,
+                              Mat_data_type_to_hid_t(matvar->data_type),numel);
             break;
         case MAT_C_STRUCT:
         {
@@ -2308,6 +3682,10 @@ Mat_VarRead73(mat_t *mat,matvar_t *matvar)
                 numel *= matvar->dims[k];
             nfields = matvar->internal->num_fields;
             fields  = matvar->data;
+            if ( mat->lazy ) {
+                Mat_H5SetLazy(mat,fields,nfields*numel);
+                break;
+            }
             for ( i = 0; i < nfields*numel; i++ ) {
                 if (  0 < fields[i]->internal->hdf5_ref &&
                      -1 < fields[i]->internal->id ) {
@@ -2324,6 +3702,13 @@ Mat_VarRead73(mat_t *mat,matvar_t *matvar)
             matvar_t **cells;
             int i,ncells = 0;
 
+            if ( mat->lazy ) {
+                if ( NULL != matvar->data && matvar->data_size > 0 )
+                    Mat_H5SetLazy(mat,matvar->data,
+                                  matvar->nbytes / matvar->data_size);
+                break;
+            }
+
             if ( NULL != matvar->internal->hdf5_name ) {
                 dset_id = H5Dopen(fid,matvar->internal->hdf5_name,H5P_DEFAULT);
             } else {
@@ -2342,8 +3727,9 @@ Mat_VarRead73(mat_t *mat,matvar_t *matvar)
         {
             hid_t sparse_dset_id, space_id;
             hsize_t dims[2] = {0,};
-            struct mat_sparse_t *sparse_data = calloc(1,sizeof(*sparse_data));
+            struct mat_sparse_t *sparse_data;
 
+            sparse_data = Mat_VarMemCalloc(matvar,1,sizeof(*sparse_data));
             if ( NULL != matvar->internal->hdf5_name ) {
                 dset_id = H5Gopen(fid,matvar->internal->hdf5_name,H5P_DEFAULT);
             } else {
@@ -2356,8 +3742,8 @@ Mat_VarRead73(mat_t *mat,matvar_t *matvar)
                 space_id = H5Dget_space(sparse_dset_id);
                 H5Sget_simple_extent_dims(space_id,dims,NULL);
                 sparse_data->nir = dims[0];
-                sparse_data->ir = malloc(sparse_data->nir*
-                                         sizeof(*sparse_data->ir));
+                sparse_data->ir = Mat_VarDataAlloc(matvar,sparse_data->nir*
+                                                  sizeof(*sparse_data->ir));
                 H5Dread(sparse_dset_id,H5T_NATIVE_INT,
                         H5S_ALL,H5S_ALL,H5P_DEFAULT,sparse_data->ir);
                 H5Sclose(space_id);
@@ -2369,8 +3755,8 @@ Mat_VarRead73(mat_t *mat,matvar_t *matvar)
                 space_id = H5Dget_space(sparse_dset_id);
                 H5Sget_simple_extent_dims(space_id,dims,NULL);
                 sparse_data->njc = dims[0];
-                sparse_data->jc = malloc(sparse_data->njc*
-                                         sizeof(*sparse_data->jc));
+                sparse_data->jc = Mat_VarDataAlloc(matvar,sparse_data->njc*
+                                                  sizeof(*sparse_data->jc));
                 H5Dread(sparse_dset_id,H5T_NATIVE_INT,
                         H5S_ALL,H5S_ALL,H5P_DEFAULT,sparse_data->jc);
                 H5Sclose(space_id);
@@ -2389,7 +3775,7 @@ Mat_VarRead73(mat_t *mat,matvar_t *matvar)
 
                 ndata_bytes = sparse_data->nzmax*Mat_SizeOf(matvar->data_type);
                 if ( !matvar->isComplex ) {
-                    sparse_data->data  = malloc(ndata_bytes);
+                    sparse_data->data  = Mat_VarDataAlloc(matvar,ndata_bytes);
                     if ( NULL != sparse_data->data ) {
                         H5Dread(sparse_dset_id,
                                 Mat_data_type_to_hid_t(matvar->data_type),
@@ -2397,26 +3783,16 @@ Mat_VarRead73(mat_t *mat,matvar_t *matvar)
                     }
                 } else {
                     mat_complex_split_t *complex_data;
-                    hid_t h5_complex_base,h5_complex;
-
-                    complex_data     = malloc(sizeof(*complex_data));
-                    complex_data->Re = malloc(ndata_bytes);
-                    complex_data->Im = malloc(ndata_bytes);
-
-                    h5_complex_base = Mat_data_type_to_hid_t(matvar->data_type);
-                    h5_complex      = H5Tcreate(H5T_COMPOUND,
-                                                H5Tget_size(h5_complex_base));
-                    H5Tinsert(h5_complex,"real",0,h5_complex_base);
-                    H5Dread(sparse_dset_id,h5_complex,H5S_ALL,H5S_ALL,
-                            H5P_DEFAULT,complex_data->Re);
-                    H5Tclose(h5_complex);
-
-                    h5_complex      = H5Tcreate(H5T_COMPOUND,
-                                                H5Tget_size(h5_complex_base));
-                    H5Tinsert(h5_complex,"imag",0,h5_complex_base);
-                    H5Dread(sparse_dset_id,h5_complex,H5S_ALL,H5S_ALL,
-                            H5P_DEFAULT,complex_data->Im);
-                    H5Tclose(h5_complex);
+
+                    complex_data     = Mat_VarMemAlloc(matvar,
+                                                       sizeof(*complex_data));
+                    complex_data->Re = Mat_VarDataAlloc(matvar,ndata_bytes);
+                    complex_data->Im = Mat_VarDataAlloc(matvar,ndata_bytes);
+
+                    Mat_H5ReadComplex(mat,sparse_dset_id,
+                                      Mat_data_type_to_hid_t(matvar->data_type),
+                                      H5S_ALL,H5S_ALL,sparse_data->nzmax,
+                                      complex_data);
                     sparse_data->data = complex_data;
                 }
                 H5Sclose(space_id);
@@ -2432,6 +3808,66 @@ Mat_VarRead73(mat_t *mat,matvar_t *matvar)
     }
 }
 
+/** @if mat_devman
+ * @brief Reads the data of an element of a cell array or structure
+ *
+ * Reads an element marked by Mat_H5SetLazy.  Elements stored in /#refs# are
+ * dereferenced again if their dataset was closed by an earlier read.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar Element of a cell array or structure
+ * @endif
+ */
+void
+Mat_VarReadLazy73(mat_t *mat,matvar_t *matvar)
+{
+    hid_t ref_id;
+
+    if ( NULL == mat || NULL == matvar || NULL != matvar->data )
+        return;
+
+    if ( 0 < matvar->internal->hdf5_ref ) {
+        ref_id = matvar->internal->id;
+        if ( ref_id < 0 || H5Iis_valid(ref_id) <= 0 )
+            ref_id = H5Rdereference(*(hid_t*)mat->fp,H5R_OBJECT,
+                                    &matvar->internal->hdf5_ref);
+        matvar->internal->id = ref_id;
+        Mat_H5ReadNextReferenceData(ref_id,matvar,mat);
+        if ( H5Iis_valid(ref_id) <= 0 )
+            matvar->internal->id = -1;
+    } else {
+        Mat_VarRead73(mat,matvar);
+    }
+}
+
+/** @if mat_devman
+ * @brief Opens the dataset with the data of a variable
+ *
+ * Elements of cell arrays and structures stored in /#refs# are dereferenced
+ * again if their dataset was closed by an earlier read.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar MAT variable read by Mat_VarReadInfo
+ * @return Dataset identifier to close with H5Dclose
+ * @endif
+ */
+static hid_t
+Mat_H5OpenData(mat_t *mat,matvar_t *matvar)
+{
+    hid_t dset_id = matvar->internal->id;
+
+    if ( 0 < matvar->internal->hdf5_ref ) {
+        if ( dset_id < 0 || H5Iis_valid(dset_id) <= 0 )
+            return H5Rdereference(*(hid_t*)mat->fp,H5R_OBJECT,
+                                  &matvar->internal->hdf5_ref);
+    } else if ( NULL != matvar->internal->hdf5_name ) {
+        return H5Dopen(*(hid_t*)mat->fp,matvar->internal->hdf5_name,
+                       H5P_DEFAULT);
+    }
+    H5Iinc_ref(dset_id);
+    return dset_id;
+}
+
 /** @if mat_devman
  * @brief Reads a slab of data from the mat variable @c matvar
  *
@@ -2451,9 +3887,10 @@ Mat_VarReadData73(mat_t *mat,matvar_t *matvar,void *data,
           int *start,int *stride,int *edge)
 {
     int err = -1;
-    int k;
-    hid_t fid,dset_id,dset_space,mem_space;
+    int k, row_major;
+    hid_t dset_id,dset_space,mem_space;
     hsize_t dset_start[10],dset_stride[10],dset_edge[10];
+    size_t nmemb = 1;
 
     if ( NULL == mat || NULL == matvar || NULL == data || NULL == start ||
          NULL == stride || NULL == edge )
@@ -2461,12 +3898,12 @@ Mat_VarReadData73(mat_t *mat,matvar_t *matvar,void *data,
     else if (NULL == matvar->internal->hdf5_name && 0 > matvar->internal->id)
         return err;
 
-    fid = *(hid_t*)mat->fp;
-
+    row_major = matvar->internal->read_flags & MAT_F_ROW_MAJOR;
     for ( k = 0; k < matvar->rank; k++ ) {
         dset_start[k]  = start[matvar->rank-k-1];
         dset_stride[k] = stride[matvar->rank-k-1];
         dset_edge[k]   = edge[matvar->rank-k-1];
+        nmemb         *= edge[matvar->rank-k-1];
     }
     mem_space = H5Screate_simple(matvar->rank, dset_edge, NULL);
 
@@ -2481,38 +3918,45 @@ Mat_VarReadData73(mat_t *mat,matvar_t *matvar,void *data,
         case MAT_C_UINT16:
         case MAT_C_INT8:
         case MAT_C_UINT8:
-            if ( NULL != matvar->internal->hdf5_name ) {
-                dset_id = H5Dopen(fid,matvar->internal->hdf5_name,H5P_DEFAULT);
-            } else {
-                dset_id = matvar->internal->id;
-                H5Iinc_ref(dset_id);
-            }
+            dset_id = Mat_H5OpenData(mat,matvar);
 
             dset_space = H5Dget_space(dset_id);
             H5Sselect_hyperslab(dset_space, H5S_SELECT_SET, dset_start,
                                 dset_stride, dset_edge, NULL);
 
             if ( !matvar->isComplex ) {
-                H5Dread(dset_id,Mat_class_type_to_hid_t(matvar->class_type),
-                        mem_space,dset_space,H5P_DEFAULT,data);
-            } else {
-                mat_complex_split_t *complex_data = data;
-                hid_t h5_complex_base,h5_complex;
-
-                h5_complex_base = Mat_class_type_to_hid_t(matvar->class_type);
-                h5_complex      = H5Tcreate(H5T_COMPOUND,
-                                            H5Tget_size(h5_complex_base));
-                H5Tinsert(h5_complex,"real",0,h5_complex_base);
-                H5Dread(dset_id,h5_complex,mem_space,dset_space,H5P_DEFAULT,
-                        complex_data->Re);
-                H5Tclose(h5_complex);
-
-                h5_complex      = H5Tcreate(H5T_COMPOUND,
-                                            H5Tget_size(h5_complex_base));
-                H5Tinsert(h5_complex,"imag",0,h5_complex_base);
-                H5Dread(dset_id,h5_complex,mem_space,dset_space,H5P_DEFAULT,
-                        complex_data->Im);
+                hid_t plist_id = Mat_H5CreateReadPlist(matvar);
+                if ( row_major )
+                    Mat_H5ReadRowMajor(mat,dset_id,
+                        Mat_class_type_to_hid_t(matvar->class_type),plist_id,
+                        dset_start,dset_stride,dset_edge,data,NULL);
+                else
+                    Mat_H5Dread(mat,dset_id,
+                                Mat_class_type_to_hid_t(matvar->class_type),
+                                mem_space,dset_space,plist_id,data);
+                if ( H5P_DEFAULT != plist_id )
+                    H5Pclose(plist_id);
+            } else if ( MAT_IS_INTERLEAVED(matvar) ) {
+                hid_t h5_complex;
+
+                /* Read both parts in one pass to the interleaved data */
+                h5_complex = Mat_H5ComplexType(
+                                 Mat_class_type_to_hid_t(matvar->class_type));
+                if ( row_major )
+                    Mat_H5ReadRowMajor(mat,dset_id,h5_complex,H5P_DEFAULT,
+                        dset_start,dset_stride,dset_edge,data,NULL);
+                else
+                    Mat_H5Dread(mat,dset_id,h5_complex,mem_space,dset_space,
+                                H5P_DEFAULT,data);
                 H5Tclose(h5_complex);
+            } else if ( row_major ) {
+                Mat_H5ReadRowMajor(mat,dset_id,
+                    Mat_class_type_to_hid_t(matvar->class_type),H5P_DEFAULT,
+                    dset_start,dset_stride,dset_edge,NULL,data);
+            } else {
+                Mat_H5ReadComplex(mat,dset_id,
+                                  Mat_class_type_to_hid_t(matvar->class_type),
+                                  mem_space,dset_space,nmemb,data);
             }
             H5Sclose(dset_space);
             H5Dclose(dset_id);
@@ -2546,7 +3990,7 @@ Mat_VarReadDataLinear73(mat_t *mat,matvar_t *matvar,void *data,
     int start,int stride,int edge)
 {
     int err = -1;
-    hid_t fid,dset_id,dset_space,mem_space;
+    hid_t dset_id,dset_space,mem_space;
     hsize_t dset_start,dset_stride,dset_edge;
     hsize_t *points, k, dimp[10];
 
@@ -2555,8 +3999,6 @@ Mat_VarReadDataLinear73(mat_t *mat,matvar_t *matvar,void *data,
     else if (NULL == matvar->internal->hdf5_name && 0 > matvar->internal->id)
         return err;
 
-    fid = *(hid_t*)mat->fp;
-
     dset_start  = start;
     dset_stride = stride;
     dset_edge   = edge;
@@ -2573,14 +4015,10 @@ Mat_VarReadDataLinear73(mat_t *mat,matvar_t *matvar,void *data,
         case MAT_C_UINT16:
         case MAT_C_INT8:
         case MAT_C_UINT8:
-            if ( NULL != matvar->internal->hdf5_name ) {
-                dset_id = H5Dopen(fid,matvar->internal->hdf5_name,H5P_DEFAULT);
-            } else {
-                dset_id = matvar->internal->id;
-                H5Iinc_ref(dset_id);
-            }
+            dset_id = Mat_H5OpenData(mat,matvar);
 
-            points = malloc(matvar->rank*dset_edge*sizeof(*points));
+            points = Mat_Malloc(mat->allocator,
+                                matvar->rank*dset_edge*sizeof(*points));
             if ( NULL == points ) {
                 err = -2;
                 break;
@@ -2597,42 +4035,144 @@ Mat_VarReadDataLinear73(mat_t *mat,matvar_t *matvar,void *data,
                     coord -= idx*dimp[l];
                 }
             }
-            dset_space = H5Dget_space(dset_id);
-            H5Sselect_elements(dset_space,H5S_SELECT_SET,dset_edge,points);
+            dset_space = H5Dget_space(dset_id);
+            H5Sselect_elements(dset_space,H5S_SELECT_SET,dset_edge,points);
+
+            if ( !matvar->isComplex ) {
+                hid_t plist_id = Mat_H5CreateReadPlist(matvar);
+                H5Dread(dset_id,Mat_class_type_to_hid_t(matvar->class_type),
+                        mem_space,dset_space,plist_id,data);
+                if ( H5P_DEFAULT != plist_id )
+                    H5Pclose(plist_id);
+                H5Eprint1(stdout);
+            } else if ( MAT_IS_INTERLEAVED(matvar) ) {
+                hid_t h5_complex;
+
+                /* Read both parts in one pass to the interleaved data */
+                h5_complex = Mat_H5ComplexType(
+                                 Mat_class_type_to_hid_t(matvar->class_type));
+                H5Dread(dset_id,h5_complex,mem_space,dset_space,H5P_DEFAULT,
+                        data);
+                H5Tclose(h5_complex);
+            } else {
+                Mat_H5ReadComplex(mat,dset_id,
+                                  Mat_class_type_to_hid_t(matvar->class_type),
+                                  mem_space,dset_space,edge,data);
+            }
+            H5Sclose(dset_space);
+            H5Dclose(dset_id);
+            Mat_Free(mat->allocator,points);
+            err = 0;
+            break;
+        default:
+            break;
+    }
+    H5Sclose(mem_space);
+
+    return err;
+}
+
+/** @if mat_devman
+ * @brief Reads a version 7.3 cell array of strings into a string pool
+ *
+ * The character data of each cell is read directly from the object it
+ * refers to and converted to UTF-8 in the pool, so no variable is created
+ * for the cells.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar Cell array read without its cells (see Mat_SetShallowInfo)
+ * @param cellstr Cell array of strings with the dimensions of @c matvar and
+ *                @c offsets[0] set
+ * @retval 0 on success
+ * @endif
+ */
+int
+Mat_VarReadCellStr73(mat_t *mat,matvar_t *matvar,mat_cellstr_t *cellstr)
+{
+    hid_t       dset_id,ref_id,space_id,attr_id;
+    hsize_t     dims[10];
+    hobj_ref_t *refs;
+    mat_uint16_t *buf = NULL;
+    size_t      i, pool_size = 0, buf_size = 0;
+    int         err = 0;
+    H5E_auto_t  efunc;
+    void       *client_data;
+
+    dset_id = Mat_H5OpenData(mat,matvar);
+    if ( dset_id < 0 )
+        return -1;
+    refs = Mat_Malloc(mat->allocator,cellstr->nstrings*sizeof(*refs));
+    if ( NULL == refs || H5Dread(dset_id,H5T_STD_REF_OBJ,H5S_ALL,H5S_ALL,
+                                 H5P_DEFAULT,refs) < 0 ) {
+        Mat_Free(mat->allocator,refs);
+        H5Dclose(dset_id);
+        return -1;
+    }
+
+    /* Turn off error printing so testing for attributes doesn't print
+     * error stacks
+     */
+    H5Eget_auto(H5E_DEFAULT,&efunc,&client_data);
+    H5Eset_auto(H5E_DEFAULT,(H5E_auto_t)0,NULL);
+    for ( i = 0; i < cellstr->nstrings && !err; i++ ) {
+        matvar_t cell;
+        size_t   n = 0;
+        int      rank = 0, empty = 0;
+
+        ref_id = H5Rdereference(dset_id,H5R_OBJECT,refs+i);
+        if ( ref_id < 0 || H5I_DATASET != H5Iget_type(ref_id) ) {
+            err = -1;
+        } else {
+            attr_id = H5Aopen_name(ref_id,"MATLAB_empty");
+            if ( -1 < attr_id ) {
+                H5Aread(attr_id,H5T_NATIVE_INT,&empty);
+                H5Aclose(attr_id);
+            }
+            space_id = H5Dget_space(ref_id);
+            rank = H5Sget_simple_extent_ndims(space_id);
+            if ( rank == 2 ) {
+                H5Sget_simple_extent_dims(space_id,dims,NULL);
+                n = dims[0]*dims[1];
+            }
+            H5Sclose(space_id);
 
-            if ( !matvar->isComplex ) {
-                H5Dread(dset_id,Mat_class_type_to_hid_t(matvar->class_type),
-                        mem_space,dset_space,H5P_DEFAULT,data);
-                H5Eprint1(stdout);
+            /* An empty cell of any class is an empty string */
+            memset(&cell,0,sizeof(cell));
+            if ( !empty ) {
+                Mat_H5ReadClassType(&cell,ref_id);
+                if ( rank != 2 || (n > 0 && (MAT_C_CHAR != cell.class_type ||
+                                             dims[1] != 1)) )
+                    err = -1;
             } else {
-                mat_complex_split_t *complex_data = data;
-                hid_t h5_complex_base,h5_complex;
-
-                h5_complex_base = Mat_class_type_to_hid_t(matvar->class_type);
-                h5_complex      = H5Tcreate(H5T_COMPOUND,
-                                            H5Tget_size(h5_complex_base));
-                H5Tinsert(h5_complex,"real",0,h5_complex_base);
-                H5Dread(dset_id,h5_complex,mem_space,dset_space,H5P_DEFAULT,
-                        complex_data->Re);
-                H5Tclose(h5_complex);
-
-                h5_complex      = H5Tcreate(H5T_COMPOUND,
-                                            H5Tget_size(h5_complex_base));
-                H5Tinsert(h5_complex,"imag",0,h5_complex_base);
-                H5Dread(dset_id,h5_complex,mem_space,dset_space,H5P_DEFAULT,
-                        complex_data->Im);
-                H5Tclose(h5_complex);
+                n = 0;
             }
-            H5Sclose(dset_space);
-            H5Dclose(dset_id);
-            free(points);
-            err = 0;
-            break;
-        default:
+            if ( !err && n > buf_size ) {
+                mat_uint16_t *tmp = Mat_Realloc(mat->allocator,
+                                                buf,n*sizeof(*buf));
+                if ( NULL == tmp ) {
+                    err = -1;
+                } else {
+                    buf      = tmp;
+                    buf_size = n;
+                }
+            }
+            if ( !err && n > 0 && H5Dread(ref_id,H5T_NATIVE_USHORT,H5S_ALL,
+                                          H5S_ALL,H5P_DEFAULT,buf) < 0 )
+                err = -1;
+        }
+        if ( ref_id >= 0 )
+            H5Oclose(ref_id);
+        if ( err ) {
+            Mat_Critical("%s is not a cell array of strings",matvar->name);
             break;
+        }
+        err = Mat_CellStrAppend(cellstr,i,&pool_size,buf,n,MAT_T_UINT16);
     }
-    H5Sclose(mem_space);
+    H5Eset_auto(H5E_DEFAULT,efunc,client_data);
 
+    Mat_Free(mat->allocator,buf);
+    Mat_Free(mat->allocator,refs);
+    H5Dclose(dset_id);
     return err;
 }
 
@@ -2647,249 +4187,364 @@ Mat_VarReadDataLinear73(mat_t *mat,matvar_t *matvar,void *data,
 matvar_t *
 Mat_VarReadNextInfo73( mat_t *mat )
 {
-    hid_t       fid;
-    hsize_t     num_objs;
-    H5E_auto_t  efunc;
-    void       *client_data;
-    matvar_t   *matvar;
+    const char *name;
+    hid_t       obj_id;
 
     if( mat == NULL )
         return NULL;
 
-    fid = *(hid_t*)mat->fp;
-    H5Gget_num_objs(fid,&num_objs);
     /* FIXME: follow symlinks, datatypes? */
-    while ( mat->next_index < num_objs ) {
-        if ( H5G_DATASET == H5Gget_objtype_by_idx(fid,mat->next_index) ) {
-            break;
-        } else if ( H5G_GROUP == H5Gget_objtype_by_idx(fid,mat->next_index) ) {
-            /* Check that this is not the /#refs# group */
-            char name[128] = {0,};
-            (void)H5Gget_objname_by_idx(fid,mat->next_index,name,127);
-            if ( strcmp(name,"#refs#") )
-                break;
-            else
-                mat->next_index++;
-        } else {
-            mat->next_index++;
-        }
-    }
+    if ( Mat_H5ReadDir(mat) || mat->next_index >= mat->num_datasets )
+        return NULL;
 
-    if ( mat->next_index >= num_objs )
+    name   = mat->dir[mat->next_index];
+    obj_id = H5Oopen(*(hid_t*)mat->fp,name,H5P_DEFAULT);
+    if ( obj_id < 0 )
         return NULL;
-    else if ( NULL == (matvar = Mat_VarCalloc()) )
+    mat->next_index++;
+
+    return Mat_H5ReadVarInfo(mat,name,obj_id);
+}
+
+/** @if mat_devman
+ * @brief Reads the header information of the MAT variable with the given name
+ *
+ * The variable is looked up directly by its link in the root group, so the
+ * cost does not depend on the number of variables in the file.  The position
+ * of Mat_VarReadNextInfo73 is not changed.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param name Name of the variable
+ * @return pointer to the MAT variable or NULL if it does not exist
+ * @endif
+ */
+matvar_t *
+Mat_VarReadInfo73( mat_t *mat, const char *name )
+{
+    hid_t      fid, obj_id;
+    H5L_info_t info;
+
+    if ( NULL == mat || NULL == name )
         return NULL;
 
-    switch ( H5Gget_objtype_by_idx(fid,mat->next_index) ) {
-        case H5G_DATASET:
-        {
-            ssize_t  name_len;
-            /* FIXME */
-            hsize_t  dims[10];
-            hid_t   attr_id,type_id,dset_id,space_id;
+    /* Only links of the root group are variables */
+    if ( '\0' == *name || NULL != strchr(name,'/') || !strcmp(name,".") ||
+         !strcmp(name,"#refs#") )
+        return NULL;
 
-            matvar->internal->fp = mat;
-            name_len = H5Gget_objname_by_idx(fid,mat->next_index,NULL,0);
-            matvar->name = malloc(1+name_len);
-            if ( matvar->name ) {
-                name_len = H5Gget_objname_by_idx(fid,mat->next_index,
-                                                 matvar->name,1+name_len);
-                matvar->name[name_len] = '\0';
-            }
-            dset_id = H5Dopen(fid,matvar->name,H5P_DEFAULT);
+    fid = *(hid_t*)mat->fp;
+    if ( H5Lexists(fid,name,H5P_DEFAULT) <= 0 )
+        return NULL;
+    if ( H5Lget_info(fid,name,&info,H5P_DEFAULT) < 0 ||
+         H5L_TYPE_HARD != info.type )
+        return NULL;
 
-            /* Get the HDF5 name of the variable */
-            name_len = H5Iget_name(dset_id,NULL,0);
-            if ( name_len > 0 ) {
-                matvar->internal->hdf5_name = malloc(name_len+1);
-                (void)H5Iget_name(dset_id,matvar->internal->hdf5_name,
-                                  name_len+1);
-            } else {
-                /* Can not get an internal name, so leave the identifier open */
-                matvar->internal->id = dset_id;
-            }
+    obj_id = H5Oopen(fid,name,H5P_DEFAULT);
+    if ( obj_id < 0 )
+        return NULL;
 
-            space_id = H5Dget_space(dset_id);
-            matvar->rank = H5Sget_simple_extent_ndims(space_id);
-            matvar->dims = malloc(matvar->rank*sizeof(*matvar->dims));
-            if ( NULL != matvar->dims ) {
-                int k;
-                H5Sget_simple_extent_dims(space_id,dims,NULL);
-                for ( k = 0; k < matvar->rank; k++ )
-                    matvar->dims[k] = dims[matvar->rank - k - 1];
-            }
-            H5Sclose(space_id);
+    return Mat_H5ReadVarInfo(mat,name,obj_id);
+}
 
-            Mat_H5ReadClassType(matvar,dset_id);
+/** @if mat_devman
+ * @brief Frees the cached listing of the variables of a version 7.3 MAT file
+ *
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @endif
+ */
+void
+Mat_FreeDir73(mat_t *mat)
+{
+    long i;
 
-            /* Turn off error printing so testing for attributes doesn't print
-             * error stacks
-             */
-            H5Eget_auto(H5E_DEFAULT,&efunc,&client_data);
-            H5Eset_auto(H5E_DEFAULT,(H5E_auto_t)0,NULL);
+    if ( NULL == mat )
+        return;
 
-            attr_id = H5Aopen_name(dset_id,"MATLAB_global");
-            /* FIXME: Check that dataspace is scalar */
-            if ( -1 < attr_id ) {
-                H5Aread(attr_id,H5T_NATIVE_INT,&matvar->isGlobal);
-                H5Aclose(attr_id);
-            }
+    if ( NULL != mat->dir ) {
+        for ( i = 0; i < mat->num_datasets; i++ )
+            free(mat->dir[i]);
+        free(mat->dir);
+        mat->dir = NULL;
+    }
+    if ( NULL != mat->dir_types ) {
+        free(mat->dir_types);
+        mat->dir_types = NULL;
+    }
+}
 
-            /* Check for attribute that indicates an empty array */
-            attr_id = H5Aopen_name(dset_id,"MATLAB_empty");
-            /* FIXME: Check that dataspace is scalar */
-            if ( -1 < attr_id ) {
-                int empty = 0;
-                H5Aread(attr_id,H5T_NATIVE_INT,&empty);
-                H5Aclose(attr_id);
-                if ( empty ) {
-                    matvar->rank = matvar->dims[0];
-                    free(matvar->dims);
-                    matvar->dims = calloc(matvar->rank,sizeof(*matvar->dims));
-                    H5Dread(dset_id,Mat_dims_type_to_hid_t(),H5S_ALL,H5S_ALL,
-                            H5P_DEFAULT,matvar->dims);
-                }
-            }
+/** @if mat_devman
+ * @brief Writes a matlab variable to a version 7.3 matlab file
+ *
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param matvar pointer to the mat variable
+ * @param compress option to compress the variable
+ *                 (only works for numeric types)
+ * @retval 0 on success
+ * @endif
+ */
+int
+Mat_VarWrite73(mat_t *mat,matvar_t *matvar,int compress)
+{
+    hid_t id;
 
-            H5Eset_auto(H5E_DEFAULT,efunc,client_data);
+    if ( NULL == mat || NULL == matvar )
+        return -1;
 
-            /* Test if dataset type is compound and if so if it's complex */
-            type_id = H5Dget_type(dset_id);
-            if ( H5T_COMPOUND == H5Tget_class(type_id) ) {
-                /* FIXME: Any more checks? */
-                matvar->isComplex = MAT_F_COMPLEX;
-            }
-            H5Tclose(type_id);
+    matvar->compression = compress;
 
-            /* If the dataset is a cell array read theinfo of the cells */
-            if ( MAT_C_CELL == matvar->class_type ) {
-                matvar_t **cells;
-                int i,ncells = 1;
-                hobj_ref_t *ref_ids;
+    /* The listing of the variables is read again after the next write */
+    Mat_FreeDir73(mat);
 
-                for ( i = 0; i < matvar->rank; i++ )
-                    ncells *= matvar->dims[i];
-                matvar->data_size = sizeof(matvar_t**);
-                matvar->nbytes    = ncells*matvar->data_size;
-                matvar->data      = malloc(matvar->nbytes);
-                cells  = matvar->data;
+    id = *(hid_t*)mat->fp;
+    return Mat_VarWriteNext73(id,matvar,matvar->name,mat);
+}
 
-                if ( ncells ) {
-                    ref_ids = malloc(ncells*sizeof(*ref_ids));
-                    H5Dread(dset_id,H5T_STD_REF_OBJ,H5S_ALL,H5S_ALL,H5P_DEFAULT,
-                            ref_ids);
-                    for ( i = 0; i < ncells; i++ ) {
-                        hid_t ref_id;
-                        cells[i] = Mat_VarCalloc();
-                        cells[i]->internal->hdf5_ref = ref_ids[i];
-                        /* Closing of ref_id is done in
-                         * Mat_H5ReadNextReferenceInfo
-                         */
-                        ref_id = H5Rdereference(dset_id,H5R_OBJECT,ref_ids+i);
-                        cells[i]->internal->id=ref_id;
-                        cells[i]->internal->fp=matvar->internal->fp;
-                        Mat_H5ReadNextReferenceInfo(ref_id,cells[i],mat);
-                    }
-                    free(ref_ids);
-                }
-            } else if ( MAT_C_STRUCT == matvar->class_type ) {
-                /* Empty structures can be a dataset */
+/** @if mat_devman
+ * @brief Writes columns as the fields of a structure array to a version 7.3
+ *        matlab file
+ *
+ * Each field of each element is still an object of /#refs#, but it is
+ * written from one variable per column that refers to a buffer holding the
+ * row of the element, so no variable is created for the elements.
+ * @ingroup mat_internal
+ * @param mat MAT file pointer
+ * @param name Name of the structure array
+ * @param ncolumns Number of fields
+ * @param field_names Array of @c ncolumns field names
+ * @param columns Array of @c ncolumns columns with the same number of rows
+ * @param compress option to compress the fields
+ * @retval 0 on success
+ * @endif
+ */
+int
+Mat_VarWriteStructColumns73(mat_t *mat,const char *name,int ncolumns,
+    const char * const *field_names,matvar_t * const *columns,int compress)
+{
+    hid_t       id,struct_id,str_type_id,fieldnames_id,attr_id,aspace_id;
+    hid_t       mspace_id,dset_id;
+    hsize_t     nfields = ncolumns,nmemb,perm_dims[2];
+    hvl_t      *fieldnames;
+    hobj_ref_t *refs = NULL;
+    matvar_t  **rows;
+    size_t      i;
+    int         k, err = 0;
+
+    /* The listing of the variables is read again after the next write */
+    Mat_FreeDir73(mat);
 
-                /* Turn off error printing so testing for attributes doesn't print
-                 * error stacks
-                 */
-                H5Eget_auto(H5E_DEFAULT,&efunc,&client_data);
-                H5Eset_auto(H5E_DEFAULT,(H5E_auto_t)0,NULL);
-                /* Check if the structure defines its fields in MATLAB_fields */
-                attr_id = H5Aopen_name(dset_id,"MATLAB_fields");
-                if ( -1 < attr_id ) {
-                    int      i;
-                    hid_t    field_id;
-                    hsize_t  nfields;
-                    hvl_t   *fieldnames_vl;
+    id = *(hid_t*)mat->fp;
+    nmemb = columns[0]->dims[0];
+    rows = Mat_Calloc(mat->allocator,ncolumns,sizeof(*rows));
+    if ( NULL == rows )
+        return -1;
+    for ( k = 0; k < ncolumns && !err; k++ ) {
+        const matvar_t *column = columns[k];
 
-                    space_id = H5Aget_space(attr_id);
-                    (void)H5Sget_simple_extent_dims(space_id,&nfields,NULL);
-                    field_id = H5Aget_type(attr_id);
-                    fieldnames_vl = malloc(nfields*sizeof(*fieldnames_vl));
-                    H5Aread(attr_id,field_id,fieldnames_vl);
+        /* The row of each element is copied to the data of rows[k] */
+        rows[k] = Mat_VarCallocMem(mat->allocator,NULL);
+        if ( NULL == rows[k] ) {
+            err = -1;
+            break;
+        }
+        rows[k]->class_type  = column->class_type;
+        rows[k]->data_type   = column->data_type;
+        rows[k]->isLogical   = column->isLogical;
+        rows[k]->compression = compress;
+        rows[k]->data_size   = Mat_SizeOf(column->data_type);
+        rows[k]->rank        = 2;
+        rows[k]->dims        = Mat_VarMemAlloc(rows[k],2*sizeof(*rows[k]->dims));
+        rows[k]->data        = Mat_VarDataAlloc(rows[k],
+                                   column->dims[1]*rows[k]->data_size+1);
+        if ( NULL == rows[k]->dims || NULL == rows[k]->data )
+            err = -1;
+        if ( MAT_C_CHAR == column->class_type &&
+             MAT_T_UTF8 == column->data_type )
+            rows[k]->data_type = MAT_T_UINT8;
+    }
+    if ( !err && nmemb > 1 ) {
+        if ( Mat_H5OpenRefs(mat,id) < 0 ||
+             NULL == (refs = Mat_Malloc(mat->allocator,
+                                        nmemb*nfields*sizeof(*refs))) )
+            err = -1;
+    }
 
-                    matvar->internal->num_fields = nfields;
-                    matvar->internal->fieldnames =
-                        calloc(nfields,sizeof(*matvar->internal->fieldnames));
-                    for ( i = 0; i < nfields; i++ ) {
-                        matvar->internal->fieldnames[i] =
-                            calloc(fieldnames_vl[i].len+1,1);
-                        memcpy(matvar->internal->fieldnames[i],fieldnames_vl[i].p,
-                               fieldnames_vl[i].len);
-                    }
+    struct_id = err ? -1 : H5Gcreate(id,name,H5P_DEFAULT,H5P_DEFAULT,
+                                     H5P_DEFAULT);
+    if ( struct_id < 0 ) {
+        Mat_Critical("Error creating group for struct %s",name);
+        err = -1;
+    } else {
+        str_type_id = H5Tcopy(H5T_C_S1);
+        H5Tset_size(str_type_id,7);
+        aspace_id = H5Screate(H5S_SCALAR);
+        attr_id = H5Acreate(struct_id,"MATLAB_class",str_type_id,
+                            aspace_id,H5P_DEFAULT,H5P_DEFAULT);
+        H5Awrite(attr_id,str_type_id,"struct");
+        H5Aclose(attr_id);
+        H5Sclose(aspace_id);
 
-                    H5Dvlen_reclaim(field_id,space_id,H5P_DEFAULT,
-                        fieldnames_vl);
-                    H5Sclose(space_id);
-                    H5Tclose(field_id);
-                    H5Aclose(attr_id);
-                    free(fieldnames_vl);
+        fieldnames = Mat_Malloc(mat->allocator,nfields*sizeof(*fieldnames));
+        for ( k = 0; k < ncolumns; k++ ) {
+            fieldnames[k].len = strlen(field_names[k]);
+            fieldnames[k].p   = (void*)field_names[k];
+        }
+        H5Tset_size(str_type_id,1);
+        fieldnames_id = H5Tvlen_create(str_type_id);
+        aspace_id     = H5Screate_simple(1,&nfields,NULL);
+        attr_id = H5Acreate(struct_id,"MATLAB_fields",fieldnames_id,
+                            aspace_id,H5P_DEFAULT,H5P_DEFAULT);
+        H5Awrite(attr_id,fieldnames_id,fieldnames);
+        H5Aclose(attr_id);
+        H5Sclose(aspace_id);
+        H5Tclose(fieldnames_id);
+        H5Tclose(str_type_id);
+        Mat_Free(mat->allocator,fieldnames);
+
+        for ( i = 0; i < nmemb; i++ ) {
+            for ( k = 0; k < ncolumns; k++ ) {
+                matvar_t *row = rows[k];
+                size_t n = Mat_VarGetColumnRow(columns[k],i,row->data);
+
+                /* An empty string is 0x0 */
+                row->dims[0] = (MAT_C_CHAR == row->class_type && 0 == n) ?
+                               0 : 1;
+                row->dims[1] = n;
+                row->nbytes  = n*row->data_size;
+                if ( 1 == nmemb ) {
+                    if ( Mat_VarWriteNext73(struct_id,row,field_names[k],
+                                            mat) )
+                        err = -1;
+                } else if ( Mat_H5WriteRef(mat,row,compress,
+                                           refs+k*nmemb+i) ) {
+                    err = -1;
                 }
-                H5Eset_auto(H5E_DEFAULT,efunc,client_data);
             }
+        }
 
-            if ( matvar->internal->id != dset_id ) {
-                /* Close dataset and increment count */
+        if ( nmemb > 1 ) {
+            perm_dims[0] = 1;
+            perm_dims[1] = nmemb;
+            mspace_id = H5Screate_simple(2,perm_dims,NULL);
+            for ( k = 0; k < ncolumns; k++ ) {
+                dset_id = H5Dcreate(struct_id,field_names[k],
+                                    H5T_STD_REF_OBJ,mspace_id,
+                                    H5P_DEFAULT,H5P_DEFAULT,H5P_DEFAULT);
+                H5Dwrite(dset_id,H5T_STD_REF_OBJ,H5S_ALL,H5S_ALL,
+                         H5P_DEFAULT,refs+k*nmemb);
                 H5Dclose(dset_id);
             }
-            mat->next_index++;
-            break;
-        }
-        case H5G_GROUP:
-        {
-            ssize_t name_len;
-            hid_t   dset_id;
-
-            matvar->internal->fp = mat;
-            name_len = H5Gget_objname_by_idx(fid,mat->next_index,NULL,0);
-            matvar->name = malloc(1+name_len);
-            if ( matvar->name ) {
-                name_len = H5Gget_objname_by_idx(fid,mat->next_index,
-                                                 matvar->name,1+name_len);
-                matvar->name[name_len] = '\0';
-            }
-            dset_id = H5Gopen(fid,matvar->name,H5P_DEFAULT);
-
-            Mat_H5ReadGroupInfo(mat,matvar,dset_id);
-            H5Gclose(dset_id);
-            mat->next_index++;
-            break;
+            H5Sclose(mspace_id);
         }
-        default:
-            break;
+        H5Gclose(struct_id);
     }
-    return matvar;
+
+    for ( k = 0; k < ncolumns; k++ )
+        Mat_VarFree(rows[k]);
+    Mat_Free(mat->allocator,rows);
+    Mat_Free(mat->allocator,refs);
+
+    return err;
 }
 
 /** @if mat_devman
- * @brief Writes a matlab variable to a version 7.3 matlab file
+ * @brief Writes a cell array of strings to a version 7.3 matlab file
  *
+ * Each string is still an object of /#refs#, but it is written from one
+ * character variable that refers to a buffer holding the string converted to
+ * UTF-16, so no variable is created for the cells.
  * @ingroup mat_internal
  * @param mat MAT file pointer
- * @param matvar pointer to the mat variable
- * @param compress option to compress the variable
- *                 (only works for numeric types)
+ * @param name Name of the cell array
+ * @param cellstr Cell array of strings with at least one string
+ * @param compress option to compress the cells
  * @retval 0 on success
  * @endif
  */
 int
-Mat_VarWrite73(mat_t *mat,matvar_t *matvar,int compress)
+Mat_VarWriteCellStr73(mat_t *mat,const char *name,const mat_cellstr_t *cellstr,
+    int compress)
 {
-    hid_t id;
+    hid_t       id,str_type_id,mspace_id,dset_id,attr_id,aspace_id;
+    hsize_t    *perm_dims;
+    hobj_ref_t *refs;
+    matvar_t   *cell;
+    const char *str;
+    size_t      i, len, max_len = 0;
+    int         k, err = 0;
 
-    if ( NULL == mat || NULL == matvar )
+    /* The listing of the variables is read again after the next write */
+    Mat_FreeDir73(mat);
+
+    id = *(hid_t*)mat->fp;
+    for ( i = 0; i < cellstr->nstrings; i++ ) {
+        (void)Mat_CellStrGet(cellstr,i,&len);
+        if ( len > max_len )
+            max_len = len;
+    }
+
+    /* Each string is converted to the data of cell */
+    cell = Mat_VarCallocMem(mat->allocator,NULL);
+    if ( NULL == cell )
         return -1;
+    cell->class_type = MAT_C_CHAR;
+    cell->data_type  = MAT_T_UINT16;
+    cell->data_size  = 2;
+    cell->rank       = 2;
+    cell->dims       = Mat_VarMemAlloc(cell,2*sizeof(*cell->dims));
+    cell->data       = Mat_VarDataAlloc(cell,2*max_len+2);
+    perm_dims = Mat_Malloc(mat->allocator,cellstr->rank*sizeof(*perm_dims));
+    refs      = Mat_Malloc(mat->allocator,cellstr->nstrings*sizeof(*refs));
+    if ( NULL == cell->dims || NULL == cell->data || NULL == perm_dims ||
+         NULL == refs || Mat_H5OpenRefs(mat,id) < 0 ) {
+        Mat_VarFree(cell);
+        Mat_Free(mat->allocator,perm_dims);
+        Mat_Free(mat->allocator,refs);
+        return -1;
+    }
 
-    matvar->compression = compress;
+    for ( i = 0; i < cellstr->nstrings; i++ ) {
+        size_t n;
+
+        str = Mat_CellStrGet(cellstr,i,&len);
+        n   = Mat_Utf8ToUtf16(cell->data,str,len);
+        /* An empty string is 0x0 */
+        cell->dims[0] = n > 0;
+        cell->dims[1] = n;
+        cell->nbytes  = 2*n;
+        if ( Mat_H5WriteRef(mat,cell,compress,refs+i) )
+            err = -1;
+    }
 
-    id = *(hid_t*)mat->fp;
-    return Mat_VarWriteNext73(id,matvar,matvar->name,&(mat->refs_id));
+    for ( k = 0; k < cellstr->rank; k++ )
+        perm_dims[k] = cellstr->dims[cellstr->rank-k-1];
+    mspace_id = H5Screate_simple(cellstr->rank,perm_dims,NULL);
+    dset_id = H5Dcreate(id,name,H5T_STD_REF_OBJ,mspace_id,
+                        H5P_DEFAULT,H5P_DEFAULT,H5P_DEFAULT);
+    if ( dset_id < 0 ) {
+        Mat_Critical("Error creating dataset for cell array %s",name);
+        err = -1;
+    } else {
+        H5Dwrite(dset_id,H5T_STD_REF_OBJ,H5S_ALL,H5S_ALL,H5P_DEFAULT,refs);
+        str_type_id = H5Tcopy(H5T_C_S1);
+        H5Tset_size(str_type_id,7);
+        aspace_id = H5Screate(H5S_SCALAR);
+        attr_id = H5Acreate(dset_id,"MATLAB_class",str_type_id,
+                            aspace_id,H5P_DEFAULT,H5P_DEFAULT);
+        H5Awrite(attr_id,str_type_id,"cell");
+        H5Aclose(attr_id);
+        H5Sclose(aspace_id);
+        H5Tclose(str_type_id);
+        H5Dclose(dset_id);
+    }
+    H5Sclose(mspace_id);
+
+    Mat_VarFree(cell);
+    Mat_Free(mat->allocator,perm_dims);
+    Mat_Free(mat->allocator,refs);
+
+    return err;
 }
 
 #endif
@@ -40,11 +40,21 @@ EXTERN mat_t    *Mat_Create73(const char *matname,const char *hdr_str);
 
 EXTERN void      Mat_VarPrint73(matvar_t *matvar,int printdata);
 EXTERN void      Mat_VarRead73(mat_t *mat,matvar_t *matvar);
+EXTERN void      Mat_VarReadLazy73(mat_t *mat,matvar_t *matvar);
 EXTERN int       Mat_VarReadData73(mat_t *mat,matvar_t *matvar,void *data,
                      int *start,int *stride,int *edge);
 EXTERN int       Mat_VarReadDataLinear73(mat_t *mat,matvar_t *matvar,void *data,
                      int start,int stride,int edge);
+EXTERN int       Mat_VarReadCellStr73(mat_t *mat,matvar_t *matvar,
+                     mat_cellstr_t *cellstr);
 EXTERN matvar_t *Mat_VarReadNextInfo73(mat_t *mat);
+EXTERN matvar_t *Mat_VarReadInfo73(mat_t *mat,const char *name);
+EXTERN void      Mat_FreeDir73(mat_t *mat);
 EXTERN int       Mat_VarWrite73(mat_t *mat,matvar_t *matvar,int compress);
+EXTERN int       Mat_VarWriteStructColumns73(mat_t *mat,const char *name,
+                     int ncolumns,const char * const *field_names,
+                     matvar_t * const *columns,int compress);
+EXTERN int       Mat_VarWriteCellStr73(mat_t *mat,const char *name,
+                     const mat_cellstr_t *cellstr,int compress);
 
 #endif
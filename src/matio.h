@@ -135,6 +135,8 @@ enum matio_flags {
     MAT_F_COMPLEX        = 0x0800, /**< @brief Complex bit flag */
     MAT_F_GLOBAL         = 0x0400, /**< @brief Global bit flag */
     MAT_F_LOGICAL        = 0x0200, /**< @brief Logical bit flag */
+    MAT_F_COMPLEX_INTERLEAVED = 0x0004, /**< Complex data is interleaved */
+    MAT_F_ROW_MAJOR      = 0x0002, /**< Data is in row-major (C) order */
     MAT_F_DONT_COPY_DATA = 0x0001  /**< Don't copy data, use keep the pointer */
 };
 
@@ -148,6 +150,17 @@ enum matio_compression {
     MAT_COMPRESSION_ZLIB = 1    /**< @brief zlib compression */
 };
 
+/** @brief Chunk shape of variables written to version 7.3 MAT files
+ *
+ * @ingroup MAT
+ * Chunk shape hint for Mat_VarSetChunking
+ */
+enum matio_chunking {
+    MAT_CHUNK_DEFAULT = 0, /**< @brief Chunks limited to 4096 elements */
+    MAT_CHUNK_COLUMN  = 1, /**< @brief Chunks of one or more whole columns */
+    MAT_CHUNK_TILE    = 2  /**< @brief Chunks of equal extent in each dimension */
+};
+
 /** @brief matio lookup type
  *
  * @ingroup MAT
@@ -220,6 +233,55 @@ typedef struct mat_sparse_t {
     void *data;              /**< Array of data elements */
 } mat_sparse_t;
 
+/** @brief cell array of strings stored in a string pool
+ *
+ * Contains the strings of a cell array of strings encoded as UTF-8 in one
+ * pool.  String i starts at pool+offsets[i] and is terminated by a NUL, so
+ * it is offsets[i+1]-offsets[i]-1 bytes long.
+ * @ingroup MAT
+ */
+typedef struct mat_cellstr_t {
+    int     rank;            /**< Rank of the cell array */
+    size_t *dims;            /**< Dimensions of the cell array */
+    size_t  nstrings;        /**< Number of strings, the product of dims */
+    size_t *offsets;         /**< Array of nstrings+1 offsets into pool, the
+                               *  last one being the size of pool
+                               */
+    char   *pool;            /**< UTF-8 strings in column-major order */
+    const struct mat_allocator_t *allocator; /**< Allocator of the structure,
+                                               *  dims, offsets and pool
+                                               */
+} mat_cellstr_t;
+
+/** @brief Memory allocation functions
+ *
+ * Functions the library calls instead of malloc, realloc and free (see
+ * Mat_SetAllocator).  Each function is passed @c user_data as its last
+ * argument.  The data of numeric, character and sparse variables is allocated
+ * with @c alloc_data and released with @c release_data if both are set, and
+ * with @c alloc and @c release otherwise.
+ * @ingroup MAT
+ */
+typedef struct mat_allocator_t {
+    void *(*alloc)(size_t size,void *user_data);    /**< Allocates memory */
+    void *(*resize)(void *ptr,size_t size,
+                    void *user_data);               /**< Resizes memory */
+    void  (*release)(void *ptr,void *user_data);    /**< Frees memory */
+    void *(*alloc_data)(size_t size,size_t alignment,
+                        void *user_data);           /**< Allocates the memory
+                                                      *  of data aligned to
+                                                      *  alignment bytes, or
+                                                      *  NULL
+                                                      */
+    void  (*release_data)(void *ptr,void *user_data); /**< Frees the memory
+                                                        *  of data, or NULL
+                                                        */
+    size_t data_alignment;   /**< Alignment passed to alloc_data, a power of
+                               *  two, or 0 for the default of 16 bytes
+                               */
+    void  *user_data;        /**< Argument passed to the functions */
+} mat_allocator_t;
+
 /* Library function */
 EXTERN void Mat_GetLibraryVersion(int *major,int *minor,int *release);
 
@@ -248,9 +310,19 @@ EXTERN mat_t      *Mat_CreateVer(const char *matname,const char *hdr_str,
                        enum mat_ft mat_file_ver);
 EXTERN int         Mat_Close(mat_t *mat);
 EXTERN mat_t      *Mat_Open(const char *matname,int mode);
+EXTERN mat_t      *Mat_OpenChunkCache(const char *matname,int mode,
+                       size_t nslots,size_t nbytes,double w0);
 EXTERN const char *Mat_GetFilename(mat_t *matfp);
 EXTERN enum mat_ft Mat_GetVersion(mat_t *matfp);
 EXTERN int         Mat_Rewind(mat_t *mat);
+EXTERN int         Mat_SetNumThreads(mat_t *mat,int nthreads);
+EXTERN int         Mat_SetLazyLoading(mat_t *mat,int enable,size_t max_bytes);
+EXTERN int         Mat_SetShallowInfo(mat_t *mat,int enable);
+EXTERN int         Mat_SetArenaAllocation(mat_t *mat,int enable);
+EXTERN int         Mat_SetAllocator(mat_t *mat,
+                       const mat_allocator_t *allocator);
+EXTERN int         Mat_SetAsyncWrite(mat_t *mat,int enable,size_t max_bytes);
+EXTERN int         Mat_Flush(mat_t *mat);
 
 /* MAT variable functions */
 EXTERN matvar_t  *Mat_VarCalloc(void);
@@ -262,6 +334,7 @@ EXTERN matvar_t  *Mat_VarCreateStruct(const char *name,int rank,size_t *dims,
 EXTERN int        Mat_VarDelete(mat_t *mat, const char *name);
 EXTERN matvar_t  *Mat_VarDuplicate(const matvar_t *in, int opt);
 EXTERN void       Mat_VarFree(matvar_t *matvar);
+EXTERN void       Mat_CellStrFree(mat_cellstr_t *cellstr);
 EXTERN matvar_t  *Mat_VarGetCell(matvar_t *matvar,int index);
 EXTERN matvar_t **Mat_VarGetCells(matvar_t *matvar,int *start,int *stride,
                       int *edge);
@@ -270,6 +343,9 @@ EXTERN matvar_t **Mat_VarGetCellsLinear(matvar_t *matvar,int start,int stride,
 EXTERN size_t     Mat_VarGetSize(matvar_t *matvar);
 EXTERN unsigned   Mat_VarGetNumberOfFields(matvar_t *matvar);
 EXTERN int        Mat_VarAddStructField(matvar_t *matvar,const char *fieldname);
+EXTERN int        Mat_VarGetStructColumns(matvar_t *matvar,int ncolumns,
+                      const char * const *field_names,matvar_t **columns,
+                      int nthreads);
 EXTERN char * const *Mat_VarGetStructFieldnames(const matvar_t *matvar);
 EXTERN matvar_t  *Mat_VarGetStructFieldByIndex(matvar_t *matvar,
                       size_t field_index,size_t index);
@@ -283,24 +359,47 @@ EXTERN matvar_t  *Mat_VarGetStructsLinear(matvar_t *matvar,int start,int stride,
                       int edge,int copy_fields);
 EXTERN void       Mat_VarPrint( matvar_t *matvar, int printdata );
 EXTERN matvar_t  *Mat_VarRead(mat_t *mat, const char *name );
+EXTERN mat_cellstr_t *Mat_VarReadCellStr(mat_t *mat,const char *name);
 EXTERN int        Mat_VarReadData(mat_t *mat,matvar_t *matvar,void *data,
                       int *start,int *stride,int *edge);
 EXTERN int        Mat_VarReadDataAll(mat_t *mat,matvar_t *matvar);
 EXTERN int        Mat_VarReadDataLinear(mat_t *mat,matvar_t *matvar,void *data,
                       int start,int stride,int edge);
 EXTERN matvar_t  *Mat_VarReadInfo( mat_t *mat, const char *name );
+EXTERN int        Mat_VarReadInto(mat_t *mat,const char *name,matvar_t *matvar);
 EXTERN matvar_t  *Mat_VarReadNext( mat_t *mat );
 EXTERN matvar_t  *Mat_VarReadNextInfo( mat_t *mat );
+EXTERN int        Mat_VarReadNextInto(mat_t *mat,matvar_t *matvar);
+EXTERN matvar_t  *Mat_VarReadPath(mat_t *mat,const char *path);
+EXTERN int        Mat_VarReadStructColumns(mat_t *mat,const char *name,
+                      int ncolumns,const char * const *field_names,
+                      matvar_t **columns);
 EXTERN matvar_t  *Mat_VarSetCell(matvar_t *matvar,int index,matvar_t *cell);
+EXTERN int        Mat_VarSetChunking(matvar_t *matvar,
+                      enum matio_chunking shape,size_t chunk_bytes);
+EXTERN int        Mat_VarSetDataDeallocator(matvar_t *matvar,
+                      void (*data_free)(void *data,void *context),
+                      void *context);
+EXTERN int        Mat_VarSetReadFlags(matvar_t *matvar,int opt);
+EXTERN int        Mat_VarSetScaling(matvar_t *matvar,double scale,
+                      double offset,enum matio_classes class_type);
 EXTERN matvar_t  *Mat_VarSetStructFieldByIndex(matvar_t *matvar,
                       size_t field_index,size_t index,matvar_t *field);
 EXTERN matvar_t  *Mat_VarSetStructFieldByName(matvar_t *matvar,
                       const char *field_name,size_t index,matvar_t *field);
+EXTERN int        Mat_VarUnshareData(matvar_t *matvar);
 EXTERN int        Mat_VarWrite(mat_t *mat,matvar_t *matvar,
                       enum matio_compression compress );
+EXTERN int        Mat_VarWriteCellStr(mat_t *mat,const char *name,
+                      const mat_cellstr_t *cellstr,
+                      enum matio_compression compress);
 EXTERN int        Mat_VarWriteInfo(mat_t *mat,matvar_t *matvar);
 EXTERN int        Mat_VarWriteData(mat_t *mat,matvar_t *matvar,void *data,
                       int *start,int *stride,int *edge);
+EXTERN int        Mat_VarWriteStructColumns(mat_t *mat,const char *name,
+                      int ncolumns,const char * const *field_names,
+                      matvar_t * const *columns,
+                      enum matio_compression compress);
 
 /* Other functions */
 EXTERN int       Mat_CalcSingleSubscript(int rank,int *dims,int *subs);
@@ -70,7 +70,26 @@ struct _mat_t {
     long  bof;              /**< Beginning of file not including any header */
     long  next_index;       /**< Index/File position of next variable to read */
     long  num_datasets;     /**< Number of datasets in the file */
+    char **dir;             /**< Names of the v7.3 variables, NULL if not listed */
+    int   *dir_types;       /**< HDF5 object types of the names in dir */
     hid_t refs_id;          /**< Id of the /#refs# group in HDF5 */
+    long  num_refs;         /**< Number of objects in the /#refs# group */
+    int    scaling;         /**< 1 if data being read is scaled, 0 otherwise */
+    double scale;           /**< Scale factor applied to data being read */
+    double offset;          /**< Offset added to data being read */
+    int    nthreads;        /**< Number of threads processing v7.3 chunks */
+    int    lazy;            /**< 1 if elements are read when accessed */
+    size_t lazy_max_bytes;  /**< Bound on the data of lazily read elements */
+    size_t lazy_bytes;      /**< Bytes of data of lazily read elements */
+    matvar_t *lazy_head;    /**< Least recently used lazily read element */
+    matvar_t *lazy_tail;    /**< Most recently used lazily read element */
+    matvar_t *lazy_unread;  /**< Lazily read elements without data */
+    int    shallow;         /**< 1 if only top-level information is read */
+    int    arena;           /**< 1 if variables are read into an arena */
+    const mat_allocator_t *allocator; /**< Allocator of variables read, or NULL */
+    struct mat_write_queue *async; /**< Queue of the background writer, or NULL */
+    void  *scratch;         /**< Buffer reused to read interleaved data */
+    size_t scratch_size;    /**< Size of @c scratch in bytes */
 };
 
 /** @if mat_devman
@@ -87,11 +106,75 @@ struct matvar_internal {
      mat_t    *fp;      /**< Pointer to the MAT file structure (mat_t) */
     unsigned num_fields;
     char **fieldnames;
+    unsigned *field_index; /**< Hash table of the field names, or NULL */
+    size_t field_index_size; /**< Number of slots in field_index */
+    int    name_shared; /**< 1 if name is a field name of the parent structure */
 #if defined(HAVE_ZLIB)
     z_stream *z;        /**< zlib compression state */
 #endif
+    int    read_flags;  /**< Options for the layout of the data */
+    int    scaling;     /**< 1 if scale/offset should be applied on read */
+    double scale;       /**< Scale factor applied on read */
+    double offset;      /**< Offset added on read */
+    int    chunk_shape; /**< Chunk shape hint for v7.3 writes */
+    size_t chunk_bytes; /**< Target chunk size for v7.3 writes, 0 for default */
+    int    lazy;        /**< 1 if the data is read on access, 2 once in memory */
+    matvar_t *lazy_prev; /**< Previous element in the list of mat_t */
+    matvar_t *lazy_next; /**< Next element in the list of mat_t */
+    struct mat_arena *arena; /**< Arena holding the variable, or NULL */
+    const mat_allocator_t *allocator; /**< Allocator of the variable, or NULL */
+    void (*data_free)(void *data,void *context); /**< Deallocator of the data */
+    void  *data_free_context; /**< Context passed to data_free */
+    struct mat_shared_data *shared; /**< Reference count of shared data */
+    size_t data_capacity; /**< Size of each data buffer reused by Mat_VarReadInto */
+    const void *capacity_buf; /**< Data buffer described by data_capacity */
 };
 
+/** @if mat_devman
+ * @brief Reference count of data shared by duplicated variables
+ *
+ * @ingroup mat_internal
+ * @endif
+ */
+struct mat_shared_data {
+    size_t refs; /**< Number of variables referencing the data */
+};
+
+/** @if mat_devman
+ * @brief Region of memory holding a variable tree read from a MAT file
+ *
+ * The variables, names, dimensions and data of the tree are carved out of a
+ * few large blocks, which are released together when the root variable is
+ * freed.
+ * @ingroup mat_internal
+ * @endif
+ */
+struct mat_arena {
+    const mat_allocator_t *allocator; /**< Allocator of the blocks, or NULL */
+    struct mat_arena_block *blocks; /**< Blocks, the current one first */
+    size_t    block_size;  /**< Size of the next block */
+    matvar_t *root;        /**< Variable whose Mat_VarFree releases the arena */
+    struct mat_arena_data *data; /**< Buffers allocated by the data hook */
+#if defined(HAVE_ZLIB)
+    struct mat_arena_stream *streams; /**< zlib streams ended on release */
+#endif
+};
+
+/** @if mat_devman
+ * @brief Non-zero if the complex data of @c matvar is stored interleaved
+ *
+ * Interleaved data is a single buffer of real/imaginary pairs instead of a
+ * mat_complex_split_t.  Only dense numeric variables use this layout.
+ * @ingroup mat_internal
+ * @endif
+ */
+#define MAT_IS_INTERLEAVED(matvar) ((matvar)->isComplex && \
+    ((matvar)->internal->read_flags & MAT_F_COMPLEX_INTERLEAVED))
+
+/* Number of doubles in the buffers used to interleave complex data a block
+ * at a time while it is decoded or encoded */
+#define MAT_INTERLEAVE_BLOCK 512
+
 /*    snprintf.c    */
 EXTERN int mat_snprintf(char *str,size_t count,const char *fmt,...);
 EXTERN int mat_asprintf(char **ptr,const char *format, ...);
@@ -112,6 +195,73 @@ EXTERN mat_uint32_t  Mat_uint32Swap(mat_uint32_t *a);
 EXTERN mat_int16_t   Mat_int16Swap(mat_int16_t  *a);
 EXTERN mat_uint16_t  Mat_uint16Swap(mat_uint16_t *a);
 
+/*   mat.c    */
+EXTERN void Mat_CopyStrided(void *out,size_t out_stride,const void *in,
+               size_t in_stride,size_t elem_size,size_t n);
+EXTERN void Mat_ScatterRowMajor(void *out,size_t out_stride,const void *in,
+               size_t in_stride,size_t elem_size,int rank,const size_t *dims,
+               size_t first,size_t n);
+EXTERN void Mat_GatherRowMajor(void *out,size_t out_stride,const void *in,
+               size_t in_stride,size_t elem_size,int rank,const size_t *dims,
+               size_t first,size_t n);
+EXTERN void Mat_VarSetLazy(mat_t *mat,matvar_t *matvar);
+EXTERN void Mat_VarReadLazy(matvar_t *matvar);
+EXTERN const mat_allocator_t *Mat_GetDefaultAllocator(void);
+EXTERN void *Mat_Malloc(const mat_allocator_t *allocator,size_t size);
+EXTERN void *Mat_Calloc(const mat_allocator_t *allocator,size_t nmemb,
+               size_t size);
+EXTERN void *Mat_Realloc(const mat_allocator_t *allocator,void *ptr,
+               size_t size);
+EXTERN void  Mat_Free(const mat_allocator_t *allocator,void *ptr);
+EXTERN char *Mat_Strdup(const mat_allocator_t *allocator,const char *str);
+EXTERN void *Mat_MallocData(const mat_allocator_t *allocator,size_t size);
+EXTERN void  Mat_FreeData(const mat_allocator_t *allocator,void *ptr);
+#if defined(HAVE_ZLIB)
+EXTERN void  Mat_SetStreamAllocator(z_stream *z,
+               const mat_allocator_t *allocator);
+EXTERN z_stream *Mat_InflateInit(const mat_allocator_t *allocator);
+EXTERN void  Mat_InflateEnd(const mat_allocator_t *allocator,z_stream *z);
+EXTERN z_stream *Mat_DeflateInit(const mat_allocator_t *allocator);
+EXTERN void  Mat_DeflateEnd(const mat_allocator_t *allocator,z_stream *z);
+#endif
+EXTERN struct mat_arena *Mat_ArenaCreate(const mat_allocator_t *allocator);
+EXTERN void  Mat_ArenaDestroy(struct mat_arena *arena);
+EXTERN void *Mat_VarMemAlloc(const matvar_t *matvar,size_t size);
+EXTERN void *Mat_VarMemCalloc(const matvar_t *matvar,size_t nmemb,
+               size_t size);
+EXTERN void *Mat_VarMemRealloc(const matvar_t *matvar,void *ptr,
+               size_t old_size,size_t size);
+EXTERN void  Mat_VarMemFree(const matvar_t *matvar,void *ptr);
+EXTERN char *Mat_VarMemStrdup(const matvar_t *matvar,const char *str);
+EXTERN void *Mat_VarDataAlloc(const matvar_t *matvar,size_t size);
+EXTERN void  Mat_VarDataFree(const matvar_t *matvar,void *ptr);
+#if defined(HAVE_ZLIB)
+EXTERN z_stream *Mat_VarStreamCalloc(const matvar_t *matvar);
+EXTERN z_stream *Mat_VarInflateInit(const matvar_t *matvar);
+EXTERN void  Mat_VarStreamFree(matvar_t *matvar);
+#endif
+EXTERN matvar_t *Mat_VarCallocMem(const mat_allocator_t *allocator,
+               struct mat_arena *arena);
+EXTERN matvar_t *Mat_VarCallocElement(const matvar_t *parent);
+EXTERN matvar_t *Mat_VarDuplicateInfo(const matvar_t *in);
+EXTERN matvar_t *Mat_VarCreateColumn(const char *name,const matvar_t *field,
+               size_t nmemb,size_t n);
+EXTERN size_t Mat_VarGetColumnRow(const matvar_t *column,size_t i,void *row);
+EXTERN size_t Mat_CharToUtf8(char *out,const void *in,size_t n,
+               enum matio_types data_type);
+EXTERN size_t Mat_Utf8ToUtf16(mat_uint16_t *out,const char *in,size_t len);
+EXTERN int    Mat_CellStrAppend(mat_cellstr_t *cellstr,size_t i,
+               size_t *pool_size,const void *data,size_t n,
+               enum matio_types data_type);
+EXTERN const char *Mat_CellStrGet(const mat_cellstr_t *cellstr,size_t i,
+               size_t *len);
+
+/* matvar_struct.c */
+EXTERN int  Mat_VarIndexStructFields(matvar_t *matvar);
+EXTERN int  Mat_VarGetStructFieldIndex(const matvar_t *matvar,const char *name,
+               size_t len);
+EXTERN void Mat_VarShareName(matvar_t *matvar,char *name);
+
 /* read_data.c */
 EXTERN int ReadDoubleData(mat_t *mat,double  *data,enum matio_types data_type,
                int len);
@@ -32,7 +32,8 @@
 /** @brief Returns a pointer to the Cell array at a specific index
  *
  * Returns a pointer to the Cell Array Field at the given 1-relative index.
- * MAT file must be a version 5 matlab file.
+ * MAT file must be a version 5 matlab file.  The data of a cell left unread
+ * by lazy loading (see Mat_SetLazyLoading) is read first.
  * @ingroup MAT
  * @param matvar Pointer to the Cell Array MAT variable
  * @param index linear index of cell to return
@@ -50,8 +51,10 @@ Mat_VarGetCell(matvar_t *matvar,int index)
     for ( i = 0; i < matvar->rank; i++ )
         nmemb *= matvar->dims[i];
 
-    if ( index < nmemb )
+    if ( index < nmemb ) {
         cell = *((matvar_t **)matvar->data + index);
+        Mat_VarReadLazy(cell);
+    }
 
     return cell;
 }
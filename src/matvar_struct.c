@@ -29,6 +29,153 @@
 #include <string.h>
 #include "matio_private.h"
 
+/** @if mat_devman
+ * @brief Hashes the first @c len characters of a field name (FNV-1a)
+ *
+ * @ingroup mat_internal
+ * @param name Field name
+ * @param len Number of characters of @c name to hash
+ * @return Hash of the field name
+ * @endif
+ */
+static size_t
+FieldNameHash(const char *name,size_t len)
+{
+    size_t i, hash = 2166136261UL;
+
+    for ( i = 0; i < len; i++ ) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+/** @if mat_devman
+ * @brief Builds the hash table of the field names of a structure
+ *
+ * The table uses open addressing with linear probing.  Each slot holds the
+ * 1-relative index of a field, or 0 if the slot is free.  Fields are inserted
+ * in order so that the first of several fields with the same name is found.
+ * The table is built whenever the field names of a structure are set, so
+ * lookups only read it and may run concurrently.
+ * @ingroup mat_internal
+ * @param matvar Pointer to the structure MAT variable
+ * @retval 0 on success
+ * @endif
+ */
+int
+Mat_VarIndexStructFields(matvar_t *matvar)
+{
+    struct matvar_internal *internal = matvar->internal;
+    size_t i, slot, size = 8;
+
+    while ( size < 2*internal->num_fields )
+        size *= 2;
+
+    Mat_VarMemFree(matvar,internal->field_index);
+    internal->field_index = NULL;
+    internal->field_index_size = 0;
+    if ( NULL == internal->fieldnames || internal->num_fields < 1 )
+        return 0;
+    internal->field_index =
+        Mat_VarMemCalloc(matvar,size,sizeof(*internal->field_index));
+    if ( NULL == internal->field_index )
+        return 1;
+    internal->field_index_size = size;
+
+    for ( i = 0; i < internal->num_fields; i++ ) {
+        const char *fieldname = internal->fieldnames[i];
+        if ( NULL == fieldname )
+            continue;
+        slot = FieldNameHash(fieldname,strlen(fieldname)) & (size-1);
+        while ( internal->field_index[slot] )
+            slot = (slot+1) & (size-1);
+        internal->field_index[slot] = i+1;
+    }
+    return 0;
+}
+
+/** @if mat_devman
+ * @brief Finds the index of a field of a structure by the field's name
+ *
+ * Uses the hash table of the field names built by Mat_VarIndexStructFields,
+ * or compares @c name with every field name if there is no table.
+ * @ingroup mat_internal
+ * @param matvar Pointer to the structure MAT variable
+ * @param name Name of the field, which need not be nul-terminated
+ * @param len Length of @c name
+ * @return 0-relative index of the field, or -1 if there is no such field
+ * @endif
+ */
+int
+Mat_VarGetStructFieldIndex(const matvar_t *matvar,const char *name,size_t len)
+{
+    const struct matvar_internal *internal = matvar->internal;
+    size_t i, slot, mask;
+
+    if ( NULL == internal->fieldnames || internal->num_fields < 1 )
+        return -1;
+
+    if ( NULL == internal->field_index ) {
+        for ( i = 0; i < internal->num_fields; i++ ) {
+            const char *fieldname = internal->fieldnames[i];
+            if ( NULL != fieldname && !strncmp(fieldname,name,len) &&
+                 '\0' == fieldname[len] )
+                return i;
+        }
+        return -1;
+    }
+
+    mask = internal->field_index_size-1;
+    slot = FieldNameHash(name,len) & mask;
+    while ( internal->field_index[slot] ) {
+        const char *fieldname =
+            internal->fieldnames[internal->field_index[slot]-1];
+        if ( !strncmp(fieldname,name,len) && '\0' == fieldname[len] )
+            return internal->field_index[slot]-1;
+        slot = (slot+1) & mask;
+    }
+    return -1;
+}
+
+/** @if mat_devman
+ * @brief Sets the name of a structure field to a field name of its parent
+ *
+ * The name is shared with the fieldnames of the parent structure instead of
+ * copied, so it is not freed with the field.
+ * @ingroup mat_internal
+ * @param matvar Pointer to the structure field
+ * @param name Field name of the parent structure
+ * @endif
+ */
+void
+Mat_VarShareName(matvar_t *matvar,char *name)
+{
+    if ( NULL == matvar )
+        return;
+    if ( !matvar->internal->name_shared && NULL != matvar->name )
+        Mat_VarMemFree(matvar,matvar->name);
+    matvar->name = name;
+    matvar->internal->name_shared = 1;
+}
+
+/** @if mat_devman
+ * @brief Gives a field removed from a structure its own copy of its name
+ *
+ * @ingroup mat_internal
+ * @param matvar Pointer to the former structure field
+ * @endif
+ */
+static void
+UnshareName(matvar_t *matvar)
+{
+    if ( NULL != matvar && matvar->internal->name_shared ) {
+        matvar->internal->name_shared = 0;
+        if ( NULL != matvar->name )
+            matvar->name = Mat_VarMemStrdup(matvar,matvar->name);
+    }
+}
+
 /** @brief Creates a structure MATLAB variable with the given name and fields
  *
  * @ingroup MAT
@@ -57,9 +204,9 @@ Mat_VarCreateStruct(const char *name,int rank,size_t *dims,const char **fields,
 
     matvar->compression = MAT_COMPRESSION_NONE;
     if ( NULL != name )
-        matvar->name = strdup(name);
+        matvar->name = Mat_VarMemStrdup(matvar,name);
     matvar->rank = rank;
-    matvar->dims = malloc(matvar->rank*sizeof(*matvar->dims));
+    matvar->dims = Mat_VarMemAlloc(matvar,matvar->rank*sizeof(*matvar->dims));
     for ( i = 0; i < matvar->rank; i++ ) {
         matvar->dims[i] = dims[i];
         nmemb *= dims[i];
@@ -72,7 +219,7 @@ Mat_VarCreateStruct(const char *name,int rank,size_t *dims,const char **fields,
     if ( nfields ) {
         matvar->internal->num_fields = nfields;
         matvar->internal->fieldnames =
-            malloc(nfields*sizeof(*matvar->internal->fieldnames));
+            Mat_VarMemAlloc(matvar,nfields*sizeof(*matvar->internal->fieldnames));
         if ( NULL == matvar->internal->fieldnames ) {
             Mat_VarFree(matvar);
             matvar = NULL;
@@ -83,14 +230,17 @@ Mat_VarCreateStruct(const char *name,int rank,size_t *dims,const char **fields,
                     matvar = NULL;
                     break;
                 } else {
-                    matvar->internal->fieldnames[i] = strdup(fields[i]);
+                    matvar->internal->fieldnames[i] =
+                        Mat_VarMemStrdup(matvar,fields[i]);
                 }
             }
         }
+        if ( NULL != matvar )
+            Mat_VarIndexStructFields(matvar);
         if ( NULL != matvar && nmemb > 0 && nfields > 0 ) {
             matvar_t **field_vars;
             matvar->nbytes = nmemb*nfields*matvar->data_size;
-            matvar->data = malloc(matvar->nbytes);
+            matvar->data = Mat_VarMemAlloc(matvar,matvar->nbytes);
             field_vars = (matvar_t**)matvar->data;
             for ( i = 0; i < nfields*nmemb; i++ )
                 field_vars[i] = NULL;
@@ -125,11 +275,13 @@ Mat_VarAddStructField(matvar_t *matvar,const char *fieldname)
     nfields = matvar->internal->num_fields+1;
     matvar->internal->num_fields = nfields;
     matvar->internal->fieldnames =
-    realloc(matvar->internal->fieldnames,
-            nfields*sizeof(*matvar->internal->fieldnames));
-    matvar->internal->fieldnames[nfields-1] = strdup(fieldname);
+    Mat_VarMemRealloc(matvar,matvar->internal->fieldnames,
+                      (nfields-1)*sizeof(*matvar->internal->fieldnames),
+                      nfields*sizeof(*matvar->internal->fieldnames));
+    matvar->internal->fieldnames[nfields-1] = Mat_VarMemStrdup(matvar,fieldname);
+    Mat_VarIndexStructFields(matvar);
 
-    new_data = malloc(nfields*nmemb*sizeof(*new_data));
+    new_data = Mat_VarMemAlloc(matvar,nfields*nmemb*sizeof(*new_data));
     if ( new_data == NULL )
         return -1;
 
@@ -140,7 +292,7 @@ Mat_VarAddStructField(matvar_t *matvar,const char *fieldname)
         new_data[cnt++] = NULL;
     }
 
-    free(matvar->data);
+    Mat_VarMemFree(matvar,matvar->data);
     matvar->data = new_data;
     matvar->nbytes = nfields*nmemb*sizeof(*new_data);
 
@@ -189,6 +341,8 @@ Mat_VarGetStructFieldnames(const matvar_t *matvar)
 /** @brief Finds a field of a structure by the field's index
  *
  * Returns a pointer to the structure field at the given 0-relative index.
+ * The data of a field left unread by lazy loading (see Mat_SetLazyLoading)
+ * is read first.
  * @ingroup MAT
  * @param matvar Pointer to the Structure MAT variable
  * @param field_index 0-relative index of the field.
@@ -219,6 +373,7 @@ Mat_VarGetStructFieldByIndex(matvar_t *matvar,size_t field_index,size_t index)
             Mat_Critical("Mat_VarGetStructField: field index out of bounds");
         } else {
             field = *((matvar_t **)matvar->data+index*nfields+field_index);
+            Mat_VarReadLazy(field);
         }
     }
 
@@ -228,6 +383,8 @@ Mat_VarGetStructFieldByIndex(matvar_t *matvar,size_t field_index,size_t index)
 /** @brief Finds a field of a structure by the field's name
  *
  * Returns a pointer to the structure field at the given 0-relative index.
+ * The data of a field left unread by lazy loading (see Mat_SetLazyLoading)
+ * is read first.
  * @ingroup MAT
  * @param matvar Pointer to the Structure MAT variable
  * @param name Name of the structure field
@@ -251,18 +408,14 @@ Mat_VarGetStructFieldByName(matvar_t *matvar,const char *field_name,
         nmemb *= matvar->dims[i];
 
     nfields = matvar->internal->num_fields;
-    field_index = -1;
-    for ( i = 0; i < nfields; i++ ) {
-        if ( !strcmp(matvar->internal->fieldnames[i],field_name) ) {
-            field_index = i;
-            break;
-        }
-    }
+    field_index = Mat_VarGetStructFieldIndex(matvar,field_name,
+                                             strlen(field_name));
 
     if ( index >= nmemb ) {
         Mat_Critical("Mat_VarGetStructField: structure index out of bounds");
     } else if ( field_index >= 0 ) {
         field = *((matvar_t **)matvar->data+index*nfields+field_index);
+        Mat_VarReadLazy(field);
     }
 
     return field;
@@ -316,7 +469,10 @@ Mat_VarGetStructField(matvar_t *matvar,void *name_or_index,int opt,int index)
  * copy_fields is non-zero, the indexed structures are copied and should be
  * freed, but if copy_fields is zero, the indexed structures are pointers to
  * the original, but should still be freed. The structures have a flag set
- * so that the structure fields are not freed.
+ * so that the structure fields are not freed.  The copied fields share their
+ * data with the original fields as described for Mat_VarDuplicate, so that
+ * indexing a large structure array does not copy its data; call
+ * Mat_VarUnshareData before modifying it.
  *
  * Note that this function is limited to structure arrays with a rank less than
  * 10.
@@ -347,9 +503,10 @@ Mat_VarGetStructs(matvar_t *matvar,int *start,int *stride,int *edge,
         return NULL;
     }
 
-    struct_slab = Mat_VarDuplicate(matvar,0);
-    if ( !copy_fields )
-        struct_slab->mem_conserve = 1;
+    struct_slab = Mat_VarDuplicateInfo(matvar);
+    if ( NULL == struct_slab )
+        return NULL;
+    struct_slab->mem_conserve = copy_fields ? 0 : 1;
 
     nfields = matvar->internal->num_fields;
 
@@ -367,7 +524,7 @@ Mat_VarGetStructs(matvar_t *matvar,int *start,int *stride,int *edge,
     }
     I *= nfields;
     struct_slab->nbytes    = N*nfields*sizeof(matvar_t *);
-    struct_slab->data = malloc(struct_slab->nbytes);
+    struct_slab->data = Mat_VarMemAlloc(struct_slab,struct_slab->nbytes);
     if ( struct_slab->data == NULL ) {
         Mat_VarFree(struct_slab);
         return NULL;
@@ -378,7 +535,7 @@ Mat_VarGetStructs(matvar_t *matvar,int *start,int *stride,int *edge,
             for ( field = 0; field < nfields; field++ ) {
                 if ( copy_fields )
                     fields[(i+j)*nfields+field] =
-                         Mat_VarDuplicate(*((matvar_t **)matvar->data + I),1);
+                         Mat_VarDuplicate(*((matvar_t **)matvar->data + I),0);
                 else
                     fields[(i+j)*nfields+field] =
                         *((matvar_t **)matvar->data + I);
@@ -412,7 +569,8 @@ Mat_VarGetStructs(matvar_t *matvar,int *start,int *stride,int *edge,
  * copy_fields is non-zero, the indexed structures are copied and should be
  * freed, but if copy_fields is zero, the indexed structures are pointers to
  * the original, but should still be freed since the mem_conserve flag is set
- * so that the structures are not freed.
+ * so that the structures are not freed.  The copied fields share their data
+ * with the original fields as described for Mat_VarDuplicate.
  * MAT File version must be 5.
  * @ingroup MAT
  * @param matvar Structure matlab variable
@@ -434,14 +592,15 @@ Mat_VarGetStructsLinear(matvar_t *matvar,int start,int stride,int edge,
        struct_slab = NULL;
     } else {
 
-        struct_slab = Mat_VarDuplicate(matvar,0);
-        if ( !copy_fields )
-            struct_slab->mem_conserve = 1;
+        struct_slab = Mat_VarDuplicateInfo(matvar);
+        if ( NULL == struct_slab )
+            return NULL;
+        struct_slab->mem_conserve = copy_fields ? 0 : 1;
 
         nfields = matvar->internal->num_fields;
 
         struct_slab->nbytes = edge*nfields*sizeof(matvar_t *);
-        struct_slab->data = malloc(struct_slab->nbytes);
+        struct_slab->data = Mat_VarMemAlloc(struct_slab,struct_slab->nbytes);
         struct_slab->dims[0] = edge;
         struct_slab->dims[1] = 1;
         fields = struct_slab->data;
@@ -450,7 +609,7 @@ Mat_VarGetStructsLinear(matvar_t *matvar,int start,int stride,int edge,
             if ( copy_fields ) {
                 for ( field = 0; field < nfields; field++ ) {
                     fields[i*nfields+field] =
-                        Mat_VarDuplicate(*((matvar_t **)matvar->data+I),1);
+                        Mat_VarDuplicate(*((matvar_t **)matvar->data+I),0);
                     I++;
                 }
             } else {
@@ -498,11 +657,9 @@ Mat_VarSetStructFieldByIndex(matvar_t *matvar,size_t field_index,size_t index,
     if ( index < nmemb && field_index < nfields ) {
         matvar_t **fields = matvar->data;
         old_field = fields[index*nfields+field_index];
+        UnshareName(old_field);
         fields[index*nfields+field_index] = field;
-        if ( NULL != field->name ) {
-            free(field->name);
-        }
-        field->name = strdup(matvar->internal->fieldnames[field_index]);
+        Mat_VarShareName(field,matvar->internal->fieldnames[field_index]);
     }
 
     return old_field;
@@ -536,22 +693,15 @@ Mat_VarSetStructFieldByName(matvar_t *matvar,const char *field_name,
         nmemb *= matvar->dims[i];
 
     nfields = matvar->internal->num_fields;
-    field_index = -1;
-    for ( i = 0; i < nfields; i++ ) {
-        if ( !strcmp(matvar->internal->fieldnames[i],field_name) ) {
-            field_index = i;
-            break;
-        }
-    }
+    field_index = Mat_VarGetStructFieldIndex(matvar,field_name,
+                                             strlen(field_name));
 
     if ( index < nmemb && field_index >= 0 ) {
         matvar_t **fields = matvar->data;
         old_field = fields[index*nfields+field_index];
+        UnshareName(old_field);
         fields[index*nfields+field_index] = field;
-        if ( NULL != field->name ) {
-            free(field->name);
-        }
-        field->name = strdup(matvar->internal->fieldnames[field_index]);
+        Mat_VarShareName(field,matvar->internal->fieldnames[field_index]);
     }
 
     return old_field;
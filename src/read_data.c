@@ -49,10 +49,16 @@
 
 /** @cond mat_devman */
 
+/* Applies the scale and offset requested with Mat_VarSetScaling to a value
+ * converted by the double and single-precision readers
+ */
+#define MAT_SCALE(mat,x) ((mat)->scaling ? (x)*(mat)->scale+(mat)->offset : (x))
+
 /** @brief Reads data of type @c data_type into a double type
  *
  * Reads from the MAT file @c len elements of data type @c data_type storing
- * them as double's in @c data.
+ * them as double's in @c data.  If a scale and offset are active on @c mat,
+ * they are applied to each element as it is converted.
  * @ingroup mat_internal
  * @param mat MAT file pointer
  * @param data Pointer to store the output double values (len*sizeof(double))
@@ -76,10 +82,14 @@ ReadDoubleData(mat_t *mat,double *data,enum matio_types data_type,int len)
             if ( mat->byteswap ) {
                 bytesread += fread(data,data_size,len,mat->fp);
                 for ( i = 0; i < len; i++ ) {
-                    (void)Mat_doubleSwap(data+i);
+                    data[i] = MAT_SCALE(mat,Mat_doubleSwap(data+i));
                 }
             } else {
                 bytesread += fread(data,data_size,len,mat->fp);
+                if ( mat->scaling ) {
+                    for ( i = 0; i < len; i++ )
+                        data[i] = data[i]*mat->scale+mat->offset;
+                }
             }
             break;
         }
@@ -91,12 +101,12 @@ ReadDoubleData(mat_t *mat,double *data,enum matio_types data_type,int len)
             if ( mat->byteswap ) {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&f,data_size,1,mat->fp);
-                    data[i] = Mat_floatSwap(&f);
+                    data[i] = MAT_SCALE(mat,Mat_floatSwap(&f));
                 }
             } else {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&f,data_size,1,mat->fp);
-                    data[i] = f;
+                    data[i] = MAT_SCALE(mat,f);
                 }
             }
             break;
@@ -109,12 +119,12 @@ ReadDoubleData(mat_t *mat,double *data,enum matio_types data_type,int len)
             if ( mat->byteswap ) {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&i32,data_size,1,mat->fp);
-                    data[i] = Mat_int32Swap(&i32);
+                    data[i] = MAT_SCALE(mat,Mat_int32Swap(&i32));
                 }
             } else {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&i32,data_size,1,mat->fp);
-                    data[i] = i32;
+                    data[i] = MAT_SCALE(mat,i32);
                 }
             }
             break;
@@ -127,12 +137,12 @@ ReadDoubleData(mat_t *mat,double *data,enum matio_types data_type,int len)
             if ( mat->byteswap ) {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&ui32,data_size,1,mat->fp);
-                    data[i] = Mat_uint32Swap(&ui32);
+                    data[i] = MAT_SCALE(mat,Mat_uint32Swap(&ui32));
                 }
             } else {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&ui32,data_size,1,mat->fp);
-                    data[i] = ui32;
+                    data[i] = MAT_SCALE(mat,ui32);
                 }
             }
             break;
@@ -145,12 +155,12 @@ ReadDoubleData(mat_t *mat,double *data,enum matio_types data_type,int len)
             if ( mat->byteswap ) {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&i16,data_size,1,mat->fp);
-                    data[i] = Mat_int16Swap(&i16);
+                    data[i] = MAT_SCALE(mat,Mat_int16Swap(&i16));
                 }
             } else {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&i16,data_size,1,mat->fp);
-                    data[i] = i16;
+                    data[i] = MAT_SCALE(mat,i16);
                 }
             }
             break;
@@ -163,12 +173,12 @@ ReadDoubleData(mat_t *mat,double *data,enum matio_types data_type,int len)
             if ( mat->byteswap ) {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&ui16,data_size,1,mat->fp);
-                    data[i] = Mat_uint16Swap(&ui16);
+                    data[i] = MAT_SCALE(mat,Mat_uint16Swap(&ui16));
                 }
             } else {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&ui16,data_size,1,mat->fp);
-                    data[i] = ui16;
+                    data[i] = MAT_SCALE(mat,ui16);
                 }
             }
             break;
@@ -181,12 +191,12 @@ ReadDoubleData(mat_t *mat,double *data,enum matio_types data_type,int len)
             if ( mat->byteswap ) {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&i8,data_size,1,mat->fp);
-                    data[i] = i8;
+                    data[i] = MAT_SCALE(mat,i8);
                 }
             } else {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&i8,data_size,1,mat->fp);
-                    data[i] = i8;
+                    data[i] = MAT_SCALE(mat,i8);
                 }
             }
             break;
@@ -199,12 +209,12 @@ ReadDoubleData(mat_t *mat,double *data,enum matio_types data_type,int len)
             if ( mat->byteswap ) {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&ui8,data_size,1,mat->fp);
-                    data[i] = ui8;
+                    data[i] = MAT_SCALE(mat,ui8);
                 }
             } else {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&ui8,data_size,1,mat->fp);
-                    data[i] = ui8;
+                    data[i] = MAT_SCALE(mat,ui8);
                 }
             }
             break;
@@ -220,7 +230,8 @@ ReadDoubleData(mat_t *mat,double *data,enum matio_types data_type,int len)
 /** @brief Reads data of type @c data_type into a double type
  *
  * Reads from the MAT file @c len compressed elements of data type @c data_type
- * storing them as double's in @c data.
+ * storing them as double's in @c data.  If a scale and offset are active on
+ * @c mat, they are applied to each element as it is converted.
  * @ingroup mat_internal
  * @param mat MAT file pointer
  * @param z Pointer to the zlib stream for inflation
@@ -258,9 +269,13 @@ ReadCompressedDoubleData(mat_t *mat,z_stream *z,double *data,
             if ( mat->byteswap ) {
                 InflateData(mat,z,data,len*data_size);
                 for ( i = 0; i < len; i++ )
-                    (void)Mat_doubleSwap(data+i);
+                    data[i] = MAT_SCALE(mat,Mat_doubleSwap(data+i));
             } else {
                 InflateData(mat,z,data,len*data_size);
+                if ( mat->scaling ) {
+                    for ( i = 0; i < len; i++ )
+                        data[i] = data[i]*mat->scale+mat->offset;
+                }
             }
             break;
         }
@@ -271,37 +286,37 @@ ReadCompressedDoubleData(mat_t *mat,z_stream *z,double *data,
                 if ( len <= 256 ){
                     InflateData(mat,z,buf.i32,len*data_size);
                     for ( i = 0; i < len; i++ )
-                        data[i] = Mat_int32Swap(buf.i32+i);
+                        data[i] = MAT_SCALE(mat,Mat_int32Swap(buf.i32+i));
                 } else {
                     int j;
                     len -= 256;
                     for ( i = 0; i < len; i+=256 ) {
                         InflateData(mat,z,buf.i32,256*data_size);
                         for ( j = 0; j < 256; j++ )
-                            data[i+j] = Mat_int32Swap(buf.i32+j);
+                            data[i+j] = MAT_SCALE(mat,Mat_int32Swap(buf.i32+j));
                     }
                     len = len-(i-256);
                     InflateData(mat,z,buf.i32,len*data_size);
                     for ( j = 0; j < len; j++ )
-                        data[i+j] = Mat_int32Swap(buf.i32+j);
+                        data[i+j] = MAT_SCALE(mat,Mat_int32Swap(buf.i32+j));
                 }
             } else {
                 if ( len <= 256 ){
                     InflateData(mat,z,buf.i32,len*data_size);
                     for ( i = 0; i < len; i++ )
-                        data[i] = buf.i32[i];
+                        data[i] = MAT_SCALE(mat,buf.i32[i]);
                 } else {
                     int j;
                     len -= 256;
                     for ( i = 0; i < len; i+=256 ) {
                         InflateData(mat,z,buf.i32,256*data_size);
                         for ( j = 0; j < 256; j++ )
-                            data[i+j] = buf.i32[j];
+                            data[i+j] = MAT_SCALE(mat,buf.i32[j]);
                     }
                     len = len-(i-256);
                     InflateData(mat,z,buf.i32,len*data_size);
                     for ( j = 0; j < len; j++ )
-                        data[i+j] = buf.i32[j];
+                        data[i+j] = MAT_SCALE(mat,buf.i32[j]);
                 }
             }
             break;
@@ -313,37 +328,37 @@ ReadCompressedDoubleData(mat_t *mat,z_stream *z,double *data,
                 if ( len <= 256 ){
                     InflateData(mat,z,buf.ui32,len*data_size);
                     for ( i = 0; i < len; i++ )
-                        data[i] = Mat_uint32Swap(buf.ui32+i);
+                        data[i] = MAT_SCALE(mat,Mat_uint32Swap(buf.ui32+i));
                 } else {
                     int j;
                     len -= 256;
                     for ( i = 0; i < len; i+=256 ) {
                         InflateData(mat,z,buf.ui32,256*data_size);
                         for ( j = 0; j < 256; j++ )
-                            data[i+j] = Mat_uint32Swap(buf.ui32+j);
+                            data[i+j] = MAT_SCALE(mat,Mat_uint32Swap(buf.ui32+j));
                     }
                     len = len-(i-256);
                     InflateData(mat,z,buf.ui32,len*data_size);
                     for ( j = 0; j < len; j++ )
-                        data[i+j] = Mat_uint32Swap(buf.ui32+j);
+                        data[i+j] = MAT_SCALE(mat,Mat_uint32Swap(buf.ui32+j));
                 }
             } else {
                 if ( len <= 256 ) {
                     InflateData(mat,z,buf.ui32,len*data_size);
                     for ( i = 0; i < len; i++ )
-                        data[i] = buf.ui32[i];
+                        data[i] = MAT_SCALE(mat,buf.ui32[i]);
                 } else {
                     int j;
                     len -= 256;
                     for ( i = 0; i < len; i+=256 ) {
                         InflateData(mat,z,buf.ui32,256*data_size);
                         for ( j = 0; j < 256; j++ )
-                            data[i+j] = buf.ui32[j];
+                            data[i+j] = MAT_SCALE(mat,buf.ui32[j]);
                     }
                     len = len-(i-256);
                     InflateData(mat,z,buf.ui32,len*data_size);
                     for ( j = 0; j < len; j++ )
-                        data[i+j] = buf.ui32[j];
+                        data[i+j] = MAT_SCALE(mat,buf.ui32[j]);
                 }
             }
             break;
@@ -355,37 +370,37 @@ ReadCompressedDoubleData(mat_t *mat,z_stream *z,double *data,
                 if ( len <= 512 ){
                     InflateData(mat,z,buf.i16,len*data_size);
                     for ( i = 0; i < len; i++ )
-                        data[i] = Mat_int16Swap(buf.i16+i);
+                        data[i] = MAT_SCALE(mat,Mat_int16Swap(buf.i16+i));
                 } else {
                     int j;
                     len -= 512;
                     for ( i = 0; i < len; i+=512 ) {
                         InflateData(mat,z,buf.i16,512*data_size);
                         for ( j = 0; j < 512; j++ )
-                            data[i+j] = Mat_int16Swap(buf.i16+j);
+                            data[i+j] = MAT_SCALE(mat,Mat_int16Swap(buf.i16+j));
                     }
                     len = len-(i-512);
                     InflateData(mat,z,buf.i16,len*data_size);
                     for ( j = 0; j < len; j++ )
-                        data[i+j] = Mat_int16Swap(buf.i16+j);
+                        data[i+j] = MAT_SCALE(mat,Mat_int16Swap(buf.i16+j));
                 }
             } else {
                 if ( len <= 512 ) {
                     InflateData(mat,z,buf.i16,len*data_size);
                     for ( i = 0; i < len; i++ )
-                        data[i] = buf.i16[i];
+                        data[i] = MAT_SCALE(mat,buf.i16[i]);
                 } else {
                     int j;
                     len -= 512;
                     for ( i = 0; i < len; i+=512 ) {
                         InflateData(mat,z,buf.i16,512*data_size);
                         for ( j = 0; j < 512; j++ )
-                            data[i+j] = buf.i16[j];
+                            data[i+j] = MAT_SCALE(mat,buf.i16[j]);
                     }
                     len = len-(i-512);
                     InflateData(mat,z,buf.i16,len*data_size);
                     for ( j = 0; j < len; j++ )
-                        data[i+j] = buf.i16[j];
+                        data[i+j] = MAT_SCALE(mat,buf.i16[j]);
                 }
             }
             break;
@@ -397,37 +412,37 @@ ReadCompressedDoubleData(mat_t *mat,z_stream *z,double *data,
                 if ( len <= 512 ){
                     InflateData(mat,z,buf.ui16,len*data_size);
                     for ( i = 0; i < len; i++ )
-                        data[i] = Mat_uint16Swap(buf.ui16+i);
+                        data[i] = MAT_SCALE(mat,Mat_uint16Swap(buf.ui16+i));
                 } else {
                     int j;
                     len -= 512;
                     for ( i = 0; i < len; i+=512 ) {
                         InflateData(mat,z,buf.ui16,512*data_size);
                         for ( j = 0; j < 512; j++ )
-                            data[i+j] = Mat_uint16Swap(buf.ui16+j);
+                            data[i+j] = MAT_SCALE(mat,Mat_uint16Swap(buf.ui16+j));
                     }
                     len = len-(i-512);
                     InflateData(mat,z,buf.ui16,len*data_size);
                     for ( j = 0; j < len; j++ )
-                        data[i+j] = Mat_uint16Swap(buf.ui16+j);
+                        data[i+j] = MAT_SCALE(mat,Mat_uint16Swap(buf.ui16+j));
                 }
             } else {
                 if ( len <= 512 ) {
                     InflateData(mat,z,buf.ui16,len*data_size);
                     for ( i = 0; i < len; i++ )
-                        data[i] = buf.ui16[i];
+                        data[i] = MAT_SCALE(mat,buf.ui16[i]);
                 } else {
                     int j;
                     len -= 512;
                     for ( i = 0; i < len; i+=512 ) {
                         InflateData(mat,z,buf.ui16,512*data_size);
                         for ( j = 0; j < 512; j++ )
-                            data[i+j] = buf.ui16[j];
+                            data[i+j] = MAT_SCALE(mat,buf.ui16[j]);
                     }
                     len = len-(i-512);
                     InflateData(mat,z,buf.ui16,len*data_size);
                     for ( j = 0; j < len; j++ )
-                        data[i+j] = buf.ui16[j];
+                        data[i+j] = MAT_SCALE(mat,buf.ui16[j]);
                 }
             }
             break;
@@ -438,19 +453,19 @@ ReadCompressedDoubleData(mat_t *mat,z_stream *z,double *data,
             if ( len <= 1024 ) {
                 InflateData(mat,z,buf.ui8,len*data_size);
                 for ( i = 0; i < len; i++ )
-                    data[i] = buf.ui8[i];
+                    data[i] = MAT_SCALE(mat,buf.ui8[i]);
             } else {
                 int j;
                 len -= 1024;
                 for ( i = 0; i < len; i+=1024 ) {
                     InflateData(mat,z,buf.ui8,1024*data_size);
                     for ( j = 0; j < 1024; j++ )
-                        data[i+j] = buf.ui8[j];
+                        data[i+j] = MAT_SCALE(mat,buf.ui8[j]);
                 }
                 len = len-(i-1024);
                 InflateData(mat,z,buf.ui8,len*data_size);
                 for ( j = 0; j < len; j++ )
-                    data[i+j] = buf.ui8[j];
+                    data[i+j] = MAT_SCALE(mat,buf.ui8[j]);
             }
             break;
         }
@@ -460,19 +475,19 @@ ReadCompressedDoubleData(mat_t *mat,z_stream *z,double *data,
             if ( len <= 1024 ) {
                 InflateData(mat,z,buf.i8,len*data_size);
                 for ( i = 0; i < len; i++ )
-                    data[i] = buf.i8[i];
+                    data[i] = MAT_SCALE(mat,buf.i8[i]);
             } else {
                 int j;
                 len -= 1024;
                 for ( i = 0; i < len; i+=1024 ) {
                     InflateData(mat,z,buf.i8,1024*data_size);
                     for ( j = 0; j < 1024; j++ )
-                        data[i+j] = buf.i8[j];
+                        data[i+j] = MAT_SCALE(mat,buf.i8[j]);
                 }
                 len = len-(i-1024);
                 InflateData(mat,z,buf.i8,len*data_size);
                 for ( j = 0; j < len; j++ )
-                    data[i+j] = buf.i8[j];
+                    data[i+j] = MAT_SCALE(mat,buf.i8[j]);
             }
             break;
         }
@@ -487,7 +502,8 @@ ReadCompressedDoubleData(mat_t *mat,z_stream *z,double *data,
 /** @brief Reads data of type @c data_type into a float type
  *
  * Reads from the MAT file @c len elements of data type @c data_type storing
- * them as float's in @c data.
+ * them as float's in @c data.  If a scale and offset are active on @c mat,
+ * they are applied to each element as it is converted.
  * @ingroup mat_internal
  * @param mat MAT file pointer
  * @param data Pointer to store the output float values (len*sizeof(float))
@@ -513,12 +529,12 @@ ReadSingleData(mat_t *mat,float *data,enum matio_types data_type,int len)
             if ( mat->byteswap ) {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&d,data_size,1,mat->fp);
-                    data[i] = Mat_doubleSwap(&d);
+                    data[i] = MAT_SCALE(mat,Mat_doubleSwap(&d));
                 }
             } else {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&d,data_size,1,mat->fp);
-                    data[i] = d;
+                    data[i] = MAT_SCALE(mat,d);
                 }
             }
             break;
@@ -531,12 +547,12 @@ ReadSingleData(mat_t *mat,float *data,enum matio_types data_type,int len)
             if ( mat->byteswap ) {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&f,data_size,1,mat->fp);
-                    data[i] = Mat_floatSwap(&f);
+                    data[i] = MAT_SCALE(mat,Mat_floatSwap(&f));
                 }
             } else {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&f,data_size,1,mat->fp);
-                    data[i] = f;
+                    data[i] = MAT_SCALE(mat,f);
                 }
             }
             break;
@@ -549,12 +565,12 @@ ReadSingleData(mat_t *mat,float *data,enum matio_types data_type,int len)
             if ( mat->byteswap ) {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&i32,data_size,1,mat->fp);
-                    data[i] = Mat_int32Swap(&i32);
+                    data[i] = MAT_SCALE(mat,Mat_int32Swap(&i32));
                 }
             } else {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&i32,data_size,1,mat->fp);
-                    data[i] = i32;
+                    data[i] = MAT_SCALE(mat,i32);
                 }
             }
             break;
@@ -567,12 +583,12 @@ ReadSingleData(mat_t *mat,float *data,enum matio_types data_type,int len)
             if ( mat->byteswap ) {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&ui32,data_size,1,mat->fp);
-                    data[i] = Mat_uint32Swap(&ui32);
+                    data[i] = MAT_SCALE(mat,Mat_uint32Swap(&ui32));
                 }
             } else {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&ui32,data_size,1,mat->fp);
-                    data[i] = ui32;
+                    data[i] = MAT_SCALE(mat,ui32);
                 }
             }
             break;
@@ -585,12 +601,12 @@ ReadSingleData(mat_t *mat,float *data,enum matio_types data_type,int len)
             if ( mat->byteswap ) {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&i16,data_size,1,mat->fp);
-                    data[i] = Mat_int16Swap(&i16);
+                    data[i] = MAT_SCALE(mat,Mat_int16Swap(&i16));
                 }
             } else {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&i16,data_size,1,mat->fp);
-                    data[i] = i16;
+                    data[i] = MAT_SCALE(mat,i16);
                 }
             }
             break;
@@ -603,12 +619,12 @@ ReadSingleData(mat_t *mat,float *data,enum matio_types data_type,int len)
             if ( mat->byteswap ) {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&ui16,data_size,1,mat->fp);
-                    data[i] = Mat_uint16Swap(&ui16);
+                    data[i] = MAT_SCALE(mat,Mat_uint16Swap(&ui16));
                 }
             } else {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&ui16,data_size,1,mat->fp);
-                    data[i] = ui16;
+                    data[i] = MAT_SCALE(mat,ui16);
                 }
             }
             break;
@@ -621,12 +637,12 @@ ReadSingleData(mat_t *mat,float *data,enum matio_types data_type,int len)
             if ( mat->byteswap ) {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&i8,data_size,1,mat->fp);
-                    data[i] = i8;
+                    data[i] = MAT_SCALE(mat,i8);
                 }
             } else {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&i8,data_size,1,mat->fp);
-                    data[i] = i8;
+                    data[i] = MAT_SCALE(mat,i8);
                 }
             }
             break;
@@ -639,12 +655,12 @@ ReadSingleData(mat_t *mat,float *data,enum matio_types data_type,int len)
             if ( mat->byteswap ) {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&ui8,data_size,1,mat->fp);
-                    data[i] = ui8;
+                    data[i] = MAT_SCALE(mat,ui8);
                 }
             } else {
                 for ( i = 0; i < len; i++ ) {
                     bytesread += fread(&ui8,data_size,1,mat->fp);
-                    data[i] = ui8;
+                    data[i] = MAT_SCALE(mat,ui8);
                 }
             }
             break;
@@ -660,7 +676,8 @@ ReadSingleData(mat_t *mat,float *data,enum matio_types data_type,int len)
 /** @brief Reads data of type @c data_type into a float type
  *
  * Reads from the MAT file @c len compressed elements of data type @c data_type
- * storing them as float's in @c data.
+ * storing them as float's in @c data.  If a scale and offset are active on
+ * @c mat, they are applied to each element as it is converted.
  * @ingroup mat_internal
  * @param mat MAT file pointer
  * @param z Pointer to the zlib stream for inflation
@@ -688,12 +705,12 @@ ReadCompressedSingleData(mat_t *mat,z_stream *z,float *data,
             if ( mat->byteswap ) {
                 for ( i = 0; i < len; i++ ) {
                     InflateData(mat,z,&d,data_size);
-                    data[i] = Mat_doubleSwap(&d);
+                    data[i] = MAT_SCALE(mat,Mat_doubleSwap(&d));
                 }
             } else {
                 for ( i = 0; i < len; i++ ) {
                     InflateData(mat,z,&d,data_size);
-                    data[i] = d;
+                    data[i] = MAT_SCALE(mat,d);
                 }
             }
             break;
@@ -706,11 +723,12 @@ ReadCompressedSingleData(mat_t *mat,z_stream *z,float *data,
             if ( mat->byteswap ) {
                 for ( i = 0; i < len; i++ ) {
                     InflateData(mat,z,&f,data_size);
-                    data[i] = Mat_floatSwap(&f);
+                    data[i] = MAT_SCALE(mat,Mat_floatSwap(&f));
                 }
             } else {
                 for ( i = 0; i < len; i++ ) {
                     InflateData(mat,z,data+i,data_size);
+                    data[i] = MAT_SCALE(mat,data[i]);
                 }
             }
             break;
@@ -723,12 +741,12 @@ ReadCompressedSingleData(mat_t *mat,z_stream *z,float *data,
             if ( mat->byteswap ) {
                 for ( i = 0; i < len; i++ ) {
                     InflateData(mat,z,&i32,data_size);
-                    data[i] = Mat_int32Swap(&i32);
+                    data[i] = MAT_SCALE(mat,Mat_int32Swap(&i32));
                 }
             } else {
                 for ( i = 0; i < len; i++ ) {
                     InflateData(mat,z,&i32,data_size);
-                    data[i] = i32;
+                    data[i] = MAT_SCALE(mat,i32);
                 }
             }
             break;
@@ -741,12 +759,12 @@ ReadCompressedSingleData(mat_t *mat,z_stream *z,float *data,
             if ( mat->byteswap ) {
                 for ( i = 0; i < len; i++ ) {
                     InflateData(mat,z,&ui32,data_size);
-                    data[i] = Mat_uint32Swap(&ui32);
+                    data[i] = MAT_SCALE(mat,Mat_uint32Swap(&ui32));
                 }
             } else {
                 for ( i = 0; i < len; i++ ) {
                     InflateData(mat,z,&ui32,data_size);
-                    data[i] = ui32;
+                    data[i] = MAT_SCALE(mat,ui32);
                 }
             }
             break;
@@ -759,12 +777,12 @@ ReadCompressedSingleData(mat_t *mat,z_stream *z,float *data,
             if ( mat->byteswap ) {
                 for ( i = 0; i < len; i++ ) {
                     InflateData(mat,z,&i16,data_size);
-                    data[i] = Mat_int16Swap(&i16);
+                    data[i] = MAT_SCALE(mat,Mat_int16Swap(&i16));
                 }
             } else {
                 for ( i = 0; i < len; i++ ) {
                     InflateData(mat,z,&i16,data_size);
-                    data[i] = i16;
+                    data[i] = MAT_SCALE(mat,i16);
                 }
             }
             break;
@@ -777,12 +795,12 @@ ReadCompressedSingleData(mat_t *mat,z_stream *z,float *data,
             if ( mat->byteswap ) {
                 for ( i = 0; i < len; i++ ) {
                     InflateData(mat,z,&ui16,data_size);
-                    data[i] = Mat_uint16Swap(&ui16);
+                    data[i] = MAT_SCALE(mat,Mat_uint16Swap(&ui16));
                 }
             } else {
                 for ( i = 0; i < len; i++ ) {
                     InflateData(mat,z,&ui16,data_size);
-                    data[i] = ui16;
+                    data[i] = MAT_SCALE(mat,ui16);
                 }
             }
             break;
@@ -794,7 +812,7 @@ ReadCompressedSingleData(mat_t *mat,z_stream *z,float *data,
             data_size = sizeof(mat_uint8_t);
             for ( i = 0; i < len; i++ ) {
                 InflateData(mat,z,&ui8,data_size);
-                data[i] = ui8;
+                data[i] = MAT_SCALE(mat,ui8);
             }
             break;
         }
@@ -805,7 +823,7 @@ ReadCompressedSingleData(mat_t *mat,z_stream *z,float *data,
             data_size = sizeof(mat_int8_t);
             for ( i = 0; i < len; i++ ) {
                 InflateData(mat,z,&i8,data_size);
-                data[i] = i8;
+                data[i] = MAT_SCALE(mat,i8);
             }
             break;
         }
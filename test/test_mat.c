@@ -118,6 +118,8 @@ static const char *helptestsstr[] = {
 "                                  to a matlab file.",
 "write_empty_struct              - Write empty structure and structure with",
 "                                  empty fields",
+"write_struct_columns            - Write a structure array from columns of",
+"                                  its fields",
 "",
 "    Cell Array Variable Tests",
 "================================================================",
@@ -133,10 +135,13 @@ static const char *helptestsstr[] = {
 "                                fields to a matlab file.",
 "write_empty_cell              - Write empty structure and structure with",
 "                                empty fields",
+"write_cellstr                 - Write a cell array of strings from a",
+"                                string pool",
 "",
 "    Character Variable Tests",
 "================================================================",
 "write_char               - Write a 2D character array.",
+"write_char_utf8          - Write a 2D UTF-8 character array.",
 "",
 "   Version 5 MAT File tests",
 "================================================================",
@@ -146,6 +151,29 @@ static const char *helptestsstr[] = {
 "                          structure",
 "readvarinfo             - Reads a variables header information only",
 "readslab                - Tests reading a part of a dataset",
+"readscaled              - Reads a variable applying a scale and offset",
+"readrowmajor            - Reads a variable in row-major order",
+"readthreads             - Reads a variable using multiple threads",
+"readvars                - Lists the variables of a file and reads them by",
+"                          name in reverse order",
+"readlazy                - Reads the cells of a cell array when accessed",
+"readlazydup             - Reads a cell array when accessed, then duplicates it",
+"readpath                - Reads a part of a variable selected by a path",
+"readinto                - Reads a variable repeatedly into the same variable",
+"readinto_sizes          - Reads variables of different sizes into the same",
+"                          variable",
+"readshallow             - Lists the top-level information of the variables",
+"readstructcolumns       - Reads fields of a structure array into columns",
+"readcellstr             - Reads a cell array of strings into a string pool",
+"readarena               - Reads the variables of a file into arenas",
+"readallocator           - Reads the variables of a file with an allocator",
+"write_rowmajor          - Writes 2D and 3D arrays from row-major data",
+"readinterleaved         - Reads a variable with complex data interleaved",
+"write_interleaved       - Writes complex arrays from interleaved data",
+"write_owned             - Writes arrays whose data is released by a callback",
+"write_chunked           - Writes arrays with chunk shape hints",
+"write_chunked_threads   - Writes an array using multiple threads",
+"write_async             - Writes arrays from a background thread",
 "writeinf                - Tests writing inf (Infinity) values",
 "writenan                - Tests writing NaN (Not A Number) values",
 "writeslab               - Tests writing a part of a dataset",
@@ -323,6 +351,20 @@ static const char *helptest_write_char[] = {
     NULL
 };
 
+static const char *helptest_write_char_utf8[] = {
+    "TEST: write_char_utf8",
+    "",
+    "Usage: test_mat write_char_utf8",
+    "",
+    "Writes a variable named a to a MAT file. The variable is a 2d character",
+    "array of dimensions 2x5 with UTF-8 data. The MAT file is the default",
+    "file version, or set by the -v option. If the MAT file is version 5,",
+    "compression can be enabled using the -z option if built with zlib",
+    "library",
+    "",
+    NULL
+};
+
 static const char *helptest_readvar[] = {
     "TEST: readvar",
     "",
@@ -334,6 +376,267 @@ static const char *helptest_readvar[] = {
     NULL
 };
 
+static const char *helptest_readscaled[] = {
+    "TEST: readscaled",
+    "",
+    "Usage: test_mat readscaled FILE variable_name scale offset",
+    "",
+    "Reads variable_name from FILE as double-precision data with each",
+    "element transformed as v*scale+offset and prints out it's information",
+    "and data",
+    "",
+    NULL
+};
+
+static const char *helptest_readvars[] = {
+    "TEST: readvars",
+    "",
+    "Usage: test_mat readvars FILE",
+    "",
+    "Prints the name of every variable in FILE, then reads the variables by",
+    "name from the same open file in reverse order and prints their",
+    "information.",
+    "",
+    NULL
+};
+
+static const char *helptest_readlazy[] = {
+    "TEST: readlazy",
+    "",
+    "Usage: test_mat readlazy FILE variable_name",
+    "",
+    "Reads the cell array variable_name from FILE with lazy loading bounded to",
+    "200 bytes.  Prints the number of cells with data, then accesses and prints",
+    "every cell, prints the number of cells with data again, and prints the",
+    "first cell after accessing it once more.",
+    "",
+    NULL
+};
+
+static const char *helptest_readlazydup[] = {
+    "TEST: readlazydup",
+    "",
+    "Usage: test_mat readlazydup FILE variable_name",
+    "",
+    "Reads the cell array variable_name from FILE with lazy loading and",
+    "duplicates it.  Prints the first cell of the duplicate, then closes FILE",
+    "and prints whether the second cell of the variable and of the duplicate",
+    "has data.",
+    "",
+    NULL
+};
+
+static const char *helptest_readpath[] = {
+    "TEST: readpath",
+    "",
+    "Usage: test_mat readpath FILE path",
+    "",
+    "Reads the part of a variable selected by path, e.g. a.b{3}.c(1:10,:),",
+    "from FILE and prints it.",
+    "",
+    NULL
+};
+
+static const char *helptest_readinto[] = {
+    "TEST: readinto",
+    "",
+    "Usage: test_mat readinto FILE VAR",
+    "",
+    "Reads variable VAR from FILE three times into the same variable with",
+    "Mat_VarReadInto, prints it and the number of reads that reused the data",
+    "of the previous read.  Then reads every variable of FILE into it with",
+    "Mat_VarReadNextInto and prints the number of variables read.",
+    "",
+    NULL
+};
+
+static const char *helptest_readinto_sizes[] = {
+    "TEST: readinto_sizes",
+    "",
+    "Usage: test_mat readinto_sizes FILE LARGE SMALL",
+    "",
+    "Reads variable LARGE, then SMALL, then LARGE again from FILE into the",
+    "same variable with Mat_VarReadInto, and prints the number of reads that",
+    "reused the data of the first read.",
+    "",
+    NULL
+};
+
+static const char *helptest_readshallow[] = {
+    "TEST: readshallow",
+    "",
+    "Usage: test_mat readshallow FILE",
+    "",
+    "Prints the top-level information of every variable in FILE, then reads",
+    "the first variable completely from the same open file and prints its",
+    "information.",
+    "",
+    NULL
+};
+
+static const char *helptest_readstructcolumns[] = {
+    "TEST: readstructcolumns",
+    "",
+    "Usage: test_mat readstructcolumns FILE var fields",
+    "",
+    "Reads the comma-separated fields of every element of the structure array",
+    "var from FILE into columns and prints them.  Then reads var and checks",
+    "that gathering the fields in memory with two threads gives the same",
+    "columns.",
+    "",
+    NULL
+};
+
+static const char *helptest_readcellstr[] = {
+    "TEST: readcellstr",
+    "",
+    "Usage: test_mat readcellstr FILE var",
+    "",
+    "Reads the cell array of strings var from FILE into a string pool and",
+    "prints the strings in UTF-8.  Then reads var and checks that the cells",
+    "of ASCII strings hold the same characters.",
+    "",
+    NULL
+};
+
+static const char *helptest_readarena[] = {
+    "TEST: readarena",
+    "",
+    "Usage: test_mat readarena FILE",
+    "",
+    "Reads every variable of the version 5 MAT file FILE into an arena and",
+    "prints it.  A field named added is added to each structure, and the",
+    "number of fields is printed.",
+    "",
+    NULL
+};
+
+static const char *helptest_readallocator[] = {
+    "TEST: readallocator",
+    "",
+    "Usage: test_mat readallocator FILE",
+    "",
+    "Reads every variable of FILE with a counting allocator, with and without",
+    "an arena, and duplicates it.  Prints the variable names, the number of",
+    "data buffers not aligned to 64 bytes, the number of frees of pointers",
+    "that did not come from the allocator and the number of allocations",
+    "still outstanding.",
+    "",
+    NULL
+};
+
+static const char *helptest_readthreads[] = {
+    "TEST: readthreads",
+    "",
+    "Usage: test_mat readthreads FILE variable_name",
+    "",
+    "Reads variable_name from FILE using 4 threads to decompress the data,",
+    "and prints out it's information and data.  Then prints a slab of every",
+    "other element of the first dimension of a numeric array.",
+    "",
+    NULL
+};
+
+static const char *helptest_readrowmajor[] = {
+    "TEST: readrowmajor",
+    "",
+    "Usage: test_mat readrowmajor FILE variable_name",
+    "",
+    "Reads variable_name from FILE in row-major order and prints its data in",
+    "memory order.  A second line prints a slab starting at index 1 of the",
+    "first dimension.",
+    "",
+    NULL
+};
+
+static const char *helptest_write_rowmajor[] = {
+    "TEST: write_rowmajor",
+    "",
+    "Usage: test_mat write_rowmajor",
+    "",
+    "Writes a 3x4 double-precision array a and a 2x3x4 double-precision array",
+    "b created with MAT_F_ROW_MAJOR from row-major data 1,2,3,..., b also with",
+    "MAT_F_DONT_COPY_DATA.",
+    "",
+    NULL
+};
+
+static const char *helptest_readinterleaved[] = {
+    "TEST: readinterleaved",
+    "",
+    "Usage: test_mat readinterleaved FILE variable_name",
+    "",
+    "Reads variable_name from FILE with complex data interleaved.  For a",
+    "double-precision array, the first line prints a slab starting at index 1",
+    "of the first dimension in memory order.  Then prints out the variable's",
+    "information and data.",
+    "",
+    NULL
+};
+
+static const char *helptest_write_interleaved[] = {
+    "TEST: write_interleaved",
+    "",
+    "Usage: test_mat write_interleaved",
+    "",
+    "Writes a 5x10 complex double-precision array a created with",
+    "MAT_F_COMPLEX_INTERLEAVED, and a 1x1 cell array b containing it.",
+    "",
+    NULL
+};
+
+static const char *helptest_write_owned[] = {
+    "TEST: write_owned",
+    "",
+    "Usage: test_mat write_owned",
+    "",
+    "Writes a 3x4 double-precision array a and a 3x4 complex array b created",
+    "with MAT_F_DONT_COPY_DATA from allocated buffers, and hands the buffers",
+    "to a deallocator with Mat_VarSetDataDeallocator.  Prints the number of",
+    "buffers released by Mat_VarFree.  Then reads a, takes its data with a",
+    "deallocator that keeps the buffer and prints the data.",
+    "",
+    NULL
+};
+
+static const char *helptest_write_chunked[] = {
+    "TEST: write_chunked",
+    "",
+    "Usage: test_mat write_chunked",
+    "",
+    "Writes 6x5 double-precision arrays a with column chunks of 96 bytes and",
+    "b with tile chunks of 72 bytes.  Then opens the file with a chunk cache",
+    "of 1 MB, and prints column 3 of a and row 2 of b.",
+    "",
+    NULL
+};
+
+static const char *helptest_write_chunked_threads[] = {
+    "TEST: write_chunked_threads",
+    "",
+    "Usage: test_mat write_chunked_threads",
+    "",
+    "Writes a 100x40 double-precision array a with one column per chunk to",
+    "test_write_chunked_serial.mat using 1 thread and to",
+    "test_write_chunked_threads.mat using 4 threads.  Then reads a from both",
+    "files and prints whether the data is identical.",
+    "",
+    NULL
+};
+
+static const char *helptest_write_async[] = {
+    "TEST: write_async",
+    "",
+    "Usage: test_mat write_async",
+    "",
+    "Writes ten 2x3 double-precision arrays a0 to a9 from a background",
+    "thread with a queue of 256 bytes, reusing the same data buffer for each",
+    "array, and prints the result of Mat_Flush.  Then prints the name and the",
+    "data of each variable of the file in order.",
+    "",
+    NULL
+};
+
 static const char *helptest_write_struct_2d_numeric[] = {
     "TEST: write_struct_2d_numeric",
     "",
@@ -378,6 +681,41 @@ static const char *helptest_write_struct_complex_2d_numeric[] = {
     NULL
 };
 
+static const char *helptest_write_struct_columns[] = {
+    "TEST: write_struct_columns",
+    "",
+    "Usage: test_mat write_struct_columns",
+    "",
+    "Writes a variable named a to a MAT file with Mat_VarWriteStructColumns.",
+    "The variable is a 3x1 structure array with a 1x2 double field x, a",
+    "scalar int32 field id and a string field name. The MAT file is the",
+    "default file version, or set by the -v option. If the MAT file is",
+    "version 5, compression can be enabled using the -z option if built with",
+    "zlib library",
+    "",
+    "MATLAB code to generate expected data",
+    "",
+    "    a = struct('x',{[1 4];[2 5];[3 6]},'id',{int32(10);int32(20);int32(30)},...",
+    "               'name',{'one';'three';''});",
+    "",
+    NULL
+};
+
+static const char *helptest_write_cellstr[] = {
+    "TEST: write_cellstr",
+    "",
+    "Usage: test_mat write_cellstr",
+    "",
+    "Writes a variable named a to a MAT file with Mat_VarWriteCellStr. The",
+    "variable is a 2x2 cell array of strings including an empty string and",
+    "a string with a non-ASCII character. The MAT file is the default file",
+    "version, or set by the -v option. If the MAT file is version 5,",
+    "compression can be enabled using the -z option if built with zlib",
+    "library",
+    "",
+    NULL
+};
+
 static const char *helptest_write_struct_2d_logical[] = {
     "TEST: write_struct_2d_logical",
     "",
@@ -632,6 +970,48 @@ help_test(const char *test)
         Mat_Help(helptest_readvarinfo);
     else if ( !strcmp(test,"readslab") )
         Mat_Help(helptest_readslab);
+    else if ( !strcmp(test,"readscaled") )
+        Mat_Help(helptest_readscaled);
+    else if ( !strcmp(test,"readthreads") )
+        Mat_Help(helptest_readthreads);
+    else if ( !strcmp(test,"readvars") )
+        Mat_Help(helptest_readvars);
+    else if ( !strcmp(test,"readlazy") )
+        Mat_Help(helptest_readlazy);
+    else if ( !strcmp(test,"readlazydup") )
+        Mat_Help(helptest_readlazydup);
+    else if ( !strcmp(test,"readpath") )
+        Mat_Help(helptest_readpath);
+    else if ( !strcmp(test,"readinto") )
+        Mat_Help(helptest_readinto);
+    else if ( !strcmp(test,"readinto_sizes") )
+        Mat_Help(helptest_readinto_sizes);
+    else if ( !strcmp(test,"readshallow") )
+        Mat_Help(helptest_readshallow);
+    else if ( !strcmp(test,"readstructcolumns") )
+        Mat_Help(helptest_readstructcolumns);
+    else if ( !strcmp(test,"readcellstr") )
+        Mat_Help(helptest_readcellstr);
+    else if ( !strcmp(test,"readarena") )
+        Mat_Help(helptest_readarena);
+    else if ( !strcmp(test,"readallocator") )
+        Mat_Help(helptest_readallocator);
+    else if ( !strcmp(test,"readrowmajor") )
+        Mat_Help(helptest_readrowmajor);
+    else if ( !strcmp(test,"write_rowmajor") )
+        Mat_Help(helptest_write_rowmajor);
+    else if ( !strcmp(test,"readinterleaved") )
+        Mat_Help(helptest_readinterleaved);
+    else if ( !strcmp(test,"write_interleaved") )
+        Mat_Help(helptest_write_interleaved);
+    else if ( !strcmp(test,"write_owned") )
+        Mat_Help(helptest_write_owned);
+    else if ( !strcmp(test,"write_chunked") )
+        Mat_Help(helptest_write_chunked);
+    else if ( !strcmp(test,"write_chunked_threads") )
+        Mat_Help(helptest_write_chunked_threads);
+    else if ( !strcmp(test,"write_async") )
+        Mat_Help(helptest_write_async);
     else if ( !strcmp(test,"write_2d_numeric") )
         Mat_Help(helptest_write_2d_numeric);
     else if ( !strcmp(test,"write_complex_2d_numeric") )
@@ -646,6 +1026,8 @@ help_test(const char *test)
         Mat_Help(helptest_write_empty_2d_numeric);
     else if ( !strcmp(test,"write_char") )
         Mat_Help(helptest_write_char);
+    else if ( !strcmp(test,"write_char_utf8") )
+        Mat_Help(helptest_write_char_utf8);
     else if ( !strcmp(test,"write_struct_2d_numeric") )
         Mat_Help(helptest_write_struct_2d_numeric);
     else if ( !strcmp(test,"write_struct_complex_2d_numeric") )
@@ -654,6 +1036,8 @@ help_test(const char *test)
         Mat_Help(helptest_write_struct_2d_logical);
     else if ( !strcmp(test,"write_empty_struct") )
         Mat_Help(helptest_write_empty_struct);
+    else if ( !strcmp(test,"write_struct_columns") )
+        Mat_Help(helptest_write_struct_columns);
     else if ( !strcmp(test,"write_cell_2d_numeric") )
         Mat_Help(helptest_write_cell_2d_numeric);
     else if ( !strcmp(test,"write_cell_complex_2d_numeric") )
@@ -662,6 +1046,8 @@ help_test(const char *test)
         Mat_Help(helptest_write_cell_2d_logical);
     else if ( !strcmp(test,"write_empty_cell") )
         Mat_Help(helptest_write_empty_cell);
+    else if ( !strcmp(test,"write_cellstr") )
+        Mat_Help(helptest_write_cellstr);
     else if ( !strcmp(test,"writeinf") )
         Mat_Help(helptest_writeinf);
     else if ( !strcmp(test,"writenan") )
@@ -1041,62 +1427,1131 @@ test_write_empty_2d_numeric(enum matio_classes matvar_class,char *output_name)
             return 1;
     }
 
-    mat = Mat_CreateVer("test_write_empty_2d_numeric.mat",NULL,mat_file_ver);
+    mat = Mat_CreateVer("test_write_empty_2d_numeric.mat",NULL,mat_file_ver);
+    if ( mat != NULL ) {
+        matvar = Mat_VarCreate("empty",matvar_class,matvar_datatype,2,dims,
+                     NULL,0);
+        Mat_VarWrite(mat,matvar,compression);
+        Mat_VarFree(matvar);
+        Mat_Close(mat);
+    } else {
+        err = 1;
+    }
+
+    return err;
+}
+
+static int
+test_write_char(char *output_name)
+{
+    char     *str = "aA1[bB2{cC3]dD4}eE5\\fF6|gG7;hH8:iI9'jJ0\"kK!,lL@<"
+                    "mM#.nN$>oO%/pP^?qQ& rR* sS( tT) uU- vV_ wW= xX+ yY` zZ~ ";
+    int       err = 0;
+    size_t    dims[2];
+    mat_t    *mat;
+    matvar_t *matvar;
+
+    mat = Mat_CreateVer(output_name,NULL,mat_file_ver);
+    if ( mat ) {
+        dims[0]   = 4;
+        dims[1]   = 26;
+        matvar = Mat_VarCreate("a",MAT_C_CHAR,MAT_T_UINT8,2,
+                    dims,str,MAT_F_DONT_COPY_DATA);
+        Mat_VarWrite(mat,matvar,compression);
+        Mat_Close(mat);
+    }
+    return err;
+}
+
+static int
+test_write_char_utf8(char *output_name)
+{
+    char     *str = "hweolrllod";
+    int       err = 0;
+    size_t    dims[2];
+    mat_t    *mat;
+    matvar_t *matvar;
+
+    mat = Mat_CreateVer(output_name,NULL,mat_file_ver);
+    if ( mat ) {
+        dims[0]   = 2;
+        dims[1]   = 5;
+        matvar = Mat_VarCreate("a",MAT_C_CHAR,MAT_T_UTF8,2,
+                    dims,str,MAT_F_DONT_COPY_DATA);
+        Mat_VarWrite(mat,matvar,compression);
+        Mat_VarFree(matvar);
+        Mat_Close(mat);
+    }
+    return err;
+}
+
+static int
+test_readvar(const char *inputfile, const char *var)
+{
+    int err = 0;
+    mat_t *mat;
+    matvar_t *matvar;
+
+    mat = Mat_Open(inputfile,MAT_ACC_RDONLY);
+    if ( mat ) {
+        matvar = Mat_VarRead(mat,(char*)var);
+        if ( matvar == NULL ) {
+            err = 1;
+        } else {
+            Mat_VarPrint( matvar, 1);
+            Mat_VarFree(matvar);
+        }
+        Mat_Close(mat);
+    } else {
+        err = 1;
+    }
+    return err;
+}
+
+static int
+test_readvars(const char *inputfile)
+{
+    int    err = 0, i, nvars = 0;
+    char **names = NULL;
+    mat_t *mat;
+    matvar_t *matvar;
+
+    mat = Mat_Open(inputfile,MAT_ACC_RDONLY);
+    if ( NULL == mat )
+        return 1;
+    while ( NULL != (matvar = Mat_VarReadNextInfo(mat)) ) {
+        names = realloc(names,(nvars+1)*sizeof(*names));
+        names[nvars++] = strdup_printf("%s",matvar->name);
+        printf("%s\n",matvar->name);
+        Mat_VarFree(matvar);
+    }
+    for ( i = nvars-1; i >= 0; i-- ) {
+        matvar = Mat_VarReadInfo(mat,names[i]);
+        if ( NULL == matvar ) {
+            err++;
+        } else {
+            Mat_VarPrint(matvar,0);
+            Mat_VarFree(matvar);
+        }
+        free(names[i]);
+    }
+    free(names);
+    Mat_Close(mat);
+
+    return err;
+}
+
+static int
+test_readlazy(const char *inputfile,const char *var)
+{
+    int err = 0, i, ncells, resident;
+    mat_t *mat;
+    matvar_t *matvar, *cell, **cells;
+
+    mat = Mat_Open(inputfile,MAT_ACC_RDONLY);
+    if ( NULL == mat )
+        return 1;
+    err = Mat_SetLazyLoading(mat,1,200);
+    matvar = Mat_VarRead(mat,(char*)var);
+    if ( err || NULL == matvar || MAT_C_CELL != matvar->class_type ) {
+        Mat_VarFree(matvar);
+        Mat_Close(mat);
+        return 1;
+    }
+
+    cells  = matvar->data;
+    ncells = matvar->nbytes / matvar->data_size;
+    for ( i = 0, resident = 0; i < ncells; i++ )
+        resident += NULL != cells[i] && NULL != cells[i]->data;
+    printf("Cells with data: %d\n",resident);
+    for ( i = 0; i < ncells; i++ ) {
+        cell = Mat_VarGetCell(matvar,i);
+        if ( NULL == cell )
+            err++;
+        else
+            Mat_VarPrint(cell,1);
+    }
+    for ( i = 0, resident = 0; i < ncells; i++ )
+        resident += NULL != cells[i] && NULL != cells[i]->data;
+    printf("Cells with data: %d\n",resident);
+    cell = Mat_VarGetCell(matvar,0);
+    if ( NULL == cell )
+        err++;
+    else
+        Mat_VarPrint(cell,1);
+
+    Mat_VarFree(matvar);
+    Mat_Close(mat);
+
+    return err;
+}
+
+static int
+test_readlazydup(const char *inputfile,const char *var)
+{
+    int err = 0;
+    mat_t *mat;
+    matvar_t *matvar, *dup, *cell;
+
+    mat = Mat_Open(inputfile,MAT_ACC_RDONLY);
+    if ( NULL == mat )
+        return 1;
+    err = Mat_SetLazyLoading(mat,1,0);
+    matvar = Mat_VarRead(mat,(char*)var);
+    if ( err || NULL == matvar || MAT_C_CELL != matvar->class_type ) {
+        Mat_VarFree(matvar);
+        Mat_Close(mat);
+        return 1;
+    }
+
+    dup  = Mat_VarDuplicate(matvar,1);
+    cell = Mat_VarGetCell(dup,0);
+    if ( NULL == cell || NULL == cell->data )
+        err++;
+    else
+        Mat_VarPrint(cell,1);
+    Mat_Close(mat);
+
+    /* The cells not read before the file was closed are left without data */
+    cell = Mat_VarGetCell(matvar,1);
+    if ( NULL == cell )
+        err++;
+    else
+        printf("Cell 2 after close: %s\n",
+               NULL == cell->data ? "no data" : "data");
+    cell = Mat_VarGetCell(dup,1);
+    if ( NULL == cell )
+        err++;
+    else
+        printf("Duplicated cell 2 after close: %s\n",
+               NULL == cell->data ? "no data" : "data");
+
+    Mat_VarFree(dup);
+    Mat_VarFree(matvar);
+
+    return err;
+}
+
+static int
+test_readpath(const char *inputfile,const char *path)
+{
+    mat_t *mat;
+    matvar_t *matvar;
+
+    mat = Mat_Open(inputfile,MAT_ACC_RDONLY);
+    if ( NULL == mat )
+        return 1;
+    matvar = Mat_VarReadPath(mat,path);
+    if ( NULL == matvar ) {
+        Mat_Close(mat);
+        return 1;
+    }
+    Mat_VarPrint(matvar,1);
+    Mat_VarFree(matvar);
+    Mat_Close(mat);
+
+    return 0;
+}
+
+static int
+test_readinto(const char *inputfile,const char *var)
+{
+    int    err = 0, k, reused = 0;
+    void  *data = NULL;
+    mat_t *mat;
+    matvar_t *matvar;
+
+    mat = Mat_Open(inputfile,MAT_ACC_RDONLY);
+    if ( NULL == mat )
+        return 1;
+    matvar = Mat_VarCalloc();
+    for ( k = 0; k < 3; k++ ) {
+        if ( Mat_VarReadInto(mat,var,matvar) ) {
+            err++;
+            break;
+        }
+        if ( k > 0 && matvar->data == data )
+            reused++;
+        data = matvar->data;
+    }
+    if ( !err ) {
+        Mat_VarPrint(matvar,1);
+        printf("Reads reusing the data: %d\n",reused);
+    }
+    Mat_Rewind(mat);
+    k = 0;
+    while ( 0 == Mat_VarReadNextInto(mat,matvar) )
+        k++;
+    printf("Variables read: %d\n",k);
+    Mat_VarFree(matvar);
+    Mat_Close(mat);
+
+    return err;
+}
+
+static int
+test_readinto_sizes(const char *inputfile,const char *large,const char *small)
+{
+    const char *names[3];
+    int    err = 0, k, reused = 0;
+    void  *data = NULL;
+    mat_t *mat;
+    matvar_t *matvar;
+
+    mat = Mat_Open(inputfile,MAT_ACC_RDONLY);
+    if ( NULL == mat )
+        return 1;
+    names[0] = large;
+    names[1] = small;
+    names[2] = large;
+    matvar = Mat_VarCalloc();
+    for ( k = 0; k < 3; k++ ) {
+        if ( Mat_VarReadInto(mat,names[k],matvar) ) {
+            err++;
+            break;
+        }
+        if ( k > 0 && matvar->data == data )
+            reused++;
+        else
+            data = matvar->data;
+    }
+    if ( !err )
+        printf("Reads reusing the data: %d\n",reused);
+    Mat_VarFree(matvar);
+    Mat_Close(mat);
+
+    return err;
+}
+
+static int
+test_readshallow(const char *inputfile)
+{
+    int    err = 0;
+    char  *name = NULL;
+    mat_t *mat;
+    matvar_t *matvar;
+
+    mat = Mat_Open(inputfile,MAT_ACC_RDONLY);
+    if ( NULL == mat )
+        return 1;
+    Mat_SetShallowInfo(mat,1);
+    while ( NULL != (matvar = Mat_VarReadNextInfo(mat)) ) {
+        if ( NULL == name )
+            name = strdup_printf("%s",matvar->name);
+        Mat_VarPrint(matvar,0);
+        Mat_VarFree(matvar);
+    }
+    if ( NULL != name ) {
+        matvar = Mat_VarRead(mat,name);
+        if ( NULL == matvar ) {
+            err++;
+        } else {
+            Mat_VarPrint(matvar,0);
+            Mat_VarFree(matvar);
+        }
+        free(name);
+    }
+    Mat_Close(mat);
+
+    return err;
+}
+
+static int
+test_readstructcolumns(const char *inputfile,const char *var,
+    const char *fields)
+{
+    int    err = 0, k, ncolumns = 0;
+    char  *names, *tok;
+    const char *field_names[16];
+    mat_t *mat;
+    matvar_t *matvar, *columns[16], *gathered[16];
+
+    names = strdup_printf("%s",fields);
+    for ( tok = strtok(names,","); NULL != tok && ncolumns < 16;
+          tok = strtok(NULL,",") )
+        field_names[ncolumns++] = tok;
+
+    mat = Mat_Open(inputfile,MAT_ACC_RDONLY);
+    if ( NULL == mat ) {
+        free(names);
+        return 1;
+    }
+    if ( Mat_VarReadStructColumns(mat,var,ncolumns,field_names,columns) ) {
+        Mat_Close(mat);
+        free(names);
+        return 1;
+    }
+    for ( k = 0; k < ncolumns; k++ )
+        Mat_VarPrint(columns[k],1);
+
+    matvar = Mat_VarRead(mat,var);
+    if ( NULL == matvar ||
+         Mat_VarGetStructColumns(matvar,ncolumns,field_names,gathered,2) ) {
+        err++;
+    } else {
+        for ( k = 0; k < ncolumns; k++ ) {
+            if ( gathered[k]->nbytes != columns[k]->nbytes ||
+                 memcmp(gathered[k]->data,columns[k]->data,
+                        columns[k]->nbytes) )
+                err++;
+            Mat_VarFree(gathered[k]);
+        }
+    }
+    Mat_VarFree(matvar);
+    for ( k = 0; k < ncolumns; k++ )
+        Mat_VarFree(columns[k]);
+    Mat_Close(mat);
+    free(names);
+
+    return err;
+}
+
+static int
+test_readcellstr(const char *inputfile,const char *var)
+{
+    int    err = 0, k;
+    size_t i, j, len;
+    const char *str;
+    mat_t *mat;
+    mat_cellstr_t *cellstr;
+    matvar_t *matvar, *cell;
+
+    mat = Mat_Open(inputfile,MAT_ACC_RDONLY);
+    if ( NULL == mat )
+        return 1;
+    cellstr = Mat_VarReadCellStr(mat,var);
+    if ( NULL == cellstr ) {
+        Mat_Close(mat);
+        return 1;
+    }
+    printf("      Name: %s\n",var);
+    printf("      Rank: %d\n",cellstr->rank);
+    printf("Dimensions: ");
+    for ( k = 0; k < cellstr->rank; k++ )
+        printf(k > 0 ? " x %lu" : "%lu",(unsigned long)cellstr->dims[k]);
+    printf("\n{\n");
+    for ( i = 0; i < cellstr->nstrings; i++ )
+        printf("%s\n",cellstr->pool+cellstr->offsets[i]);
+    printf("}\n");
+
+    matvar = Mat_VarRead(mat,var);
+    if ( NULL == matvar ) {
+        err++;
+    } else {
+        for ( i = 0; i < cellstr->nstrings; i++ ) {
+            str = cellstr->pool+cellstr->offsets[i];
+            len = cellstr->offsets[i+1]-cellstr->offsets[i]-1;
+            for ( j = 0; j < len && !(str[j] & 0x80); j++ );
+            cell = Mat_VarGetCell(matvar,i);
+            if ( j < len ) {
+                /* The cell of a non-ASCII string is not compared */
+            } else if ( NULL == cell ) {
+                err++;
+            } else if ( len > 0 && (cell->dims[0]*cell->dims[1] != len ||
+                                    memcmp(cell->data,str,len)) ) {
+                err++;
+            }
+        }
+    }
+    Mat_VarFree(matvar);
+    Mat_CellStrFree(cellstr);
+    Mat_Close(mat);
+
+    return err;
+}
+
+static int
+test_readarena(const char *inputfile)
+{
+    int    err = 0;
+    mat_t *mat;
+    matvar_t *matvar;
+
+    mat = Mat_Open(inputfile,MAT_ACC_RDONLY);
+    if ( NULL == mat )
+        return 1;
+    if ( Mat_SetArenaAllocation(mat,1) ) {
+        Mat_Close(mat);
+        return 1;
+    }
+    while ( NULL != (matvar = Mat_VarReadNext(mat)) ) {
+        Mat_VarPrint(matvar,1);
+        if ( MAT_C_STRUCT == matvar->class_type ) {
+            if ( Mat_VarAddStructField(matvar,"added") )
+                err++;
+            else
+                printf("Fields after adding: %u\n",
+                       Mat_VarGetNumberOfFields(matvar));
+        }
+        Mat_VarFree(matvar);
+    }
+    Mat_Close(mat);
+
+    return err;
+}
+
+#define TEST_ALLOC_MAGIC 0x4d41544cUL
+
+struct test_alloc_header {
+    unsigned long magic;
+    size_t        size;
+    void         *block;
+};
+
+struct test_alloc_stats {
+    long outstanding;
+    int  mismatched;
+};
+
+static void *
+test_alloc_aligned(size_t size,size_t alignment,struct test_alloc_stats *stats)
+{
+    struct test_alloc_header *header;
+    char  *block;
+    size_t addr;
+
+    block = (char*)malloc(sizeof(*header)+alignment+size);
+    if ( NULL == block )
+        return NULL;
+    addr = ((size_t)block+sizeof(*header)+alignment-1) & ~(alignment-1);
+    header = (struct test_alloc_header*)addr - 1;
+    header->magic = TEST_ALLOC_MAGIC;
+    header->size  = size;
+    header->block = block;
+    stats->outstanding++;
+    return (void*)addr;
+}
+
+static void
+test_release(void *ptr,void *user_data)
+{
+    struct test_alloc_stats  *stats = (struct test_alloc_stats*)user_data;
+    struct test_alloc_header *header;
+
+    if ( NULL == ptr )
+        return;
+    header = (struct test_alloc_header*)ptr - 1;
+    if ( TEST_ALLOC_MAGIC != header->magic ) {
+        stats->mismatched++;
+        return;
+    }
+    header->magic = 0;
+    stats->outstanding--;
+    free(header->block);
+}
+
+static void *
+test_alloc(size_t size,void *user_data)
+{
+    return test_alloc_aligned(size,16,(struct test_alloc_stats*)user_data);
+}
+
+static void *
+test_resize(void *ptr,size_t size,void *user_data)
+{
+    struct test_alloc_header *header;
+    void *new_ptr;
+
+    new_ptr = test_alloc(size,user_data);
+    if ( NULL == new_ptr || NULL == ptr )
+        return new_ptr;
+    header = (struct test_alloc_header*)ptr - 1;
+    memcpy(new_ptr,ptr,header->size < size ? header->size : size);
+    test_release(ptr,user_data);
+    return new_ptr;
+}
+
+static void *
+test_alloc_data(size_t size,size_t alignment,void *user_data)
+{
+    return test_alloc_aligned(size,alignment,(struct test_alloc_stats*)user_data);
+}
+
+static int
+test_count_misaligned(matvar_t *matvar,size_t alignment)
+{
+    int    misaligned = 0;
+    size_t i, nmemb = 0;
+    matvar_t **cells;
+
+    if ( NULL == matvar || NULL == matvar->data )
+        return 0;
+    if ( MAT_C_STRUCT == matvar->class_type ||
+         MAT_C_CELL == matvar->class_type ) {
+        nmemb = 1;
+        for ( i = 0; i < (size_t)matvar->rank; i++ )
+            nmemb *= matvar->dims[i];
+        if ( MAT_C_STRUCT == matvar->class_type )
+            nmemb *= Mat_VarGetNumberOfFields(matvar);
+    } else if ( MAT_C_SPARSE != matvar->class_type ) {
+        if ( matvar->isComplex ) {
+            mat_complex_split_t *complex_data = matvar->data;
+            if ( (size_t)complex_data->Re % alignment )
+                misaligned++;
+            if ( (size_t)complex_data->Im % alignment )
+                misaligned++;
+        } else if ( (size_t)matvar->data % alignment ) {
+            misaligned++;
+        }
+        return misaligned;
+    }
+    cells = (matvar_t**)matvar->data;
+    for ( i = 0; i < nmemb; i++ )
+        misaligned += test_count_misaligned(cells[i],alignment);
+    return misaligned;
+}
+
+static int
+test_readallocator(const char *inputfile)
+{
+    int    err = 0, misaligned = 0;
+    size_t dims[2] = {2,2};
+    double data[4] = {1,2,3,4};
+    mat_t *mat;
+    matvar_t *matvar, *copy;
+    mat_allocator_t allocator;
+    struct test_alloc_stats stats = {0,0};
+
+    allocator.alloc          = test_alloc;
+    allocator.resize         = test_resize;
+    allocator.release        = test_release;
+    allocator.alloc_data     = test_alloc_data;
+    allocator.release_data   = test_release;
+    allocator.data_alignment = 64;
+    allocator.user_data      = &stats;
+
+    mat = Mat_Open(inputfile,MAT_ACC_RDONLY);
+    if ( NULL == mat )
+        return 1;
+    if ( Mat_SetAllocator(mat,&allocator) ) {
+        Mat_Close(mat);
+        return 1;
+    }
+    while ( NULL != (matvar = Mat_VarReadNext(mat)) ) {
+        printf("Variable: %s\n",matvar->name);
+        misaligned += test_count_misaligned(matvar,64);
+        /* Mat_VarDuplicate does not copy the arrays of sparse variables */
+        if ( MAT_C_SPARSE != matvar->class_type ) {
+            copy = Mat_VarDuplicate(matvar,1);
+            if ( NULL == copy )
+                err++;
+            else
+                misaligned += test_count_misaligned(copy,64);
+            Mat_VarFree(copy);
+        }
+        Mat_VarFree(matvar);
+    }
+    Mat_Close(mat);
+
+    /* The arena takes its blocks from the allocator too */
+    mat = Mat_Open(inputfile,MAT_ACC_RDONLY);
+    if ( NULL == mat )
+        return 1;
+    Mat_SetAllocator(mat,&allocator);
+    Mat_SetArenaAllocation(mat,1);
+    while ( NULL != (matvar = Mat_VarReadNext(mat)) ) {
+        misaligned += test_count_misaligned(matvar,64);
+        Mat_VarFree(matvar);
+    }
+    Mat_Close(mat);
+
+    Mat_SetAllocator(NULL,&allocator);
+    matvar = Mat_VarCreate("b",MAT_C_DOUBLE,MAT_T_DOUBLE,2,dims,data,0);
+    Mat_SetAllocator(NULL,NULL);
+    if ( NULL == matvar )
+        err++;
+    else
+        misaligned += test_count_misaligned(matvar,64);
+    Mat_VarFree(matvar);
+
+    printf("Misaligned data buffers: %d\n",misaligned);
+    printf("Mismatched frees: %d\n",stats.mismatched);
+    printf("Outstanding allocations: %ld\n",stats.outstanding);
+
+    return err;
+}
+
+static int
+test_readthreads(const char *inputfile,const char *var)
+{
+    int err = 0, k, start[10], stride[10], edge[10];
+    size_t i, nmemb = 1;
+    double *slab;
+    mat_t *mat;
+    matvar_t *matvar;
+
+    mat = Mat_Open(inputfile,MAT_ACC_RDONLY);
+    if ( NULL == mat )
+        return 1;
+    Mat_SetNumThreads(mat,4);
+    matvar = Mat_VarRead(mat,(char*)var);
+    if ( NULL == matvar ) {
+        Mat_Close(mat);
+        return 1;
+    }
+    Mat_VarPrint(matvar,1);
+    Mat_VarFree(matvar);
+    Mat_Close(mat);
+
+    mat = Mat_Open(inputfile,MAT_ACC_RDONLY);
+    if ( NULL == mat )
+        return 1;
+    Mat_SetNumThreads(mat,4);
+    matvar = Mat_VarReadInfo(mat,(char*)var);
+    if ( NULL != matvar && MAT_C_DOUBLE == matvar->class_type &&
+         !matvar->isComplex && matvar->rank <= 10 ) {
+        for ( k = 0; k < matvar->rank; k++ ) {
+            start[k]  = 0;
+            stride[k] = 1;
+            edge[k]   = matvar->dims[k];
+        }
+        stride[0] = 2;
+        edge[0]   = (matvar->dims[0]+1)/2;
+        for ( k = 0; k < matvar->rank; k++ )
+            nmemb *= edge[k];
+        slab = malloc(nmemb*sizeof(*slab));
+        err = Mat_VarReadData(mat,matvar,slab,start,stride,edge);
+        if ( !err ) {
+            for ( i = 0; i < nmemb; i++ )
+                printf("%g ",slab[i]);
+            printf("\n");
+        }
+        free(slab);
+    }
+    Mat_VarFree(matvar);
+    Mat_Close(mat);
+
+    return err;
+}
+
+static int
+test_readscaled(const char *inputfile,const char *var,double scale,
+    double offset)
+{
+    int err = 0;
+    mat_t *mat;
+    matvar_t *matvar;
+
+    mat = Mat_Open(inputfile,MAT_ACC_RDONLY);
+    if ( mat ) {
+        matvar = Mat_VarReadInfo(mat,(char*)var);
+        if ( matvar == NULL ) {
+            err = 1;
+        } else {
+            err = Mat_VarSetScaling(matvar,scale,offset,MAT_C_DOUBLE);
+            if ( !err )
+                err = Mat_VarReadDataAll(mat,matvar);
+            if ( !err )
+                Mat_VarPrint(matvar,1);
+            Mat_VarFree(matvar);
+        }
+        Mat_Close(mat);
+    } else {
+        err = 1;
+    }
+    return err;
+}
+
+static int
+test_readrowmajor(const char *inputfile,const char *var)
+{
+    int err = 0, k, start[10], stride[10], edge[10];
+    size_t i, nmemb = 1;
+    double *data, *slab;
+    mat_t *mat;
+    matvar_t *matvar;
+
+    mat = Mat_Open(inputfile,MAT_ACC_RDONLY);
+    if ( NULL == mat )
+        return 1;
+    matvar = Mat_VarReadInfo(mat,(char*)var);
+    if ( NULL == matvar || MAT_C_DOUBLE != matvar->class_type ||
+         matvar->rank > 10 ) {
+        Mat_VarFree(matvar);
+        Mat_Close(mat);
+        return 1;
+    }
+    Mat_VarSetReadFlags(matvar,MAT_F_ROW_MAJOR);
+
+    /* Read the slab first since the full read consumes compressed data */
+    for ( k = 0; k < matvar->rank; k++ ) {
+        start[k]  = 0;
+        stride[k] = 1;
+        edge[k]   = matvar->dims[k];
+    }
+    start[0] = 1;
+    edge[0]  = matvar->dims[0]-1;
+    for ( k = 0; k < matvar->rank; k++ )
+        nmemb *= edge[k];
+    slab = malloc(nmemb*sizeof(*slab));
+    err = Mat_VarReadData(mat,matvar,slab,start,stride,edge);
+    if ( !err )
+        err = Mat_VarReadDataAll(mat,matvar);
+    if ( !err && NULL != matvar->data ) {
+        data = matvar->data;
+        for ( i = 0; i < matvar->nbytes / matvar->data_size; i++ )
+            printf("%g ",data[i]);
+        printf("\n");
+        for ( i = 0; i < nmemb; i++ )
+            printf("%g ",slab[i]);
+        printf("\n");
+    }
+    free(slab);
+    Mat_VarFree(matvar);
+    Mat_Close(mat);
+
+    return err;
+}
+
+static int
+test_write_rowmajor(void)
+{
+    size_t dims_a[2] = {3,4}, dims_b[3] = {2,3,4};
+    double data[24];
+    int    err = 0, i;
+    mat_t    *mat;
+    matvar_t *matvar;
+
+    for ( i = 0; i < 24; i++ )
+        data[i] = i+1;
+
+    mat = Mat_CreateVer("test_write_rowmajor.mat",NULL,mat_file_ver);
+    if ( mat != NULL ) {
+        matvar = Mat_VarCreate("a",MAT_C_DOUBLE,MAT_T_DOUBLE,2,dims_a,data,
+                               MAT_F_ROW_MAJOR);
+        Mat_VarWrite(mat,matvar,compression);
+        Mat_VarFree(matvar);
+        matvar = Mat_VarCreate("b",MAT_C_DOUBLE,MAT_T_DOUBLE,3,dims_b,data,
+                               MAT_F_ROW_MAJOR | MAT_F_DONT_COPY_DATA);
+        Mat_VarWrite(mat,matvar,compression);
+        Mat_VarFree(matvar);
+        Mat_Close(mat);
+    } else {
+        err = 1;
+    }
+    return err;
+}
+
+static int
+test_readinterleaved(const char *inputfile,const char *var)
+{
+    int err = 0, k, start[10], stride[10], edge[10];
+    size_t i, nmemb = 1;
+    double *slab = NULL;
+    mat_t *mat;
+    matvar_t *matvar;
+
+    mat = Mat_Open(inputfile,MAT_ACC_RDONLY);
+    if ( NULL == mat )
+        return 1;
+    matvar = Mat_VarReadInfo(mat,(char*)var);
+    if ( NULL == matvar || matvar->rank > 10 ) {
+        Mat_VarFree(matvar);
+        Mat_Close(mat);
+        return 1;
+    }
+    Mat_VarSetReadFlags(matvar,MAT_F_COMPLEX_INTERLEAVED);
+
+    if ( MAT_C_DOUBLE == matvar->class_type && matvar->isComplex ) {
+        /* Read the slab first since the full read consumes compressed data */
+        for ( k = 0; k < matvar->rank; k++ ) {
+            start[k]  = 0;
+            stride[k] = 1;
+            edge[k]   = matvar->dims[k];
+        }
+        start[0] = 1;
+        edge[0]  = matvar->dims[0]-1;
+        for ( k = 0; k < matvar->rank; k++ )
+            nmemb *= edge[k];
+        slab = malloc(2*nmemb*sizeof(*slab));
+        err = Mat_VarReadData(mat,matvar,slab,start,stride,edge);
+        if ( !err ) {
+            for ( i = 0; i < 2*nmemb; i++ )
+                printf("%g ",slab[i]);
+            printf("\n");
+        }
+        free(slab);
+    }
+    if ( !err )
+        err = Mat_VarReadDataAll(mat,matvar);
+    if ( !err )
+        Mat_VarPrint(matvar,1);
+    Mat_VarFree(matvar);
+    Mat_Close(mat);
+
+    return err;
+}
+
+static int
+test_write_interleaved(void)
+{
+    size_t dims[2] = {5,10}, dims_b[2] = {1,1};
+    double data[100];
+    int    err = 0, i;
+    mat_t    *mat;
+    matvar_t *matvar, *cells[1];
+
+    for ( i = 0; i < 50; i++ ) {
+        data[2*i]   = i+1;
+        data[2*i+1] = i+51;
+    }
+
+    mat = Mat_CreateVer("test_write_interleaved.mat",NULL,mat_file_ver);
+    if ( mat != NULL ) {
+        matvar = Mat_VarCreate("a",MAT_C_DOUBLE,MAT_T_DOUBLE,2,dims,data,
+                               MAT_F_COMPLEX | MAT_F_COMPLEX_INTERLEAVED);
+        Mat_VarWrite(mat,matvar,compression);
+        Mat_VarFree(matvar);
+        cells[0] = Mat_VarCreate("a",MAT_C_DOUBLE,MAT_T_DOUBLE,2,dims,data,
+                                 MAT_F_COMPLEX | MAT_F_COMPLEX_INTERLEAVED);
+        matvar = Mat_VarCreate("b",MAT_C_CELL,MAT_T_CELL,2,dims_b,cells,0);
+        Mat_VarWrite(mat,matvar,compression);
+        Mat_VarFree(matvar);
+        Mat_Close(mat);
+    } else {
+        err = 1;
+    }
+    return err;
+}
+
+struct test_owned_data {
+    int   released;
+    void *taken;
+};
+
+static void
+test_release_owned(void *data,void *context)
+{
+    ((struct test_owned_data*)context)->released++;
+    free(data);
+}
+
+static void
+test_release_owned_complex(void *data,void *context)
+{
+    mat_complex_split_t *complex_data = (mat_complex_split_t*)data;
+
+    free(complex_data->Re);
+    free(complex_data->Im);
+    test_release_owned(data,context);
+}
+
+static void
+test_take_owned(void *data,void *context)
+{
+    ((struct test_owned_data*)context)->taken = data;
+}
+
+static int
+test_write_owned(void)
+{
+    size_t dims[2] = {3,4};
+    double *data;
+    int    err = 0, i;
+    mat_t    *mat;
+    matvar_t *matvar;
+    mat_complex_split_t *complex_data;
+    struct test_owned_data owned = {0,NULL};
+
+    mat = Mat_CreateVer("test_write_owned.mat",NULL,mat_file_ver);
+    if ( NULL == mat )
+        return 1;
+    data = malloc(12*sizeof(*data));
+    for ( i = 0; i < 12; i++ )
+        data[i] = i+1;
+    matvar = Mat_VarCreate("a",MAT_C_DOUBLE,MAT_T_DOUBLE,2,dims,data,
+                           MAT_F_DONT_COPY_DATA);
+    err += Mat_VarSetDataDeallocator(matvar,test_release_owned,&owned);
+    Mat_VarWrite(mat,matvar,compression);
+    Mat_VarFree(matvar);
+
+    complex_data = malloc(sizeof(*complex_data));
+    complex_data->Re = malloc(12*sizeof(double));
+    complex_data->Im = malloc(12*sizeof(double));
+    for ( i = 0; i < 12; i++ ) {
+        ((double*)complex_data->Re)[i] = i+1;
+        ((double*)complex_data->Im)[i] = i+13;
+    }
+    matvar = Mat_VarCreate("b",MAT_C_DOUBLE,MAT_T_DOUBLE,2,dims,complex_data,
+                           MAT_F_DONT_COPY_DATA | MAT_F_COMPLEX);
+    err += Mat_VarSetDataDeallocator(matvar,test_release_owned_complex,
+                                     &owned);
+    Mat_VarWrite(mat,matvar,compression);
+    Mat_VarFree(matvar);
+    Mat_Close(mat);
+    printf("Buffers released: %d\n",owned.released);
+
+    /* Take the data of a variable read from the file */
+    mat = Mat_Open("test_write_owned.mat",MAT_ACC_RDONLY);
+    if ( NULL == mat )
+        return 1;
+    matvar = Mat_VarRead(mat,"a");
+    if ( NULL == matvar ) {
+        err++;
+    } else {
+        err += Mat_VarSetDataDeallocator(matvar,test_take_owned,&owned);
+        Mat_VarFree(matvar);
+    }
+    Mat_Close(mat);
+    if ( NULL != owned.taken ) {
+        data = owned.taken;
+        for ( i = 0; i < 12; i++ )
+            printf("%g ",data[i]);
+        printf("\n");
+        free(owned.taken);
+    }
+
+    return err;
+}
+
+static int
+test_write_chunked(void)
+{
+    size_t dims[2] = {6,5};
+    double data[30], slab[6];
+    int    err = 0, i, start[2] = {0,2}, stride[2] = {1,1}, edge[2] = {6,1};
+    mat_t    *mat;
+    matvar_t *matvar;
+
+    for ( i = 0; i < 30; i++ )
+        data[i] = i+1;
+
+    mat = Mat_CreateVer("test_write_chunked.mat",NULL,mat_file_ver);
     if ( mat != NULL ) {
-        matvar = Mat_VarCreate("empty",matvar_class,matvar_datatype,2,dims,
-                     NULL,0);
+        matvar = Mat_VarCreate("a",MAT_C_DOUBLE,MAT_T_DOUBLE,2,dims,data,0);
+        Mat_VarSetChunking(matvar,MAT_CHUNK_COLUMN,96);
+        Mat_VarWrite(mat,matvar,compression);
+        Mat_VarFree(matvar);
+        matvar = Mat_VarCreate("b",MAT_C_DOUBLE,MAT_T_DOUBLE,2,dims,data,0);
+        Mat_VarSetChunking(matvar,MAT_CHUNK_TILE,72);
         Mat_VarWrite(mat,matvar,compression);
         Mat_VarFree(matvar);
         Mat_Close(mat);
     } else {
-        err = 1;
+        return 1;
+    }
+
+    mat = Mat_OpenChunkCache("test_write_chunked.mat",MAT_ACC_RDONLY,521,
+                             1048576,0.75);
+    if ( NULL == mat )
+        return 1;
+    matvar = Mat_VarReadInfo(mat,"a");
+    if ( NULL != matvar ) {
+        err += Mat_VarReadData(mat,matvar,slab,start,stride,edge);
+        for ( i = 0; i < 6; i++ )
+            printf("%g ",slab[i]);
+        printf("\n");
+        Mat_VarFree(matvar);
+    } else {
+        err++;
+    }
+    matvar = Mat_VarReadInfo(mat,"b");
+    if ( NULL != matvar ) {
+        start[0] = 1;
+        start[1] = 0;
+        edge[0]  = 1;
+        edge[1]  = 5;
+        err += Mat_VarReadData(mat,matvar,slab,start,stride,edge);
+        for ( i = 0; i < 5; i++ )
+            printf("%g ",slab[i]);
+        printf("\n");
+        Mat_VarFree(matvar);
+    } else {
+        err++;
     }
+    Mat_Close(mat);
 
     return err;
 }
 
 static int
-test_write_char(char *output_name)
+test_write_chunked_threads(void)
 {
-    char     *str = "aA1[bB2{cC3]dD4}eE5\\fF6|gG7;hH8:iI9'jJ0\"kK!,lL@<"
-                    "mM#.nN$>oO%/pP^?qQ& rR* sS( tT) uU- vV_ wW= xX+ yY` zZ~ ";
-    int       err = 0;
-    size_t    dims[2];
+    size_t dims[2] = {100,40};
+    double data[4000];
+    int    err = 0, i, k, nthreads[2] = {1,4};
+    const char *files[2] = {"test_write_chunked_serial.mat",
+                            "test_write_chunked_threads.mat"};
     mat_t    *mat;
-    matvar_t *matvar;
+    matvar_t *matvar[2];
 
-    mat = Mat_CreateVer(output_name,NULL,mat_file_ver);
-    if ( mat ) {
-        dims[0]   = 4;
-        dims[1]   = 26;
-        matvar = Mat_VarCreate("a",MAT_C_CHAR,MAT_T_UINT8,2,
-                    dims,str,MAT_F_DONT_COPY_DATA);
-        Mat_VarWrite(mat,matvar,compression);
+    for ( i = 0; i < 4000; i++ )
+        data[i] = (i*i) % 97;
+
+    for ( k = 0; k < 2; k++ ) {
+        mat = Mat_CreateVer(files[k],NULL,mat_file_ver);
+        if ( NULL == mat )
+            return 1;
+        Mat_SetNumThreads(mat,nthreads[k]);
+        matvar[k] = Mat_VarCreate("a",MAT_C_DOUBLE,MAT_T_DOUBLE,2,dims,data,0);
+        Mat_VarSetChunking(matvar[k],MAT_CHUNK_COLUMN,0);
+        err += Mat_VarWrite(mat,matvar[k],compression);
+        Mat_VarFree(matvar[k]);
         Mat_Close(mat);
     }
+
+    for ( k = 0; k < 2; k++ ) {
+        matvar[k] = NULL;
+        mat = Mat_Open(files[k],MAT_ACC_RDONLY);
+        if ( NULL != mat ) {
+            matvar[k] = Mat_VarRead(mat,"a");
+            Mat_Close(mat);
+        }
+    }
+    if ( NULL != matvar[0] && NULL != matvar[1] &&
+         matvar[0]->nbytes == matvar[1]->nbytes &&
+         !memcmp(matvar[0]->data,matvar[1]->data,matvar[0]->nbytes) &&
+         !memcmp(matvar[1]->data,data,sizeof(data)) ) {
+        printf("Data written using 4 threads matches the serial write\n");
+    } else {
+        printf("Data written using 4 threads differs from the serial write\n");
+        err++;
+    }
+    Mat_VarFree(matvar[0]);
+    Mat_VarFree(matvar[1]);
+
     return err;
 }
 
 static int
-test_readvar(const char *inputfile, const char *var)
+test_write_async(void)
 {
-    int err = 0;
-    mat_t *mat;
+    size_t dims[2] = {2,3};
+    double data[6];
+    char   name[8];
+    int    err = 0, i, k;
+    mat_t    *mat;
     matvar_t *matvar;
 
-    mat = Mat_Open(inputfile,MAT_ACC_RDONLY);
-    if ( mat ) {
-        matvar = Mat_VarRead(mat,(char*)var);
-        if ( matvar == NULL ) {
-            err = 1;
-        } else {
-            Mat_VarPrint( matvar, 1);
-            Mat_VarFree(matvar);
-        }
-        Mat_Close(mat);
-    } else {
-        err = 1;
+    mat = Mat_CreateVer("test_write_async.mat",NULL,mat_file_ver);
+    if ( NULL == mat )
+        return 1;
+    /* Without threads the variables are written by Mat_VarWrite */
+    Mat_SetAsyncWrite(mat,1,256);
+    for ( k = 0; k < 10; k++ ) {
+        for ( i = 0; i < 6; i++ )
+            data[i] = 10*k+i;
+        sprintf(name,"a%d",k);
+        matvar = Mat_VarCreate(name,MAT_C_DOUBLE,MAT_T_DOUBLE,2,dims,data,
+                               MAT_F_DONT_COPY_DATA);
+        err += Mat_VarWrite(mat,matvar,compression);
+        Mat_VarFree(matvar);
+    }
+    printf("Flush: %d\n",Mat_Flush(mat));
+    err += Mat_Close(mat);
+
+    mat = Mat_Open("test_write_async.mat",MAT_ACC_RDONLY);
+    if ( NULL == mat )
+        return 1;
+    while ( NULL != (matvar = Mat_VarReadNext(mat)) ) {
+        printf("%s:",matvar->name);
+        for ( i = 0; i < 6; i++ )
+            printf(" %g",((double*)matvar->data)[i]);
+        printf("\n");
+        Mat_VarFree(matvar);
     }
+    Mat_Close(mat);
+
     return err;
 }
 
@@ -1193,6 +2648,79 @@ test_write_empty_struct(char *output_name)
 }
 
 
+static int
+test_write_struct_columns(char *output_name)
+{
+    size_t dims[2];
+    int    err = 0;
+    double x[6] = {1,2,3,4,5,6};
+    mat_int32_t id[3] = {10,20,30};
+    /* Rows of a 3x5 character array, shorter strings end with NUL */
+    char   name[15] = {'o','t','\0','n','h','\0','e','r','\0',
+                       '\0','e','\0','\0','e','\0'};
+    const char *field_names[3] = {"x","id","name"};
+    mat_t *mat;
+    matvar_t *columns[3];
+
+    dims[0] = 3;
+    dims[1] = 2;
+    columns[0] = Mat_VarCreate("x",MAT_C_DOUBLE,MAT_T_DOUBLE,2,dims,x,
+                               MAT_F_DONT_COPY_DATA);
+    dims[1] = 1;
+    columns[1] = Mat_VarCreate("id",MAT_C_INT32,MAT_T_INT32,2,dims,id,
+                               MAT_F_DONT_COPY_DATA);
+    dims[1] = 5;
+    columns[2] = Mat_VarCreate("name",MAT_C_CHAR,MAT_T_UINT8,2,dims,name,
+                               MAT_F_DONT_COPY_DATA);
+
+    mat = Mat_CreateVer(output_name,NULL,mat_file_ver);
+    if ( mat == NULL ) {
+        err = 1;
+    } else {
+        err = Mat_VarWriteStructColumns(mat,"a",3,field_names,columns,
+                                        compression);
+        Mat_Close(mat);
+    }
+    Mat_VarFree(columns[0]);
+    Mat_VarFree(columns[1]);
+    Mat_VarFree(columns[2]);
+
+    return err;
+}
+
+static int
+test_write_cellstr(char *output_name)
+{
+    size_t dims[2] = {2,2}, offsets[5];
+    int    err = 0, i;
+    /* Strings in column-major order, the third is UTF-8 */
+    const char *strings[4] = {"one","","h\303\251llo","three"};
+    char   pool[32];
+    mat_cellstr_t cellstr;
+    mat_t *mat;
+
+    offsets[0] = 0;
+    for ( i = 0; i < 4; i++ ) {
+        strcpy(pool+offsets[i],strings[i]);
+        offsets[i+1] = offsets[i]+strlen(strings[i])+1;
+    }
+    cellstr.rank     = 2;
+    cellstr.dims     = dims;
+    cellstr.nstrings = 4;
+    cellstr.offsets  = offsets;
+    cellstr.pool     = pool;
+
+    mat = Mat_CreateVer(output_name,NULL,mat_file_ver);
+    if ( mat == NULL ) {
+        err = 1;
+    } else {
+        err = Mat_VarWriteCellStr(mat,"a",&cellstr,compression);
+        Mat_Close(mat);
+    }
+
+    return err;
+}
+
 static int
 test_write_struct_2d_logical(char *output_name)
 {
@@ -2288,6 +3816,112 @@ test_struct_api_getlinear(void)
     return err;
 }
 
+static int
+test_struct_api_share(void)
+{
+    size_t dims[2];
+    int    err = 0, i;
+    double    r[4], c[4];
+    mat_complex_split_t z = {c,r};
+    matvar_t *field, *matvar, *matvar2, *matvar3;
+    const char *fieldnames[2] = {"r","z"};
+
+    dims[0] = 1;
+    dims[1] = 3;
+    matvar = Mat_VarCreateStruct("a", 2, dims, fieldnames, 2);
+
+    dims[0] = 2; dims[1] = 2;
+    for ( i = 0; i < 3; i++ ) {
+        r[0] = 4*i+1; r[1] = 4*i+2; r[2] = 4*i+3; r[3] = 4*i+4;
+        c[0] = -r[0]; c[1] = -r[1]; c[2] = -r[2]; c[3] = -r[3];
+        field = Mat_VarCreate(NULL,MAT_C_DOUBLE,MAT_T_DOUBLE,2,dims,r,0);
+        Mat_VarSetStructFieldByName(matvar, "r", i, field);
+        field = Mat_VarCreate(NULL,MAT_C_DOUBLE,MAT_T_DOUBLE,2,dims,&z,
+                              MAT_F_COMPLEX);
+        Mat_VarSetStructFieldByName(matvar, "z", i, field);
+    }
+
+    /* The indexed fields and the duplicate share the data */
+    matvar2 = Mat_VarGetStructsLinear(matvar, 0, 2, 2, 1);
+    matvar3 = Mat_VarDuplicate(matvar,0);
+    field = Mat_VarGetStructFieldByName(matvar2,"r",1);
+    printf("Indexed data shared: %d\n",
+           field->data == Mat_VarGetStructFieldByName(matvar,"r",2)->data);
+    printf("Duplicated data shared: %d\n",
+           Mat_VarGetStructFieldByName(matvar3,"z",0)->data ==
+           Mat_VarGetStructFieldByName(matvar,"z",0)->data);
+    Mat_VarFree(matvar);
+
+    /* Modify the duplicate after unsharing its data */
+    err += Mat_VarUnshareData(matvar3);
+    field = Mat_VarGetStructFieldByName(matvar3,"r",2);
+    printf("Data shared after unsharing: %d\n",
+           field->data == Mat_VarGetStructFieldByName(matvar2,"r",1)->data);
+    ((double*)field->data)[0] = 0;
+    Mat_VarFree(matvar3);
+
+    Mat_VarPrint(matvar2,1);
+    Mat_VarFree(matvar2);
+
+    return err;
+}
+
+static int
+test_struct_api_fieldindex(void)
+{
+    size_t dims[2] = {1,1};
+    int    err = 0, i, nfound = 0;
+    double value;
+    char   name[16];
+    matvar_t *field, *old_field, *matvar, *matvar2;
+
+    /* Enough fields to collide in the hash table, and a duplicate name */
+    matvar = Mat_VarCreateStruct("a", 2, dims, NULL, 0);
+    for ( i = 0; i < 1000; i++ ) {
+        sprintf(name,"f%d",i);
+        err += Mat_VarAddStructField(matvar,name);
+    }
+    err += Mat_VarAddStructField(matvar,"f7");
+    for ( i = 0; i < 1000; i++ ) {
+        value = i;
+        sprintf(name,"f%d",i);
+        field = Mat_VarCreate(NULL,MAT_C_DOUBLE,MAT_T_DOUBLE,2,dims,&value,0);
+        Mat_VarSetStructFieldByName(matvar, name, 0, field);
+    }
+    for ( i = 0; i < 1000; i++ ) {
+        sprintf(name,"f%d",i);
+        field = Mat_VarGetStructFieldByName(matvar,name,0);
+        if ( NULL != field && i == *(double*)field->data &&
+             !strcmp(field->name,name) )
+            nfound++;
+    }
+    printf("Fields found: %d\n",nfound);
+    printf("Missing field found: %d\n",
+           NULL != Mat_VarGetStructFieldByName(matvar,"f1000",0));
+    printf("Field of the duplicate name set: %d\n",
+           NULL != Mat_VarGetStructFieldByIndex(matvar,1000,0));
+
+    /* The duplicate shares the field names of its own structure */
+    matvar2 = Mat_VarDuplicate(matvar,1);
+    value = -3;
+    field = Mat_VarCreate(NULL,MAT_C_DOUBLE,MAT_T_DOUBLE,2,dims,&value,0);
+    old_field = Mat_VarSetStructFieldByName(matvar, "f3", 0, field);
+    Mat_VarFree(matvar);
+    printf("Replaced field: %s = %g\n",old_field->name,
+           *(double*)old_field->data);
+    Mat_VarFree(old_field);
+
+    field = Mat_VarGetStructFieldByName(matvar2,"f3",0);
+    printf("Duplicated field: %s = %g\n",field->name,*(double*)field->data);
+    printf("Duplicated field names shared: %d\n",
+           field->name == Mat_VarGetStructFieldnames(matvar2)[3]);
+    field = Mat_VarGetStructFieldByName(matvar2,"f999",0);
+    printf("Duplicated field: %s = %g\n",field->name,*(double*)field->data);
+    Mat_VarFree(matvar2);
+
+    return err;
+}
+
 static int
 test_struct_api_get(void)
 {
@@ -3124,6 +4758,12 @@ int main (int argc, char *argv[])
                 output_name = "test_write_char.mat";
             err += test_write_char(output_name);
             ntests++;
+        } else if ( !strcasecmp(argv[k],"write_char_utf8") ) {
+            k++;
+            if ( NULL == output_name )
+                output_name = "test_write_char_utf8.mat";
+            err += test_write_char_utf8(output_name);
+            ntests++;
         } else if ( !strcasecmp(argv[k],"writenull") ) {
             k++;
             err += test_write_null();
@@ -3162,6 +4802,18 @@ int main (int argc, char *argv[])
                 output_name = "test_write_struct_2d_logical.mat";
             err += test_write_struct_2d_logical(output_name);
             ntests++;
+        } else if ( !strcasecmp(argv[k],"write_struct_columns") ) {
+            k++;
+            if ( NULL == output_name )
+                output_name = "test_write_struct_columns.mat";
+            err += test_write_struct_columns(output_name);
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"write_cellstr") ) {
+            k++;
+            if ( NULL == output_name )
+                output_name = "test_write_cellstr.mat";
+            err += test_write_cellstr(output_name);
+            ntests++;
         } else if ( !strcasecmp(argv[k],"write_struct_2d_numeric") ) {
             k++;
             if ( NULL == output_name )
@@ -3230,6 +4882,14 @@ int main (int argc, char *argv[])
             k++;
             err += test_struct_api_get();
             ntests++;
+        } else if ( !strcasecmp(argv[k],"struct_api_share") ) {
+            k++;
+            err += test_struct_api_share();
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"struct_api_fieldindex") ) {
+            k++;
+            err += test_struct_api_fieldindex();
+            ntests++;
         } else if ( !strcasecmp(argv[k],"cell_api_set") ) {
             k++;
             err += test_cell_api_set();
@@ -3297,6 +4957,182 @@ int main (int argc, char *argv[])
             test_readslab(argv[k],argv[k+1]);
             k+=2;
             ntests++;
+        } else if ( !strcasecmp(argv[k],"readscaled") ) {
+            k++;
+            if ( argc < k+4 ) {
+                Mat_Critical("Must specify the input file, variable, scale "
+                             "and offset respectively");
+                err++;
+            } else {
+                err += test_readscaled(argv[k],argv[k+1],atof(argv[k+2]),
+                                       atof(argv[k+3]));
+                k+=4;
+            }
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"readvars") ) {
+            k++;
+            if ( argc < k+1 ) {
+                Mat_Critical("Must specify the input file");
+                err++;
+            } else {
+                err += test_readvars(argv[k]);
+                k++;
+            }
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"readlazy") ) {
+            k++;
+            if ( argc < k+2 ) {
+                Mat_Critical("Must specify the input file and variable respectively");
+                err++;
+            } else {
+                err += test_readlazy(argv[k],argv[k+1]);
+                k+=2;
+            }
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"readlazydup") ) {
+            k++;
+            if ( argc < k+2 ) {
+                Mat_Critical("Must specify the input file and variable respectively");
+                err++;
+            } else {
+                err += test_readlazydup(argv[k],argv[k+1]);
+                k+=2;
+            }
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"readpath") ) {
+            k++;
+            if ( argc < k+2 ) {
+                Mat_Critical("Must specify the input file and path respectively");
+                err++;
+            } else {
+                err += test_readpath(argv[k],argv[k+1]);
+                k+=2;
+            }
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"readinto") ) {
+            k++;
+            if ( argc < k+2 ) {
+                Mat_Critical("Must specify the input file and variable respectively");
+                err++;
+            } else {
+                err += test_readinto(argv[k],argv[k+1]);
+                k+=2;
+            }
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"readinto_sizes") ) {
+            k++;
+            if ( argc < k+3 ) {
+                Mat_Critical("Must specify the input file and variables respectively");
+                err++;
+            } else {
+                err += test_readinto_sizes(argv[k],argv[k+1],argv[k+2]);
+                k+=3;
+            }
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"readshallow") ) {
+            k++;
+            if ( argc < k+1 ) {
+                Mat_Critical("Must specify the input file");
+                err++;
+            } else {
+                err += test_readshallow(argv[k]);
+                k++;
+            }
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"readstructcolumns") ) {
+            k++;
+            if ( argc < k+3 ) {
+                Mat_Critical("Must specify the input file, variable, and fields respectively");
+                err++;
+            } else {
+                err += test_readstructcolumns(argv[k],argv[k+1],argv[k+2]);
+                k+=3;
+            }
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"readcellstr") ) {
+            k++;
+            if ( argc < k+2 ) {
+                Mat_Critical("Must specify the input file and variable respectively");
+                err++;
+            } else {
+                err += test_readcellstr(argv[k],argv[k+1]);
+                k+=2;
+            }
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"readarena") ) {
+            k++;
+            if ( argc < k+1 ) {
+                Mat_Critical("Must specify the input file");
+                err++;
+            } else {
+                err += test_readarena(argv[k]);
+                k++;
+            }
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"readallocator") ) {
+            k++;
+            if ( argc < k+1 ) {
+                Mat_Critical("Must specify the input file");
+                err++;
+            } else {
+                err += test_readallocator(argv[k]);
+                k++;
+            }
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"readthreads") ) {
+            k++;
+            if ( argc < k+2 ) {
+                Mat_Critical("Must specify the input file and variable respectively");
+                err++;
+            } else {
+                err += test_readthreads(argv[k],argv[k+1]);
+                k+=2;
+            }
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"readrowmajor") ) {
+            k++;
+            if ( argc < k+2 ) {
+                Mat_Critical("Must specify the input file and variable respectively");
+                err++;
+            } else {
+                err += test_readrowmajor(argv[k],argv[k+1]);
+                k+=2;
+            }
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"readinterleaved") ) {
+            k++;
+            if ( argc < k+2 ) {
+                Mat_Critical("Must specify the input file and variable respectively");
+                err++;
+            } else {
+                err += test_readinterleaved(argv[k],argv[k+1]);
+                k+=2;
+            }
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"write_interleaved") ) {
+            k++;
+            err += test_write_interleaved();
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"write_owned") ) {
+            k++;
+            err += test_write_owned();
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"write_chunked") ) {
+            k++;
+            err += test_write_chunked();
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"write_chunked_threads") ) {
+            k++;
+            err += test_write_chunked_threads();
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"write_async") ) {
+            k++;
+            err += test_write_async();
+            ntests++;
+        } else if ( !strcasecmp(argv[k],"write_rowmajor") ) {
+            k++;
+            err += test_write_rowmajor();
+            ntests++;
         } else if ( !strcasecmp(argv[k],"readslab4") ) {
             k++;
             test_readslab4(argv[k],argv[k+1]);
@@ -908,6 +908,9 @@ main (int argc, char *argv[])
                 matvar = NULL;
             }
         } else {
+            /* The listing only needs the top-level information */
+            if ( print_whos == printfunc )
+                Mat_SetShallowInfo(mat,1);
             while ( (matvar = Mat_VarReadNextInfo(mat)) != NULL ) {
                 (*printfunc)(matvar);
                 Mat_VarFree(matvar);